@@ -14,6 +14,7 @@
 #include "../wxm/edit/inframe.h"
 #include "../wxm/edit/single_line.h"
 #include "../wxm/utils.h"
+#include "../wxm/file_searcher.h"
 
 #ifdef _MSC_VER
 # pragma warning( push )
@@ -632,7 +633,14 @@ void WXMFindInFilesDialog::FindReplaceInFiles(bool bReplace)
 		totalfiles=g_FileNameList.size();
 	}
 
-	if(g_Continue)
+	if(g_Continue && !bReplace && WxRadioButtonDir->GetValue())
+	{
+#ifdef SHOW_RESULT_COUNT
+		ResultCount=
+#endif
+		FindInDirByWorkers(dialog, max);
+	}
+	else if(g_Continue)
 	{
 		boost::scoped_ptr<MadEdit> tempedit;
 		if(WxRadioButtonDir->GetValue())
@@ -781,6 +789,191 @@ void WXMFindInFilesDialog::FindReplaceInFiles(bool bReplace)
 #endif
 }
 
+// the files opened in editors and the ones deferred by the workers are searched in the GUI thread,
+// the others are loaded and searched by ParallelFileSearcher, all the results are listed in the
+// order of the files
+int WXMFindInFilesDialog::FindInDirByWorkers(wxProgressDialog& dialog, int max)
+{
+	int ResultCount=0;
+
+	wxm::FileSearchingOptions opt;
+	m_FindText->GetText(opt.expr);
+	opt.inhex = WxCheckBoxFindHex->GetValue();
+	opt.use_regex = WxCheckBoxRegex->GetValue();
+	opt.case_sensitive = WxCheckBoxCaseSensitive->GetValue();
+	opt.whole_word = WxCheckBoxWholeWord->GetValue();
+	// the same syntax as wxm::SearchingWXMEdit loads for the files
+	MadSyntax defsyntax(false);
+	opt.delimiters = defsyntax.m_Delimiter;
+	opt.first_only = WxCheckBoxListFirstOnly->GetValue();
+	opt.encoding = wxm::WXMEncodingManager::ExtractEncodingName(WxComboBoxEncoding->GetValue());
+	if(opt.encoding == wxm::WXMEncodingManager::ExtractEncodingName(WxComboBoxEncoding->GetString(0)))
+		opt.encoding.Clear();
+
+	wxConfigBase *cfg=wxConfigBase::Get(false);
+	wxString oldpath=cfg->GetPath();
+	cfg->Read(wxT("/wxMEdit/DefaultEncoding"), &opt.default_encoding);
+	long maxtextsize;
+	cfg->Read(wxT("/wxMEdit/MaxTextFileSize"), &maxtextsize, 10*1000*1000);
+	opt.max_text_file_size = maxtextsize;
+	cfg->SetPath(oldpath);
+
+	std::vector<wxString> files;
+	std::vector<MadEdit*> opened;   // nullptr if the file is not opened
+	for(MadFileNameList::iterator fnit=g_FileNameList.begin(); fnit!=g_FileNameList.end(); ++fnit)
+	{
+		int id;
+		files.push_back(*fnit);
+		opened.push_back(g_MainFrame->GetEditByFileName(*fnit, id));
+	}
+
+	if(files.empty())
+		return ResultCount;
+
+	const size_t totalfiles = files.size();
+	wxString fmt(_("Processing %d of %d files..."));
+	wxString loc, text;
+
+	wxm::ParallelFileSearcher finder(opt, files);
+	for(size_t i=0; i<opened.size(); ++i)
+	{
+		if(opened[i] != nullptr)
+			finder.Defer(i);
+	}
+
+	if(!finder.Start())
+	{
+		if(opt.use_regex && !opt.inhex)
+		{
+			wxMessageDialog dlg(this, wxString::Format(_("'%s' is not a valid regular expression."), opt.expr.c_str()),
+				wxT("wxMEdit"), wxOK|wxICON_ERROR);
+			dlg.ShowModal();
+		}
+		return ResultCount;
+	}
+
+	// the deferred files not opened are loaded and searched by the editor
+	boost::scoped_ptr<MadEdit> tempedit;
+
+	std::vector<wxm::FileSearchingResult> results;
+	bool running = true;
+	while(running)
+	{
+		wxMilliSleep(50);
+
+		results.clear();
+		running = finder.FetchResults(results);
+
+		if(!results.empty())
+		{
+			for(size_t i=0; i<results.size(); ++i)
+			{
+				const wxm::FileSearchingResult& res = results[i];
+				if(res.deferred)
+				{
+					size_t processed = res.index;
+					wxString str = wxString::Format(fmt, processed, totalfiles) + wxT('\n') + res.filename;
+					if(!dialog.Update(int(processed*max / totalfiles), str))
+					{
+						finder.Cancel();
+						return ResultCount;
+					}
+
+					MadEdit *madedit = opened[res.index];
+					if(madedit == nullptr)
+					{
+						if(!tempedit)
+							tempedit.reset(new wxm::SearchingWXMEdit(this, opt.whole_word));
+						madedit = tempedit.get();
+						madedit->LoadFromFile(res.filename, opt.encoding);
+					}
+					if(!FindInEdit(madedit, opt, ResultCount))
+					{
+						finder.Cancel();
+						return ResultCount;
+					}
+					continue;
+				}
+
+				g_MainFrame->m_FindInFilesResults->Freeze();
+				for(size_t idx=0; idx<res.matches.size(); ++idx)
+				{
+					const wxm::FileSearchingMatch& m = res.matches[idx];
+					if(m.line >= 0)
+					{
+						loc.Printf(_("Line(%d): "), m.line+1);
+						text = loc + m.linetext;
+					}
+					else
+					{
+						loc.Printf(_("Offset(%s): "), wxLongLong(m.bpos).ToString().c_str());
+						text = loc + _("Binary file matches");
+					}
+					wxFileOffset epos = m.epos;
+					g_MainFrame->AddItemToFindInFilesResults(text, idx, res.filename, -1, m.bpos, epos);
+					++ResultCount;
+				}
+				g_MainFrame->m_FindInFilesResults->Thaw();
+			}
+		}
+
+		if(!running)
+			break;
+
+		size_t processed = finder.GetProcessedCount();
+		if(!dialog.Update(int(processed*max / totalfiles), wxString::Format(fmt, processed, totalfiles)))
+			finder.Cancel();
+	}
+
+	return ResultCount;
+}
+
+bool WXMFindInFilesDialog::FindInEdit(MadEdit* madedit, const wxm::FileSearchingOptions& opt, int& ResultCount)
+{
+	wxm::WXMSearcher& searcher = *(madedit->Searcher(opt.inhex, opt.use_regex));
+	searcher.SetOption(opt.case_sensitive, opt.whole_word);
+
+	vector<wxFileOffset> begpos, endpos;
+	if(searcher.FindAll(opt.expr, opt.first_only, &begpos, &endpos) < 0)
+		return false;
+
+	size_t count=begpos.size();
+	if(count==0)
+		return true;
+	if(opt.first_only) count=1;
+
+	wxString filename=madedit->GetFileName();
+	int line=-1, oldline;
+	wxString linetext, loc, text;
+	g_MainFrame->m_FindInFilesResults->Freeze();
+	for(size_t idx=0; idx<count; ++idx)
+	{
+		if(madedit->IsTextFile())
+		{
+			oldline=line;
+			line=madedit->GetLineByPos(begpos[idx]);
+			if(line!=oldline)
+			{
+				linetext.Empty();
+				madedit->GetLine(linetext, line, 512);
+			}
+			loc.Printf(_("Line(%d): "), line+1);
+		}
+		else
+		{
+			loc.Printf(_("Offset(%s): "), wxLongLong(begpos[idx]).ToString().c_str());
+			linetext = _("Binary file matches");
+		}
+
+		text = loc +linetext;
+		g_MainFrame->AddItemToFindInFilesResults(text, idx, filename, -1, begpos[idx], endpos[idx]);
+		++ResultCount;
+	}
+	g_MainFrame->m_FindInFilesResults->Thaw();
+
+	return true;
+}
+
 void WXMFindInFilesDialog::WxCheckBoxEnableReplaceClick(wxCommandEvent& event)
 {
 	WxButtonReplace->Enable(event.IsChecked());
@@ -36,6 +36,11 @@
 
 
 class MadEdit;
+class wxProgressDialog;
+namespace wxm
+{
+	struct FileSearchingOptions;
+}
 
 class WXMFindInFilesDialog: public wxDialog
 {
@@ -115,6 +120,9 @@ class WXMFindInFilesDialog: public wxDialog
 		wxm::wxRecentList *m_RecentFindFilter, *m_RecentFindExclude;
 		void UpdateCheckBoxByCBHex(bool check);
 		void FindReplaceInFiles(bool bReplace);//false: find; true: replace
+		int FindInDirByWorkers(wxProgressDialog& dialog, int max);
+		// return false if the searching failed
+		bool FindInEdit(MadEdit* madedit, const wxm::FileSearchingOptions& opt, int& ResultCount);
 	//private:
 	public:
 		//(*Handlers(WXMFindInFilesDialog)
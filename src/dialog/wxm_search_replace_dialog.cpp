@@ -23,6 +23,7 @@
 #include <wx/intl.h>
 #include <wx/string.h>
 //*)
+#include <wx/progdlg.h>
 // disable 4996 }
 #ifdef _MSC_VER
 # pragma warning( pop )
@@ -41,6 +42,22 @@ extern wxm::InFrameWXMEdit* g_active_wxmedit;
 
 WXMSearchReplaceDialog *g_SearchReplaceDialog=nullptr;
 
+// show a progress dialog for replacing all in a document larger than this
+const wxFileOffset REPLACE_ALL_PROGRESS_SIZE = 16 * 1024 * 1024;
+
+struct ReplaceAllProgress
+{
+	wxProgressDialog* dialog;
+	ReplaceAllProgress(wxProgressDialog* dlg): dialog(dlg) {}
+
+	bool operator()(wxFileOffset pos, wxFileOffset end)
+	{
+		if (end <= 0)
+			return dialog->Update(0);
+		return dialog->Update(int(pos * 100 / end));
+	}
+};
+
 //(*IdInit(WXMSearchReplaceDialog)
 const long WXMSearchReplaceDialog::ID_WXCHECKBOXMOVEFOCUS = wxNewId();
 const long WXMSearchReplaceDialog::ID_WXCHECKBOXWRAPAROUND = wxNewId();
@@ -859,7 +876,18 @@ void WXMSearchReplaceDialog::WxButtonReplaceAllClick(wxCommandEvent& event)
 		wxm::WXMSearcher* searcher = g_active_wxmedit->Searcher(WxCheckBoxFindHex->GetValue(), WxCheckBoxRegex->GetValue());
 		searcher->SetOption(WxCheckBoxCaseSensitive->GetValue(), WxCheckBoxWholeWord->GetValue());
 
-		count = searcher->ReplaceAll(text, reptext, nullptr, nullptr, rangeFrom, rangeTo);
+		if(g_active_wxmedit->GetFileSize() >= REPLACE_ALL_PROGRESS_SIZE)
+		{
+			wxProgressDialog dialog(this->GetTitle(), _("Replacing..."), 100, this,
+				wxPD_CAN_ABORT|wxPD_APP_MODAL|wxPD_ELAPSED_TIME|wxPD_REMAINING_TIME);
+			searcher->SetProgressCallback(ReplaceAllProgress(&dialog));
+			count = searcher->ReplaceAll(text, reptext, nullptr, nullptr, rangeFrom, rangeTo);
+			searcher->SetProgressCallback(wxm::WXMSearcher::ProgressCallback());
+		}
+		else
+		{
+			count = searcher->ReplaceAll(text, reptext, nullptr, nullptr, rangeFrom, rangeTo);
+		}
 
 		if(count>=0)
 		{
@@ -18,6 +18,7 @@
 #include <wx/intl.h>
 #include <wx/string.h>
 //*)
+#include <wx/longlong.h>
 // disable 4996 }
 #ifdef _MSC_VER
 # pragma warning( pop )
@@ -130,15 +131,15 @@ WXMWordCountDialog::WXMWordCountDialog(wxWindow* parent,wxWindowID id,const wxPo
 	if (selection)
 		this->SetTitle(_("Word Count (Selected Text)"));
 
-	WxStaticTextLineCount->SetLabel(wxString() << data.lines);
-	WxStaticTextWordCount->SetLabel(wxString() << data.words);
-	WxStaticTextByteCount->SetLabel(wxString() << data.bytes);
-	WxStaticTextCharCountAll->SetLabel(wxString() << data.chars);
-	WxStaticTextCharCountNoSPNoCtrl->SetLabel(wxString() << (data.chars - data.spaces - data.controls));
-	WxStaticTextSpaceCount->SetLabel(wxString() << data.spaces);
-	WxStaticTextControlCount->SetLabel(wxString() << data.controls);
-	WxStaticTextFullwidthCount->SetLabel(wxString() << (data.fullwidths + data.ambws));
-	WxStaticTextPureFullwidthCount->SetLabel(wxString() << (data.fullwidths));
+	WxStaticTextLineCount->SetLabel(wxLongLong(data.lines).ToString());
+	WxStaticTextWordCount->SetLabel(wxLongLong(data.words).ToString());
+	WxStaticTextByteCount->SetLabel(wxLongLong(data.bytes).ToString());
+	WxStaticTextCharCountAll->SetLabel(wxLongLong(data.chars).ToString());
+	WxStaticTextCharCountNoSPNoCtrl->SetLabel(wxLongLong(data.chars - data.spaces - data.controls).ToString());
+	WxStaticTextSpaceCount->SetLabel(wxLongLong(data.spaces).ToString());
+	WxStaticTextControlCount->SetLabel(wxLongLong(data.controls).ToString());
+	WxStaticTextFullwidthCount->SetLabel(wxLongLong(data.fullwidths + data.ambws).ToString());
+	WxStaticTextPureFullwidthCount->SetLabel(wxLongLong(data.fullwidths).ToString());
 	wxString str;
 	for(size_t i=0; i<data.detail.Count(); ++i)
 		str << data.detail[i] << wxT("\n");
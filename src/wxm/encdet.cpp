@@ -18,8 +18,10 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/assign/list_inserter.hpp>
 #include <boost/assign/list_of.hpp>
-#include <boost/range/iterator_range.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
+#include <cstring>
+#include <deque>
 #include <string>
 
 #ifdef _DEBUG
@@ -33,6 +35,10 @@ namespace wxm
 struct EncodingChecker
 {
 	virtual bool MatchText(const wxByte *text, size_t len) const = 0;
+	virtual bool MatchSample(const EncodingSample& sample) const
+	{
+		return MatchText(sample.Head(), sample.HeadSize());
+	}
 	virtual std::string BOM() const = 0;
 	virtual std::string EncodingName() const = 0;
 
@@ -108,55 +114,23 @@ struct UTF16Checker: public EncodingChecker
 {
 	virtual bool MatchText(const wxByte *text, size_t len) const override
 	{
-		bool ok = false;
-		bool highsurrogate = false;
-
-		wxUint16* u16text=(wxUint16*)text;
-		size_t count = len / 2;
-		for(size_t i=0; i<count; ++i)
-		{
-			wxUint16 u = DByteToUInt(u16text[i]);
-			if(u == 0)
-				return false;
-
-			if(u >= 0xD800 && u <= 0xDB00)
-			{
-				if(highsurrogate)
-					return false;
-
-				highsurrogate = true;
-				continue;
-			}
-
-			if(u >= 0xDC00 && u <= 0xDF00)
-			{
-				if(!highsurrogate)
-					return false;
-
-				ok = true;
-			}
-			else if((u & 0xFF00) == 0)
-			{
-				ok = true;
-			}
-
-			highsurrogate = false;
-		}
+		xm::UTF16ScanStats stats;
+		xm::ScanUTF16(text, len, BigEndian(), true, stats);
 
-		return ok;
+		return stats.zero == 0 && stats.invalid == 0 && (stats.latin != 0 || stats.pairs != 0);
 	}
 
 	virtual ~UTF16Checker(){}
 
 private:
-	virtual wxUint16 DByteToUInt(wxUint16 u) const = 0;
+	virtual bool BigEndian() const = 0;
 };
 
 class UTF16LEChecker: public UTF16Checker
 {
-	virtual wxUint16 DByteToUInt(wxUint16 u) const override
+	virtual bool BigEndian() const override
 	{
-		return wxINT16_SWAP_ON_BE(u);
+		return false;
 	}
 
 	virtual std::string EncodingName() const override
@@ -172,9 +146,9 @@ class UTF16LEChecker: public UTF16Checker
 
 class UTF16BEChecker: public UTF16Checker
 {
-	virtual wxUint16 DByteToUInt(wxUint16 u) const override
+	virtual bool BigEndian() const override
 	{
-		return wxINT16_SWAP_ON_LE(u);
+		return true;
 	}
 
 	virtual std::string EncodingName() const override
@@ -189,130 +163,8 @@ class UTF16BEChecker: public UTF16Checker
 };
 
 
-struct UTF8BytesChecker
-{
-	bool Check(const wxByte* str, size_t len, bool& nonascii) const
-	{
-		if (len < this->TakenBytes())
-			return false;
-
-		nonascii = nonascii || NonASCII();
-		return this->BytesMatch(str);
-	}
-
-	virtual bool NonASCII() const { return true; }
-	virtual bool BytesMatch(const wxByte* bytes) const= 0;
-	virtual size_t TakenBytes() const = 0;
-
-	virtual ~UTF8BytesChecker() {}
-};
-
-struct UTF8SingleByteChecker: public UTF8BytesChecker
-{
-	virtual bool BytesMatch(const wxByte* bytes) const override { return true; }
-	virtual bool NonASCII() const override { return false; }
-
-	virtual size_t TakenBytes() const override { return 1; }
-};
-
-struct UTF8TwoBytesChecker: public UTF8BytesChecker
-{
-	virtual bool BytesMatch(const wxByte* b) const override
-	{
-		return (b[1] & 0xC0)==0x80;
-	}
-	virtual size_t TakenBytes() const override { return 2; }
-};
-
-struct UTF8ThreeBytesChecker: public UTF8BytesChecker
-{
-	virtual bool BytesMatch(const wxByte* b) const override
-	{
-		return (b[1] & 0xC0)==0x80 && (b[2] & 0xC0)==0x80;
-	}
-
-	virtual size_t TakenBytes() const override { return 3; }
-};
-
-// first byte is 0xE0, second byte should >=0xA0
-struct UTF8ThreeBytesCheckerLB: public UTF8ThreeBytesChecker
-{
-	virtual bool BytesMatch(const wxByte* b) const override
-	{
-		return (b[1] & 0xE0)==0xA0 && (b[2] & 0xC0)==0x80;
-	}
-
-};
-
-// first byte is 0xED, second byte should < 0xA0
-// skip surrogates
-struct UTF8ThreeBytesCheckerM: public UTF8ThreeBytesChecker
-{
-	virtual bool BytesMatch(const wxByte* b) const override
-	{
-		return (b[1] & 0xA0)==0x80 && (b[2] & 0xC0)==0x80;
-	}
-};
-
-struct UTF8FourBytesChecker: public UTF8BytesChecker
-{
-	virtual bool BytesMatch(const wxByte* b) const override
-	{
-		return (b[1] & 0xC0)==0x80 && (b[2] & 0xC0)==0x80 && (b[3] & 0xC0)==0x80;
-	}
-
-	virtual size_t TakenBytes() const override { return 4; }
-};
-
-// first byte is 0xF0, second byte should >=0x90
-struct UTF8FourBytesCheckerLB: public UTF8FourBytesChecker
-{
-	virtual bool BytesMatch(const wxByte* b) const override
-	{
-		return (b[1] & 0xF0)>=0x90 && (b[1] & 0xF0)<=0xb0 && (b[2] & 0xC0)==0x80 && (b[3] & 0xC0)==0x80;
-	}
-
-};
-
-// first byte is 0xF4, second byte should <=0x8F
-struct UTF8FourBytesCheckerUB: public UTF8FourBytesChecker
-{
-	virtual bool BytesMatch(const wxByte* b) const override
-	{
-		return (b[1] & 0xF0)==0x80 && (b[2] & 0xC0)==0x80 && (b[3] & 0xC0)==0x80;
-	}
-
-};
-
-struct UTF8InvalidBytesChecker: public UTF8BytesChecker
-{
-	virtual bool BytesMatch(const wxByte* bytes) const override { return false; }
-	virtual size_t TakenBytes() const override { return 1; }
-};
-
 struct UTF8Checker: public EncodingChecker
 {
-	UTF8Checker()
-	{
-		// 0x00-0x7F b1
-		// 0x80-0xBF bx-2 bx-3 bx-4
-		// 0xC0-0xC1 err
-		// 0xC2-0xDF b2-1
-		// 0xE0-0xEF b3-1
-		// 0xF0-0xF7 b4-1
-		m_decoders[0x7F] = &m_dec1;
-		m_decoders[0xC1] = &m_dec_invalid;
-		m_decoders[0xDF] = &m_dec2;
-		m_decoders[0xE0] = &m_dec3lb;
-		m_decoders[0xEC] = &m_dec3;
-		m_decoders[0xED] = &m_dec3m;
-		m_decoders[0xEF] = &m_dec3;
-		m_decoders[0xF0] = &m_dec4lb;
-		m_decoders[0xF3] = &m_dec4;
-		m_decoders[0xF4] = &m_dec4ub;
-		m_decoders[0xFF] = &m_dec_invalid;
-	}
-
 	virtual std::string BOM() const override
 	{
 		return "\xEF\xBB\xBF";
@@ -320,41 +172,21 @@ struct UTF8Checker: public EncodingChecker
 
 	virtual bool MatchText(const wxByte* str, size_t len) const override
 	{
-		bool nonascii = false;
-		while(len > 0)
-		{
-			CheckerMap::const_iterator it = m_decoders.lower_bound(str[0]);
-			const UTF8BytesChecker* checker = it->second;
-			if (!checker->Check(str, len, nonascii))
-				return false;
+		xm::UTF8ScanStats stats;
+		xm::ScanUTF8(str, len, true, true, stats);
 
-			size_t bytes = checker->TakenBytes();
-			len -= bytes;
-			str += bytes;
-		}
+		return stats.invalid == 0 && stats.multibyte > 0;
+	}
 
-		return nonascii;
+	virtual bool MatchSample(const EncodingSample& sample) const override
+	{
+		return sample.MaybeUTF8();
 	}
 
 	virtual std::string EncodingName() const override
 	{
 		return "UTF-8";
 	}
-
-private:
-
-	typedef std::map<wxByte, UTF8BytesChecker*> CheckerMap;
-	CheckerMap m_decoders;
-
-	UTF8SingleByteChecker   m_dec1;
-	UTF8TwoBytesChecker     m_dec2;
-	UTF8ThreeBytesCheckerLB m_dec3lb;
-	UTF8ThreeBytesChecker   m_dec3;
-	UTF8ThreeBytesCheckerM  m_dec3m;
-	UTF8FourBytesCheckerLB  m_dec4lb;
-	UTF8FourBytesChecker    m_dec4;
-	UTF8FourBytesCheckerUB  m_dec4ub;
-	UTF8InvalidBytesChecker m_dec_invalid;
 };
 
 bool IsUTF8(const wxByte *text, size_t len)
@@ -390,12 +222,12 @@ struct ISO646Checker: public EncodingChecker
 
 	virtual bool MatchText(const wxByte* text, size_t len) const override
 	{
-		BOOST_FOREACH(wxByte b, boost::make_iterator_range(text, text+len))
-		{
-			if (b==0x00 || b >= 0x80)
-				return false;
-		}
-		return true;
+		return xm::FindNonISO646(text, len) == len;
+	}
+
+	virtual bool MatchSample(const EncodingSample& sample) const override
+	{
+		return sample.IsISO646();
 	}
 
 	virtual std::string EncodingName() const override
@@ -422,7 +254,7 @@ struct WXMEncodingDetector
 		return bom == std::string((const char*)text, bom.size());
 	}
 
-	std::string DetectEncoding(const wxByte *text, size_t len) const
+	std::string DetectBOMEncoding(const wxByte *text, size_t len) const
 	{
 		BOOST_FOREACH(BOMEncMap::value_type bom_enc, m_bom_enc_map)
 		{
@@ -430,6 +262,15 @@ struct WXMEncodingDetector
 				return bom_enc.second;
 		}
 
+		return std::string();
+	}
+
+	std::string DetectEncoding(const wxByte *text, size_t len) const
+	{
+		std::string enc = DetectBOMEncoding(text, len);
+		if (!enc.empty())
+			return enc;
+
 		BOOST_FOREACH(const boost::shared_ptr<EncodingChecker> checker, m_checkers)
 		{
 			if (checker->MatchText(text, len))
@@ -439,6 +280,21 @@ struct WXMEncodingDetector
 		return std::string();
 	}
 
+	std::string DetectEncoding(const EncodingSample& sample) const
+	{
+		std::string enc = DetectBOMEncoding(sample.Head(), sample.HeadSize());
+		if (!enc.empty())
+			return enc;
+
+		BOOST_FOREACH(const boost::shared_ptr<EncodingChecker> checker, m_checkers)
+		{
+			if (checker->MatchSample(sample))
+				return checker->EncodingName();
+		}
+
+		return std::string();
+	}
+
 	WXMEncodingDetector()
 	{
 		boost::assign::push_back(m_checkers)
@@ -464,11 +320,15 @@ private:
 	BOMEncMap m_bom_enc_map;
 };
 
-bool MatchWXMEncoding(wxString& enc, const wxByte *text, size_t len)
+const WXMEncodingDetector& Detector()
 {
 	static const WXMEncodingDetector det;
+	return det;
+}
 
-	std::string detenc = det.DetectEncoding(text, len);
+bool MatchWXMEncoding(wxString& enc, const wxByte *text, size_t len)
+{
+	std::string detenc = Detector().DetectEncoding(text, len);
 	if (detenc.empty())
 		return false;
 
@@ -476,6 +336,157 @@ bool MatchWXMEncoding(wxString& enc, const wxByte *text, size_t len)
 	return true;
 }
 
+bool MatchWXMEncoding(wxString& enc, const EncodingSample& sample)
+{
+	std::string detenc = Detector().DetectEncoding(sample);
+	if (detenc.empty())
+		return false;
+
+	enc = wxString(detenc.c_str(), wxConvUTF8);
+	return true;
+}
+
+namespace
+{
+	const size_t SAMPLE_WINDOW_SIZE = 64 * 1024;
+	const size_t MAX_SAMPLE_WINDOWS = 17;
+	const size_t HEAD_DETECTING_SIZE = 4096;
+	// ICU does not look beyond 8KB of the text
+	const size_t MAX_DETECTING_SIZE = 8192;
+	// the UTF-8 sequences in the head, the tail and the middle to trust UTF-8
+	const size_t CONFIDENT_UTF8_SEQUENCES = 256;
+}
+
+EncodingSample::EncodingSample(wxFileOffset textsize)
+	: m_textsize(textsize), m_next(0), m_decided(false), m_dettextfull(false), m_iso646(true)
+{
+	if (textsize <= 0)
+		return;
+
+	wxFileOffset count = (textsize + SAMPLE_WINDOW_SIZE - 1) / SAMPLE_WINDOW_SIZE;
+	size_t n = size_t(std::min(count, wxFileOffset(MAX_SAMPLE_WINDOWS)));
+
+	// the head, the tail, then the middle of every span sampled
+	std::vector<size_t> order(1, 0);
+	if (n > 1)
+	{
+		order.push_back(n - 1);
+
+		std::deque<std::pair<size_t, size_t> > spans(1, std::make_pair(size_t(0), n - 1));
+		while (!spans.empty())
+		{
+			size_t lo = spans.front().first;
+			size_t hi = spans.front().second;
+			spans.pop_front();
+			if (hi - lo < 2)
+				continue;
+
+			size_t mid = (lo + hi) / 2;
+			order.push_back(mid);
+			spans.push_back(std::make_pair(lo, mid));
+			spans.push_back(std::make_pair(mid, hi));
+		}
+	}
+
+	BOOST_FOREACH(size_t i, order)
+	{
+		wxFileOffset pos = 0;
+		if (n > 1)
+			pos = (textsize - wxFileOffset(SAMPLE_WINDOW_SIZE)) * wxFileOffset(i) / wxFileOffset(n - 1);
+		m_windows.push_back(pos - pos % 4);
+	}
+}
+
+bool EncodingSample::NextWindow(wxFileOffset& pos, size_t& len) const
+{
+	if (m_decided || m_next >= m_windows.size())
+		return false;
+
+	pos = m_windows[m_next];
+	len = size_t(std::min(m_textsize - pos, wxFileOffset(SAMPLE_WINDOW_SIZE)));
+	return true;
+}
+
+void EncodingSample::AddWindow(const wxByte *data, size_t len)
+{
+	wxASSERT(m_next < m_windows.size());
+
+	const wxFileOffset pos = m_windows[m_next++];
+	const bool atstart = (pos == 0);
+	const bool atend = (pos + wxFileOffset(len) >= m_textsize);
+
+	xm::ScanUTF8(data, len, atstart, atend, m_utf8);
+
+	const size_t nonascii = xm::FindNonASCII(data, len);
+	const bool nul = std::memchr(data, 0, len) != nullptr;
+	if (m_iso646 && (nul || nonascii < len))
+		m_iso646 = false;
+
+	if (atstart)
+	{
+		m_head.assign(data, data + len);
+
+		if (nul || nonascii < len)
+			m_dettext.assign(data, data + std::min(len, HEAD_DETECTING_SIZE));
+
+		// UTF-16/32 or binary data, the other windows cannot tell more
+		if (nul || !Detector().DetectBOMEncoding(data, len).empty())
+			m_decided = true;
+	}
+	else if (nonascii < len)
+	{
+		AppendDetectingText(data, len, nonascii);
+	}
+
+	if (Decisive())
+		m_decided = true;
+}
+
+// append the text around the first non-ASCII byte of the window; as a byte
+// < 0x40 is always a single-byte char in the multi-byte encodings, the text
+// is begun and ended after such bytes so that no char is cut
+void EncodingSample::AppendDetectingText(const wxByte *data, size_t len, size_t nonascii)
+{
+	if (m_dettextfull)
+		return;
+
+	size_t begin = (nonascii > 64) ? nonascii - 64 : 0;
+	if (begin == 0)
+	{
+		while (begin < len && data[begin] >= 0x40)
+			++begin;
+		if (begin++ == len)
+			return;
+	}
+
+	size_t end = len;
+	if (len - begin >= MAX_DETECTING_SIZE - m_dettext.size())
+	{
+		m_dettextfull = true;
+		end = begin + (MAX_DETECTING_SIZE - m_dettext.size());
+
+		size_t cut = end;
+		while (cut > begin && data[cut - 1] >= 0x40)
+			--cut;
+		if (cut > begin)
+			end = cut;
+	}
+
+	if (!m_dettext.empty())
+		m_dettext.push_back('\n');
+	m_dettext.insert(m_dettext.end(), data + begin, data + end);
+}
+
+bool EncodingSample::Decisive() const
+{
+	// not UTF-8, and the statistical detector has got enough text
+	if (m_utf8.invalid != 0)
+		return m_dettextfull;
+
+	// UTF-8 in the head, the tail and the middle
+	return m_next >= 3 && m_utf8.multibyte >= CONFIDENT_UTF8_SEQUENCES;
+}
+
 bool MatchEUCJPMoreThanGB18030(const wxByte *text, size_t len)
 {
 	size_t i=0;
@@ -558,6 +569,14 @@ private:
 };
 #endif
 
+void DetectEncoding(const EncodingSample& sample, wxm::WXMEncodingID &enc, bool skip_utf8)
+{
+	if (sample.DetectingSize() != 0)
+		DetectEncoding(sample.DetectingText(), sample.DetectingSize(), enc, skip_utf8);
+	else
+		DetectEncoding(sample.Head(), std::min(sample.HeadSize(), HEAD_DETECTING_SIZE), enc, skip_utf8);
+}
+
 void DetectEncoding(const wxByte *text, size_t len, wxm::WXMEncodingID &enc, bool skip_utf8)
 {
 	UErrorCode status = U_ZERO_ERROR;
@@ -10,6 +10,7 @@
 #define _WXM_ENCDET_H_
 
 #include "encoding/encoding_def.h"
+#include "../xm/encoding_scan.h"
 
 #ifdef _MSC_VER
 # pragma warning( push )
@@ -31,11 +32,59 @@
 # pragma warning( pop )
 #endif
 
+#include <vector>
+
 namespace wxm
 {
+	// EncodingSample collects windows of a text for detecting its encoding: the
+	// head, and for a large text the tail, the middle and the points between
+	// them, until the evidence of the windows read so far is decisive.
+	//   EncodingSample sample(size);
+	//   while (sample.NextWindow(pos, len))
+	//       sample.AddWindow(<len bytes at pos>, len);
+	struct EncodingSample
+	{
+		explicit EncodingSample(wxFileOffset textsize);
+
+		// get the next window to read, return false if no more is needed
+		bool NextWindow(wxFileOffset& pos, size_t& len) const;
+		// add the data of the window got by NextWindow()
+		void AddWindow(const wxByte *data, size_t len);
+
+		const wxByte* Head() const { return m_head.empty() ? nullptr : &m_head[0]; }
+		size_t HeadSize() const { return m_head.size(); }
+
+		// whether all the windows are well-formed UTF-8 text, with non-ASCII chars
+		bool MaybeUTF8() const { return m_utf8.invalid == 0 && m_utf8.multibyte > 0; }
+		// whether all the windows are ASCII text without NUL
+		bool IsISO646() const { return m_iso646; }
+
+		// the text for the statistical detector: the head and the parts
+		// around the non-ASCII bytes of the other windows
+		const wxByte* DetectingText() const { return m_dettext.empty() ? nullptr : &m_dettext[0]; }
+		size_t DetectingSize() const { return m_dettext.size(); }
+
+	private:
+		void AppendDetectingText(const wxByte *data, size_t len, size_t nonascii);
+		bool Decisive() const;
+
+		wxFileOffset m_textsize;
+		std::vector<wxFileOffset> m_windows;
+		size_t m_next;
+		bool m_decided;
+
+		std::vector<wxByte> m_head;
+		std::vector<wxByte> m_dettext;
+		bool m_dettextfull;
+		xm::UTF8ScanStats m_utf8;
+		bool m_iso646;
+	};
+
 	bool IsUTF8(const wxByte *text, size_t len);
 	bool MatchWXMEncoding(wxString& enc, const wxByte *text, size_t len);
+	bool MatchWXMEncoding(wxString& enc, const EncodingSample& sample);
 	void DetectEncoding(const wxByte *text, size_t len, wxm::WXMEncodingID &enc, bool skip_utf8);
+	void DetectEncoding(const EncodingSample& sample, wxm::WXMEncodingID &enc, bool skip_utf8);
 } //namespace wxm
 
 #endif //_WXM_ENCDET_H_
@@ -146,6 +146,15 @@ void WXMEncodingDoubleByte::MultiByteInit()
 
 	memset(m_leadbyte_tab.c_array(), lbUnset, 256);
 	m_leadbyte_tab[0]=lbNotLeadByte;
+
+	// fill the decoding tables now rather than on demand, so that decoding
+	// only reads them and may run in several threads at the same time
+	memset(m_db2u_tab.c_array(), svtInvaliad, sizeof(m_db2u_tab));
+	for(int b=1; b<=0xFF; ++b)
+	{
+		if (m_dbfix->LeadByteInfo(b) == lbUnset)
+			FillLeadByte(b);
+	}
 }
 
 ucs4_t WXMEncodingDoubleByte::MultiBytetoUCS4(const wxByte* buf)
@@ -167,36 +176,35 @@ bool WXMEncodingDoubleByte::IsLeadByte(wxByte byte)
 	if (lbinfo != lbUnset)
 		return lbinfo==lbLeadByte;
 
-	if(m_leadbyte_tab[byte]==lbUnset)
-	{
-		wxByte dbs[3]={byte,0,0};
-		UChar32 ch;
+	return m_leadbyte_tab[byte]==lbLeadByte;
+}
 
-		// check first byte
-		if(m_mbcnv->MB2WC(ch, (char*)dbs, 1) == 1)
-		{
-			m_b2u_tab[byte] = ch;
+void WXMEncodingDoubleByte::FillLeadByte(wxByte byte)
+{
+	wxByte dbs[3]={byte,0,0};
+	UChar32 ch;
 
-			m_leadbyte_tab[byte]=lbNotLeadByte;
-		}
+	// check first byte
+	if(m_mbcnv->MB2WC(ch, (char*)dbs, 1) == 1)
+	{
+		m_b2u_tab[byte] = ch;
 
-		memset(m_db2u_tab[byte].c_array(), svtInvaliad, sizeof(ucs4_t)*256);
-		for(int i=1; i<=0xFF; ++i)
+		m_leadbyte_tab[byte]=lbNotLeadByte;
+	}
+
+	for(int i=1; i<=0xFF; ++i)
+	{
+		dbs[1] = i;
+		if(m_mbcnv->MB2WC(ch, (char*)dbs, 2) == 1)
 		{
-			dbs[1] = i;
-			if(m_mbcnv->MB2WC(ch, (char*)dbs, 2) == 1)
-			{
-				m_db2u_tab[byte][i] = ch;
+			m_db2u_tab[byte][i] = ch;
 
-				m_leadbyte_tab[byte] = lbLeadByte;
-			}
+			m_leadbyte_tab[byte] = lbLeadByte;
 		}
-
-		if (m_leadbyte_tab[byte] == lbLeadByte)
-			m_b2u_tab[byte] = 0;
 	}
 
-	return m_leadbyte_tab[byte]==lbLeadByte;
+	if (m_leadbyte_tab[byte] == lbLeadByte)
+		m_b2u_tab[byte] = 0;
 }
 
 size_t WXMEncodingDoubleByte::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
@@ -216,26 +224,29 @@ size_t WXMEncodingDoubleByte::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
 	return 2;
 }
 
-bool WXMEncodingDoubleByte::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
+size_t WXMEncodingDoubleByte::DecodeUChar32(const wxByte* buf, size_t rest, ucs4_t& uc)
 {
-	wxFileOffset rest;
-	wxByte* buf = mapper.BufferLoadBytes(rest, 2);
-	if (buf == nullptr)
-		return false;
-
-	ucs4_t uc;
 	if(rest==1 || buf[1] == 0 || (uc=MultiBytetoUCS4(buf)) == (ucs4_t)svtInvaliad)
 	{
 		wxByte db[2] = {buf[0], 0}; // re-check by first byte
 		if((uc=MultiBytetoUCS4(db)) == (ucs4_t)svtInvaliad)
 			uc = buf[0];
 
-		mapper.MoveUChar32Bytes(ucqueue, uc, 1);
-		return true;
+		return 1;
 	}
 
-	mapper.MoveUChar32Bytes(ucqueue, uc, 2);
-	return true;
+	return 2;
+}
+
+bool WXMEncodingDoubleByte::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
+{
+	return NextUChar32ByDecoder(ucqueue, mapper, MemberUChar32Decoder<WXMEncodingDoubleByte>(this));
+}
+
+size_t WXMEncodingDoubleByte::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                             ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	return DecodeUChar32Span(buf, len, more, ucs, lens, maxcount, MemberUChar32Decoder<WXMEncodingDoubleByte>(this));
 }
 
 };// namespace wxm
@@ -68,6 +68,11 @@ struct WXMEncodingDoubleByte: public WXMEncodingMultiByte
 	virtual ucs4_t MultiBytetoUCS4(const wxByte* buf) override;
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) override;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) override;
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount) override;
+
+	// decode one UChar32 from buf[0, rest), return its byte-length
+	size_t DecodeUChar32(const wxByte* buf, size_t rest, ucs4_t& uc);
 
 	virtual bool IsSingleByteEncoding() override
 	{
@@ -100,10 +105,13 @@ private:
 	boost::array<wxByte, 256> m_leadbyte_tab;
 
 	boost::array<ucs4_t, 256> m_b2u_tab;
-	std::map<wxByte, boost::array<ucs4_t, 256> > m_db2u_tab;
+	boost::array<boost::array<ucs4_t, 256>, 256> m_db2u_tab;
 
+	// filled on demand, only the main thread encodes
 	boost::array<wxWord, 0x10000> m_bmp2mb_tab;
 
+	// fill m_leadbyte_tab, m_b2u_tab and m_db2u_tab for the first byte
+	void FillLeadByte(wxByte byte);
 	wxWord GetCachedMBofUCS4(ucs4_t u);
 	void CacheMBofUCS4(wxWord& mb, ucs4_t u);
 };
@@ -416,6 +416,8 @@ WXMEncoding* WXMEncodingManager::GetWxmEncoding(ssize_t idx)
 {
 	wxASSERT(idx<(ssize_t)m_wxenc_list.size() && idx>=0);
 
+	wxMutexLocker lock(m_inst_lock);
+
 	EncInstMap::iterator it = m_inst_map.find(idx);
 	if (it!=m_inst_map.end() && it->second!=nullptr)
 		return it->second;
@@ -469,7 +471,7 @@ WXMEncoding* WXMEncodingManager::GetWxmEncoding(WXMEncodingID enc)
 	size_t idx;
 	for(idx=0;idx<m_wxenc_list.size();idx++)
 	{
-		if(m_wxnameenc_map[m_wxenc_list[idx]]==enc)
+		if(NameToEncoding(m_wxenc_list[idx])==enc)
 		{
 			return GetWxmEncoding(idx);
 		}
@@ -483,7 +485,7 @@ WXMEncoding* WXMEncodingManager::GetWxmEncoding(const wxString& name)
 	size_t idx;
 	for(idx=0;idx<m_wxenc_list.size();idx++)
 	{
-		if(m_wxenc_list[idx].Lower()==name.Lower())
+		if(m_wxenc_list[idx].CmpNoCase(name)==0)
 		{
 			return GetWxmEncoding(idx);
 		}
@@ -504,6 +506,62 @@ void WXMEncoding::Create(ssize_t idx)
 	m_simp_unicode = WXMEncodingManager::IsSimpleUnicodeEncoding(m_enc);
 }
 
+namespace
+{
+
+// feed NextUChar32() with a span of bytes
+struct SpanBytesMapper: public UChar32BytesMapper
+{
+	SpanBytesMapper(const wxByte* buf, size_t len, ucs4_t* ucs, wxByte* lens)
+		: m_buf(buf), m_len(len), m_pos(0), m_ucs(ucs), m_lens(lens), m_count(0)
+	{}
+
+	virtual void MoveUChar32Bytes(MadUCQueue &ucqueue, ucs4_t uc, size_t len) override
+	{
+		m_ucs[m_count] = uc;
+		m_lens[m_count] = wxByte(len);
+		++m_count;
+		m_pos += len;
+	}
+
+	virtual wxByte* BufferLoadBytes(wxFileOffset& rest, size_t buf_len) override
+	{
+		if (m_pos >= m_len)
+			return nullptr;
+
+		rest = wxFileOffset(m_len - m_pos);
+		return const_cast<wxByte*>(m_buf + m_pos);
+	}
+
+	size_t Pos() const { return m_pos; }
+	size_t Count() const { return m_count; }
+
+private:
+	const wxByte* m_buf;
+	size_t m_len;
+	size_t m_pos;
+	ucs4_t* m_ucs;
+	wxByte* m_lens;
+	size_t m_count;
+};
+
+} // namespace
+
+size_t WXMEncoding::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                   ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	size_t end = len;
+	if (more)
+		end = (len >= UCHAR32_MAX_BYTES)? len - (UCHAR32_MAX_BYTES - 1): 0;
+
+	SpanBytesMapper mapper(buf, len, ucs, lens);
+	MadUCQueue ucqueue;
+	while (mapper.Count() < maxcount && mapper.Pos() < end)
+		NextUChar32(ucqueue, mapper);
+
+	return mapper.Count();
+}
+
 
 bool WXMEncodingDecoderISO646::IsUChar32_LineFeed(const wxByte* buf, size_t len)
 {
@@ -28,6 +28,7 @@
 #ifndef WX_PRECOMP
 # include <wx/string.h>
 #endif
+#include <wx/thread.h>
 // disable 4996 }
 #ifdef _MSC_VER
 # pragma warning( pop )
@@ -83,6 +84,8 @@ struct WXMEncodingManager: private boost::noncopyable
 	}
 	void FreeEncodings();
 
+	// the instances are created on demand under a lock,
+	// so they can be got and used to decode in any thread
 	WXMEncoding* GetWxmEncoding(ssize_t idx);
 	WXMEncoding* GetWxmEncoding(WXMEncodingID enc);
 	WXMEncoding* GetWxmEncoding(const wxString& name);
@@ -169,10 +172,14 @@ private:
 
 	typedef std::map<ssize_t, WXMEncoding*> EncInstMap;
 	EncInstMap m_inst_map;
+	wxMutex m_inst_lock;        // guards m_inst_map
 };
 
 struct WXMBlockDumper;
 
+// the max byte-length of a UChar32 decoded by WXMEncoding::NextUChar32()
+const size_t UCHAR32_MAX_BYTES = 4;
+
 
 struct WXMEncodingDecoder: private boost::noncopyable
 {
@@ -225,9 +232,18 @@ protected:
 
 public:
 	// return the converted length of buf
+	// some encodings cache the converted chars, call it in the main thread only
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) = 0;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) = 0;
 
+	// decode at most maxcount UChar32s from buf[0, len) into ucs, and their byte-lengths into lens,
+	// the same as calling NextUChar32() repeatedly;
+	// if more is true, len is not the end of the text and up to UCHAR32_MAX_BYTES-1 bytes
+	// at the end of buf may be left to the next call, since they may be an incomplete UChar32;
+	// return the count of decoded UChar32s
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount);
+
 	virtual ucs4_t MultiBytetoUCS4(const wxByte* buf)
 	{
 		return (ucs4_t)svtInvaliad;
@@ -260,6 +276,59 @@ public:
 	WXMEncodingID GetEncoding() { return m_enc; }
 };
 
+// the decoder of one UChar32 used by the helpers below:
+//   size_t dec(const wxByte* buf, size_t rest, ucs4_t& uc);
+// which returns the byte-length of uc, rest is at most UCHAR32_MAX_BYTES
+
+// WXMEncoding::NextUChar32() with dec
+template <typename Decoder>
+bool NextUChar32ByDecoder(MadUCQueue &ucqueue, UChar32BytesMapper& mapper, Decoder dec)
+{
+	wxFileOffset rest;
+	wxByte* buf = mapper.BufferLoadBytes(rest, UCHAR32_MAX_BYTES);
+	if (buf == nullptr)
+		return false;
+
+	ucs4_t uc;
+	size_t len = dec(buf, (rest < wxFileOffset(UCHAR32_MAX_BYTES))? size_t(rest): UCHAR32_MAX_BYTES, uc);
+	mapper.MoveUChar32Bytes(ucqueue, uc, len);
+	return true;
+}
+
+// dec with the member function size_t Enc::DecodeUChar32(const wxByte* buf, size_t rest, ucs4_t& uc)
+template <typename Enc>
+struct MemberUChar32Decoder
+{
+	Enc* enc;
+	explicit MemberUChar32Decoder(Enc* e): enc(e) {}
+
+	size_t operator()(const wxByte* buf, size_t rest, ucs4_t& uc) const
+	{
+		return enc->DecodeUChar32(buf, rest, uc);
+	}
+};
+
+// WXMEncoding::DecodeUChar32s() with dec
+template <typename Decoder>
+size_t DecodeUChar32Span(const wxByte* buf, size_t len, bool more,
+                         ucs4_t* ucs, wxByte* lens, size_t maxcount, Decoder dec)
+{
+	size_t end = len;
+	if (more)
+		end = (len >= UCHAR32_MAX_BYTES)? len - (UCHAR32_MAX_BYTES - 1): 0;
+
+	size_t pos = 0;
+	size_t n = 0;
+	for (; n < maxcount && pos < end; ++n)
+	{
+		size_t rest = len - pos;
+		size_t ulen = dec(buf + pos, (rest < UCHAR32_MAX_BYTES)? rest: UCHAR32_MAX_BYTES, ucs[n]);
+		lens[n] = wxByte(ulen);
+		pos += ulen;
+	}
+	return n;
+}
+
 };// namespace wxm
 
 #endif // _WXM_ENCODING_H_
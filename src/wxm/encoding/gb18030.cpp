@@ -21,14 +21,43 @@ namespace wxm
 
 void WXMEncodingGB18030::MultiByteInit()
 {
-	memset(m_db2u.c_array(), svtNotCached, sizeof(ucs4_t)*BMP_DBYTE_CNT);
-	memset(m_qb2u.c_array(), svtNotCached, sizeof(ucs4_t)*BMP_QBYTE_CNT);
-
 	memset(m_bmp2mb.c_array(), svtNotCached, sizeof(wxDword)*0xD800);
 	memset(m_bmp2mb.c_array()+0xD800, svtInvaliad, sizeof(wxDword)*0x800);
 	memset(m_bmp2mb.c_array()+0xE000, svtNotCached, sizeof(wxDword)*0x2000);
 
+	// fill the decoding tables now rather than on demand, so that decoding
+	// only reads them and may run in several threads at the same time
+	wxByte buf[4] = {0, 0, 0, 0};
+	for (size_t idx=0; idx<BMP_DBYTE_CNT; ++idx)
+	{
+		buf[0] = wxByte(0x81 + idx / (0xFE - 0x40 + 1));
+		buf[1] = wxByte(0x40 + idx % (0xFE - 0x40 + 1));
+		m_db2u[idx] = ICUMultiBytetoUCS4(buf, 2);
+	}
+	for (size_t idx=0; idx<BMP_QBYTE_CNT; ++idx)
+	{
+		buf[0] = wxByte(0x81 + idx / 12600);
+		buf[1] = wxByte(0x30 + idx / 1260 % 10);
+		buf[2] = wxByte(0x81 + idx / 10 % 126);
+		buf[3] = wxByte(0x30 + idx % 10);
+		m_qb2u[idx] = ICUMultiBytetoUCS4(buf, 4);
+	}
+
 	m_qb2u[BMP_QBYTE_IDX_FFFD] = 0x00FFFD;
+
+#if (U_ICU_VERSION_MAJOR_NUM*10+U_ICU_VERSION_MINOR_NUM < 48)
+	m_qb2u[(0x81-0x81)*12600 + (0x35-0x30)*1260 + (0xF4-0x81)*10 + 0x37-0x30] = (ucs4_t)0x00E7C7;
+	m_db2u[(0xA8 - 0x81)*(0xFE - 0x40 + 1) + (0xBC - 0x40)] = (ucs4_t)0x001E3F;
+#endif
+}
+
+ucs4_t WXMEncodingGB18030::ICUMultiBytetoUCS4(const wxByte* buf, size_t len)
+{
+	UChar32 ch = 0;
+	if (m_icucnv.MB2WC(ch, (const char*)buf, len) == 0)
+		return (ucs4_t)svtInvaliad;
+
+	return (ucs4_t)ch;
 }
 
 inline bool IsQByte2NONBMP(const wxByte* buf)
@@ -82,47 +111,13 @@ ucs4_t WXMEncodingGB18030::QByte2BMP(const wxByte* buf)
 	if (idx >= BMP_QBYTE_CNT)
 		return (ucs4_t)svtInvaliad;
 
-	if (m_qb2u[idx] != (ucs4_t)svtUCS4NotCached)
-		return m_qb2u[idx];
-
-#if (U_ICU_VERSION_MAJOR_NUM*10+U_ICU_VERSION_MINOR_NUM < 48)
-	if (idx == (0x81-0x81)*12600 + (0x35-0x30)*1260 + (0xF4-0x81)*10 + 0x37-0x30)
-	{
-		m_db2u[idx] = (ucs4_t)0x00E7C7;
-		return (ucs4_t)0x00E7C7;
-	}
-#endif
-
-	UChar32 ch = 0;
-	size_t len = m_icucnv.MB2WC(ch, (const char*)buf, 4);
-	if (len == 0)
-		return (ucs4_t)svtInvaliad;
-
-	m_qb2u[idx] = (ucs4_t)ch;
-	return (ucs4_t)ch;
+	return m_qb2u[idx];
 }
 
 ucs4_t WXMEncodingGB18030::DByte2BMP(const wxByte* buf)
 {
 	size_t idx = (buf[0] - 0x81)*(0xFE - 0x40 + 1) + (buf[1] - 0x40);
-	if (m_db2u[idx] != (ucs4_t)svtUCS4NotCached)
-		return m_db2u[idx];
-
-#if (U_ICU_VERSION_MAJOR_NUM*10+U_ICU_VERSION_MINOR_NUM < 48)
-	if (idx == (0xA8 - 0x81)*(0xFE - 0x40 + 1) + (0xBC - 0x40))
-	{
-		m_db2u[idx] = (ucs4_t)0x001E3F;
-		return (ucs4_t)0x001E3F;
-	}
-#endif
-
-	UChar32 ch = 0;
-	size_t len = m_icucnv.MB2WC(ch, (const char*)buf, 2);
-	if (len==0)
-		return (ucs4_t)svtInvaliad;
-
-	m_db2u[idx] = (ucs4_t)ch;
-	return (ucs4_t)ch;
+	return m_db2u[idx];
 }
 
 size_t WXMEncodingGB18030::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
@@ -204,14 +199,9 @@ void WXMEncodingGB18030::CacheMBofUCS4(wxDword& mb, ucs4_t u)
 }
 
 
-bool WXMEncodingGB18030::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
+size_t WXMEncodingGB18030::DecodeUChar32(const wxByte* buf, size_t rest, ucs4_t& uc)
 {
-	wxFileOffset rest;
-	wxByte *buf = mapper.BufferLoadBytes(rest, 4);
-	if (buf == nullptr)
-		return false;
-
-	ucs4_t uc = (ucs4_t)svtInvaliad;
+	uc = (ucs4_t)svtInvaliad;
 	if (rest >= 4)
 	{
 		if (IsQByte2NONBMP(buf))
@@ -220,10 +210,7 @@ bool WXMEncodingGB18030::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& ma
 			uc = QByte2BMP(buf);
 
 		if (uc != (ucs4_t)svtInvaliad)
-		{
-			mapper.MoveUChar32Bytes(ucqueue, uc, 4);
-			return true;
-		}
+			return 4;
 	}
 
 	if (rest >= 2)
@@ -233,15 +220,22 @@ bool WXMEncodingGB18030::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& ma
 			uc = DByte2BMP(buf2);
 
 		if (uc != (ucs4_t)svtInvaliad)
-		{
-			mapper.MoveUChar32Bytes(ucqueue, uc, 2);
-			return true;
-		}
+			return 2;
 	}
 
 	uc = buf[0];
-	mapper.MoveUChar32Bytes(ucqueue, uc, 1);
-	return true;
+	return 1;
+}
+
+bool WXMEncodingGB18030::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
+{
+	return NextUChar32ByDecoder(ucqueue, mapper, MemberUChar32Decoder<WXMEncodingGB18030>(this));
+}
+
+size_t WXMEncodingGB18030::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                          ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	return DecodeUChar32Span(buf, len, more, ucs, lens, maxcount, MemberUChar32Decoder<WXMEncodingGB18030>(this));
 }
 
 };// namespace wxm
@@ -28,6 +28,11 @@ struct WXMEncodingGB18030: public WXMEncodingMultiByte, WXMEncodingDecoderISO646
 	virtual ucs4_t MultiBytetoUCS4(const wxByte* buf) override;
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) override;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) override;
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount) override;
+
+	// decode one UChar32 from buf[0, rest), return its byte-length
+	size_t DecodeUChar32(const wxByte* buf, size_t rest, ucs4_t& uc);
 
 	virtual bool IsSingleByteEncoding() override
 	{
@@ -58,11 +63,13 @@ private:
 	static const size_t BMP_DBYTE_CNT = (0xFE - 0x81 + 1)*(0xFE - 0x40 + 1);
 	boost::array<ucs4_t, BMP_DBYTE_CNT> m_db2u;
 
+	// filled on demand, only the main thread encodes
 	boost::array<wxDword, 0x10000> m_bmp2mb;
 	//std::map<ucs4_t, wxWord> m_nonbmp2db;
 
 	ICUConverter m_icucnv;
 
+	ucs4_t ICUMultiBytetoUCS4(const wxByte* buf, size_t len);
 	ucs4_t QByte2NONBMP(const wxByte* buf);
 	ucs4_t QByte2BMP(const wxByte* buf);
 	ucs4_t DByte2BMP(const wxByte* buf);
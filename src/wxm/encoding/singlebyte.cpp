@@ -293,4 +293,16 @@ bool WXMEncodingSingleByte::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper&
 	return true;
 }
 
+size_t WXMEncodingSingleByte::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                             ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	size_t n = (len < maxcount)? len: maxcount;
+	for (size_t i = 0; i < n; ++i)
+	{
+		ucs[i] = m_tounicode[buf[i]];
+		lens[i] = 1;
+	}
+	return n;
+}
+
 };// namespace wxm
@@ -67,6 +67,8 @@ struct WXMEncodingSingleByte: public WXMEncodingMultiByte
 	virtual ucs4_t MultiBytetoUCS4(const wxByte* buf) override;
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) override;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) override;
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount) override;
 
 	virtual bool IsSingleByteEncoding() override
 	{
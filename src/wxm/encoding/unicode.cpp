@@ -18,6 +18,122 @@
 namespace wxm
 {
 
+namespace
+{
+
+// the decoders of one UChar32 for NextUChar32() & DecodeUChar32Span(),
+// rest is the count of the available bytes, at most UCHAR32_MAX_BYTES
+
+struct UTF8Decoder
+{
+	size_t operator()(const wxByte* buf, size_t rest, ucs4_t& uc) const
+	{
+		if(buf[0]<=0x7F)
+		{
+			uc = buf[0];
+			return 1;
+		}
+
+		if(buf[0]<=0xDF)
+		{
+			if(rest>=2 && (buf[1] & 0xC0) == 0x80)     // valid 2 bytes
+			{
+				if((uc= ((ucs4_t(buf[0] & 0x1F)<<6) | (buf[1] & 0x3F) )) >= 0x80)
+					return 2;
+			}
+			uc = buf[0];
+			return 1;
+		}
+
+		if(buf[0]<=0xEF)
+		{
+			if(rest>=3 && (buf[1] & 0xC0)==0x80 && (buf[2] & 0xC0)==0x80)     // valid 3 bytes
+			{
+				uc= (ucs4_t(buf[0] & 0x0F)<<12) | (ucs4_t(buf[1] & 0x3F) << 6) | (buf[2] & 0x3F);
+				if(uc>=0x800 )//&& !(uc>=0xD800 && uc<=0xDFFF))
+					return 3;
+			}
+			uc = buf[0];
+			return 1;
+		}
+
+		if((buf[0]&0xF0) == 0xF0)
+		{
+			if(rest>=4 && (buf[1] & 0xC0)==0x80 && (buf[2] & 0xC0)==0x80 && (buf[3] & 0xC0)==0x80)     // valid 4 bytes
+			{
+				uc= (ucs4_t(buf[0] & 0x07)<<18) | (ucs4_t(buf[1] & 0x3F) << 12) | (ucs4_t(buf[2] & 0x3F) << 6) | (buf[3] & 0x3F);
+				if(uc>=0x10000 && uc<=0x10FFFF)
+					return 4;
+			}
+		}
+
+		uc = buf[0];
+		return 1;
+	}
+};
+
+template <bool BE>
+struct UTF16Decoder
+{
+	static ucs4_t Unit(const wxByte* buf)
+	{
+		return BE? ((ucs4_t(buf[0])<<8) | buf[1]): ((ucs4_t(buf[1])<<8) | buf[0]);
+	}
+
+	size_t operator()(const wxByte* buf, size_t rest, ucs4_t& uc) const
+	{
+		if(rest < 2)
+		{
+			uc = (ucs4_t)'?';
+			return 1;
+		}
+
+		uc = Unit(buf);
+
+		//utf16 surrogates
+		if(uc>=0xD800 && uc<=0xDBFF && rest >= 4)
+		{
+			ucs4_t uc1 = Unit(buf+2);
+			if(uc1>=0xDC00 && uc1<=0xDFFF)
+			{
+				//ucs4=(highChar -0xD800) * 0x400 + (lowChar -0xDC00) + 0x10000
+				uc = ((uc-0xD800)<<10) + (uc1-0xDC00) + 0x10000;
+				return 4;
+			}
+		}
+
+		return 2;
+	}
+};
+
+template <bool BE>
+struct UTF32Decoder
+{
+	size_t operator()(const wxByte* buf, size_t rest, ucs4_t& uc) const
+	{
+		if(rest < 4)
+		{
+			uc = (ucs4_t)'?';
+			return rest;
+		}
+
+		wxUint32 u;
+		if(BE)
+			u = (wxUint32(buf[0])<<24) | (wxUint32(buf[1])<<16) | (wxUint32(buf[2])<<8) | buf[3];
+		else
+			u = (wxUint32(buf[3])<<24) | (wxUint32(buf[2])<<16) | (wxUint32(buf[1])<<8) | buf[0];
+		uc = ucs4_t(u);
+
+		if(uc>0x10FFFF || uc<0)
+		{
+			uc='?'; // not a valid ucs4 char
+		}
+		return 4;
+	}
+};
+
+} // namespace
+
 size_t WXMEncodingUTF8::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
 {
 	/***  from rfc3629
@@ -75,64 +191,41 @@ size_t WXMEncodingUTF8::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
 
 bool WXMEncodingUTF8::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
 {
-	wxFileOffset rest;
-	wxByte* buf = mapper.BufferLoadBytes(rest, 4);
-	if (buf == nullptr)
-		return false;
-
-	int cnt= (rest<4)? int(rest): 4;
-
-	if(buf[0]<=0x7F)
-	{
-		mapper.MoveUChar32Bytes(ucqueue, buf[0], 1);
-		return true;
-	}
-
-	ucs4_t uc;
-	if(buf[0]<=0xDF)
-	{
-		if(cnt>=2 && (buf[1] & 0xC0) == 0x80)     // valid 2 bytes
-		{
-			if((uc= ((ucs4_t(buf[0] & 0x1F)<<6) | (buf[1] & 0x3F) )) >= 0x80)
-			{
-				mapper.MoveUChar32Bytes(ucqueue, uc, 2);
-				return true;
-			}
-		}
-		mapper.MoveUChar32Bytes(ucqueue, buf[0], 1);
-		return true;
-	}
-
-	if(buf[0]<=0xEF)
-	{
-		if(cnt>=3 && (buf[1] & 0xC0)==0x80 && (buf[2] & 0xC0)==0x80)     // valid 3 bytes
-		{
-			uc= (ucs4_t(buf[0] & 0x0F)<<12) | (ucs4_t(buf[1] & 0x3F) << 6) | (buf[2] & 0x3F);
-			if(uc>=0x800 )//&& !(uc>=0xD800 && uc<=0xDFFF))
-			{
-				mapper.MoveUChar32Bytes(ucqueue, uc, 3);
-				return true;
-			}
-		}
-		mapper.MoveUChar32Bytes(ucqueue, buf[0], 1);
-		return true;
-	}
-
-	if((buf[0]&0xF0) == 0xF0)
+	return NextUChar32ByDecoder(ucqueue, mapper, UTF8Decoder());
+}
+size_t WXMEncodingUTF8::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                       ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	size_t end = len;
+	if (more)
+		end = (len >= UCHAR32_MAX_BYTES)? len - (UCHAR32_MAX_BYTES - 1): 0;
+
+	UTF8Decoder dec;
+	size_t pos = 0;
+	size_t n = 0;
+	while (n < maxcount && pos < end)
 	{
-		if(cnt>=4 && (buf[1] & 0xC0)==0x80 && (buf[2] & 0xC0)==0x80 && (buf[3] & 0xC0)==0x80)     // valid 4 bytes
+		// a run of ASCII chars
+		size_t stop = pos + (maxcount - n);
+		if (stop > end)
+			stop = end;
+		while (pos < stop && buf[pos] <= 0x7F)
 		{
-			uc= (ucs4_t(buf[0] & 0x07)<<18) | (ucs4_t(buf[1] & 0x3F) << 12) | (ucs4_t(buf[2] & 0x3F) << 6) | (buf[3] & 0x3F);
-			if(uc>=0x10000 && uc<=0x10FFFF)
-			{
-				mapper.MoveUChar32Bytes(ucqueue, uc, 4);
-				return true;
-			}
+			ucs[n] = buf[pos];
+			lens[n] = 1;
+			++n;
+			++pos;
 		}
+		if (pos >= stop)
+			break;
+
+		size_t rest = len - pos;
+		size_t ulen = dec(buf + pos, (rest < UCHAR32_MAX_BYTES)? rest: UCHAR32_MAX_BYTES, ucs[n]);
+		lens[n] = wxByte(ulen);
+		++n;
+		pos += ulen;
 	}
-
-	mapper.MoveUChar32Bytes(ucqueue, buf[0], 1);
-	return true;
+	return n;
 }
 
 size_t WXMEncodingUTF16LE::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
@@ -172,45 +265,12 @@ ucs4_t WXMEncodingUTF16LE::PeekUChar32_Newline(WXMBlockDumper& dumper, size_t le
 }
 bool WXMEncodingUTF16LE::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
 {
-	wxFileOffset rest;
-	wxByte* buf = mapper.BufferLoadBytes(rest, 4);
-	if (buf == nullptr)
-		return false;
-
-	if(rest >= 2)
-	{
-		ucs4_t uc;
-		uc=(ucs4_t(buf[1])<<8) | buf[0];
-
-		//utf16 surrogates
-		if(uc>=0xD800 && uc<=0xDBFF && rest >= 4)
-		{
-			buf+=2;
-			ucs4_t uc1=(ucs4_t(buf[1])<<8) | buf[0];
-
-			if(uc1>=0xDC00 && uc1<=0xDFFF)
-			{
-				//ucs4=(highChar -0xD800) * 0x400 + (lowChar -0xDC00) + 0x10000
-				ucs4_t uc2 = ((uc-0xD800)<<10) + (uc1-0xDC00) + 0x10000;
-				mapper.MoveUChar32Bytes(ucqueue, uc2, 4);
-				return true;
-			}
-		}
-
-		mapper.MoveUChar32Bytes(ucqueue, uc, 2);
-		return true;
-	}
-
-	/***
-	ucs4_t uc;
-	if(m_MadEdit->editMode_!=emHexMode)
-		uc=wxT('?');
-	else
-		uc=m_NextUChar_LineIter->Get(m_NextUChar_Pos);
-	***/
-
-	mapper.MoveUChar32Bytes(ucqueue, (ucs4_t)'?', 1);
-	return true;
+	return NextUChar32ByDecoder(ucqueue, mapper, UTF16Decoder<false>());
+}
+size_t WXMEncodingUTF16LE::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                          ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	return DecodeUChar32Span(buf, len, more, ucs, lens, maxcount, UTF16Decoder<false>());
 }
 
 size_t WXMEncodingUTF16BE::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
@@ -260,35 +320,12 @@ ucs4_t WXMEncodingUTF16BE::PeekUChar32_Newline(WXMBlockDumper& dumper, size_t le
 }
 bool WXMEncodingUTF16BE::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
 {
-	wxFileOffset rest;
-	wxByte* buf = mapper.BufferLoadBytes(rest, 4);
-	if (buf == nullptr)
-		return false;
-
-	if(rest >= 2)
-	{
-		ucs4_t uc;
-		uc=(ucs4_t(buf[0])<<8) | buf[1];
-
-		if(uc>=0xD800 && uc<=0xDBFF && rest>=4)
-		{
-			buf+=2;
-			ucs4_t uc1=(ucs4_t(buf[0])<<8) | buf[1];
-
-			if(uc1>=0xDC00 && uc1<=0xDFFF)
-			{
-				ucs4_t uc2 = ((uc-0xD800)<<10) + (uc1-0xDC00) + 0x10000;
-				mapper.MoveUChar32Bytes(ucqueue, uc2, 4);
-				return true;
-			}
-		}
-
-		mapper.MoveUChar32Bytes(ucqueue, uc, 2);
-		return true;
-	}
-
-	mapper.MoveUChar32Bytes(ucqueue, (ucs4_t)'?', 1);
-	return true;
+	return NextUChar32ByDecoder(ucqueue, mapper, UTF16Decoder<true>());
+}
+size_t WXMEncodingUTF16BE::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                          ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	return DecodeUChar32Span(buf, len, more, ucs, lens, maxcount, UTF16Decoder<true>());
 }
 
 size_t WXMEncodingUTF32LE::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
@@ -330,25 +367,12 @@ ucs4_t WXMEncodingUTF32LE::PeekUChar32_Newline(WXMBlockDumper& dumper, size_t le
 }
 bool WXMEncodingUTF32LE::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
 {
-	wxFileOffset rest;
-	wxByte* buf = mapper.BufferLoadBytes(rest, 4);
-	if (buf == nullptr)
-		return false;
-
-	if(rest>=4)
-	{
-		ucs4_t ucs4=wxUINT32_SWAP_ON_BE(*((ucs4_t*)buf));
-		if(ucs4>0x10FFFF || ucs4<0)
-		{
-			ucs4='?'; // not a valid ucs4 char
-		}
-
-		mapper.MoveUChar32Bytes(ucqueue, ucs4, 4);
-		return true;
-	}
-
-	mapper.MoveUChar32Bytes(ucqueue, (ucs4_t)'?', size_t(rest));
-	return true;
+	return NextUChar32ByDecoder(ucqueue, mapper, UTF32Decoder<false>());
+}
+size_t WXMEncodingUTF32LE::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                          ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	return DecodeUChar32Span(buf, len, more, ucs, lens, maxcount, UTF32Decoder<false>());
 }
 
 size_t WXMEncodingUTF32BE::UCS4toMultiByte(ucs4_t ucs4, wxByte* buf)
@@ -390,25 +414,12 @@ ucs4_t WXMEncodingUTF32BE::PeekUChar32_Newline(WXMBlockDumper& dumper, size_t le
 }
 bool WXMEncodingUTF32BE::NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper)
 {
-	wxFileOffset rest;
-	wxByte* buf = mapper.BufferLoadBytes(rest, 4);
-	if (buf == nullptr)
-		return false;
-
-	if(rest>=4)
-	{
-		ucs4_t ucs4=wxUINT32_SWAP_ON_LE(*((ucs4_t*)buf));
-		if(ucs4>0x10FFFF || ucs4<0)
-		{
-			ucs4='?'; // not a valid ucs4 char
-		}
-
-		mapper.MoveUChar32Bytes(ucqueue, ucs4, 4);
-		return true;
-	}
-
-	mapper.MoveUChar32Bytes(ucqueue, (ucs4_t)'?', size_t(rest));
-	return true;
+	return NextUChar32ByDecoder(ucqueue, mapper, UTF32Decoder<true>());
+}
+size_t WXMEncodingUTF32BE::DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+                                          ucs4_t* ucs, wxByte* lens, size_t maxcount)
+{
+	return DecodeUChar32Span(buf, len, more, ucs, lens, maxcount, UTF32Decoder<true>());
 }
 
 };// namespace wxm
@@ -27,6 +27,8 @@ struct WXMEncodingUTF8: public WXMEncoding, WXMEncodingDecoderISO646
 {
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) override;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) override;
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount) override;
 
 private:
 	friend WXMEncoding* WXMEncodingManager::GetWxmEncoding(ssize_t idx);
@@ -38,6 +40,8 @@ struct WXMEncodingUTF16LE: public WXMEncoding
 {
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) override;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) override;
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount) override;
 	virtual ucs4_t PeekUChar32_Newline(WXMBlockDumper& dumper, size_t len) override;
 	virtual bool IsUChar32_LineFeed(WXMBlockDumper& dumper, size_t len) override;
 	virtual bool IsUChar32_LineFeed(const wxByte* buf, size_t len) override
@@ -55,6 +59,8 @@ struct WXMEncodingUTF16BE: public WXMEncoding
 {
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) override;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) override;
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount) override;
 	virtual ucs4_t PeekUChar32_Newline(WXMBlockDumper& dumper, size_t len) override;
 	virtual bool IsUChar32_LineFeed(WXMBlockDumper& dumper, size_t len) override;
 	virtual bool IsUChar32_LineFeed(const wxByte* buf, size_t len) override
@@ -72,6 +78,8 @@ struct WXMEncodingUTF32LE: public WXMEncoding
 {
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) override;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) override;
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount) override;
 	virtual ucs4_t PeekUChar32_Newline(WXMBlockDumper& dumper, size_t len) override;
 	virtual bool IsUChar32_LineFeed(WXMBlockDumper& dumper, size_t len) override;
 	virtual bool IsUChar32_LineFeed(const wxByte* buf, size_t len) override
@@ -89,6 +97,8 @@ struct WXMEncodingUTF32BE: public WXMEncoding
 {
 	virtual size_t UCS4toMultiByte(ucs4_t ucs4, wxByte* buf) override;
 	virtual bool NextUChar32(MadUCQueue &ucqueue, UChar32BytesMapper& mapper) override;
+	virtual size_t DecodeUChar32s(const wxByte* buf, size_t len, bool more,
+	                              ucs4_t* ucs, wxByte* lens, size_t maxcount) override;
 	virtual ucs4_t PeekUChar32_Newline(WXMBlockDumper& dumper, size_t len) override;
 	virtual bool IsUChar32_LineFeed(WXMBlockDumper& dumper, size_t len) override;
 	virtual bool IsUChar32_LineFeed(const wxByte* buf, size_t len) override
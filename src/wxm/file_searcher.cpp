@@ -0,0 +1,224 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/file_searcher.cpp
+// Description: Searching in Files by Multiple Threads
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#include "file_searcher.h"
+#include "../xm/cxx11.h"
+#include "searcher.h"
+#include "headless_doc.h"
+#include "parallel.h"
+
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <new>
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
+#endif
+
+namespace wxm
+{
+
+struct ParallelFileSearcher::Worker: public wxThread
+{
+	Worker(ParallelFileSearcher* owner): wxThread(wxTHREAD_JOINABLE), m_owner(owner)
+	{}
+
+	virtual ExitCode Entry() override
+	{
+		m_owner->Work();
+		return (ExitCode)0;
+	}
+
+private:
+	ParallelFileSearcher* m_owner;
+};
+
+ParallelFileSearcher::ParallelFileSearcher(const FileSearchingOptions& opt,
+	const std::vector<wxString>& files, size_t threads)
+	: m_opt(opt), m_files(files), m_deferred(files.size(), false), m_threadcount(threads)
+	, m_cancel(false), m_next(0), m_processed(0), m_fetched(0)
+{
+	if (m_threadcount == 0)
+		m_threadcount = DefaultThreadCount();
+	m_threadcount = std::min(m_threadcount, std::max(m_files.size(), size_t(1)));
+}
+
+ParallelFileSearcher::~ParallelFileSearcher()
+{
+	Cancel();
+
+	BOOST_FOREACH(Worker* w, m_workers)
+	{
+		w->Wait();
+		delete w;
+	}
+}
+
+bool ParallelFileSearcher::Start()
+{
+	{
+		MemorySearcher searcher(m_opt.inhex, m_opt.use_regex, m_opt.case_sensitive, m_opt.whole_word,
+			m_opt.delimiters);
+		if (!searcher.Prepare(m_opt.expr))
+			return false;
+	}
+
+	for (size_t i = 0; i < m_threadcount; ++i)
+	{
+		Worker* w = new Worker(this);
+		if (w->Create() != wxTHREAD_NO_ERROR || w->Run() != wxTHREAD_NO_ERROR)
+		{
+			delete w;
+			break;
+		}
+		m_workers.push_back(w);
+	}
+
+	return !m_workers.empty();
+}
+
+void ParallelFileSearcher::Cancel()
+{
+	wxMutexLocker lock(m_mutex);
+	m_cancel = true;
+}
+
+size_t ParallelFileSearcher::GetProcessedCount()
+{
+	wxMutexLocker lock(m_mutex);
+	return m_processed;
+}
+
+bool ParallelFileSearcher::FetchResults(std::vector<FileSearchingResult>& out)
+{
+	wxMutexLocker lock(m_mutex);
+
+	std::map<size_t, FileSearchingResult>::iterator it;
+	while ((it = m_done.find(m_fetched)) != m_done.end())
+	{
+		if (!it->second.matches.empty() || it->second.deferred)
+		{
+			out.push_back(FileSearchingResult());
+			std::swap(out.back(), it->second);
+		}
+		m_done.erase(it);
+		++m_fetched;
+	}
+
+	if (m_cancel)
+		return m_processed < m_next;
+
+	return m_fetched < m_files.size();
+}
+
+void ParallelFileSearcher::Work()
+{
+	// wxString may share its buffer by a reference count that is not thread-safe,
+	// so every worker uses its own copies
+	const wxString expr(m_opt.expr.c_str());
+	const wxString encoding(m_opt.encoding.c_str());
+	const wxString defaultenc(m_opt.default_encoding.c_str());
+	const wxString delimiters(m_opt.delimiters.c_str());
+
+	MemorySearcher searcher(m_opt.inhex, m_opt.use_regex, m_opt.case_sensitive, m_opt.whole_word, delimiters);
+	searcher.Prepare(expr);
+
+	HeadlessDocument doc;
+
+	for (;;)
+	{
+		size_t idx;
+		{
+			wxMutexLocker lock(m_mutex);
+			if (m_cancel || m_next >= m_files.size())
+				break;
+			idx = m_next++;
+		}
+
+		FileSearchingResult res;
+		res.index = idx;
+		res.filename = m_files[idx].c_str();
+		try
+		{
+			res.deferred = m_deferred[idx] || !SearchFile(searcher, doc, res, encoding, defaultenc);
+		}
+		catch (std::bad_alloc&)
+		{
+			res.matches.clear();
+			res.deferred = true;
+		}
+		doc.Clear();
+
+		wxMutexLocker lock(m_mutex);
+		std::swap(m_done[idx], res);
+		++m_processed;
+	}
+}
+
+bool ParallelFileSearcher::SearchFile(MemorySearcher& searcher, HeadlessDocument& doc, FileSearchingResult& res,
+	const wxString& encoding, const wxString& defaultenc)
+{
+	HeadlessDocument::LoadResult loaded = doc.LoadFromFile(res.filename, encoding, defaultenc,
+		m_opt.max_text_file_size, m_opt.max_loaded_file_size);
+	if (loaded != HeadlessDocument::LOAD_OK)
+		return loaded != HeadlessDocument::LOAD_TOO_LARGE;
+
+	std::vector<size_t> begidx, endidx;
+	std::vector<wxFileOffset> begpos, endpos;
+	if (searcher.InHex())
+	{
+		searcher.FindAll(doc.Data(), doc.Data() + doc.GetSize(), m_opt.first_only, begidx, endidx);
+		for (size_t i = 0; i < begidx.size(); ++i)
+		{
+			begpos.push_back(wxFileOffset(begidx[i]));
+			endpos.push_back(wxFileOffset(endidx[i]));
+		}
+	}
+	else
+	{
+		doc.Decode();
+		searcher.FindAll(doc.TextBegin(), doc.TextEnd(), m_opt.first_only, begidx, endidx);
+		for (size_t i = 0; i < begidx.size(); ++i)
+		{
+			begpos.push_back(doc.TextOffsetToPos(begidx[i]));
+			endpos.push_back(doc.TextOffsetToPos(endidx[i]));
+		}
+	}
+
+	if (begpos.empty())
+		return true;
+
+	res.matches.resize(begpos.size());
+	int line = -1;
+	wxString linetext;
+	for (size_t i = 0; i < begpos.size(); ++i)
+	{
+		FileSearchingMatch& m = res.matches[i];
+		m.bpos = begpos[i];
+		m.epos = endpos[i];
+		m.line = -1;
+
+		if (doc.IsTextFile())
+		{
+			int oldline = line;
+			line = doc.GetLineByPos(m.bpos);
+			if (line != oldline)
+			{
+				linetext.Empty();
+				doc.GetLine(linetext, line, 512);
+			}
+			m.line = line;
+			m.linetext = linetext;
+		}
+	}
+
+	return true;
+}
+
+} //namespace wxm
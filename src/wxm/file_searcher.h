@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/file_searcher.h
+// Description: Searching in Files by Multiple Threads
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WXM_FILE_SEARCHER_H_
+#define _WXM_FILE_SEARCHER_H_
+
+#include "../xm/cxx11.h"
+
+#ifdef _MSC_VER
+# pragma warning( push )
+# pragma warning( disable : 4996 )
+#endif
+// disable 4996 {
+#include <wx/string.h>
+#include <wx/thread.h>
+// disable 4996 }
+#ifdef _MSC_VER
+# pragma warning( pop )
+#endif
+
+#include <boost/noncopyable.hpp>
+#include <vector>
+#include <map>
+
+namespace wxm
+{
+
+struct MemorySearcher;
+struct HeadlessDocument;
+
+struct FileSearchingOptions
+{
+	wxString expr;
+	bool inhex;
+	bool use_regex;
+	bool case_sensitive;
+	bool whole_word;
+	wxString delimiters;        // the word delimiters of the syntax the editors search the files by
+	bool first_only;
+	wxString encoding;          // empty to detect the encoding of every file
+	wxString default_encoding;
+	wxFileOffset max_text_file_size;
+	wxFileOffset max_loaded_file_size; // larger files are deferred to the caller
+
+	FileSearchingOptions()
+		: inhex(false), use_regex(false), case_sensitive(true), whole_word(false), first_only(false)
+		, max_text_file_size(10*1000*1000), max_loaded_file_size(8*1024*1024)
+	{}
+};
+
+struct FileSearchingMatch
+{
+	wxFileOffset bpos, epos;
+	int line;                   // -1 if the file is not a text file
+	wxString linetext;
+};
+
+struct FileSearchingResult
+{
+	size_t index;               // index of the file in the list
+	wxString filename;
+	std::vector<FileSearchingMatch> matches;
+	bool deferred;              // not searched, the caller must search it by itself
+
+	FileSearchingResult(): index(0), deferred(false) {}
+};
+
+// ParallelFileSearcher searches a list of files by a pool of worker threads,
+// every worker loads, decodes and matches a whole file by itself, so the files
+// larger than max_loaded_file_size or out of memory are deferred to the caller.
+// The results are fetched by the GUI thread in the order of the file list.
+struct ParallelFileSearcher: private boost::noncopyable
+{
+	ParallelFileSearcher(const FileSearchingOptions& opt, const std::vector<wxString>& files,
+		size_t threads = 0);
+	~ParallelFileSearcher();
+
+	// call it before Start(), the file idx is not searched but returned as deferred
+	void Defer(size_t idx) { m_deferred[idx] = true; }
+
+	// return false if the pattern is invalid or no thread can be run
+	bool Start();
+	void Cancel();
+
+	// move the results of finished files to out in the order of the file list
+	// return false after all the results were fetched
+	bool FetchResults(std::vector<FileSearchingResult>& out);
+
+	size_t GetProcessedCount();
+	size_t GetFileCount() const { return m_files.size(); }
+
+private:
+	struct Worker;
+	friend struct Worker;
+
+	void Work();
+	// return false if the file is deferred
+	bool SearchFile(MemorySearcher& searcher, HeadlessDocument& doc, FileSearchingResult& res,
+		const wxString& encoding, const wxString& defaultenc);
+
+	FileSearchingOptions m_opt;
+	std::vector<wxString> m_files;
+	std::vector<bool> m_deferred;
+	size_t m_threadcount;
+	std::vector<Worker*> m_workers;
+
+	wxMutex m_mutex;            // guards the members below
+	bool m_cancel;
+	size_t m_next;              // next file to be searched
+	size_t m_processed;
+	size_t m_fetched;           // next result to be fetched
+	std::map<size_t, FileSearchingResult> m_done;
+};
+
+} //namespace wxm
+
+#endif //_WXM_FILE_SEARCHER_H_
@@ -0,0 +1,304 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/headless_doc.cpp
+// Description: Loading and Decoding Files without MadEdit
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#include "headless_doc.h"
+#include "../xm/cxx11.h"
+#include "encoding/encoding.h"
+#include "encdet.h"
+#include "utils.h"
+#include "../wxmedit/mad_encdet.h"
+
+#ifdef _MSC_VER
+# pragma warning( push )
+# pragma warning( disable : 4996 )
+#endif
+// disable 4996 {
+#include <wx/file.h>
+#include <wx/log.h>
+// disable 4996 }
+#ifdef _MSC_VER
+# pragma warning( pop )
+#endif
+
+#include <algorithm>
+
+#ifndef __WXMSW__
+# include <fcntl.h>
+#endif
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
+#endif
+
+namespace wxm
+{
+
+namespace
+{
+
+// open filename as MadFileNameIsUTF8() & MadConvFileName_WC2MB_UseLibc do,
+// but without switching the filename conversion shared by the whole process
+bool OpenFile(wxFile& file, const wxString& filename)
+{
+#ifdef __WXMSW__
+	wxLogNull nolog;
+	return file.Open(filename, wxFile::read);
+#else
+	// try the libc encoding first, then UTF-8
+	const wxCharBuffer names[2] = { filename.mb_str(wxConvLibc), filename.mb_str(wxConvUTF8) };
+	for (size_t i = 0; i < 2; ++i)
+	{
+		if (names[i].data() == nullptr || names[i].data()[0] == '\0')
+			continue;
+
+		int fd = open(names[i].data(), O_RDONLY);
+		if (fd != -1)
+		{
+			file.Attach(fd);
+			return true;
+		}
+	}
+	return false;
+#endif
+}
+
+} // namespace
+
+void HeadlessDocument::Clear()
+{
+	m_filename.Clear();
+	m_data.clear();
+	m_enc = nullptr;
+	m_textfile = true;
+	m_decoded = false;
+	m_text.clear();
+	m_blockpos.clear();
+	m_textbegin = 0;
+	m_linebegins.clear();
+}
+
+HeadlessDocument::LoadResult HeadlessDocument::LoadFromFile(const wxString& filename, const wxString& encoding,
+	const wxString& defaultenc, wxFileOffset maxtextsize, wxFileOffset maxsize)
+{
+	Clear();
+
+	wxFile file;
+	if (!OpenFile(file, filename))
+		return LOAD_FAILED;
+
+	wxFileOffset size = file.Length();
+	if (size < 0)
+		return LOAD_FAILED;
+	if (size > maxsize || wxFileOffset(size_t(size) + PADDING) != size + PADDING)
+		return LOAD_TOO_LARGE;
+
+	m_data.resize(size_t(size) + PADDING, 0);
+	if (size > 0 && file.Read(&m_data[0], size_t(size)) != ssize_t(size))
+	{
+		Clear();
+		return LOAD_FAILED;
+	}
+
+	m_filename = filename;
+	DetectEncoding(encoding, defaultenc, maxtextsize);
+
+	return LOAD_OK;
+}
+
+void HeadlessDocument::DetectEncoding(const wxString& encoding, const wxString& defaultenc, wxFileOffset maxtextsize)
+{
+	const size_t max_detecting_size = 4096;
+	size_t sz = std::min(GetSize(), max_detecting_size);
+	const wxByte* buf = Data();
+
+	// sample the head, the tail and the middle of the file for its encoding
+	EncodingSample sample(GetSize());
+	wxFileOffset pos;
+	size_t len;
+	while (sample.NextWindow(pos, len))
+		sample.AddWindow(buf + size_t(pos), len);
+
+	WXMEncodingManager& encmgr = WXMEncodingManager::Instance();
+
+	if (sz == 0)
+	{
+		m_enc = encmgr.GetWxmEncoding(encoding.IsEmpty() ? defaultenc : encoding);
+		m_textfile = true;
+		return;
+	}
+
+	bool hexmode = wxFileOffset(GetSize()) >= maxtextsize;
+	bool preset = false;
+	bool skip_utf8 = false;
+	wxString encname = encoding;
+
+	if (!hexmode)
+	{
+		preset = !encoding.IsEmpty() || MatchWXMEncoding(encname, sample);
+		skip_utf8 = !preset;
+	}
+
+	if (!preset)
+	{
+		if (encoding.IsEmpty())
+		{
+			WXMEncodingID enc = encmgr.NameToEncoding(defaultenc);
+			wxm::DetectEncoding(sample, enc, skip_utf8);
+			// by the id rather than the name, so that the names shared by all the threads are not copied
+			m_enc = encmgr.GetWxmEncoding(enc);
+		}
+
+		if (!hexmode)
+			hexmode = IsBinaryData(buf, sz);
+	}
+
+	if (m_enc == nullptr)
+		m_enc = encmgr.GetWxmEncoding(encname);
+	m_textfile = !hexmode;
+}
+
+void HeadlessDocument::Decode()
+{
+	if (m_decoded)
+		return;
+	m_decoded = true;
+
+	size_t size = GetSize();
+	m_text.reserve(size);
+	m_blockpos.reserve(size / POSITION_BLOCK + 1);
+
+	const size_t batch = 4096;
+	std::vector<ucs4_t> ucs(batch);
+	std::vector<wxByte> lens(batch);
+	const wxByte* data = Data();
+	size_t pos = 0;
+	while (pos < size)
+	{
+		size_t count = m_enc->DecodeUChar32s(data + pos, size - pos, false, &ucs[0], &lens[0], batch);
+
+		size_t idx = m_text.size();
+		for (size_t i = 0; i < count; ++i, ++idx)
+		{
+			if (idx % POSITION_BLOCK == 0)
+				m_blockpos.push_back(wxFileOffset(pos));
+			pos += lens[i];
+		}
+
+		m_text.insert(m_text.end(), ucs.begin(), ucs.begin() + count);
+	}
+
+	// ignore BOM in first line
+	m_textbegin = (!m_text.empty() && m_text[0] == 0xFEFF) ? 1 : 0;
+}
+
+void HeadlessDocument::BuildLineIndex()
+{
+	Decode();
+
+	m_linebegins.push_back(0);
+	size_t count = m_text.size();
+	for (size_t i = 0; i < count; ++i)
+	{
+		ucs4_t uc = m_text[i];
+		if (uc == 0x0D)
+		{
+			if (i + 1 < count && m_text[i + 1] == 0x0A)
+				++i;
+			m_linebegins.push_back(i + 1);
+		}
+		else if (uc == 0x0A)
+		{
+			m_linebegins.push_back(i + 1);
+		}
+	}
+}
+
+void HeadlessDocument::DecodeBlockLengths(size_t blk, size_t count, wxByte* lens)
+{
+	ucs4_t ucs[POSITION_BLOCK];
+	size_t pos = size_t(m_blockpos[blk]);
+
+	// the blocks begin at the same chars as in Decode(), so they are decoded the same
+	for (size_t done = 0; done < count; )
+	{
+		size_t n = m_enc->DecodeUChar32s(Data() + pos, GetSize() - pos, false, ucs, lens + done, count - done);
+		for (size_t i = 0; i < n; ++i)
+			pos += lens[done + i];
+		done += n;
+	}
+}
+
+wxFileOffset HeadlessDocument::CharToPos(size_t idx)
+{
+	if (idx >= m_text.size())
+		return wxFileOffset(GetSize());
+
+	size_t blk = idx / POSITION_BLOCK;
+	size_t count = idx % POSITION_BLOCK;
+	wxFileOffset pos = m_blockpos[blk];
+	if (count == 0)
+		return pos;
+
+	wxByte lens[POSITION_BLOCK];
+	DecodeBlockLengths(blk, count, lens);
+	for (size_t i = 0; i < count; ++i)
+		pos += lens[i];
+	return pos;
+}
+
+size_t HeadlessDocument::PosToChar(wxFileOffset pos)
+{
+	if (m_blockpos.empty() || pos <= 0)
+		return 0;
+
+	size_t blk = std::upper_bound(m_blockpos.begin(), m_blockpos.end(), pos) - m_blockpos.begin() - 1;
+	size_t idx = blk * POSITION_BLOCK;
+	size_t count = std::min(size_t(POSITION_BLOCK), m_text.size() - idx);
+
+	wxByte lens[POSITION_BLOCK];
+	DecodeBlockLengths(blk, count, lens);
+
+	wxFileOffset p = m_blockpos[blk];
+	for (size_t i = 0; i < count && p < pos; ++i, ++idx)
+		p += lens[i];
+	return idx;
+}
+
+int HeadlessDocument::GetLineByPos(wxFileOffset pos)
+{
+	if (m_linebegins.empty())
+		BuildLineIndex();
+
+	size_t idx = PosToChar(pos);
+	return int(std::upper_bound(m_linebegins.begin(), m_linebegins.end(), idx) - m_linebegins.begin()) - 1;
+}
+
+void HeadlessDocument::GetLine(wxString& ws, int line, size_t maxlen)
+{
+	if (m_linebegins.empty())
+		BuildLineIndex();
+
+	if (line < 0 || size_t(line) >= m_linebegins.size())
+		return;
+
+	if (maxlen == 0)
+		maxlen = size_t(-1);
+
+	size_t idx = std::max(m_linebegins[line], m_textbegin);
+	for (; idx < m_text.size() && ws.Len() < maxlen; ++idx)
+	{
+		ucs4_t uc = m_text[idx];
+		if (uc == 0x0D || uc == 0x0A)
+			break;
+
+		WxStrAppendUCS4(ws, uc);
+	}
+}
+
+} //namespace wxm
@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/headless_doc.h
+// Description: Loading and Decoding Files without MadEdit
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WXM_HEADLESS_DOC_H_
+#define _WXM_HEADLESS_DOC_H_
+
+#include "../xm/cxx11.h"
+#include "../wxmedit/ucs4_t.h"
+
+#ifdef _MSC_VER
+# pragma warning( push )
+# pragma warning( disable : 4996 )
+#endif
+// disable 4996 {
+#include <wx/string.h>
+// disable 4996 }
+#ifdef _MSC_VER
+# pragma warning( pop )
+#endif
+
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+namespace wxm
+{
+
+struct WXMEncoding;
+
+// HeadlessDocument loads a whole file, chooses its encoding and decodes it by
+// the same rules as MadLines::LoadFromFile(), but needs neither MadEdit nor a
+// wxWindow, so that it can be used in worker threads.
+// It keeps the whole file and its decoded text (4 bytes per char) in memory,
+// so the callers should bound the size of the files loaded by it.
+struct HeadlessDocument: private boost::noncopyable
+{
+	HeadlessDocument()
+		: m_enc(nullptr), m_textfile(true), m_decoded(false), m_textbegin(0)
+	{}
+
+	enum LoadResult { LOAD_OK, LOAD_FAILED, LOAD_TOO_LARGE };
+
+	// encoding: use it if not empty, otherwise detect the encoding of the file
+	// maxtextsize: a file not smaller than it is treated as binary data
+	// maxsize: a file larger than it is not loaded
+	LoadResult LoadFromFile(const wxString& filename, const wxString& encoding,
+		const wxString& defaultenc, wxFileOffset maxtextsize, wxFileOffset maxsize);
+	void Clear();
+
+	const wxString& GetFileName() const { return m_filename; }
+	const wxByte* Data() const { return m_data.empty() ? nullptr : &m_data[0]; }
+	size_t GetSize() const { return m_data.empty() ? 0 : m_data.size() - PADDING; }
+	bool IsTextFile() const { return m_textfile; }
+	WXMEncoding* GetEncoding() const { return m_enc; }
+
+	// decode the data to UCS4 chars, do nothing if it was decoded
+	void Decode();
+
+	// the decoded text without BOM
+	const ucs4_t* TextBegin() const { return m_text.empty() ? nullptr : &m_text[0] + m_textbegin; }
+	const ucs4_t* TextEnd() const { return m_text.empty() ? nullptr : &m_text[0] + m_text.size(); }
+
+	// idx is the offset from TextBegin()
+	wxFileOffset TextOffsetToPos(size_t idx) { return CharToPos(m_textbegin + idx); }
+
+	// return the line number of the char at pos
+	int GetLineByPos(wxFileOffset pos);
+	// the same as MadEdit::GetLine()
+	void GetLine(wxString& ws, int line, size_t maxlen);
+
+private:
+	enum { PADDING = 4 }; // decoders may peek 4 bytes at once
+	enum { POSITION_BLOCK = 256 }; // chars between the byte positions kept
+
+	void DetectEncoding(const wxString& encoding, const wxString& defaultenc, wxFileOffset maxtextsize);
+	void BuildLineIndex();
+
+	// decode the byte lengths of count chars from the beginning of the block blk
+	void DecodeBlockLengths(size_t blk, size_t count, wxByte* lens);
+	// the byte position of the char idx of m_text, and the index of the first char not before pos
+	wxFileOffset CharToPos(size_t idx);
+	size_t PosToChar(wxFileOffset pos);
+
+	wxString m_filename;
+	std::vector<wxByte> m_data;
+	WXMEncoding* m_enc;
+	bool m_textfile;
+
+	bool m_decoded;
+	std::vector<ucs4_t> m_text;
+	std::vector<wxFileOffset> m_blockpos;  // byte position of every POSITION_BLOCK chars
+	size_t m_textbegin;                    // 1 if the text begins with BOM
+	std::vector<size_t> m_linebegins;      // index of the first char of every line
+};
+
+} //namespace wxm
+
+#endif //_WXM_HEADLESS_DOC_H_
@@ -0,0 +1,387 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/line_sorter.cpp
+// Description: Sorting Lines by Keys Extracted in Parallel
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#include "line_sorter.h"
+#include "../xm/cxx11.h"
+#include "../xm/trace.h"
+#include "encoding/encoding.h"
+#include "parallel.h"
+
+#include <unicode/uchar.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
+#endif
+
+namespace wxm
+{
+
+namespace
+{
+
+const size_t PREFIX_BYTES = sizeof(wxUint64);
+const size_t MIN_PART_LINES = 4096;
+
+// the byte order of the sequences is the order of the code points,
+// including the invalid ones up to 31 bits
+void AppendUTF8(std::vector<char>& out, wxUint32 uc)
+{
+	if (uc < 0x80)
+	{
+		out.push_back(char(uc));
+		return;
+	}
+
+	size_t n = (uc < 0x800)? 2: (uc < 0x10000)? 3: (uc < 0x200000)? 4: (uc < 0x4000000)? 5: 6;
+	char buf[6];
+	for (size_t i = n - 1; i > 0; --i)
+	{
+		buf[i] = char(0x80 | (uc & 0x3F));
+		uc >>= 6;
+	}
+	buf[0] = char((0xFF00 >> n) | uc);
+	out.insert(out.end(), buf, buf + n);
+}
+
+} // namespace
+
+struct LineSorter::KeyLess
+{
+	const LineSorter* sorter;
+	explicit KeyLess(const LineSorter* s): sorter(s) {}
+
+	bool operator()(const Key& a, const Key& b) const
+	{
+		return sorter->Less(a, b);
+	}
+};
+
+LineSorter::LineSorter(bool casesensitive, bool numeric, size_t threads)
+	: m_casesensitive(casesensitive), m_numeric(numeric), m_threads(threads)
+	, m_enc(nullptr)
+{
+	if (m_threads == 0)
+		m_threads = DefaultThreadCount();
+	m_rawbegin.push_back(0);
+}
+
+wxByte* LineSorter::AddLine(size_t len)
+{
+	size_t begin = m_raw.size();
+	m_raw.resize(begin + len);
+	m_rawbegin.push_back(m_raw.size());
+
+	return (len == 0) ? nullptr : &m_raw[begin];
+}
+
+void LineSorter::Sort(WXMEncoding* enc)
+{
+	XM_TRACE_SCOPE("LineSorter::Sort");
+
+	const size_t count = m_rawbegin.size() - 1;
+
+	m_enc = enc;
+
+	size_t parts = std::max(std::min(m_threads, count / MIN_PART_LINES), size_t(1));
+	m_partbegin.clear();
+	for (size_t i = 0; i <= parts; ++i)
+		m_partbegin.push_back(count / parts * i + std::min(count % parts, i));
+
+	m_keys.resize(count);
+	if (m_numeric)
+		m_numbers.resize(count);
+	m_parttexts.assign(parts, std::vector<char>());
+
+	RunInParallel(this, &LineSorter::ExtractKeys, parts);
+
+	std::vector<wxByte>().swap(m_raw);
+	std::vector<size_t>().swap(m_rawbegin);
+
+	size_t total = 1;
+	for (size_t p = 0; p < parts; ++p)
+		total += m_parttexts[p].size();
+	m_text.clear();
+	m_text.reserve(total);
+	for (size_t p = 0; p < parts; ++p)
+	{
+		size_t base = m_text.size();
+		for (size_t i = m_partbegin[p]; i < m_partbegin[p + 1]; ++i)
+			m_keys[i].text += base;
+
+		m_text.insert(m_text.end(), m_parttexts[p].begin(), m_parttexts[p].end());
+		std::vector<char>().swap(m_parttexts[p]);
+	}
+	m_text.push_back(0); // keep &m_text[0] valid
+
+	RunInParallel(this, &LineSorter::SortPart, parts);
+
+	// merge the sorted parts pairwise, the former of the equal keys first
+	m_runs = m_partbegin;
+	while (m_runs.size() > 2)
+	{
+		m_merged.resize(count);
+		size_t runcount = m_runs.size() - 1;
+		RunInParallel(this, &LineSorter::MergeRuns, runcount / 2);
+		if (runcount % 2 != 0)
+			std::copy(m_keys.begin() + m_runs[runcount - 1], m_keys.end(), m_merged.begin() + m_runs[runcount - 1]);
+		m_keys.swap(m_merged);
+
+		std::vector<size_t> runs;
+		for (size_t i = 0; i < m_runs.size(); i += 2)
+			runs.push_back(m_runs[i]);
+		if (runs.back() != count)
+			runs.push_back(count);
+		m_runs.swap(runs);
+	}
+	std::vector<Key>().swap(m_merged);
+}
+
+void LineSorter::ExtractKeys(size_t part)
+{
+	const size_t end = m_partbegin[part + 1];
+	std::vector<char>& text = m_parttexts[part];
+	std::vector<ucs4_t> ucs;
+	std::vector<wxByte> lens;
+	std::string digits;
+
+	for (size_t i = m_partbegin[part]; i < end; ++i)
+	{
+		size_t len = m_rawbegin[i + 1] - m_rawbegin[i];
+		size_t n = 0;
+		if (len > 0)
+		{
+			if (ucs.size() < len)
+			{
+				ucs.resize(len);
+				lens.resize(len);
+			}
+			n = m_enc->DecodeUChar32s(&m_raw[m_rawbegin[i]], len, false, &ucs[0], &lens[0], len);
+		}
+		MakeKey(i, n == 0 ? nullptr : &ucs[0], n, text, digits);
+	}
+}
+
+void LineSorter::MakeKey(size_t line, ucs4_t* ucs, size_t count, std::vector<char>& text, std::string& digits)
+{
+	Key& key = m_keys[line];
+	key.line = wxUint32(line);
+	key.text = text.size();
+	key.prefix = 0;
+	key.number = 0;
+
+	if (!m_casesensitive)
+	{
+		for (size_t i = 0; i < count; ++i)
+			ucs[i] = u_tolower(ucs[i]);
+	}
+
+	for (size_t i = 0; i < count; ++i)
+		AppendUTF8(text, wxUint32(ucs[i]));
+	key.len = text.size() - key.text;
+
+	if (!m_numeric)
+	{
+		for (size_t i = 0; i < PREFIX_BYTES; ++i)
+			key.prefix = (key.prefix << 8) | ((i < key.len) ? (unsigned char)text[key.text + i] : 0);
+		return;
+	}
+
+	// the leading chars are ASCII before the end of a number,
+	// so the indices of the chars are the offsets in the text
+	enum { NUM_SIGN, NUM_INT, NUM_FRAC, NUM_END };
+	int numstep = NUM_SIGN;
+	Number& num = m_numbers[line];
+	num.int_begin = num.int_len = num.frac_begin = num.frac_len = -1;
+	num.negative = false;
+
+	for (size_t i = 0; i < count && numstep != NUM_END; ++i)
+	{
+		const ucs4_t uc = ucs[i];
+		const bool digit = (uc >= '0' && uc <= '9');
+		if (numstep == NUM_SIGN)
+		{
+			if (uc == ' ' || uc == '\t')
+				continue;
+
+			if (uc == '-')
+				num.negative = true;
+			if (uc == '-' || uc == '+')
+				numstep = NUM_INT;
+			else if (uc == '.')
+				numstep = NUM_FRAC;
+			else if (digit)
+			{
+				num.int_begin = int(i);
+				num.int_len = 1;
+				numstep = NUM_INT;
+			}
+			else
+				numstep = NUM_END; // invalid number format
+		}
+		else if (numstep == NUM_INT)
+		{
+			if (uc == '.')
+				numstep = NUM_FRAC;
+			else if (!digit)
+				numstep = NUM_END;
+			else if (num.int_begin == -1)
+			{
+				num.int_begin = int(i);
+				num.int_len = 1;
+			}
+			else
+				++num.int_len;
+		}
+		else // NUM_FRAC
+		{
+			if (!digit)
+				numstep = NUM_END;
+			else
+			{
+				if (num.int_begin == -1)
+				{
+					num.int_begin = 0;
+					num.int_len = 0;
+				}
+				if (num.frac_begin == -1)
+				{
+					num.frac_begin = int(i);
+					num.frac_len = 1;
+				}
+				else
+					++num.frac_len;
+			}
+		}
+	}
+
+	if (num.int_begin < 0)
+	{
+		key.prefix = 1;
+		return;
+	}
+
+	// trim the leading '0' of the integer and the trailing '0' of the fraction
+	while (num.int_len > 0 && ucs[num.int_begin] == '0')
+	{
+		++num.int_begin;
+		--num.int_len;
+	}
+	if (num.frac_begin >= 0)
+	{
+		while (num.frac_len > 0 && ucs[num.frac_begin + num.frac_len - 1] == '0')
+			--num.frac_len;
+		if (num.frac_len == 0)
+			num.frac_begin = -1;
+	}
+
+	// not a decimal point, which depends on the locale
+	digits.clear();
+	if (num.negative)
+		digits += '-';
+	for (int i = 0; i < num.int_len; ++i)
+		digits += char(ucs[num.int_begin + i]);
+	int frac_len = 0;
+	if (num.frac_begin >= 0)
+	{
+		frac_len = num.frac_len;
+		for (int i = 0; i < frac_len; ++i)
+			digits += char(ucs[num.frac_begin + i]);
+	}
+	if (num.int_len + frac_len == 0)
+		digits += '0';
+	char exp[16];
+	std::sprintf(exp, "e-%d", frac_len);
+	digits += exp;
+
+	// the conversion is monotonic, so different doubles order the numbers
+	key.number = std::strtod(digits.c_str(), nullptr);
+}
+
+void LineSorter::SortPart(size_t part)
+{
+	std::stable_sort(m_keys.begin() + m_partbegin[part], m_keys.begin() + m_partbegin[part + 1], KeyLess(this));
+}
+
+void LineSorter::MergeRuns(size_t pair)
+{
+	std::vector<Key>::iterator it = m_keys.begin();
+	std::merge(it + m_runs[pair * 2], it + m_runs[pair * 2 + 1],
+		it + m_runs[pair * 2 + 1], it + m_runs[pair * 2 + 2],
+		m_merged.begin() + m_runs[pair * 2], KeyLess(this));
+}
+
+bool LineSorter::Less(const Key& a, const Key& b) const
+{
+	if (a.prefix != b.prefix)
+		return a.prefix < b.prefix;
+
+	if (m_numeric)
+	{
+		if (a.prefix != 0) // invalid numbers are equal
+			return false;
+		if (a.number != b.number)
+			return a.number < b.number;
+		return NumberLess(a, b);
+	}
+
+	size_t len = std::min(a.len, b.len);
+	if (len > PREFIX_BYTES)
+	{
+		int cmp = std::memcmp(&m_text[a.text + PREFIX_BYTES], &m_text[b.text + PREFIX_BYTES], len - PREFIX_BYTES);
+		if (cmp != 0)
+			return cmp < 0;
+	}
+	return a.len < b.len;
+}
+
+bool LineSorter::NumberLess(const Key& a, const Key& b) const
+{
+	const Number* na = &m_numbers[a.line];
+	const Number* nb = &m_numbers[b.line];
+	if (na->negative != nb->negative)
+		return na->negative;
+
+	const char* ta = &m_text[a.text];
+	const char* tb = &m_text[b.text];
+	if (na->negative)
+	{
+		std::swap(na, nb);
+		std::swap(ta, tb);
+	}
+
+	if (na->int_len != nb->int_len)
+		return na->int_len < nb->int_len;
+
+	int cmp = std::memcmp(ta + na->int_begin, tb + nb->int_begin, size_t(na->int_len));
+	if (cmp != 0)
+		return cmp < 0;
+
+	if (nb->frac_begin < 0)
+		return false;
+	if (na->frac_begin < 0)
+		return true;
+
+	cmp = std::memcmp(ta + na->frac_begin, tb + nb->frac_begin, size_t(std::min(na->frac_len, nb->frac_len)));
+	if (cmp != 0)
+		return cmp < 0;
+	return na->frac_len < nb->frac_len;
+}
+
+bool LineSorter::SameText(size_t i, size_t j) const
+{
+	const Key& a = m_keys[i];
+	const Key& b = m_keys[j];
+	return a.len == b.len && std::memcmp(&m_text[a.text], &m_text[b.text], a.len) == 0;
+}
+
+} //namespace wxm
@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/line_sorter.h
+// Description: Sorting Lines by Keys Extracted in Parallel
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WXM_LINE_SORTER_H_
+#define _WXM_LINE_SORTER_H_
+
+#include "../xm/cxx11.h"
+#include "../wxmedit/ucs4_t.h"
+
+#ifdef _MSC_VER
+# pragma warning( push )
+# pragma warning( disable : 4996 )
+#endif
+// disable 4996 {
+#include <wx/defs.h>
+// disable 4996 }
+#ifdef _MSC_VER
+# pragma warning( pop )
+#endif
+
+#include <boost/noncopyable.hpp>
+#include <string>
+#include <vector>
+
+namespace wxm
+{
+
+struct WXMEncoding;
+
+// LineSorter sorts the lines copied into it by the keys extracted from their text.
+// A line is keyed by its case-folded text in UTF-8, whose byte order is the order of
+// the code points, and the first bytes of the text are compared as one integer;
+// for numeric sorting it is keyed by its leading decimal number as a double,
+// and the digits are compared only if the doubles are equal.
+// The keys are extracted and sorted by parts in parallel, then the parts are merged.
+struct LineSorter: private boost::noncopyable
+{
+	LineSorter(bool casesensitive, bool numeric, size_t threads = 0);
+
+	// return a buffer of len bytes for the text of the next line without its newline char,
+	// it is valid until the next call
+	wxByte* AddLine(size_t len);
+
+	// decode the lines by enc and sort them stably
+	void Sort(WXMEncoding* enc);
+
+	// the count of the sorted lines
+	size_t Count() const { return m_keys.size(); }
+	// the index in the adding order of the i-th sorted line
+	size_t Order(size_t i) const { return m_keys[i].line; }
+	// the i-th and the j-th sorted lines have the same case-folded text
+	bool SameText(size_t i, size_t j) const;
+
+private:
+	struct Key
+	{
+		wxUint64 prefix;    // the first bytes of the text, or 0/1 for a valid/invalid number
+		double number;
+		size_t text;        // the offset of the text in m_text
+		size_t len;
+		wxUint32 line;
+	};
+
+	// the leading number in bytes of the text, int_begin=-1 indicates invalid number
+	struct Number
+	{
+		int int_begin, int_len, frac_begin, frac_len;
+		bool negative;
+	};
+
+	struct KeyLess;
+	friend struct KeyLess;
+
+	void ExtractKeys(size_t part);
+	void SortPart(size_t part);
+	void MergeRuns(size_t pair);
+
+	void MakeKey(size_t line, ucs4_t* ucs, size_t count, std::vector<char>& text, std::string& digits);
+	bool Less(const Key& a, const Key& b) const;
+	bool NumberLess(const Key& a, const Key& b) const;
+
+	bool m_casesensitive;
+	bool m_numeric;
+	size_t m_threads;
+
+	std::vector<wxByte> m_raw;              // the undecoded text of the lines
+	std::vector<size_t> m_rawbegin;         // offsets of the lines in m_raw, and the end
+
+	WXMEncoding* m_enc;
+
+	std::vector<size_t> m_partbegin;        // the first lines of the parts, and the end
+	std::vector<std::vector<char> > m_parttexts;
+	std::vector<char> m_text;               // the case-folded text in UTF-8
+	std::vector<Key> m_keys;
+	std::vector<Number> m_numbers;          // by line, for numeric sorting
+
+	std::vector<size_t> m_runs;             // the sorted runs to be merged
+	std::vector<Key> m_merged;
+};
+
+} //namespace wxm
+
+#endif //_WXM_LINE_SORTER_H_
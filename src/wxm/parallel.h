@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/parallel.h
+// Description: Running the Jobs of an Object in Parallel
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WXM_PARALLEL_H_
+#define _WXM_PARALLEL_H_
+
+#include "../xm/cxx11.h"
+
+#ifdef _MSC_VER
+# pragma warning( push )
+# pragma warning( disable : 4996 )
+#endif
+// disable 4996 {
+#include <wx/defs.h>
+#include <wx/thread.h>
+// disable 4996 }
+#ifdef _MSC_VER
+# pragma warning( pop )
+#endif
+
+#include <boost/foreach.hpp>
+#include <vector>
+
+namespace wxm
+{
+
+// the count of threads used when the caller does not specify one
+inline size_t DefaultThreadCount()
+{
+	int cpus = wxThread::GetCPUCount();
+	return (cpus > 0) ? size_t(cpus) : 1;
+}
+
+template<typename T>
+struct MemberJobThread: public wxThread
+{
+	typedef void (T::*Job)(size_t);
+
+	MemberJobThread(T* obj, Job job, size_t idx)
+		: wxThread(wxTHREAD_JOINABLE), m_obj(obj), m_job(job), m_idx(idx)
+	{}
+
+	virtual ExitCode Entry() override
+	{
+		(m_obj->*m_job)(m_idx);
+		return (ExitCode)0;
+	}
+
+private:
+	T* m_obj;
+	Job m_job;
+	size_t m_idx;
+};
+
+// run (obj->*job)(i) for every i in [0, count) by a thread each, and return after all of them finished;
+// the job 0, and a job whose thread cannot be started, is run by the calling thread
+template<typename T>
+void RunInParallel(T* obj, void (T::*job)(size_t), size_t count)
+{
+	std::vector<MemberJobThread<T>*> threads;
+	for (size_t i = 1; i < count; ++i)
+	{
+		MemberJobThread<T>* t = new MemberJobThread<T>(obj, job, i);
+		if (t->Create() != wxTHREAD_NO_ERROR || t->Run() != wxTHREAD_NO_ERROR)
+		{
+			delete t;
+			(obj->*job)(i);
+			continue;
+		}
+		threads.push_back(t);
+	}
+
+	if (count > 0)
+		(obj->*job)(0);
+
+	BOOST_FOREACH(MemberJobThread<T>* t, threads)
+	{
+		t->Wait();
+		delete t;
+	}
+}
+
+} //namespace wxm
+
+#endif //_WXM_PARALLEL_H_
@@ -13,10 +13,12 @@
 #include "case_conv.h"
 #include "../xm/utils.hpp"
 #include "../mad_utils.h"
+#include "../xm/trace.h"
 
 #include <unicode/uchar.h>
 #include <iostream>
 #include <string>
+#include <cstring>
 
 //#include <boost/xpressive/xpressive.hpp>
 #include <boost/xpressive/xpressive_dynamic.hpp>
@@ -331,6 +333,54 @@ struct UCQueueSet
 	int          lock;
 };
 
+const wxFileOffset REPLACE_PROGRESS_STEP = 1024 * 1024;
+
+// thrown by the iterators if the progress callback canceled the searching
+struct SearchCanceled {};
+
+// the document & the end of the range bound to the iterators of one search,
+// and the pool of the ucqueues shared by its UCIterators
+struct CharIteratorContext
+{
+	MadLines         *lines;
+	wxFileOffset     endpos;
+	list<UCQueueSet> ucqueues;
+
+	// set by ReplaceAll for all of its searches, then the progress is reported
+	// while the iterators advance, even if nothing is matched for a long way
+	const wxm::WXMSearcher::ProgressCallback *progress;
+	wxFileOffset     progress_end;
+	wxFileOffset     progress_pos;    // reported last
+
+	CharIteratorContext(): lines(nullptr), endpos(0), progress(nullptr), progress_end(0), progress_pos(0) {}
+
+	void Init(MadLines *lns, const wxFileOffset &epos)
+	{
+		wxASSERT(epos >= 0 && epos <= lns->GetSize());
+
+		lines = lns;
+		endpos = epos;
+		ucqueues.clear();
+	}
+
+	// call progress after every REPLACE_PROGRESS_STEP bytes searched,
+	// return false if it was canceled
+	bool ReportProgress(wxFileOffset pos)
+	{
+		if (progress == nullptr || progress->empty() || pos - progress_pos < REPLACE_PROGRESS_STEP)
+			return true;
+
+		progress_pos = pos;
+		return (*progress)(pos, progress_end);
+	}
+
+	void Advance(wxFileOffset pos)
+	{
+		if (!ReportProgress(pos))
+			throw SearchCanceled();
+	}
+};
+
 struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 {
 	typedef std::bidirectional_iterator_tag iterator_category;
@@ -339,70 +389,58 @@ struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 	typedef const value_type *pointer;
 	typedef const value_type &reference;
 
-	static MadLines         *s_lines;
-	static wxFileOffset     s_endpos;
-	static list<UCQueueSet> s_ucqueues;
-
-	static void Init(MadLines *lines, const wxFileOffset &endpos)
-	{
-		wxASSERT(endpos >= 0 && endpos <= lines->GetSize());
-
-		s_lines = lines;
-		s_endpos = endpos;
-		s_ucqueues.clear();
-	}
-
 	typedef list<UCQueueSet>::iterator UCQIterator;
 #define UCQ_MAXSIZE (10 * 1024)
 #define BUF_MAXSIZE (5 * 1024)
 
+	CharIteratorContext *ctx;
 	UCQIterator     ucqit;
 	int             ucqidx;
 
-	UCIterator() :ucqidx(-1) {}
+	UCIterator() :ctx(nullptr), ucqidx(-1) {}
 
 	~UCIterator()
 	{
 		if (ucqidx >= 0 && --ucqit->lock == 0)
 		{
-			s_ucqueues.erase(ucqit);
+			ctx->ucqueues.erase(ucqit);
 		}
 	}
 
 	//UCIterator(wxFileOffset pos0):ucqidx(-1), pos(pos0) {}
 
-	UCIterator(const UCIterator &ucit) :ucqidx(-1)
+	UCIterator(const UCIterator &ucit) :ctx(nullptr), ucqidx(-1)
 	{
 		this->operator =(ucit);
 	}
 
-	UCIterator(const MadCaretPos& cp)
-		:WXMCharIterator(cp)
+	UCIterator(CharIteratorContext *context, const MadCaretPos& cp)
+		:WXMCharIterator(cp), ctx(context)
 	{
-		if (linepos == lit->m_Size && pos<s_lines->GetSize())
+		if (linepos == lit->m_Size && pos<ctx->lines->GetSize())
 		{
 			++lit;
 			linepos = 0;
 		}
 
-		s_ucqueues.push_back(UCQueueSet());
-		ucqit = s_ucqueues.end();
+		ctx->ucqueues.push_back(UCQueueSet());
+		ucqit = ctx->ucqueues.end();
 		--ucqit;
 
 		ucqit->lock = 1;            // lock this ucqueue
 
 		ucqidx = 0;
 
-		if (pos >= s_lines->GetSize())
+		if (pos >= ctx->lines->GetSize())
 			return;
 
 		MadUCQueue& ucqueue = ucqit->ucq;
-		s_lines->InitNextUChar(lit, linepos);
+		ctx->lines->InitNextUChar(lit, linepos);
 		int i = BUF_MAXSIZE;
 
-		if (pos >= s_endpos) i = 10;
+		if (pos >= ctx->endpos) i = 10;
 
-		while (--i>0 && s_lines->NextUChar(ucqueue))
+		while (--i>0 && ctx->lines->NextUChar(ucqueue))
 		{
 			//ucqit->size += ucqueue.back().second;
 		}
@@ -413,9 +451,10 @@ struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 		if (ucqidx >= 0 && --ucqit->lock == 0)
 		{
 			wxASSERT(ucqit != it.ucqit);
-			s_ucqueues.erase(ucqit);
+			ctx->ucqueues.erase(ucqit);
 		}
 
+		ctx = it.ctx;
 		pos = it.pos;
 		lit = it.lit;
 		linepos = it.linepos;
@@ -454,7 +493,7 @@ struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 
 		if (linepos == lit->m_Size)
 		{
-			if (pos == s_endpos)
+			if (pos == ctx->endpos)
 				return *this; // end
 
 			++lit;
@@ -465,17 +504,17 @@ struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 
 		if (ucqidx == (int)(*ucqueue).size())
 		{
-			wxASSERT(pos <= s_endpos);
+			wxASSERT(pos <= ctx->endpos);
 
 			if (ucqidx >= UCQ_MAXSIZE)
 			{
 				if (--ucqit->lock == 0)
 				{
-					s_ucqueues.erase(ucqit);
+					ctx->ucqueues.erase(ucqit);
 				}
 
-				s_ucqueues.push_back(UCQueueSet());
-				ucqit = s_ucqueues.end();
+				ctx->ucqueues.push_back(UCQueueSet());
+				ucqit = ctx->ucqueues.end();
 				--ucqit;
 
 				ucqit->lock = 1;            // lock this ucqueue
@@ -485,9 +524,11 @@ struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 				ucqueue = &(ucqit->ucq);
 			}
 
-			s_lines->InitNextUChar(lit, linepos);
+			ctx->Advance(pos);
+
+			ctx->lines->InitNextUChar(lit, linepos);
 			int i = BUF_MAXSIZE;
-			while (--i>0 && s_lines->NextUChar(*ucqueue))
+			while (--i>0 && ctx->lines->NextUChar(*ucqueue))
 			{
 				//ucqit->size += ucqueue->back().second;
 			}
@@ -517,18 +558,18 @@ struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 		{
 			if (--ucqit->lock == 0)
 			{
-				s_ucqueues.erase(ucqit);
+				ctx->ucqueues.erase(ucqit);
 			}
 
-			s_ucqueues.push_back(UCQueueSet());
-			ucqit = s_ucqueues.end();
+			ctx->ucqueues.push_back(UCQueueSet());
+			ucqit = ctx->ucqueues.end();
 			--ucqit;
 
 			ucqit->lock = 1;              // lock this ucqueue
 
 			ucqidx = 0;
 
-			MadUCPair ucp = s_lines->PreviousUChar(lit, linepos);
+			MadUCPair ucp = ctx->lines->PreviousUChar(lit, linepos);
 
 			wxASSERT(ucp.second != 0);
 
@@ -567,7 +608,7 @@ struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 	{
 		if (pos == it.pos)
 			return true;
-		return (pos >= s_endpos && it.pos >= s_endpos);
+		return (pos >= ctx->endpos && it.pos >= ctx->endpos);
 	}
 
 	bool operator!=(const UCIterator & it) const
@@ -577,10 +618,6 @@ struct UCIterator : public WXMCharIterator   // ucs4_t widechar iterator
 
 };
 
-MadLines *UCIterator::s_lines = nullptr;
-wxFileOffset UCIterator::s_endpos = 0;
-list<UCQueueSet> UCIterator::s_ucqueues;
-
 void MadCaretPos::AssignWith(const WXMCharIterator& ucit)
 {
 	pos = ucit.pos;
@@ -627,28 +664,19 @@ struct ByteIterator : public WXMCharIterator
 	typedef const value_type *pointer;
 	typedef const value_type &reference;
 
-	static MadLines         *s_lines;
-	static wxFileOffset     s_endpos;
+	CharIteratorContext *ctx;
 
-	static void Init(MadLines *lines, const wxFileOffset &endpos)
-	{
-		wxASSERT(endpos >= 0 && endpos <= lines->GetSize());
-
-		s_lines = lines;
-		s_endpos = endpos;
-	}
-
-	ByteIterator() {}
+	ByteIterator() :ctx(nullptr) {}
 
 	ByteIterator(const ByteIterator &it)
 	{
 		this->operator =(it);
 	}
 
-	ByteIterator(const MadCaretPos& cp)
-		:WXMCharIterator(cp)
+	ByteIterator(CharIteratorContext *context, const MadCaretPos& cp)
+		:WXMCharIterator(cp), ctx(context)
 	{
-		if (linepos == lit->m_Size && pos<s_lines->GetSize())
+		if (linepos == lit->m_Size && pos<ctx->lines->GetSize())
 		{
 			++lit;
 			linepos = 0;
@@ -657,6 +685,7 @@ struct ByteIterator : public WXMCharIterator
 
 	ByteIterator & operator=(const ByteIterator & it)
 	{
+		ctx = it.ctx;
 		pos = it.pos;
 		lit = it.lit;
 		linepos = it.linepos;
@@ -682,9 +711,12 @@ struct ByteIterator : public WXMCharIterator
 		++pos;
 		++linepos;
 
+		if ((pos & 0xFFFF) == 0)
+			ctx->Advance(pos);
+
 		if (linepos == lit->m_Size)
 		{
-			if (pos == s_endpos)
+			if (pos == ctx->endpos)
 				return *this; // end
 
 			++lit;
@@ -737,7 +769,7 @@ struct ByteIterator : public WXMCharIterator
 	{
 		if (pos == it.pos)
 			return true;
-		return (pos >= s_endpos && it.pos >= s_endpos);
+		return (pos >= ctx->endpos && it.pos >= ctx->endpos);
 	}
 
 	bool operator!=(const ByteIterator & it) const
@@ -747,14 +779,68 @@ struct ByteIterator : public WXMCharIterator
 
 };
 
-MadLines *ByteIterator::s_lines = nullptr;
-wxFileOffset ByteIterator::s_endpos = 0;
-
 extern bool g_regex_dot_match_newline;
 
 namespace wxm
 {
 
+const size_t REGEX_CACHE_SIZE = 4;
+
+// the state of one searcher: the iterators bound to the searched document
+// and the compiled patterns, no searcher shares anything with another one
+struct SearchingContext
+{
+	CharIteratorContext iters;
+
+	boost::scoped_ptr<JumpTable_UCS4> text_jtab; // allocated on the first text searching
+	JumpTable_Hex hex_jtab;
+
+	struct CompiledRegex
+	{
+		ucs4string expr;
+		regex_constants::syntax_option_type opt;
+		basic_regex<UCIterator> regex;
+	};
+	list<CompiledRegex> regexes;        // the most recently used first
+	const basic_regex<UCIterator>* regex; // the one of the current searching
+
+	SearchingContext(): regex(nullptr) {}
+
+	// throw regex_error if exprstr is invalid
+	const basic_regex<UCIterator>& CompileRegex(const ucs4string& exprstr, regex_constants::syntax_option_type opt)
+	{
+		for (list<CompiledRegex>::iterator it = regexes.begin(); it != regexes.end(); ++it)
+		{
+			if (it->opt == opt && it->expr == exprstr)
+			{
+				regexes.splice(regexes.begin(), regexes, it);
+				return regexes.front().regex;
+			}
+		}
+
+		regex_compiler<UCIterator, ucs4_regex_traits > ucs4comp;
+		basic_regex<UCIterator> re = ucs4comp.compile(exprstr, opt);
+
+		if (regexes.size() >= REGEX_CACHE_SIZE)
+			regexes.pop_back();
+		regexes.push_front(CompiledRegex());
+		regexes.front().expr = exprstr;
+		regexes.front().opt = opt;
+		regexes.front().regex = re;
+
+		return regexes.front().regex;
+	}
+};
+
+WXMSearcher::WXMSearcher(MadEdit* edit, bool use_regex): m_ctx(new SearchingContext)
+	, m_edit(edit), m_use_regex(use_regex), m_case_sensitive(true), m_whole_word(false)
+{
+}
+
+WXMSearcher::~WXMSearcher()
+{
+}
+
 ucs4string WXMSearcher::from_wxString(const wxString& wxs)
 {
 #ifdef __WXMSW__
@@ -802,6 +888,40 @@ void WXMSearcher::AssignCaretPos(wxFileOffset& pos, MadCaretPos& cp)
 	cp.linepos = pos - cp.linepos;
 }
 
+// report the progress of the searches of ReplaceAll in the scope of it
+struct ReplaceProgressScope
+{
+	ReplaceProgressScope(CharIteratorContext& iters, const WXMSearcher::ProgressCallback& progress,
+		wxFileOffset begin, wxFileOffset end)
+		: m_iters(iters)
+	{
+		m_iters.progress = &progress;
+		m_iters.progress_end = end;
+		m_iters.progress_pos = begin;
+	}
+	~ReplaceProgressScope()
+	{
+		m_iters.progress = nullptr;
+	}
+private:
+	CharIteratorContext& m_iters;
+};
+
+// hold the lines of the edit for ReplaceAll in the scope of it
+struct HoldLinesScope
+{
+	HoldLinesScope(MadEdit* edit): m_edit(edit)
+	{
+		m_edit->HoldLines();
+	}
+	~HoldLinesScope()
+	{
+		m_edit->ReleaseLines();
+	}
+private:
+	MadEdit* m_edit;
+};
+
 bool TextSearcher::IsDelimiterChar(ucs4_t uc)
 {
 	return (uc <= 0x20 || m_edit->m_Syntax->IsDelimiter(uc) || uc == 0x3000);
@@ -854,10 +974,10 @@ bool TextSearcher::NextRegexSearchingPos(MadCaretPos& cp, const wxString &expr)
 		cp.linepos += len;
 	}
 
-	if (cp.pos == UCIterator::s_endpos)
+	if (cp.pos == m_ctx->iters.endpos)
 		return false;
 
-	UCIterator it(cp);
+	UCIterator it(&m_ctx->iters, cp);
 	++it;
 	cp.AssignWith(it);
 	return true;
@@ -869,20 +989,12 @@ MadSearchResult TextSearcher::Search(/*IN_OUT*/MadCaretPos& beginpos, /*IN_OUT*/
 	if (beginpos.pos >= endpos.pos || text.IsEmpty())
 		return SR_NO;
 
-	const wxString *text_ptr = &text;
-	if (!m_case_sensitive)
-	{
-		static wxString text_ncase;
-		text_ncase = wxm::WxStrToNormalCase(text);
-		text_ptr = &text_ncase;
-	}
+	ucs4string exprstr(from_wxString(m_case_sensitive ? text : wxm::WxStrToNormalCase(text)));
 
-	ucs4string exprstr(from_wxString(*text_ptr));
+	m_ctx->iters.Init(m_edit->m_Lines, endpos.pos);
 
-	UCIterator::Init(m_edit->m_Lines, endpos.pos);
-
-	UCIterator start(beginpos);
-	UCIterator end(endpos);
+	UCIterator start(&m_ctx->iters, beginpos);
+	UCIterator end(&m_ctx->iters, endpos);
 	bool found;
 
 	UCIterator fbegin, fend;
@@ -919,6 +1031,8 @@ MadSearchResult TextSearcher::Search(/*IN_OUT*/MadCaretPos& beginpos, /*IN_OUT*/
 MadSearchResult TextSearcher::FindNext(const wxString &text,
 	wxFileOffset rangeFrom, wxFileOffset rangeTo)
 {
+	XM_TRACE_SCOPE("TextSearcher::FindNext");
+
 	MadCaretPos bpos, epos;
 
 	if (rangeFrom < 0)
@@ -941,6 +1055,8 @@ MadSearchResult TextSearcher::FindNext(const wxString &text,
 MadSearchResult TextSearcher::FindPrevious(const wxString &text,
 	wxFileOffset rangeFrom, wxFileOffset rangeTo)
 {
+	XM_TRACE_SCOPE("TextSearcher::FindPrevious");
+
 	MadCaretPos bpos, epos;
 
 	if (rangeFrom < 0)
@@ -1109,6 +1225,8 @@ int TextSearcher::FindAll(const wxString &expr, bool bFirstOnly,
 	vector<wxFileOffset> *pbegpos, vector<wxFileOffset> *pendpos,
 	wxFileOffset rangeFrom, wxFileOffset rangeTo)
 {
+	XM_TRACE_SCOPE("TextSearcher::FindAll");
+
 	if (expr.empty())
 		return 0;
 
@@ -1156,9 +1274,14 @@ int TextSearcher::ReplaceAll(const wxString &expr, const wxString &fmt,
 	vector<wxFileOffset> *pbegpos, vector<wxFileOffset> *pendpos,
 	wxFileOffset rangeFrom, wxFileOffset rangeTo)
 {
+	XM_TRACE_SCOPE("TextSearcher::ReplaceAll");
+
 	if (expr.empty())
 		return 0;
 
+	// the iterators below are kept while the progress dialog dispatches the events
+	HoldLinesScope hold(m_edit);
+
 	MadCaretPos bpos, epos, endpos;
 
 	if (rangeFrom <= 0)
@@ -1175,74 +1298,58 @@ int TextSearcher::ReplaceAll(const wxString &expr, const wxString &fmt,
 		return 0;
 
 	endpos = epos;
-	int multi = 0;
 
-	vector<wxFileOffset> del_bpos;
-	vector<wxFileOffset> del_epos;
-	vector<const ucs4_t*> ins_ucs;
-	vector<wxFileOffset> ins_len;
-
-	list<ucs4string> outs;
+	// the replacements are written to the document data while searching,
+	// and applied in a single Undo at the end
+	MadOverwriteStream ows(m_edit->m_Lines);
+	ReplaceProgressScope progress(m_ctx->iters, m_progress, bpos.pos, endpos.pos);
+	wxFileOffset diff = 0;
+	ucs4string out;
 
 	int state;
-	while ((state = Search(bpos, epos, expr)) == SR_YES)
+	try
 	{
-		ucs4string out;
-		int state = Replace(out, bpos, epos, expr, fmt);
-		if (state == SR_EXPR_ERROR)
-			return SR_EXPR_ERROR;
+		while ((state = Search(bpos, epos, expr)) == SR_YES)
+		{
+			out.clear();
+			int state = Replace(out, bpos, epos, expr, fmt);
+			if (state == SR_EXPR_ERROR)
+				return SR_EXPR_ERROR;
 
-		del_bpos.push_back(bpos.pos);
-		del_epos.push_back(epos.pos);
+			wxFileOffset len = m_edit->AppendOverwriteData(ows, bpos, epos, out.c_str(), nullptr, out.length());
 
-		outs.push_back(out);
-		ucs4string &str = outs.back();
-		ins_ucs.push_back(str.c_str());
-		ins_len.push_back(str.length());
+			if (pbegpos != 0 && pendpos != 0)
+			{
+				pbegpos->push_back(bpos.pos + diff);
+				pendpos->push_back(bpos.pos + diff + len);
+			}
+			diff += len - (epos.pos - bpos.pos);
 
-		if (bpos.iter != epos.iter)
-			++multi;
+			m_ctx->iters.Advance(epos.pos);
 
-		if (bpos.pos == epos.pos && !NextRegexSearchingPos(epos, expr))
-			break;
+			if (bpos.pos == epos.pos && !NextRegexSearchingPos(epos, expr))
+				break;
 
-		bpos = epos;
-		epos = endpos;
+			bpos = epos;
+			epos = endpos;
+		}
 	}
-
-	if (state == SR_EXPR_ERROR)
-		return SR_EXPR_ERROR;
-
-	int count = int(del_bpos.size());
-
-	if (count>0)
+	catch (SearchCanceled)
 	{
-		wxFileOffset size = del_epos.back() - del_bpos.front();
-		if ((size <= 2 * 1024 * 1024) || (multi >= 40 && size <= 10 * 1024 * 1024))
-			m_edit->OverwriteDataSingle(del_bpos, del_epos, &ins_ucs, nullptr, ins_len);
-		else
-			m_edit->OverwriteDataMultiple(del_bpos, del_epos, &ins_ucs, nullptr, ins_len);
-
 		if (pbegpos != 0 && pendpos != 0)
 		{
-			pbegpos->resize(count);
-			pendpos->resize(count);
-
-			wxFileOffset diff = 0, b, e, l;
-			for (int i = 0; i<count; i++)
-			{
-				b = del_bpos[i];
-				e = del_epos[i];
-				l = ins_len[i];
-				size = b + diff;
-				(*pbegpos)[i] = size;
-				(*pendpos)[i] = size + l;
-				diff += (l - (e - b));
-			}
+			pbegpos->clear();
+			pendpos->clear();
 		}
+		return SR_CANCELED;
 	}
 
-	return count;
+	if (state == SR_EXPR_ERROR)
+		return SR_EXPR_ERROR;
+
+	m_edit->OverwriteData(ows);
+
+	return int(ows.m_Count);
 }
 
 void TextSearcher::UpdateWXMEditCaret(MadCaretPos& cp)
@@ -1263,10 +1370,11 @@ void TextSearcher::UpdateWXMEditCaret(wxFileOffset& pos, MadCaretPos& cp)
 	UpdateWXMEditCaret(cp);
 }
 
-static JumpTable_UCS4 sg_jtab;
 bool StringSearcher::SearchingPrepare(const ucs4string& exprstr, const wxString& text)
 {
-	sg_jtab.Build(exprstr);
+	if (!m_ctx->text_jtab)
+		m_ctx->text_jtab.reset(new JumpTable_UCS4);
+	m_ctx->text_jtab->Build(exprstr);
 	return true;
 }
 
@@ -1275,11 +1383,10 @@ bool StringSearcher::DoSearch(bool& found, UCIterator& fbegin, UCIterator& fend,
 {
 	fbegin = start;
 	fend = end;
-	found = ::Search(fbegin, fend, exprstr, sg_jtab, m_case_sensitive);
+	found = ::Search(fbegin, fend, exprstr, *m_ctx->text_jtab, m_case_sensitive);
 	return true;
 }
 
-static basic_regex<UCIterator> sg_expression;
 bool RegexSearcher::SearchingPrepare(const ucs4string& exprstr, const wxString& text)
 {
 	try
@@ -1289,8 +1396,7 @@ bool RegexSearcher::SearchingPrepare(const ucs4string& exprstr, const wxString&
 			opt = opt | regex_constants::icase;
 		if (!g_regex_dot_match_newline)
 			opt = opt | regex_constants::not_dot_newline;
-		regex_compiler<UCIterator, ucs4_regex_traits > ucs4comp;
-		sg_expression = ucs4comp.compile(exprstr, opt);
+		m_ctx->regex = &m_ctx->CompileRegex(exprstr, opt);
 	}
 	catch (regex_error)
 	{
@@ -1309,7 +1415,7 @@ bool RegexSearcher::DoSearch(bool& found, UCIterator& fbegin, UCIterator& fend,
 	match_results<UCIterator> what;
 	try
 	{
-		found = regex_search(start, end, what, sg_expression);
+		found = regex_search(start, end, what, *m_ctx->regex);
 	}
 	catch (regex_error)
 	{
@@ -1350,13 +1456,13 @@ MadSearchResult RegexSearcher::Replace(ucs4string &out, const MadCaretPos& begin
 
 	ucs4string fmtstr(from_wxString(fmt));
 
-	UCIterator begin(beginpos);
-	UCIterator end(endpos);
+	UCIterator begin(&m_ctx->iters, beginpos);
+	UCIterator end(&m_ctx->iters, endpos);
 
 	try
 	{
 		std::back_insert_iterator<ucs4string> oi(out);
-		regex_replace(oi, begin, end, sg_expression, fmtstr);
+		regex_replace(oi, begin, end, *m_ctx->regex, fmtstr);
 		out = ConvertEscape(out);
 	}
 	catch (regex_error)
@@ -1376,14 +1482,13 @@ MadSearchResult HexSearcher::SearchHex(/*IN_OUT*/MadCaretPos& beginpos, /*IN_OUT
 	if (beginpos.pos >= endpos.pos || hex.empty())
 		return SR_NO;
 
-	ByteIterator::Init(m_edit->m_Lines, endpos.pos);
-	ByteIterator start(beginpos);
-	ByteIterator end(endpos);
+	m_ctx->iters.Init(m_edit->m_Lines, endpos.pos);
+	ByteIterator start(&m_ctx->iters, beginpos);
+	ByteIterator end(&m_ctx->iters, endpos);
 
-	static JumpTable_Hex jtab;
-	jtab.Build(hex);
+	m_ctx->hex_jtab.Build(hex);
 
-	if (!::Search(start, end, hex, jtab, true))
+	if (!::Search(start, end, hex, m_ctx->hex_jtab, true))
 		return SR_NO;
 
 	beginpos.AssignWith(start);
@@ -1395,6 +1500,8 @@ MadSearchResult HexSearcher::SearchHex(/*IN_OUT*/MadCaretPos& beginpos, /*IN_OUT
 MadSearchResult HexSearcher::FindNext(const wxString &hexstr,
 	wxFileOffset rangeFrom, wxFileOffset rangeTo)
 {
+	XM_TRACE_SCOPE("HexSearcher::FindNext");
+
 	vector<wxByte> hex;
 	if (!StringToHex(hexstr, hex))
 		return SR_EXPR_ERROR;
@@ -1421,6 +1528,8 @@ MadSearchResult HexSearcher::FindNext(const wxString &hexstr,
 MadSearchResult HexSearcher::FindPrevious(const wxString &hexstr,
 	wxFileOffset rangeFrom, wxFileOffset rangeTo)
 {
+	XM_TRACE_SCOPE("HexSearcher::FindPrevious");
+
 	vector<wxByte> hex;
 	if (!StringToHex(hexstr, hex))
 		return SR_EXPR_ERROR;
@@ -1588,6 +1697,8 @@ int HexSearcher::ReplaceAll(const wxString &expr, const wxString &fmt,
 	vector<wxFileOffset> *pbegpos, vector<wxFileOffset> *pendpos,
 	wxFileOffset rangeFrom, wxFileOffset rangeTo)
 {
+	XM_TRACE_SCOPE("HexSearcher::ReplaceAll");
+
 	if (expr.empty())
 		return 0;
 
@@ -1599,10 +1710,7 @@ int HexSearcher::ReplaceAll(const wxString &expr, const wxString &fmt,
 	if (!StringToHex(fmt, fmthex))
 		return SR_EXPR_ERROR;
 
-	vector<wxFileOffset> del_bpos;
-	vector<wxFileOffset> del_epos;
-	vector<wxByte*> ins_data;
-	vector<wxFileOffset> ins_len;
+	HoldLinesScope hold(m_edit);
 
 	MadCaretPos bpos, epos, endpos;
 
@@ -1620,58 +1728,52 @@ int HexSearcher::ReplaceAll(const wxString &expr, const wxString &fmt,
 		return 0;
 
 	endpos = epos;
-	int multi = 0;
 
-	while (SearchHex(bpos, epos, hex) == SR_YES)
-	{
-		del_bpos.push_back(bpos.pos);
-		del_epos.push_back(epos.pos);
-		ins_data.push_back(fmthex.empty() ? nullptr : &fmthex[0]);
-		ins_len.push_back(fmthex.size());
+	MadOverwriteStream ows(m_edit->m_Lines);
+	ReplaceProgressScope progress(m_ctx->iters, m_progress, bpos.pos, endpos.pos);
+	wxFileOffset diff = 0;
+	wxByte* ins_data = fmthex.empty() ? nullptr : &fmthex[0];
 
-		if (bpos.iter != epos.iter)
-			++multi;
+	try
+	{
+		while (SearchHex(bpos, epos, hex) == SR_YES)
+		{
+			wxFileOffset len = m_edit->AppendOverwriteData(ows, bpos, epos, nullptr, ins_data, fmthex.size());
 
-		bpos = epos;
-		epos = endpos;
-	}
+			if (pbegpos != 0 && pendpos != 0)
+			{
+				pbegpos->push_back(bpos.pos + diff);
+				pendpos->push_back(bpos.pos + diff + len);
+			}
+			diff += len - (epos.pos - bpos.pos);
 
-	int count = int(del_bpos.size());
+			m_ctx->iters.Advance(epos.pos);
 
-	if (count>0)
+			bpos = epos;
+			epos = endpos;
+		}
+	}
+	catch (SearchCanceled)
 	{
-		wxFileOffset size = del_epos.back() - del_bpos.front();
-		if (m_edit->IsTextFile() && ((size <= 2 * 1024 * 1024) || (multi >= 40 && size <= 10 * 1024 * 1024)))
-			m_edit->OverwriteDataSingle(del_bpos, del_epos, nullptr, &ins_data, ins_len);
-		else
-			m_edit->OverwriteDataMultiple(del_bpos, del_epos, nullptr, &ins_data, ins_len);
-
 		if (pbegpos != 0 && pendpos != 0)
 		{
-			pbegpos->resize(count);
-			pendpos->resize(count);
-
-			wxFileOffset diff = 0, b, e, l;
-			for (int i = 0; i<count; i++)
-			{
-				b = del_bpos[i];
-				e = del_epos[i];
-				l = ins_len[i];
-				size = b + diff;
-				(*pbegpos)[i] = size;
-				(*pendpos)[i] = size + l;
-				diff += (l - (e - b));
-			}
+			pbegpos->clear();
+			pendpos->clear();
 		}
+		return SR_CANCELED;
 	}
 
-	return count;
+	m_edit->OverwriteData(ows);
+
+	return int(ows.m_Count);
 }
 
 int HexSearcher::FindAll(const wxString &expr, bool bFirstOnly,
 	vector<wxFileOffset> *pbegpos, vector<wxFileOffset> *pendpos,
 	wxFileOffset rangeFrom, wxFileOffset rangeTo)
 {
+	XM_TRACE_SCOPE("HexSearcher::FindAll");
+
 	if (expr.empty())
 		return 0;
 
@@ -1712,4 +1814,203 @@ int HexSearcher::FindAll(const wxString &expr, bool bFirstOnly,
 	return count;
 }
 
+static ucs4string WxStrToUCS4(const wxString& wxs)
+{
+	ucs4string ucs;
+	const wxChar* pwcs = wxs.c_str();
+	size_t count = wxs.Len();
+	for (size_t i = 0; i < count; ++i)
+	{
+		ucs4_t uc = pwcs[i];
+#ifdef __WXMSW__
+		if (uc >= 0xD800 && uc <= 0xDBFF && i + 1 < count)
+		{
+			ucs4_t uc1 = pwcs[i + 1];
+			if (uc1 >= 0xDC00 && uc1 <= 0xDFFF)
+			{
+				++i;
+				uc = ((uc - 0xD800) << 10) + (uc1 - 0xDC00) + 0x10000;
+			}
+		}
+#endif
+		ucs.push_back(uc);
+	}
+	return ucs;
+}
+
+struct MemorySearcher::Pattern
+{
+	ucs4string text;
+	JumpTable_UCS4 text_jtab;
+	basic_regex<const ucs4_t*> regex;
+	std::vector<wxByte> hex;
+	JumpTable_Hex hex_jtab;
+	MadCharBits delimiters;
+};
+
+MemorySearcher::MemorySearcher(bool inhex, bool use_regex, bool case_sensitive, bool whole_word,
+	const wxString& delimiters)
+	: m_pattern(new Pattern), m_inhex(inhex), m_use_regex(use_regex && !inhex)
+	, m_case_sensitive(case_sensitive || inhex), m_whole_word(whole_word && !inhex), m_line_anchor(false)
+{
+	for (size_t i = 0; i < delimiters.Len(); ++i)
+		m_pattern->delimiters.Set(ucs4_t(delimiters[i]));
+}
+
+MemorySearcher::~MemorySearcher()
+{
+}
+
+bool MemorySearcher::Prepare(const wxString& expr)
+{
+	if (expr.IsEmpty())
+		return false;
+
+	if (m_inhex)
+	{
+		if (!StringToHex(expr, m_pattern->hex) || m_pattern->hex.empty())
+			return false;
+
+		m_pattern->hex_jtab.Build(m_pattern->hex);
+		return true;
+	}
+
+	ucs4string exprstr(WxStrToUCS4(m_case_sensitive ? expr : wxm::WxStrToNormalCase(expr)));
+
+	if (!m_use_regex)
+	{
+		m_pattern->text = exprstr;
+		m_pattern->text_jtab.Build(exprstr);
+		return true;
+	}
+
+	m_line_anchor = (expr.find_first_of(wxT('^')) != wxString::npos || expr.find_last_of(wxT('$')) != wxString::npos);
+
+	try
+	{
+		regex_constants::syntax_option_type opt = regex_constants::ECMAScript;
+		if (!m_case_sensitive)
+			opt = opt | regex_constants::icase;
+		if (!g_regex_dot_match_newline)
+			opt = opt | regex_constants::not_dot_newline;
+		regex_compiler<const ucs4_t*, ucs4_regex_traits > ucs4comp;
+		m_pattern->regex = ucs4comp.compile(exprstr, opt);
+	}
+	catch (regex_error)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// the same as TextSearcher::IsDelimiterChar()
+bool MemorySearcher::IsDelimiterChar(ucs4_t uc)
+{
+	return (uc <= 0x20 || m_pattern->delimiters.Test(uc) || uc == 0x3000);
+}
+
+bool MemorySearcher::IsWordBoundary(const ucs4_t* begin, const ucs4_t* end, const ucs4_t* pos)
+{
+	if (pos == begin || pos == end)
+		return true;
+
+	return IsDelimiterChar(*pos) || IsDelimiterChar(*(pos - 1));
+}
+
+size_t MemorySearcher::FindAll(const ucs4_t* begin, const ucs4_t* end, bool bFirstOnly,
+	std::vector<size_t>& begidx, std::vector<size_t>& endidx)
+{
+	wxASSERT(!m_inhex);
+
+	size_t count = 0;
+	const ucs4_t* start = begin;
+	while (start < end)
+	{
+		const ucs4_t* fbegin = start;
+		const ucs4_t* fend = end;
+		bool found;
+
+		if (m_use_regex)
+		{
+			match_results<const ucs4_t*> what;
+			try
+			{
+				found = regex_search(start, end, what, m_pattern->regex);
+			}
+			catch (regex_error)
+			{
+				break;
+			}
+
+			if (found)
+			{
+				fbegin = what[0].first;
+				fend = what[0].second;
+			}
+		}
+		else
+		{
+			found = ::Search(fbegin, fend, m_pattern->text, m_pattern->text_jtab, m_case_sensitive);
+		}
+
+		if (!found)
+			break;
+
+		if (m_whole_word && !(IsWordBoundary(begin, end, fbegin) && IsWordBoundary(begin, end, fend)))
+		{
+			start = (fend > fbegin) ? fend : fbegin + 1;
+			continue;
+		}
+
+		begidx.push_back(size_t(fbegin - begin));
+		endidx.push_back(size_t(fend - begin));
+		++count;
+		if (bFirstOnly)
+			break;
+
+		start = fend;
+		if (fbegin == fend)
+		{
+			// an empty match, search from the next char or the next line
+			if (m_line_anchor)
+			{
+				while (start < end && *start != 0x0A && *start != 0x0D)
+					++start;
+			}
+			if (start == end)
+				break;
+			++start;
+		}
+	}
+
+	return count;
+}
+
+size_t MemorySearcher::FindAll(const wxByte* begin, const wxByte* end, bool bFirstOnly,
+	std::vector<size_t>& begidx, std::vector<size_t>& endidx)
+{
+	wxASSERT(m_inhex);
+
+	size_t count = 0;
+	const wxByte* start = begin;
+	while (start < end)
+	{
+		const wxByte* fbegin = start;
+		const wxByte* fend = end;
+		if (!::Search(fbegin, fend, m_pattern->hex, m_pattern->hex_jtab, true))
+			break;
+
+		begidx.push_back(size_t(fbegin - begin));
+		endidx.push_back(size_t(fend - begin));
+		++count;
+		if (bFirstOnly)
+			break;
+
+		start = fend;
+	}
+
+	return count;
+}
+
 } // namespace wxm
@@ -26,6 +26,9 @@
 # pragma warning( pop )
 #endif
 
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/function.hpp>
 #include <vector>
 #include <string>
 
@@ -36,7 +39,7 @@ struct UCIterator;
 // returned state of Search & Replace
 enum MadSearchResult
 {
-	SR_EXPR_ERROR = -2, SR_YES = -1, SR_NO = 0
+	SR_CANCELED = -3, SR_EXPR_ERROR = -2, SR_YES = -1, SR_NO = 0
 };
 
 enum MadReplaceResult
@@ -50,13 +53,12 @@ enum MadReplaceResult
 
 namespace wxm
 {
+	struct SearchingContext;
 
-	struct WXMSearcher
+	struct WXMSearcher: private boost::noncopyable
 	{
-		WXMSearcher(MadEdit* edit, bool use_regex): m_edit(edit), m_use_regex(use_regex)
-			, m_case_sensitive(true), m_whole_word(false)
-		{}
-		virtual ~WXMSearcher() {}
+		WXMSearcher(MadEdit* edit, bool use_regex);
+		virtual ~WXMSearcher();
 
 		virtual void SetOption(bool case_sensitive, bool whole_word)
 		{
@@ -75,7 +77,7 @@ namespace wxm
 		virtual MadReplaceResult ReplaceOnce(const wxString& expr, const wxString& fmt,
 			wxFileOffset rangeFrom = -1, wxFileOffset rangeTo = -1) = 0;
 
-		// return the replaced count or SR_EXPR_ERROR
+		// return the replaced count, SR_EXPR_ERROR or SR_CANCELED
 		virtual int ReplaceAll(const wxString& expr, const wxString& fmt,
 			std::vector<wxFileOffset>* pbegpos = nullptr, std::vector<wxFileOffset>* pendpos = nullptr,
 			wxFileOffset rangeFrom = -1, wxFileOffset rangeTo = -1) = 0;
@@ -86,6 +88,11 @@ namespace wxm
 			std::vector<wxFileOffset>* pbegpos, std::vector<wxFileOffset>* pendpos,
 			wxFileOffset rangeFrom = -1, wxFileOffset rangeTo = -1) = 0;
 
+		// called by ReplaceAll with the searched position and the end of the range,
+		// return false to cancel it and leave the document unchanged
+		typedef boost::function<bool(wxFileOffset pos, wxFileOffset end)> ProgressCallback;
+		void SetProgressCallback(const ProgressCallback& progress) { m_progress = progress; }
+
 	protected:
 		ucs4string from_wxString(const wxString& wxs);
 
@@ -94,6 +101,9 @@ namespace wxm
 		void AssignFileEnd(MadCaretPos& cp);
 		void AssignCaretPos(wxFileOffset& pos, MadCaretPos& cp);
 
+		// the compiled patterns & the searching state owned by this searcher
+		boost::scoped_ptr<SearchingContext> m_ctx;
+		ProgressCallback m_progress;
 		MadEdit* m_edit;
 		bool m_use_regex;
 		bool m_case_sensitive;
@@ -201,6 +211,40 @@ namespace wxm
 		RegexSearcher m_regex_searcher;
 		HexSearcher m_hex_searcher;
 	};
+
+	// MemorySearcher searches in a decoded text or in raw bytes without MadEdit,
+	// every instance keeps its own compiled pattern and can be used in its own thread
+	struct MemorySearcher: private boost::noncopyable
+	{
+		// delimiters: the chars separating the words besides the spaces, as MadSyntax::m_Delimiter
+		MemorySearcher(bool inhex, bool use_regex, bool case_sensitive, bool whole_word,
+			const wxString& delimiters);
+		~MemorySearcher();
+
+		// compile expr, return false if expr is invalid
+		bool Prepare(const wxString& expr);
+
+		// list the matched ranges in [begin, end) to begidx & endidx as offsets from begin
+		// return the found count
+		size_t FindAll(const ucs4_t* begin, const ucs4_t* end, bool bFirstOnly,
+			std::vector<size_t>& begidx, std::vector<size_t>& endidx);
+		size_t FindAll(const wxByte* begin, const wxByte* end, bool bFirstOnly,
+			std::vector<size_t>& begidx, std::vector<size_t>& endidx);
+
+		bool InHex() const { return m_inhex; }
+
+	private:
+		bool IsDelimiterChar(ucs4_t uc);
+		bool IsWordBoundary(const ucs4_t* begin, const ucs4_t* end, const ucs4_t* pos);
+
+		struct Pattern;
+		boost::scoped_ptr<Pattern> m_pattern;
+		bool m_inhex;
+		bool m_use_regex;
+		bool m_case_sensitive;
+		bool m_whole_word;
+		bool m_line_anchor;
+	};
 } //namespace wxm
 
 #endif //_WXM_SEARCHER_H_
@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/word_counter.cpp
+// Description: Counting Words and Chars of Text Chunks in Parallel
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#include "word_counter.h"
+#include "../xm/cxx11.h"
+#include "../xm/trace.h"
+#include "encoding/encoding.h"
+#include "parallel.h"
+
+#include <unicode/uchar.h>
+#include <algorithm>
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
+#endif
+
+namespace wxm
+{
+
+namespace
+{
+
+const int32_t WORD_COUNT_PIECE = 0x4000;    // UChar32s broken into words at a time
+const size_t DECODE_BATCH = 64 * 1024;      // bytes decoded at a time
+
+} // namespace
+
+WordCountPart::WordCountPart()
+	: words(WORD_COUNT_PIECE)
+	, chars(0), controls(0), spaces(0), fullwidths(0), ambws(0)
+{
+}
+
+void WordCountPart::Count(ucs4_t uc)
+{
+	blocks.Count(xm::UnicodeBlockSet::GetInstance().FindBlockIndex(uc));
+	words += (UChar32)uc;
+
+	++chars;
+	if (u_iscntrl(uc))
+		++controls;
+	else if (u_isspace(uc))
+		++spaces;
+
+	if (xm::IsWideWidthEverywhere(uc))
+		++fullwidths;
+	if (xm::IsAmbiguousWidth(uc))
+		++ambws;
+}
+
+void WordCountPart::Merge(const WordCountPart& following)
+{
+	words.Merge(following.words);
+	blocks.Merge(following.blocks);
+	chars += following.chars;
+	controls += following.controls;
+	spaces += following.spaces;
+	fullwidths += following.fullwidths;
+	ambws += following.ambws;
+}
+
+ParallelWordCounter::ParallelWordCounter(WXMEncoding* enc, size_t threads)
+	: m_enc(enc), m_threads(threads), m_chunkcount(0)
+{
+	if (m_threads == 0)
+		m_threads = DefaultThreadCount();
+}
+
+wxByte* ParallelWordCounter::AddChunk(size_t len)
+{
+	if (m_chunks.size() <= m_chunkcount)
+		m_chunks.resize(m_chunkcount + 1);
+
+	std::vector<wxByte>& chunk = m_chunks[m_chunkcount++];
+	chunk.resize(len);
+	return (len == 0) ? nullptr : &chunk[0];
+}
+
+void ParallelWordCounter::Count()
+{
+	XM_TRACE_SCOPE("ParallelWordCounter::Count");
+
+	const size_t count = m_chunkcount;
+	m_parts.clear();
+	for (size_t i = 0; i < count; ++i)
+		m_parts.push_back(boost::shared_ptr<WordCountPart>(new WordCountPart()));
+
+	RunInParallel(this, &ParallelWordCounter::CountChunk, count);
+
+	for (size_t i = 0; i < count; ++i)
+		m_result.Merge(*m_parts[i]);
+
+	m_parts.clear();
+	m_chunkcount = 0;
+}
+
+void ParallelWordCounter::CountChunk(size_t idx)
+{
+	const std::vector<wxByte>& chunk = m_chunks[idx];
+	WordCountPart& part = *m_parts[idx];
+
+	std::vector<ucs4_t> ucs(DECODE_BATCH);
+	std::vector<wxByte> lens(DECODE_BATCH);
+
+	for (size_t pos = 0; pos < chunk.size(); )
+	{
+		size_t len = std::min(chunk.size() - pos, DECODE_BATCH);
+		bool more = (pos + len < chunk.size());
+
+		size_t n = m_enc->DecodeUChar32s(&chunk[pos], len, more, &ucs[0], &lens[0], DECODE_BATCH);
+		if (n == 0)
+			break;
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			part.Count(ucs[i]);
+			pos += lens[i];
+		}
+	}
+}
+
+} //namespace wxm
@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        wxm/word_counter.h
+// Description: Counting Words and Chars of Text Chunks in Parallel
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WXM_WORD_COUNTER_H_
+#define _WXM_WORD_COUNTER_H_
+
+#include "../xm/cxx11.h"
+#include "../xm/uutils.h"
+#include "../xm/ublock.h"
+#include "../wxmedit/ucs4_t.h"
+
+#ifdef _MSC_VER
+# pragma warning( push )
+# pragma warning( disable : 4996 )
+#endif
+// disable 4996 {
+#include <wx/defs.h>
+// disable 4996 }
+#ifdef _MSC_VER
+# pragma warning( pop )
+#endif
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace wxm
+{
+
+struct WXMEncoding;
+
+// the counts of a part of the text, which are merged in order into the counts of the whole text
+struct WordCountPart: private boost::noncopyable
+{
+	WordCountPart();
+
+	void Count(ucs4_t uc);
+	// append the counts of following, which counted the text right after the text of this
+	void Merge(const WordCountPart& following);
+
+	xm::AccumulativeWordCounter words;
+	xm::UnicodeBlockCharCounter blocks;
+	wxInt64 chars;
+	wxInt64 controls;
+	wxInt64 spaces;
+	wxInt64 fullwidths;
+	wxInt64 ambws;
+};
+
+// ParallelWordCounter counts the chunks of text copied into it, one chunk by a thread.
+// A chunk must end at the end of a line or of the text, then no char is split by chunks,
+// and the joint of two chunks is a word boundary.
+struct ParallelWordCounter: private boost::noncopyable
+{
+	ParallelWordCounter(WXMEncoding* enc, size_t threads = 0);
+
+	// return a buffer of len bytes for the next chunk, it is valid until Count()
+	wxByte* AddChunk(size_t len);
+	// a chunk has been added for every thread
+	bool IsFull() const { return m_chunkcount >= m_threads; }
+	// count the added chunks in parallel, merge their counts into Result() and remove them
+	void Count();
+
+	WordCountPart& Result() { return m_result; }
+
+private:
+	void CountChunk(size_t idx);
+
+	WXMEncoding* m_enc;
+	size_t m_threads;
+
+	std::vector<std::vector<wxByte> > m_chunks;
+	size_t m_chunkcount;
+	std::vector<boost::shared_ptr<WordCountPart> > m_parts;
+	WordCountPart m_result;
+};
+
+} //namespace wxm
+
+#endif //_WXM_WORD_COUNTER_H_
@@ -342,6 +342,18 @@ selection_handler( GtkWidget *WXUNUSED(widget),
 
     if (!data->IsSupportedFormat( format )) return;
 
+    //[mad] render the deferred text now, it's converted to the target by GTK+
+    wxDeferredTextDataObject *deferred = dynamic_cast<wxDeferredTextDataObject*>(data);
+    if (deferred)
+    {
+        std::string utf8;
+        if (!deferred->RenderUTF8(utf8) || utf8.size() > size_t(G_MAXINT))
+            return;
+
+        gtk_selection_data_set_text( selection_data, utf8.data(), gint(utf8.size()) );
+        return;
+    }
+
     int size = data->GetDataSize( format );
 
     if (size == 0) return;
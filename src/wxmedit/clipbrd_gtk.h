@@ -25,6 +25,41 @@
 #include <wx/module.h>
 #include <wx/clipbrd.h>
 
+#include <string>
+
+// ----------------------------------------------------------------------------
+// wxDeferredTextDataObject
+// ----------------------------------------------------------------------------
+
+// wxDeferredTextDataObject is offered in the text formats as soon as it's set,
+// but its text is produced by selection_handler only when the text is requested,
+// then copying a huge text costs nothing until it's pasted
+class wxDeferredTextDataObject : public wxDataObject
+{
+public:
+    // append the text in UTF-8 to utf8, return false if it's not available
+    virtual bool RenderUTF8(std::string &utf8) = 0;
+
+    virtual wxDataFormat GetPreferredFormat(Direction WXUNUSED(dir) = Get) const override
+    {
+        return wxDataFormat(wxDF_UNICODETEXT);
+    }
+    virtual size_t GetFormatCount(Direction dir = Get) const override
+    {
+        return (dir == Get) ? 2 : 0;
+    }
+    virtual void GetAllFormats(wxDataFormat *formats, Direction dir = Get) const override
+    {
+        if (dir != Get) return;
+        formats[0] = wxDataFormat(wxDF_UNICODETEXT);
+        formats[1] = wxDataFormat(wxDF_TEXT);
+    }
+
+    // the text is got by RenderUTF8() only
+    virtual size_t GetDataSize(const wxDataFormat& WXUNUSED(format)) const override { return 0; }
+    virtual bool GetDataHere(const wxDataFormat& WXUNUSED(format), void *WXUNUSED(buf)) const override { return false; }
+};
+
 // ----------------------------------------------------------------------------
 // wxClipboardGtk
 // ----------------------------------------------------------------------------
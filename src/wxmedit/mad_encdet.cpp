@@ -8,6 +8,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "mad_encdet.h"
+#include "../xm/encoding_scan.h"
 
 #ifdef _DEBUG
 #include <crtdbg.h>
@@ -36,8 +37,21 @@ void DetectChineseEncoding(const wxByte *text, size_t len, wxm::WXMEncodingID &e
     size_t cp950=0;
     size_t cp936=0;
 
-    while (i++ < len)
+    while (i < len)
     {
+        // no punctuation mark can be matched in ASCII text, skip it but the last byte
+        if(b1<0x80 && c<0x80)
+        {
+            size_t n = xm::FindNonASCII(text, len-i);
+            if(n > 1)
+            {
+                text += n-1;
+                i += n-1;
+                b1 = c = 0;
+            }
+        }
+
+        ++i;
         b0=b1;
         b1=c;
         c=*text++;
@@ -157,7 +171,14 @@ void DetectJapaneseEncoding(const wxByte *text, size_t len, wxm::WXMEncodingID &
     size_t i=0;
     wxm::WXMEncodingID xenc= wxm::ENC_DEFAULT;
 
-    while (xenc == 0 && i++ < len) {
+    while (xenc == 0) {
+
+        // ASCII chars are the same in Shift_JIS and EUC-JP
+        size_t n = xm::FindNonASCII(text, len-i);
+        text += n;
+        i += n;
+
+        if(i++ >= len) break;
 
         c = *text++;
 
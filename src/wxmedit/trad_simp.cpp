@@ -11540,36 +11540,36 @@ void FreeConvertChineseTable()
     }
 }
 
-int ConvertChinese(const wxChar *in, wxChar *out, size_t count, MadConvertChineseFlag flag)
+ucs2_t *GetConvertTable(MadConvertChineseFlag flag)
 {
-    int converted=0;
-    ucs2_t *table=nullptr;
-
     switch(flag)
     {
     case ccfTrad2Simp:
         BuildConvertTable(Trad2SimpTable, Trad2Simp_Table);
-        table=Trad2SimpTable;
-        break;
+        return Trad2SimpTable;
     case ccfSimp2Trad:
         BuildConvertTable(Simp2TradTable, Simp2Trad_Table);
-        table=Simp2TradTable;
-        break;
+        return Simp2TradTable;
     case ccfKanji2Trad:
         BuildConvertTable(Kanji2TradTable, Kanji2Trad_Table);
-        table=Kanji2TradTable;
-        break;
+        return Kanji2TradTable;
     case ccfKanji2Simp:
         BuildConvertTable(Kanji2SimpTable, Kanji2Simp_Table);
-        table=Kanji2SimpTable;
-        break;
+        return Kanji2SimpTable;
     case ccfChinese2Kanji:
         BuildConvertTable(Chinese2KanjiTable, Chinese2Kanji_Table);
-        table=Chinese2KanjiTable;
-        break;
+        return Chinese2KanjiTable;
     default:
-        return 0;
+        return nullptr;
     }
+}
+
+int ConvertChinese(const wxChar *in, wxChar *out, size_t count, MadConvertChineseFlag flag)
+{
+    int converted=0;
+    ucs2_t *table=GetConvertTable(flag);
+    if(table==nullptr)
+        return 0;
 
     for(size_t i=0; i<count; ++i, ++in, ++out)
     {
@@ -11588,6 +11588,25 @@ int ConvertChinese(const wxChar *in, wxChar *out, size_t count, MadConvertChines
     return converted;
 }
 
+int ConvertChinese(ucs4_t *ucs, size_t count, MadConvertChineseFlag flag)
+{
+    int converted=0;
+    ucs2_t *table=GetConvertTable(flag);
+    if(table==nullptr)
+        return 0;
+
+    for(size_t i=0; i<count; ++i, ++ucs)
+    {
+        if(*ucs >= 0 && *ucs < 65536 && table[ *ucs ] != 0)
+        {
+            *ucs = table[ *ucs ];
+            ++converted;
+        }
+    }
+
+    return converted;
+}
+
 
 void ConvertChineseInClipboard(MadConvertChineseFlag flag)
 {
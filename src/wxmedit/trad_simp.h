@@ -22,6 +22,8 @@ enum MadConvertChineseFlag
 };
 
 int ConvertChinese(const wxChar *in, wxChar *out, size_t count, MadConvertChineseFlag flag);
+// convert in place, return the count of converted chars
+int ConvertChinese(ucs4_t *ucs, size_t count, MadConvertChineseFlag flag);
 void ConvertChineseInClipboard(MadConvertChineseFlag flag);
 void FreeConvertChineseTable();
 
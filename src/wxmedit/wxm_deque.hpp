@@ -12,6 +12,7 @@
 #include "../xm/cxx11.h"
 #include <iterator>
 #include <utility>
+#include <deque>
 #include <cstddef>
 
 #ifdef _MSC_VER
@@ -39,12 +40,14 @@ private:
         T* end;
         buffer* prev;
         buffer* next;
-        buffer(MadDeque<T> *d) :
+        size_type seq;  // sequence number in the chain, increases from front to back
+        buffer(MadDeque<T> *d, size_type s) :
             mdeque(d),
             begin( (T*) operator new(N * sizeof(T)) ),
             end(begin + N),
             prev(nullptr),
-            next(nullptr)
+            next(nullptr),
+            seq(s)
         {
         }
         ~buffer()
@@ -91,30 +94,51 @@ public:
         {
             return (ptr != it.ptr) || (buf != it.buf);
         }
+        bool operator<(const iterator& it) const
+        {
+            return (buf == it.buf) ? (ptr < it.ptr) : (buf->seq < it.buf->seq);
+        }
+        bool operator>(const iterator& it) const
+        {
+            return it < *this;
+        }
+        bool operator<=(const iterator& it) const
+        {
+            return !(it < *this);
+        }
+        bool operator>=(const iterator& it) const
+        {
+            return !(*this < it);
+        }
 
+        // O(1): locate the target buffer by the directory of the deque
         iterator& operator+=(difference_type off)
         {
-            if(off != 0)
+            const difference_type n = difference_type(buffer::N);
+            difference_type idx = (ptr - buf->begin) + off;
+            if(idx >= 0 && idx < n)
             {
-                do
-                {
-                    ++(*this);
-                }
-                while(--off > 0);
+                ptr += off;
+                return *this;
             }
+
+            difference_type boff = (idx >= 0) ? (idx / n) : -((-idx - 1) / n) - 1;
+            buf = buf->mdeque->get_buffer(buf, boff);
+            ptr = buf->begin + (idx - boff * n);
             return *this;
         }
         iterator& operator-=(difference_type off)
         {
-            if(off != 0)
-            {
-                do
-                {
-                    --(*this);
-                }
-                while(--off > 0);
-            }
-            return *this;
+            return *this += -off;
+        }
+        difference_type operator-(const iterator& it) const
+        {
+            return (difference_type(buf->seq) - difference_type(it.buf->seq)) * difference_type(buffer::N)
+                + (ptr - buf->begin) - (it.ptr - it.buf->begin);
+        }
+        reference operator[](difference_type off) const
+        {
+            return *(*this + off);
         }
 
         // pre-increment operator
@@ -158,11 +182,16 @@ public:
             return it;
         }
 
-        iterator operator+(difference_type off)
+        iterator operator+(difference_type off) const
         {
             iterator it = *this;
-            if(off>=0) it += off;
-            else       it -= (-off);
+            it += off;
+            return it;
+        }
+        iterator operator-(difference_type off) const
+        {
+            iterator it = *this;
+            it += -off;
             return it;
         }
     };
@@ -170,6 +199,7 @@ public:
 private:
     size_type m_size;
     buffer *m_first_buffer, *m_last_buffer;
+    std::deque<buffer*> m_buffers; // directory of the buffer chain, m_buffers[i]->seq == m_first_buffer->seq + i
     iterator m_begin_iterator, m_end_iterator;
 
 public:
@@ -178,10 +208,11 @@ public:
     // buffer methods
     void add_buffer_back()
     {
-        buffer *tmp = new buffer(this);
+        buffer *tmp = new buffer(this, m_last_buffer->seq + 1);
         tmp->prev = m_last_buffer;
         m_last_buffer->next = tmp;
         m_last_buffer = tmp;
+        m_buffers.push_back(tmp);
     }
     void delete_first_buffer()
     {
@@ -191,6 +222,7 @@ public:
             delete m_first_buffer;
             m_first_buffer = tmp;
             m_first_buffer->prev = nullptr;
+            m_buffers.pop_front();
         }
     }
     void free_buffer()
@@ -203,46 +235,23 @@ public:
             m_first_buffer = tmp;
         }while(m_first_buffer != nullptr);
         m_last_buffer = nullptr;
+        m_buffers.clear();
     }
-    pointer get_pointer(size_type index) const
+    // get the buffer off buffers after b, append buffers if necessary like iterator::operator++
+    buffer* get_buffer(buffer *b, difference_type off)
     {
-        //assert(index<m_size)
-        if(index <= m_size/2) // from begin
-        {
-            buffer *buf = m_begin_iterator.buf;
-            T* ptr = m_begin_iterator.ptr;
-            size_type count = buf->end - ptr;
-            while(index >= count)
-            {
-                buf = buf->next;
-                ptr = buf->begin;
-                index -= count;
-                count = buffer::N;
-            }
-            return ptr + index;
-        }
-
-        // from end
-        index = m_size - index;
-        buffer *buf = m_end_iterator.buf;
-        T* ptr = buf->begin;
-        if(buf == m_begin_iterator.buf)
+        size_type idx = size_type(difference_type(b->seq - m_first_buffer->seq) + off);
+        //assert(difference_type(idx) >= 0)
+        while(idx >= m_buffers.size())
         {
-            ptr = m_begin_iterator.ptr;
-        }
-        size_type count = m_end_iterator.ptr - ptr;
-        while(index > count)
-        {
-            buf = buf->prev;
-            ptr = buf->begin;
-            if(buf == m_begin_iterator.buf)
-            {
-                ptr = m_begin_iterator.ptr;
-            }
-            index -= count;
-            count = buf->end - ptr;
+            add_buffer_back();
         }
-        return ptr + (count - index);
+        return m_buffers[idx];
+    }
+    pointer get_pointer(size_type index) const
+    {
+        //assert(index<m_size)
+        return &*(m_begin_iterator + difference_type(index));
     }
 
 private:
@@ -263,16 +272,18 @@ private:
 public:
     MadDeque() :
         m_size(0),
-        m_first_buffer(new buffer(this)),
+        m_first_buffer(new buffer(this, 0)),
         m_last_buffer(m_first_buffer),
+        m_buffers(1, m_first_buffer),
         m_begin_iterator(iterator(m_first_buffer, m_first_buffer->begin)),
         m_end_iterator(m_begin_iterator)
     {
     }
     MadDeque(const MadDeque& d) :
         m_size(0),
-        m_first_buffer(new buffer(this)),
+        m_first_buffer(new buffer(this, 0)),
         m_last_buffer(m_first_buffer),
+        m_buffers(1, m_first_buffer),
         m_begin_iterator(iterator(m_first_buffer, m_first_buffer->begin)),
         m_end_iterator(m_begin_iterator)
     {
@@ -0,0 +1,485 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4 expandtab
+// Name:        wxmedit/wxm_line_index.hpp
+// Description: Balanced Line Index for Row/Position/Line Lookup
+// Copyright:   2013-2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WXM_LINE_INDEX_HPP_
+#define _WXM_LINE_INDEX_HPP_
+
+#include "../xm/cxx11.h"
+#include <vector>
+#include <cstddef>
+
+// the link from a line to its node in MadLineIndex
+struct MadLineIndexHook
+{
+protected:
+    MadLineIndexHook() {}
+};
+
+// MadLineIndex is a treap over the lines of a document in document order.
+// Every node caches the byte-size and the row count of its line and the sums
+// of its subtree, so that row->line, pos->line, line->pos and line->lineid
+// lookups are O(log n), and so are inserting, erasing and updating a line.
+// A line may also carry a mark (a bookmark), the marks are counted in the
+// subtrees too, so the n-th mark and the marks before a line are O(log n).
+//
+// Traits must provide:
+//   typedef ... offset_type;
+//   static offset_type Size(const LineIter&);
+//   static size_t RowCount(const LineIter&);
+//   static MadLineIndexHook*& Hook(const LineIter&);
+template <typename LineIter, typename Traits>
+class MadLineIndex
+{
+public:
+    typedef typename Traits::offset_type offset_type;
+
+private:
+    struct Node : public MadLineIndexHook
+    {
+        LineIter line;
+        offset_type size, sum_size;
+        size_t rows, sum_rows;
+        size_t count;               // lines in subtree
+        size_t marked, sum_marked;  // marked is 0 or 1
+        unsigned int priority;
+        Node *left, *right, *parent;
+
+        Node(const LineIter& lit, unsigned int prio)
+            : line(lit), size(Traits::Size(lit)), sum_size(size)
+            , rows(Traits::RowCount(lit)), sum_rows(rows), count(1)
+            , marked(0), sum_marked(0)
+            , priority(prio), left(nullptr), right(nullptr), parent(nullptr)
+        {
+        }
+    };
+
+    Node *m_root;
+    unsigned int m_seed;
+
+    static Node* ToNode(MadLineIndexHook* hook) { return static_cast<Node*>(hook); }
+
+    static offset_type SumSize(const Node* n) { return n ? n->sum_size : 0; }
+    static size_t SumRows(const Node* n) { return n ? n->sum_rows : 0; }
+    static size_t Count(const Node* n) { return n ? n->count : 0; }
+    static size_t SumMarked(const Node* n) { return n ? n->sum_marked : 0; }
+
+    static void Pull(Node* n)
+    {
+        n->sum_size = n->size + SumSize(n->left) + SumSize(n->right);
+        n->sum_rows = n->rows + SumRows(n->left) + SumRows(n->right);
+        n->count = 1 + Count(n->left) + Count(n->right);
+        n->sum_marked = n->marked + SumMarked(n->left) + SumMarked(n->right);
+    }
+    static void PullUp(Node* n)
+    {
+        for(; n != nullptr; n = n->parent)
+            Pull(n);
+    }
+
+    unsigned int NextPriority()
+    {
+        // xorshift32
+        m_seed ^= m_seed << 13;
+        m_seed ^= m_seed >> 17;
+        m_seed ^= m_seed << 5;
+        return m_seed;
+    }
+
+    void ReplaceChild(Node* parent, Node* oldchild, Node* newchild)
+    {
+        if(parent == nullptr)
+            m_root = newchild;
+        else if(parent->left == oldchild)
+            parent->left = newchild;
+        else
+            parent->right = newchild;
+
+        if(newchild != nullptr)
+            newchild->parent = parent;
+    }
+
+    // move n above its parent, the sums of the ancestors are not changed
+    void RotateUp(Node* n)
+    {
+        Node* p = n->parent;
+        Node* g = p->parent;
+
+        if(p->left == n)
+        {
+            p->left = n->right;
+            if(p->left) p->left->parent = p;
+            n->right = p;
+        }
+        else
+        {
+            p->right = n->left;
+            if(p->right) p->right->parent = p;
+            n->left = p;
+        }
+        p->parent = n;
+        ReplaceChild(g, p, n);
+
+        Pull(p);
+        Pull(n);
+    }
+
+    static Node* Rightmost(Node* n)
+    {
+        while(n->right != nullptr) n = n->right;
+        return n;
+    }
+
+public:
+    MadLineIndex() : m_root(nullptr), m_seed(2463534242U)
+    {
+    }
+    ~MadLineIndex()
+    {
+        Clear();
+    }
+
+    bool Empty() const { return m_root == nullptr; }
+    size_t LineCount() const { return Count(m_root); }
+    size_t RowCount() const { return SumRows(m_root); }
+    offset_type Size() const { return SumSize(m_root); }
+    size_t MarkCount() const { return SumMarked(m_root); }
+
+    void Clear()
+    {
+        std::vector<Node*> stack;
+        if(m_root) stack.push_back(m_root);
+        while(!stack.empty())
+        {
+            Node* n = stack.back();
+            stack.pop_back();
+            if(n->left) stack.push_back(n->left);
+            if(n->right) stack.push_back(n->right);
+            Traits::Hook(n->line) = nullptr;
+            delete n;
+        }
+        m_root = nullptr;
+    }
+
+    // insert lit before next, or at the end if next has no node
+    void Insert(const LineIter& lit, MadLineIndexHook* next)
+    {
+        Node* n = new Node(lit, NextPriority());
+        Traits::Hook(lit) = n;
+
+        if(m_root == nullptr)
+        {
+            m_root = n;
+            return;
+        }
+
+        Node* p;
+        Node* nx = ToNode(next);
+        if(nx == nullptr)
+        {
+            p = Rightmost(m_root);
+            p->right = n;
+        }
+        else if(nx->left == nullptr)
+        {
+            p = nx;
+            p->left = n;
+        }
+        else
+        {
+            p = Rightmost(nx->left);
+            p->right = n;
+        }
+        n->parent = p;
+        PullUp(p);
+
+        while(n->parent != nullptr && n->priority > n->parent->priority)
+            RotateUp(n);
+    }
+
+    void Erase(const LineIter& lit)
+    {
+        Node* n = ToNode(Traits::Hook(lit));
+        if(n == nullptr)
+            return;
+
+        // rotate n down to a leaf
+        while(n->left != nullptr || n->right != nullptr)
+        {
+            Node* c;
+            if(n->left == nullptr)       c = n->right;
+            else if(n->right == nullptr) c = n->left;
+            else c = (n->left->priority > n->right->priority) ? n->left : n->right;
+            RotateUp(c);
+        }
+
+        Node* p = n->parent;
+        ReplaceChild(p, n, nullptr);
+        PullUp(p);
+
+        Traits::Hook(lit) = nullptr;
+        delete n;
+    }
+
+    // the size or the rows of lit were changed
+    void Update(const LineIter& lit)
+    {
+        Node* n = ToNode(Traits::Hook(lit));
+        if(n == nullptr)
+            return;
+
+        n->size = Traits::Size(lit);
+        n->rows = Traits::RowCount(lit);
+        PullUp(n);
+    }
+
+    // the sizes or the rows of many lines were changed
+    void UpdateAll()
+    {
+        if(m_root == nullptr)
+            return;
+
+        // post-order traversal
+        std::vector<Node*> stack, order;
+        stack.push_back(m_root);
+        while(!stack.empty())
+        {
+            Node* n = stack.back();
+            stack.pop_back();
+            order.push_back(n);
+            if(n->left) stack.push_back(n->left);
+            if(n->right) stack.push_back(n->right);
+        }
+
+        for(typename std::vector<Node*>::reverse_iterator it = order.rbegin(); it != order.rend(); ++it)
+        {
+            Node* n = *it;
+            n->size = Traits::Size(n->line);
+            n->rows = Traits::RowCount(n->line);
+            Pull(n);
+        }
+    }
+
+    // get lineid, first rowid and position of lit
+    void Locate(const LineIter& lit, size_t& lineid, size_t& rowid, offset_type& pos) const
+    {
+        Node* n = ToNode(Traits::Hook(lit));
+
+        lineid = Count(n->left);
+        rowid = SumRows(n->left);
+        pos = SumSize(n->left);
+
+        for(Node* p = n->parent; p != nullptr; n = p, p = p->parent)
+        {
+            if(p->right == n)
+            {
+                lineid += Count(p->left) + 1;
+                rowid += SumRows(p->left) + p->rows;
+                pos += SumSize(p->left) + p->size;
+            }
+        }
+    }
+
+    // IN:  lineid; OUT: lit, first rowid and position of the line
+    void FindByLine(size_t lineid, LineIter& lit, size_t& rowid, offset_type& pos) const
+    {
+        Node* n = m_root;
+        rowid = 0;
+        pos = 0;
+
+        if(lineid >= Count(n))
+            lineid = Count(n) - 1;
+
+        while(true)
+        {
+            size_t lc = Count(n->left);
+            if(lineid < lc)
+            {
+                n = n->left;
+                continue;
+            }
+
+            rowid += SumRows(n->left);
+            pos += SumSize(n->left);
+            if(lineid == lc)
+                break;
+
+            lineid -= lc + 1;
+            rowid += n->rows;
+            pos += n->size;
+            n = n->right;
+        }
+
+        lit = n->line;
+    }
+
+    // IN:  rowid; OUT: lit, lineid, first rowid and position of the line
+    void FindByRow(size_t rowid, LineIter& lit, size_t& lineid, size_t& rowid0, offset_type& pos) const
+    {
+        if(rowid >= SumRows(m_root))
+        {
+            Last(lit, lineid, rowid0, pos);
+            return;
+        }
+
+        Node* n = m_root;
+        lineid = 0;
+        rowid0 = 0;
+        pos = 0;
+
+        while(true)
+        {
+            size_t lr = SumRows(n->left);
+            if(rowid < lr)
+            {
+                n = n->left;
+                continue;
+            }
+
+            lineid += Count(n->left);
+            rowid0 += lr;
+            pos += SumSize(n->left);
+            rowid -= lr;
+            if(rowid < n->rows)
+                break;
+
+            rowid -= n->rows;
+            ++lineid;
+            rowid0 += n->rows;
+            pos += n->size;
+            n = n->right;
+        }
+
+        lit = n->line;
+    }
+
+    // IN:  pos; OUT: lit, lineid, first rowid and position of the line
+    // a position beyond the last newline belongs to the last line
+    void FindByPos(offset_type pos, LineIter& lit, size_t& lineid, size_t& rowid, offset_type& pos0) const
+    {
+        if(pos >= SumSize(m_root))
+        {
+            Last(lit, lineid, rowid, pos0);
+            return;
+        }
+
+        Node* n = m_root;
+        lineid = 0;
+        rowid = 0;
+        pos0 = 0;
+
+        while(true)
+        {
+            offset_type ls = SumSize(n->left);
+            if(pos < ls)
+            {
+                n = n->left;
+                continue;
+            }
+
+            lineid += Count(n->left);
+            rowid += SumRows(n->left);
+            pos0 += ls;
+            pos -= ls;
+            if(pos < n->size)
+                break;
+
+            pos -= n->size;
+            ++lineid;
+            rowid += n->rows;
+            pos0 += n->size;
+            n = n->right;
+        }
+
+        lit = n->line;
+    }
+
+    bool Marked(const LineIter& lit) const
+    {
+        Node* n = ToNode(Traits::Hook(lit));
+        return n != nullptr && n->marked != 0;
+    }
+
+    void SetMark(const LineIter& lit, bool mark)
+    {
+        Node* n = ToNode(Traits::Hook(lit));
+        if(n == nullptr || (n->marked != 0) == mark)
+            return;
+
+        n->marked = mark ? 1 : 0;
+        PullUp(n);
+    }
+
+    // only the subtrees with marks are visited
+    void ClearMarks()
+    {
+        std::vector<Node*> stack;
+        if(SumMarked(m_root) != 0) stack.push_back(m_root);
+        while(!stack.empty())
+        {
+            Node* n = stack.back();
+            stack.pop_back();
+            if(SumMarked(n->left) != 0) stack.push_back(n->left);
+            if(SumMarked(n->right) != 0) stack.push_back(n->right);
+            n->marked = 0;
+            n->sum_marked = 0;
+        }
+    }
+
+    // the marks of the lines before lit
+    size_t CountMarksBefore(const LineIter& lit) const
+    {
+        Node* n = ToNode(Traits::Hook(lit));
+        size_t marks = SumMarked(n->left);
+
+        for(Node* p = n->parent; p != nullptr; n = p, p = p->parent)
+        {
+            if(p->right == n)
+                marks += SumMarked(p->left) + p->marked;
+        }
+        return marks;
+    }
+
+    // IN:  markid, less than MarkCount(); OUT: lit and lineid of the marked line
+    void FindByMark(size_t markid, LineIter& lit, size_t& lineid) const
+    {
+        Node* n = m_root;
+        lineid = 0;
+
+        while(true)
+        {
+            size_t lm = SumMarked(n->left);
+            if(markid < lm)
+            {
+                n = n->left;
+                continue;
+            }
+
+            lineid += Count(n->left);
+            markid -= lm;
+            if(markid < n->marked)
+                break;
+
+            markid -= n->marked;
+            ++lineid;
+            n = n->right;
+        }
+
+        lit = n->line;
+    }
+
+    void Last(LineIter& lit, size_t& lineid, size_t& rowid, offset_type& pos) const
+    {
+        Node* n = Rightmost(m_root);
+        lit = n->line;
+        lineid = Count(m_root) - 1;
+        rowid = SumRows(m_root) - n->rows;
+        pos = SumSize(m_root) - n->size;
+    }
+};
+
+#endif //_WXM_LINE_INDEX_HPP_
@@ -12,6 +12,7 @@
 #include "../wxm/encoding/encoding.h"
 #include "../wxm/encdet.h"
 #include "../wxm/def.h"
+#include "../xm/trace.h"
 #include "mad_encdet.h"
 #include "wxm_syntax.h"
 #include "wxmedit.h"
@@ -22,6 +23,7 @@
 #endif
 // disable 4996 {
 #include <wx/filename.h>
+#include <wx/timer.h>
 // disable 4996 }
 #ifdef _MSC_VER
 # pragma warning( pop )
@@ -31,6 +33,22 @@
 
 #include <algorithm>
 
+#ifdef __WXMSW__
+# include <wx/msw/wrapwin.h>
+# include <io.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <signal.h>
+# include <unistd.h>
+#endif
+#ifdef __linux__
+# include <sys/sendfile.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# include <errno.h>
+#endif
+
 #ifdef _DEBUG
 #include <crtdbg.h>
 #define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
@@ -44,6 +62,17 @@ const wxFileOffset BUFFER_BASE_MASK = wxFileOffset(-1) << BUFFER_BITS;
                                     //wxFileOffset(-1) -  BUFFER_MASK;
 
 #define NEXTUCHAR_BUFFER_SIZE (1024 * 10)
+#define NEXTUCHAR_DECODE_MIN 16
+#define NEXTUCHAR_DECODE_MAX 1024
+
+// files not smaller than this are mapped into memory by MadFileData
+const wxFileOffset MMAP_MIN_SIZE = BUFFER_SIZE * 4;   // 1MB
+
+const size_t STALE_REFORMAT_CHUNK = 1024;   // lines reformatted by ReformatStaleLines() between time checks
+
+// text files larger than this are split into lines lazily, see MadLines::IndexTail()
+const wxFileOffset LAZY_INDEX_MIN_SIZE = 16 * 1024 * 1024;
+const wxFileOffset TAIL_INDEX_CHUNK = 1024 * 1024;   // bytes split out of the unindexed tail at least
 
 //===========================================================================
 // MadFileNameIsUTF8, MadDirExists, MadConvFileName_WC2MB_UseLibc
@@ -373,11 +402,159 @@ wxFileOffset MadMemData::Put(wxByte * buffer, size_t size)
     return pos;
 }
 
+void MadMemData::Compact(const MadLiveRanges &live)
+{
+    XM_TRACE_SCOPE("MadMemData::Compact");
+
+    vector <wxByte*> oldbufs;
+    oldbufs.swap(m_Buffers);
+    m_Size = 0;
+
+    // the new buffers are filled no faster than the old ones are passed,
+    // so at most a buffer more is allocated than before
+    size_t freed = 0;   // the old buffers before it have been freed
+    for(size_t i = 0; i < live.Count(); ++i)
+    {
+        wxASSERT(live[i].packed == m_Size);
+
+        wxFileOffset pos = live[i].pos, rest = live[i].size;
+        while(rest > 0)
+        {
+            size_t buf = size_t(pos >> BUFFER_BITS);    //pos / BUFFER_SIZE;
+            int idx = int(pos & BUFFER_MASK);           //pos % BUFFER_SIZE;
+            wxASSERT(buf < oldbufs.size());
+
+            for(; freed < buf; ++freed)
+            {
+                delete []oldbufs[freed];
+                oldbufs[freed] = nullptr;
+            }
+
+            size_t size = size_t(std::min(rest, wxFileOffset(BUFFER_SIZE - idx)));
+            Put(oldbufs[buf] + idx, size);
+            pos += size;
+            rest -= size;
+        }
+    }
+
+    for(; freed < oldbufs.size(); ++freed)
+        delete []oldbufs[freed];
+}
+
+wxFileOffset MadMemData::GetAllocatedSize()
+{
+    return wxFileOffset(m_Buffers.size()) * BUFFER_SIZE;
+}
+
 
 //===========================================================================
 // MadFileData
 //===========================================================================
 
+#ifndef __WXMSW__
+namespace
+{
+    // reading the mapped pages beyond the end of a file truncated by another application
+    // raises SIGBUS, the handler replaces these pages with zero-filled ones, as the bytes
+    // are lost anyway, and marks the mapping damaged for VerifyMapping()
+    struct MappedRange
+    {
+        wxByte *volatile addr;
+        volatile size_t size;
+        volatile sig_atomic_t damaged;
+    };
+
+    const size_t MAX_MAPPED_RANGES = 64;
+    MappedRange g_MappedRanges[MAX_MAPPED_RANGES];
+    size_t g_PageSize = 0;
+    struct sigaction g_OldSigBusAction;
+    volatile sig_atomic_t g_SigBusHandlerInstalled = 0;
+
+    void MappedRangeSigBusHandler(int sig, siginfo_t *info, void *context)
+    {
+        wxByte *fault = (wxByte*)info->si_addr;
+        for(size_t i=0; i<MAX_MAPPED_RANGES; ++i)
+        {
+            MappedRange &mr = g_MappedRanges[i];
+            wxByte *addr = mr.addr;
+            if(addr == nullptr || fault < addr || fault >= addr + mr.size)
+                continue;
+
+            wxByte *page = addr + (size_t(fault - addr) & ~(g_PageSize - 1));
+            size_t size = mr.size - size_t(page - addr);
+            // POSIX does not list mmap() as async-signal-safe, this relies on Linux,
+            // where it is a plain system call
+            if(mmap(page, size, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED)
+                break;
+
+            mr.damaged = 1;
+            return; // the faulting read is restarted
+        }
+
+        // not ours, pass it to the previous handler
+        if((g_OldSigBusAction.sa_flags & SA_SIGINFO) && g_OldSigBusAction.sa_sigaction != nullptr)
+        {
+            g_OldSigBusAction.sa_sigaction(sig, info, context);
+            return;
+        }
+        if(!(g_OldSigBusAction.sa_flags & SA_SIGINFO) &&
+           g_OldSigBusAction.sa_handler != SIG_DFL && g_OldSigBusAction.sa_handler != SIG_IGN)
+        {
+            g_OldSigBusAction.sa_handler(sig);
+            return;
+        }
+
+        // the default action or ignored, restore it and raise the signal again,
+        // it is delivered after returning; RegisterMappedRange() reinstalls this handler
+        g_SigBusHandlerInstalled = 0;
+        sigaction(sig, &g_OldSigBusAction, nullptr);
+        raise(sig);
+    }
+
+    // return false if the range cannot be guarded, then it must not be mapped
+    bool RegisterMappedRange(wxByte *addr, size_t size)
+    {
+        if(!g_SigBusHandlerInstalled)
+        {
+            g_PageSize = size_t(sysconf(_SC_PAGESIZE));
+
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_sigaction = MappedRangeSigBusHandler;
+            sa.sa_flags = SA_SIGINFO;
+            sigemptyset(&sa.sa_mask);
+            if(sigaction(SIGBUS, &sa, &g_OldSigBusAction) != 0)
+                return false;
+
+            g_SigBusHandlerInstalled = 1;
+        }
+
+        for(size_t i=0; i<MAX_MAPPED_RANGES; ++i)
+        {
+            MappedRange &mr = g_MappedRanges[i];
+            if(mr.addr != nullptr)
+                continue;
+
+            mr.size = size;
+            mr.damaged = 0;
+            mr.addr = addr;
+            return true;
+        }
+        return false;
+    }
+
+    MappedRange *FindMappedRange(wxByte *addr)
+    {
+        for(size_t i=0; i<MAX_MAPPED_RANGES; ++i)
+        {
+            if(g_MappedRanges[i].addr == addr)
+                return &g_MappedRanges[i];
+        }
+        return nullptr;
+    }
+}
+#endif
+
 MadFileData::MadFileData(const wxString &name)
 {
     m_Name = name;
@@ -386,6 +563,11 @@ MadFileData::MadFileData(const wxString &name)
     m_ReadOnly = false;
     m_Buffer1 = nullptr;
     m_Buffer2 = nullptr;
+    m_Map = nullptr;
+    m_MapSize = 0;
+#ifdef __WXMSW__
+    m_MapHandle = nullptr;
+#endif
 
     int utf8test=MadFileNameIsUTF8(name);
 
@@ -416,11 +598,14 @@ MadFileData::MadFileData(const wxString &name)
         size_t size = BUFFER_SIZE;
         if(BUFFER_SIZE > m_Size) size = size_t(m_Size);
         m_File.Read(m_Buffer1, size);
+
+        Map();
     }
 }
 
 MadFileData::~MadFileData()
 {
+    Unmap();
     if(m_File.IsOpened())   m_File.Close();
     if(m_Buffer1)       delete []m_Buffer1;
     if(m_Buffer2)       delete []m_Buffer2;
@@ -430,6 +615,9 @@ wxByte MadFileData::Get(const wxFileOffset &pos)
 {
     wxASSERT((pos >= 0) && (pos < m_Size));
 
+    if(pos < m_MapSize)
+        return m_Map[(size_t)pos];
+
     wxFileOffset idx;
     if(m_Buf1Pos>=0)
     {
@@ -476,6 +664,12 @@ void MadFileData::Get(const wxFileOffset &pos, wxByte * buffer, size_t size)
 {
     wxASSERT((pos >= 0) && (size > 0) && ((pos + size) <= m_Size));
 
+    if(wxFileOffset(pos + size) <= m_MapSize)
+    {
+        memcpy(buffer, m_Map+(size_t)pos, size);
+        return;
+    }
+
     wxFileOffset idx;
     if(m_Buf1Pos>=0)
     {
@@ -531,6 +725,8 @@ void MadFileData::Get(const wxFileOffset &pos, wxByte * buffer, size_t size)
 
 wxFileOffset MadFileData::Put(wxByte *buffer, size_t size)
 {
+    Unmap();
+
     wxFileOffset pos=m_SavePos;
 
     m_File.Seek(m_SavePos);
@@ -571,6 +767,7 @@ bool MadFileData::Rename(const wxString &name)
 {
     //wxASSERT(handle_ != INVALID_HANDLE_VALUE);
 
+    Unmap();
     m_File.Close();
 
     MadConvFileName_WC2MB_UseLibc uselibc(MadFileNameIsUTF8(m_Name)<0);
@@ -587,6 +784,95 @@ bool MadFileData::Rename(const wxString &name)
     return false;
 }
 
+bool MadFileData::Map()
+{
+    Unmap();
+
+    if(m_Size < MMAP_MIN_SIZE || !m_File.IsOpened())
+        return false;
+
+    // the file cannot be mapped into the address space at once
+    if(wxFileOffset(size_t(m_Size)) != m_Size)
+        return false;
+
+#ifdef __WXMSW__
+    HANDLE file = (HANDLE)_get_osfhandle(m_File.fd());
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+
+    HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr)
+        return false;
+
+    void *addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size_t(m_Size));
+    if(addr == nullptr)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    m_MapHandle = mapping;
+#else
+    void *addr = mmap(nullptr, size_t(m_Size), PROT_READ, MAP_SHARED, m_File.fd(), 0);
+    if(addr == MAP_FAILED)
+        return false;
+
+    if(!RegisterMappedRange((wxByte*)addr, size_t(m_Size)))
+    {
+        munmap(addr, size_t(m_Size));
+        return false;
+    }
+#endif
+
+    m_Map = (wxByte*)addr;
+    m_MapSize = m_Size;
+    return true;
+}
+
+void MadFileData::Unmap()
+{
+    if(m_Map == nullptr)
+        return;
+
+#ifdef __WXMSW__
+    UnmapViewOfFile(m_Map);
+    CloseHandle((HANDLE)m_MapHandle);
+    m_MapHandle = nullptr;
+#else
+    FindMappedRange(m_Map)->addr = nullptr;
+    munmap(m_Map, size_t(m_MapSize));
+#endif
+
+    m_Map = nullptr;
+    m_MapSize = 0;
+}
+
+void MadFileData::Refresh()
+{
+    m_Buf1Pos = -1;
+    m_Buf2Pos = -1;
+
+    Map();
+}
+
+void MadFileData::VerifyMapping()
+{
+    if(m_Map == nullptr)
+        return;
+
+#ifndef __WXMSW__
+    // the pages beyond the end of a truncated file have been or will be replaced by zero-filled
+    // ones, a mapped file cannot be truncated under Windows
+    struct stat st;
+    if(!FindMappedRange(m_Map)->damaged && fstat(m_File.fd(), &st) == 0 && wxFileOffset(st.st_size) >= m_MapSize)
+        return;
+
+    Unmap();
+    m_Buf1Pos = -1;
+    m_Buf2Pos = -1;
+#endif
+}
+
 
 //===========================================================================
 // MadLine
@@ -641,7 +927,7 @@ bool MadLine::FirstUCharIs0x0A(wxm::WXMEncoding *encoding)
 //===========================================================================
 
 MadLines::MadLines(MadEdit *madedit)
-    : m_manual(false)
+    : m_Generation(0), m_HasStaleLines(false), m_StaleLineHint(0), m_TailNewLineUnit(xm::nluNone), m_manual(false)
 {
     m_MadEdit = madedit;
     m_Syntax = madedit->m_Syntax;
@@ -658,17 +944,27 @@ MadLines::MadLines(MadEdit *madedit)
     m_TmpFileData = nullptr;
 
     m_MemData = new MadMemData();
+    m_MemDataPins = 0;
 
     m_WriteBuffer=nullptr;
+    m_WriteBufferUsed=0;
 
     m_NextUChar_Buffer = new wxByte[NEXTUCHAR_BUFFER_SIZE+10];
     m_NextUChar_BufferLoadNew=true;
     m_NextUChar_BufferStart=0;
     m_NextUChar_BufferSize=0;
+
+    m_NextUChar_UCs = new ucs4_t[NEXTUCHAR_DECODE_MAX];
+    m_NextUChar_Lens = new wxByte[NEXTUCHAR_DECODE_MAX];
+    m_NextUChar_DecodedStart=0;
+    m_NextUChar_DecodedCount=0;
+    m_NextUChar_DecodeBatch=NEXTUCHAR_DECODE_MIN;
 }
 
 MadLines::~MadLines(void)
 {
+    MadEdit::RenderDeferredClipboardText(this);
+
     // clear all lines
     Empty(true);
 
@@ -686,15 +982,23 @@ MadLines::~MadLines(void)
         delete m_MemData;
 
     delete []m_NextUChar_Buffer;
+    delete []m_NextUChar_UCs;
+    delete []m_NextUChar_Lens;
 }
 
 
 void MadLines::Empty(bool freeAll)
 {
+    ++m_Generation;
+
     m_Size = 0;
     m_LineCount = 0;
     m_RowCount = 0;
 
+    m_HasStaleLines = false;
+    m_StaleLineHint = 0;
+    m_TailNewLineUnit = xm::nluNone;
+
     MadLineIterator iter, end;
     iter = m_LineList.begin();
     end = m_LineList.end();
@@ -708,6 +1012,7 @@ void MadLines::Empty(bool freeAll)
 
         // reserve one empty line
         iter->Empty();
+        m_LineList.UpdateIndex(iter);
         // to second line
         ++iter;
 
@@ -728,6 +1033,8 @@ void MadLines::Empty(bool freeAll)
 
 void MadLines::Clear(bool freeAll)
 {
+    MadEdit::RenderDeferredClipboardText(this);
+
     Empty(freeAll);
 
     m_Name = wxT("");
@@ -751,9 +1058,106 @@ void MadLines::Clear(bool freeAll)
     m_MemData->Reset();
 }
 
+// collect the ranges of data referred to by the blocks
+struct MadLiveRangeCollector: public MadBlockVisitor
+{
+    MadLiveRangeCollector(MadMemData *data, MadLiveRanges &live): m_Data(data), m_Live(live) {}
+
+    virtual void Visit(MadBlockVector &blocks) override
+    {
+        for(MadBlockIterator it = blocks.begin(); it != blocks.end(); ++it)
+        {
+            if(it->m_Data == m_Data)
+                m_Live.Add(it->m_Pos, it->m_Size);
+        }
+    }
+
+private:
+    MadMemData *m_Data;
+    MadLiveRanges &m_Live;
+};
+
+// move the blocks referring to data to the packed positions of their data
+struct MadBlockRemapper: public MadBlockVisitor
+{
+    MadBlockRemapper(MadMemData *data, const MadLiveRanges &live): m_Data(data), m_Live(live) {}
+
+    virtual void Visit(MadBlockVector &blocks) override
+    {
+        for(MadBlockIterator it = blocks.begin(); it != blocks.end(); ++it)
+        {
+            if(it->m_Data == m_Data)
+                it->m_Pos = (it->m_Size > 0) ? m_Live.Map(it->m_Pos) : 0;
+        }
+    }
+
+private:
+    MadMemData *m_Data;
+    const MadLiveRanges &m_Live;
+};
+
+void MadLines::VisitBlocks(MadBlockVisitor &visitor)
+{
+    for(MadLineIterator lit = m_LineList.begin(); lit != m_LineList.end(); ++lit)
+        visitor.Visit(lit->m_Blocks);
+
+    m_MadEdit->m_UndoBuffer->VisitBlocks(visitor);
+    MadEdit::VisitDeferredClipboardBlocks(this, visitor);
+}
+
+void MadLines::CollectLiveMemData(MadLiveRanges &live)
+{
+    MadLiveRangeCollector collector(m_MemData, live);
+    VisitBlocks(collector);
+    live.Pack();
+
+    m_MemDataStats.m_Live = live.LiveSize();
+    m_MemDataStats.m_Dead = m_MemData->GetSize() - live.LiveSize();
+    m_MemDataStats.m_Allocated = m_MemData->GetAllocatedSize();
+}
+
+const MadMemDataStats &MadLines::CountMemData()
+{
+    XM_TRACE_SCOPE("MadLines::CountMemData");
+
+    MadLiveRanges live;
+    CollectLiveMemData(live);
+    return m_MemDataStats;
+}
+
+bool MadLines::CompactMemData(wxFileOffset minFree)
+{
+    if(m_MemDataPins != 0)
+        return false;
+
+    XM_TRACE_SCOPE("MadLines::CompactMemData");
+
+    MadLiveRanges live;
+    CollectLiveMemData(live);
+
+    // the live bytes are packed into whole buffers
+    wxFileOffset needed = (live.LiveSize() + BUFFER_MASK) & BUFFER_BASE_MASK;
+    wxFileOffset tofree = m_MemDataStats.m_Allocated - needed;
+    if(tofree <= 0 || tofree < minFree || tofree < live.LiveSize())
+        return false;
+
+    m_MemData->Compact(live);
+
+    MadBlockRemapper remapper(m_MemData, live);
+    VisitBlocks(remapper);
+
+    wxFileOffset allocated = m_MemData->GetAllocatedSize();
+    m_MemDataStats.m_Dead = 0;
+    m_MemDataStats.m_Reclaimed += m_MemDataStats.m_Allocated - allocated;
+    m_MemDataStats.m_Allocated = allocated;
+    ++m_MemDataStats.m_Compactions;
+    return true;
+}
+
 void MadLines::SetEncoding(wxm::WXMEncoding *encoding)
 {
     m_Encoding=encoding;
+    ++m_Generation;
 }
 
 ucs4_t MadLines::GetNewLine(const MadLineIterator &iter)
@@ -802,6 +1206,8 @@ void MadLines::LoadNewBuffer()
 
 void MadLines::InitNextUChar(const MadLineIterator &iter, const wxFileOffset pos)
 {
+    UndoDecodedUChars();
+
     m_NextUChar_LineIter = iter;
     m_NextUChar_Pos = pos;
     m_NextUChar_LineSize = iter->m_Size;
@@ -849,13 +1255,70 @@ wxByte* MadLines::BufferLoadBytes(wxFileOffset& rest, size_t buf_len)
     return m_NextUChar_Buffer+m_NextUChar_BufferStart;
 }
 
+// give the bytes of the UChar32s decoded but not taken back to m_NextUChar_Buffer
+void MadLines::UndoDecodedUChars()
+{
+    size_t bytes = 0;
+    for(size_t i = 0; i < m_NextUChar_DecodedCount; ++i)
+        bytes += m_NextUChar_Lens[m_NextUChar_DecodedStart + i];
+
+    m_NextUChar_BufferStart -= bytes;
+    m_NextUChar_BufferSize += bytes;
+
+    m_NextUChar_DecodedStart = 0;
+    m_NextUChar_DecodedCount = 0;
+    m_NextUChar_DecodeBatch = NEXTUCHAR_DECODE_MIN;
+}
+
+// decode a batch of UChar32s, the batch grows while the same line is read on,
+// so that a short read (e.g. a row to paint) does not decode the whole buffer
+bool MadLines::DecodeNextUChars()
+{
+    wxFileOffset rest;
+    wxByte* buf = BufferLoadBytes(rest, wxm::UCHAR32_MAX_BYTES);
+    if (buf == nullptr)
+        return false;
+
+    bool more = (m_NextUChar_BufferNextPos != m_NextUChar_LineSize);
+    size_t count = m_Encoding->DecodeUChar32s(buf, m_NextUChar_BufferSize, more,
+                        m_NextUChar_UCs, m_NextUChar_Lens, m_NextUChar_DecodeBatch);
+    wxASSERT(count > 0);
+
+    size_t bytes = 0;
+    for(size_t i = 0; i < count; ++i)
+        bytes += m_NextUChar_Lens[i];
+
+    m_NextUChar_BufferStart += bytes;
+    m_NextUChar_BufferSize -= bytes;
+
+    m_NextUChar_DecodedStart = 0;
+    m_NextUChar_DecodedCount = count;
+
+    if(m_NextUChar_DecodeBatch < NEXTUCHAR_DECODE_MAX)
+        m_NextUChar_DecodeBatch *= 2;
+
+    return true;
+}
+
 bool MadLines::NextUChar(MadUCQueue &ucqueue)
 {
-    return m_Encoding->NextUChar32(ucqueue, *this);
+    if(m_NextUChar_DecodedCount == 0 && !DecodeNextUChars())
+        return false;
+
+    size_t idx = m_NextUChar_DecodedStart++;
+    --m_NextUChar_DecodedCount;
+
+    size_t len = m_NextUChar_Lens[idx];
+    ucqueue.push_back(MadUCPair(m_NextUChar_UCs[idx], len));
+    m_NextUChar_Pos += len;
+    return true;
 }
 
 bool MadLines::NextUCharIs0x0A(void)
 {
+    if(m_NextUChar_DecodedCount != 0)
+        return m_NextUChar_UCs[m_NextUChar_DecodedStart] == 0x0A;
+
     wxFileOffset rest;
     wxByte* buf = BufferLoadBytes(rest, 4);
     if (buf == nullptr)
@@ -1058,7 +1521,9 @@ int MadLines::FindStringNoCase(MadUCQueue &ucqueue, MadStringIterator begin,
 MadLineState MadLines::Reformat(MadLineIterator iter)
 {
     ReformatCount = 1;
+    ++m_Generation;
 
+    iter->m_StaleState = false;
     iter->m_BracePairIndices.clear();
 
     if(iter->m_Size == 0)                    // is a empty line
@@ -1067,6 +1532,8 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
     m_NextUChar_BufferLoadNew=false;
     m_NextUChar_BufferStart=0;
     m_NextUChar_BufferSize=0;
+    m_NextUChar_DecodedStart=0;
+    m_NextUChar_DecodedCount=0;
 
     MadLineIterator nextline = iter;
     ++nextline;
@@ -1118,10 +1585,12 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
     int bracexpos_count;
 
     MadStringIterator sit, sitend;
-    vector < wxString > strvec;
+    vector < wxString > strvec; // { srange->end } for FindString()
     MadSyntaxRange *srange = nullptr;
     if(state.RangeId)
         srange = m_Syntax->GetSyntaxRange(state.RangeId);
+    if(srange)
+        strvec.assign(1, srange->end);
 
     int CheckState = m_Syntax->m_CheckState;
 
@@ -1215,8 +1684,7 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
                                 !m_Syntax->m_LeftBrace.empty())
                             {
                                 bool ok=false;
-                                index=(this->*FindString)(ucqueue, m_Syntax->m_LeftBrace.begin(),
-                                                        m_Syntax->m_LeftBrace.end(), length);
+                                index=m_Syntax->m_LeftBraceMatcher.Find(this, ucqueue, 0, length);
                                 if(index != 0)
                                 {
                                     ok=true;
@@ -1264,8 +1732,7 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
                                     bracexpos_count++;
                                 }
                                 else // check right brace
-                                    if((index=(this->*FindString)(ucqueue, m_Syntax->m_RightBrace.begin(),
-                                                                m_Syntax->m_RightBrace.end(), length)) != 0 )
+                                    if((index=m_Syntax->m_RightBraceMatcher.Find(this, ucqueue, 0, length)) != 0 )
                                 {
                                     ok=true;
                                     ucs4_t uc=ucqueue[length-1].first;
@@ -1410,8 +1877,7 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
                                 // check block comment on
                                 if(!m_Syntax->m_BlockCommentOn.empty())
                                 {
-                                    index =(this->*FindString)(ucqueue, m_Syntax->m_BlockCommentOn.begin(),
-                                            m_Syntax->m_BlockCommentOn.end(), length);
+                                    index = m_Syntax->m_BlockCommentOnMatcher.Find(this, ucqueue, 0, length);
                                     if(index != 0)    // got
                                     {
                                         // check InRange
@@ -1430,8 +1896,7 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
                                 {
                                     if(!m_Syntax->m_LineComment.empty())
                                     {
-                                        index =(this->*FindString)(ucqueue, m_Syntax->m_LineComment.begin(),
-                                                m_Syntax->m_LineComment.end(), length);
+                                        index = m_Syntax->m_LineCommentMatcher.Find(this, ucqueue, 0, length);
                                         if(index != 0)    // got
                                         {
                                             // check InRange
@@ -1460,28 +1925,26 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
                             {
                                 if(srange)
                                 {
-                                    strvec.push_back(srange->end);
                                     if((this->*FindString)(ucqueue, strvec.begin(), strvec.end(), length) != 0)
                                     {
                                         eatUCharCount = length;
                                         state.RangeId = 0;
-                                        strvec.clear();
                                         goto _NOCHECK_;
                                     }
-                                    strvec.clear();
                                 }
                             }
 
                             // check range on
                             if(state.LineComment==0 && state.RangeId == 0 && !m_Syntax->m_RangeBeginString.empty())
                             {
-                                index =(this->*FindString)(ucqueue, m_Syntax->m_RangeBeginString.begin(),
-                                        m_Syntax->m_RangeBeginString.end(), length);
+                                index = m_Syntax->m_RangeBeginMatcher.Find(this, ucqueue, 0, length);
                                 if(index != 0)
                                 {
                                     eatUCharCount = length;
                                     state.RangeId = wxByte(m_Syntax->m_CustomRange[index - 1].id);
                                     srange = m_Syntax->GetSyntaxRange(state.RangeId);
+                                    if(srange)
+                                        strvec.assign(1, srange->end);
                                     //goto _NOCHECK_;
                                 }
                             }
@@ -1785,6 +2248,7 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
             rowidx_idx = 0;
             rowidx.m_Start = 0;
 
+            m_LineList.UpdateIndex(iter);
             iter = nline;
             InitNextUChar(iter, 0);
             NextUChar(ucqueue);
@@ -1796,22 +2260,57 @@ MadLineState MadLines::Reformat(MadLineIterator iter)
         iter->m_RowIndices[1] = rowidx;
     }
 
+    m_LineList.UpdateIndex(iter);
+
     m_NextUChar_BufferLoadNew=true;
 
     return state;
 }
 
 // reformat lines [first,last].
-// if State isn't OK , may format all rest of lines [first, end)
+// if State isn't OK , may format the rest of lines visible in the window,
+// and leave the others to ReformatStaleLines()
 // return reformated line count
 size_t MadLines::Reformat(MadLineIterator first, MadLineIterator last)
 {
+    size_t maxrest = size_t(m_MadEdit->m_VisibleRowCount) * 2;
+    if(maxrest < 100)
+        maxrest = 100;
+
+    return Reformat(first, last, maxrest);
+}
+
+// maxrest: max count of the lines reformatted after last
+size_t MadLines::Reformat(MadLineIterator first, MadLineIterator last, size_t maxrest)
+{
+    XM_TRACE_SCOPE("MadLines::Reformat");
+
+    ++m_Generation;
+
+    if(m_HasStaleLines)
+    {
+        // the stale lines after first may be moved up by the changes of lines
+        size_t lineid = size_t(m_LineList.GetLineId(first));
+        if(lineid < m_StaleLineHint)
+            m_StaleLineHint = lineid;
+    }
+
     MadLineState state;
     MadLineIterator next = first, end = m_LineList.end();
     bool bContinue = true, bIsNotEnd = true, bStateIsNotOkay;
-    size_t count = 0;
+    size_t count = 0, rest = 0;
     do
     {
+        if(!bContinue && ++rest > maxrest)
+        {
+            // first has got its new state, but the propagation is deferred
+            MarkStaleLine(first);
+            break;
+        }
+
+        if(IsUnindexedTail(first))
+            IndexTail(TAIL_INDEX_CHUNK);
+
         if(bContinue && first == last)
             bContinue = false;
 
@@ -1822,6 +2321,10 @@ size_t MadLines::Reformat(MadLineIterator first, MadLineIterator last)
             if(uc == 0 || (uc == 0x0D && next->FirstUCharIs0x0A(m_Encoding)))
                 do
                 {
+                    // never append the whole unindexed tail
+                    if(IsUnindexedTail(next))
+                        IndexTail(TAIL_INDEX_CHUNK);
+
                     if(bContinue && next == last)
                     {
                         bContinue = false;
@@ -1854,7 +2357,7 @@ size_t MadLines::Reformat(MadLineIterator first, MadLineIterator last)
             // to next line
             first = next;
 
-            if(first->m_State == state)
+            if(first->m_State == state && !first->m_StaleState)
                 bStateIsNotOkay = false;
             else
             {
@@ -1871,6 +2374,7 @@ size_t MadLines::Reformat(MadLineIterator first, MadLineIterator last)
                 // add a empty line to end
                 first = m_LineList.insert(next, MadLine());
                 first->Empty();
+                m_LineList.UpdateIndex(first);
                 ++m_LineCount;
                 ++m_RowCount;
                 first->m_State = state;
@@ -1885,8 +2389,308 @@ size_t MadLines::Reformat(MadLineIterator first, MadLineIterator last)
     return count;
 }
 
+void MadLines::MarkStaleLine(MadLineIterator lit)
+{
+    ++m_Generation;
+    lit->m_StaleState = true;
+
+    size_t lineid = size_t(m_LineList.GetLineId(lit));
+    if(!m_HasStaleLines || lineid < m_StaleLineHint)
+        m_StaleLineHint = lineid;
+    m_HasStaleLines = true;
+}
+
+size_t MadLines::ReformatStaleLines(long maxms, int &firstline, int &lastline)
+{
+    XM_TRACE_SCOPE("MadLines::ReformatStaleLines");
+
+    firstline = lastline = -1;
+    if(!m_HasStaleLines)
+        return 0;
+
+    const wxLongLong start = wxGetLocalTimeMillis();
+
+    if(m_StaleLineHint >= m_LineCount)
+        m_StaleLineHint = m_LineCount - 1;
+
+    MadLineIterator lit, end = m_LineList.end();
+    wxFileOffset pos;
+    size_t lineid = m_StaleLineHint;
+    m_LineList.LocateByLine(lit, pos, int(lineid));
+
+    bool fromBegin = (lineid == 0);
+    size_t count = 0;
+    for(;;)
+    {
+        // find the first stale line
+        while(lit != end && !lit->m_StaleState)
+        {
+            ++lit;
+            ++lineid;
+        }
+
+        if(lit == end)
+        {
+            if(fromBegin)
+            {
+                m_HasStaleLines = false;
+                lineid = 0;
+                break;
+            }
+
+            // make sure no stale line was missed
+            fromBegin = true;
+            lit = m_LineList.begin();
+            lineid = 0;
+            continue;
+        }
+
+        if(firstline < 0 || int(lineid) < firstline)
+            firstline = int(lineid);
+
+        size_t oldlines = m_LineCount;
+        size_t n = Reformat(lit, lit, STALE_REFORMAT_CHUNK);
+        count += n;
+
+        int last = int(lineid + n + m_LineCount - oldlines);
+        if(last > lastline)
+            lastline = last;
+
+        if((wxGetLocalTimeMillis() - start).ToLong() >= maxms)
+            break;
+    }
+
+    m_StaleLineHint = lineid;
+
+    return count;
+}
+
+// the newline chars of ISO-646 compatible encodings and UTF-16/32
+// can be located without decoding the text
+static xm::NewLineUnit GetNewLineUnit(wxm::WXMEncoding *encoding)
+{
+    switch(encoding->GetEncoding())
+    {
+    case wxm::ENC_UTF_16LE: return xm::nluUTF16LE;
+    case wxm::ENC_UTF_16BE: return xm::nluUTF16BE;
+    case wxm::ENC_UTF_32LE: return xm::nluUTF32LE;
+    case wxm::ENC_UTF_32BE: return xm::nluUTF32BE;
+    default: break;
+    }
+
+    if(dynamic_cast<wxm::WXMEncodingDecoderISO646*>(encoding) != nullptr)
+        return xm::nluByte;
+
+    return xm::nluNone;
+}
+
+static void InitSplitLine(MadLine &line, MadInData *data, wxFileOffset pos, wxFileOffset size, wxByte nlsize)
+{
+    line.m_Blocks.resize(1);
+    line.m_Blocks[0] = MadBlock(data, pos, size);
+    line.m_RowIndices.resize(2);
+    line.m_RowIndices[0].Reset();
+    line.m_RowIndices[1] = MadRowIndex(size, 0);
+    line.m_Size = size;
+    line.m_NewLineSize = nlsize;
+}
+
+// every new line has only one row and is marked as stale, so that
+// the lines are decoded for the row-widths and syntax states
+// by Reformat() & ReformatStaleLines() from iter one by one
+bool MadLines::SplitLines(MadLineIterator iter, xm::NewLineUnit nlu, wxFileOffset minsize)
+{
+    wxASSERT(iter->m_Blocks.size() == 1);
+
+    ++m_Generation;
+
+    const size_t unit = xm::NewLineUnitSize(nlu);
+    MadInData *data = iter->m_Blocks[0].m_Data;
+    const wxFileOffset base = iter->m_Blocks[0].m_Pos;
+    const wxFileOffset size = iter->m_Size;
+    const MadLineState state = iter->m_State;
+
+    vector<wxByte> buffer(BUFFER_SIZE);
+    wxByte *buf = &buffer[0];
+    wxByte nextunit[4];
+
+    MadLineIterator end = m_LineList.end();
+    wxFileOffset pos = 0, linepos = 0;
+    bool tail = false;
+
+    while(pos + wxFileOffset(unit) <= size)
+    {
+        if(pos >= minsize && linepos != 0)
+        {
+            tail = true;
+            break;
+        }
+
+        size_t len = BUFFER_SIZE;
+        if(wxFileOffset(len) > size - pos)
+            len = size_t(size - pos);
+        len -= len % unit;
+
+        data->Get(base + pos, buf, len);
+
+        size_t off = 0;
+        while(off < len && (off += xm::FindNewLine(buf + off, len - off, nlu)) < len)
+        {
+            wxByte nlsize = wxByte(unit);
+            if(xm::NewLineChar(buf + off, nlu) == 0x0D)
+            {
+                const wxByte *next = nullptr;
+                if(off + unit * 2 <= len)
+                {
+                    next = buf + off + unit;
+                }
+                else if(pos + wxFileOffset(off + unit * 2) <= size)
+                {
+                    data->Get(base + pos + off + unit, nextunit, unit);
+                    next = nextunit;
+                }
+
+                if(next != nullptr && xm::NewLineChar(next, nlu) == 0x0A) // DOS newline chars
+                {
+                    nlsize += wxByte(unit);
+                    m_MadEdit->m_newline = &wxm::g_nl_dos;
+                }
+                else if(m_MadEdit->m_newline->IsDefault())
+                {
+                    m_MadEdit->m_newline = &wxm::g_nl_mac;
+                }
+            }
+            else if(m_MadEdit->m_newline->IsDefault())
+            {
+                m_MadEdit->m_newline = &wxm::g_nl_unix;
+            }
+
+            off += nlsize;
+            const wxFileOffset lineend = pos + off;
+
+            if(linepos == 0)
+            {
+                InitSplitLine(*iter, data, base, lineend, nlsize);
+                m_LineList.UpdateIndex(iter);
+            }
+            else
+            {
+                MadLine line;
+                InitSplitLine(line, data, base + linepos, lineend - linepos, nlsize);
+                line.m_State = state;
+                line.m_StaleState = true;
+                m_LineList.insert(end, line);
+                ++m_LineCount;
+                ++m_RowCount;
+            }
+
+            linepos = lineend;
+        }
+
+        pos += (off > len) ? off : len;
+    }
+
+    if(linepos == 0)    // no newline char
+        return false;
+
+    // the rest data, or an empty line after the last newline char
+    MadLine line;
+    if(linepos < size)
+        InitSplitLine(line, data, base + linepos, size - linepos, 0);
+    else
+        line.Empty();
+    line.m_State = state;
+    line.m_StaleState = true;
+    m_LineList.insert(end, line);
+    ++m_LineCount;
+    ++m_RowCount;
+
+    return tail;
+}
+
+bool MadLines::IsUnindexedTail(const MadLineIterator &lit)
+{
+    if(m_TailNewLineUnit == xm::nluNone)
+        return false;
+
+    MadLineIterator tail = m_LineList.end();
+    return lit == --tail;
+}
+
+// split the lines from the first minsize bytes of the unindexed tail,
+// the tail line itself becomes the first of them
+void MadLines::IndexTail(wxFileOffset minsize)
+{
+    wxASSERT(m_TailNewLineUnit != xm::nluNone);
+
+    MadLineIterator tail = m_LineList.end();
+    --tail;
+
+    if(!SplitLines(tail, m_TailNewLineUnit, minsize))
+        m_TailNewLineUnit = xm::nluNone;
+
+    MarkStaleLine(tail);
+    if(m_TailNewLineUnit != xm::nluNone)
+    {
+        tail = m_LineList.end();
+        MarkStaleLine(--tail);
+    }
+}
+
+void MadLines::IndexTailByRow(size_t rowid)
+{
+    while(m_TailNewLineUnit != xm::nluNone && rowid + 1 >= m_RowCount)
+    {
+        // guess the bytes of the rows by the indexed lines
+        MadLineIterator tail = m_LineList.end();
+        --tail;
+        wxFileOffset bytes = (m_Size - tail->m_Size) / wxFileOffset(m_RowCount);
+        IndexTail(std::max(TAIL_INDEX_CHUNK, wxFileOffset(rowid + 2 - m_RowCount) * bytes));
+    }
+}
+
+void MadLines::IndexTailByLine(size_t lineid)
+{
+    while(m_TailNewLineUnit != xm::nluNone && lineid + 1 >= m_LineCount)
+    {
+        MadLineIterator tail = m_LineList.end();
+        --tail;
+        wxFileOffset bytes = (m_Size - tail->m_Size) / wxFileOffset(m_LineCount);
+        IndexTail(std::max(TAIL_INDEX_CHUNK, wxFileOffset(lineid + 2 - m_LineCount) * bytes));
+    }
+}
+
+void MadLines::IndexTailByPos(wxFileOffset pos)
+{
+    while(m_TailNewLineUnit != xm::nluNone)
+    {
+        MadLineIterator tail = m_LineList.end();
+        --tail;
+        wxFileOffset tailpos = m_Size - tail->m_Size;
+        if(pos < tailpos)
+            break;
+
+        IndexTail(std::max(TAIL_INDEX_CHUNK, pos - tailpos + 1));
+    }
+}
+
+size_t MadLines::GetEstimatedRowCount()
+{
+    if(m_TailNewLineUnit == xm::nluNone || m_RowCount < 2)
+        return m_RowCount;
+
+    MadLineIterator tail = m_LineList.end();
+    --tail;
+    double indexed = double(m_Size - tail->m_Size);
+    return m_RowCount + size_t(double(tail->m_Size) * double(m_RowCount - 1) / indexed);
+}
+
 void MadLines::RecountLineWidth(void)
 {
+    XM_TRACE_SCOPE("MadLines::RecountLineWidth");
+
+    ++m_Generation;
+
     MadLineIterator iter = m_LineList.begin();
     MadLineIterator iterend = m_LineList.end();
 
@@ -1916,6 +2720,13 @@ void MadLines::RecountLineWidth(void)
 
     do
     {
+        if(IsUnindexedTail(iter))
+        {
+            // keep the only row of the unsplit data
+            ++m_RowCount;
+            continue;
+        }
+
         rowidx_idx = 0;
 
         rowidx = iter->m_RowIndices.front();
@@ -2237,6 +3048,7 @@ void MadLines::RecountLineWidth(void)
     }
     while(++iter != iterend);
 
+    m_LineList.UpdateAllIndices();
 }
 
 void MadLines::Append(const MadLineIterator &lit1, const MadLineIterator &lit2)
@@ -2244,6 +3056,8 @@ void MadLines::Append(const MadLineIterator &lit1, const MadLineIterator &lit2)
     if(lit2->m_Size == 0)                    // is a empty line
         return;
 
+    ++m_Generation;
+
     lit1->m_Size += lit2->m_Size;
 
     MadBlockVector &blks1 = lit1->m_Blocks;
@@ -2259,6 +3073,8 @@ void MadLines::Append(const MadLineIterator &lit1, const MadLineIterator &lit2)
     }
 
     blks1.insert(blks1.end(), bit2, blks2.end());
+
+    m_LineList.UpdateIndex(lit1);
 }
 
 //===========================================================================
@@ -2286,10 +3102,13 @@ void MadLines::InitFileSyntax()
     wxFont *font=m_MadEdit->m_TextFont;
     m_Syntax->InitNextWord1(m_MadEdit->m_Lines, m_MadEdit->m_WordBuffer, m_MadEdit->m_WidthBuffer, font->GetFaceName(), font->GetPointSize(), font->GetFamily());
     m_MadEdit->m_Syntax = m_Syntax;
+    ++m_Generation;
 }
 
 bool MadLines::LoadFromFile(const wxString &filename, const wxString &encoding)
 {
+    XM_TRACE_SCOPE("MadLines::LoadFromFile");
+
     MadFileData *fd = new MadFileData(filename);
 
     if(!fd->OpenSuccess())
@@ -2298,6 +3117,8 @@ bool MadLines::LoadFromFile(const wxString &filename, const wxString &encoding)
         return false;
     }
 
+    MadEdit::RenderDeferredClipboardText(this);
+
     if(m_FileData)
         delete m_FileData;
     m_FileData = fd;
@@ -2377,6 +3198,8 @@ bool MadLines::LoadFromFile(const wxString &filename, const wxString &encoding)
     // set line's row indices
     iter->m_RowIndices[1].m_Start = m_Size;
 
+    m_LineList.UpdateIndex(iter);
+
     long MaxSizeToLoad;
     m_MadEdit->m_Config->Read(wxT("/wxMEdit/MaxSizeToLoad"), &MaxSizeToLoad, 20*1000*1000);
 
@@ -2446,28 +3269,35 @@ bool MadLines::LoadFromFile(const wxString &filename, const wxString &encoding)
     m_MadEdit->m_Config->Read(wxT("/wxMEdit/MaxTextFileSize"), &maxtextfilesize, 10*1000*1000);
     m_MadEdit->m_Config->SetPath(oldpath);
 
-    bool preset=false;
-    bool hexmode=false;
-    bool skip_utf8=false;
-
-    if(m_Size>=maxtextfilesize)
+    // sample the head, the tail and the middle of the file for its encoding
+    wxm::EncodingSample sample(m_Size);
     {
-        hexmode = true;
-    }
-    else
-    {
-        preset = PresetFileEncoding(encoding, buf, sz);
-        skip_utf8 = !preset;
+        std::vector<wxByte> window;
+        wxFileOffset pos;
+        size_t len;
+        while(sample.NextWindow(pos, len))
+        {
+            window.resize(len);
+            iter->m_Blocks[0].m_Data->Get(pos, &window[0], len);
+            sample.AddWindow(&window[0], len);
+        }
     }
 
+    bool hexmode=false;
+    bool preset = PresetFileEncoding(encoding, sample);
+
     if(!preset)
     {
-        SetFileEncoding(encoding, defaultenc, buf, sz, skip_utf8);
-
-        if(!hexmode)
-            hexmode = IsBinaryData(buf, sz);
+        SetFileEncoding(encoding, defaultenc, sample, true);
+        hexmode = IsBinaryData(buf, sz);
     }
 
+    // a huge text file is indexed lazily if its newline chars can be located
+    // without decoding, otherwise it's too slow to load it as a text file
+    xm::NewLineUnit nlu = GetNewLineUnit(m_Encoding);
+    if(m_Size>=maxtextfilesize && nlu == xm::nluNone)
+        hexmode = true;
+
     if(hexmode)
     {
         m_MaxLineWidth = -1;       // indicate the data is not text data
@@ -2475,6 +3305,17 @@ bool MadLines::LoadFromFile(const wxString &filename, const wxString &encoding)
     }
     else
     {
+        if(nlu != xm::nluNone)
+        {
+            wxFileOffset minsize = (m_Size > LAZY_INDEX_MIN_SIZE) ? TAIL_INDEX_CHUNK : m_Size;
+            if(SplitLines(iter, nlu, minsize))
+            {
+                m_TailNewLineUnit = nlu;
+                MadLineIterator tail = m_LineList.end();
+                MarkStaleLine(--tail);
+            }
+        }
+
         Reformat(iter, iter);
     }
 
@@ -2484,7 +3325,7 @@ bool MadLines::LoadFromFile(const wxString &filename, const wxString &encoding)
 }
 
 
-bool MadLines::PresetFileEncoding(const wxString& encoding, const wxByte* buf, size_t sz)
+bool MadLines::PresetFileEncoding(const wxString& encoding, const wxm::EncodingSample& sample)
 {
     if(!encoding.IsEmpty())
     {
@@ -2493,7 +3334,7 @@ bool MadLines::PresetFileEncoding(const wxString& encoding, const wxByte* buf, s
     }
 
     wxString wxmenc;
-    if(wxm::MatchWXMEncoding(wxmenc, buf, sz))
+    if(wxm::MatchWXMEncoding(wxmenc, sample))
     {
         m_MadEdit->SetEncoding(wxmenc);
         return true;
@@ -2503,7 +3344,7 @@ bool MadLines::PresetFileEncoding(const wxString& encoding, const wxByte* buf, s
 }
 
 void MadLines::SetFileEncoding(const wxString& encoding, const wxString& defaultenc, 
-                               const wxByte* buf, size_t sz, bool skip_utf8)
+                               const wxm::EncodingSample& sample, bool skip_utf8)
 {
     if(!encoding.IsEmpty())
     {
@@ -2525,7 +3366,7 @@ void MadLines::SetFileEncoding(const wxString& encoding, const wxString& default
     }
 
     // use Encoding Detector
-    wxm::DetectEncoding(buf, sz, enc, skip_utf8);
+    wxm::DetectEncoding(sample, enc, skip_utf8);
 
     m_MadEdit->SetEncoding(wxm::WXMEncodingManager::Instance().EncodingToName(enc));
 }
@@ -2654,6 +3495,82 @@ void MadLines::WriteBlockToData(MadOutData *data, const MadBlockIterator &bit)
     while((size -= bs) > 0);
 }
 
+// copy size bytes at pos of infd to the current offset of outfd in the kernel,
+// which may share the data (reflink) if the filesystem supports it;
+// return the bytes copied, less than size if the kernel cannot copy the rest
+static wxFileOffset KernelCopyFileRange(int infd, wxFileOffset pos, int outfd, wxFileOffset size)
+{
+    wxFileOffset copied = 0;
+#ifdef __linux__
+    static bool no_copy_file_range = false;
+    const wxFileOffset maxlen = 0x40000000;
+
+    while(copied < size)
+    {
+        size_t len = size_t(std::min(size - copied, maxlen));
+        ssize_t n = -1;
+
+# ifdef SYS_copy_file_range
+        if(!no_copy_file_range)
+        {
+            loff_t off = pos + copied;
+            n = syscall(SYS_copy_file_range, infd, &off, outfd, nullptr, len, 0u);
+            if(n < 0 && errno == ENOSYS)
+                no_copy_file_range = true;
+        }
+# endif
+        if(n < 0) // cross-filesystem on old kernels, etc.
+        {
+            off_t off = off_t(pos + copied);
+            n = sendfile(outfd, infd, &off, len);
+        }
+
+        if(n <= 0)
+            break;
+        copied += n;
+    }
+#else
+    (void)infd; (void)pos; (void)outfd; (void)size;
+#endif
+    return copied;
+}
+
+void MadLines::FlushWriteBuffer(wxFile &file)
+{
+    if(m_WriteBufferUsed != 0)
+    {
+        file.Write(m_WriteBuffer, m_WriteBufferUsed);
+        m_WriteBufferUsed = 0;
+    }
+}
+
+void MadLines::WriteBuffered(wxFile &file, MadInData *data, wxFileOffset pos, wxFileOffset size)
+{
+    m_SaveStats.m_Rewritten += size;
+
+    while(size > 0)
+    {
+        size_t bs = size_t(std::min(size, wxFileOffset(size_t(BUFFER_SIZE) - m_WriteBufferUsed)));
+        data->Get(pos, m_WriteBuffer + m_WriteBufferUsed, bs);
+        pos += bs;
+        size -= bs;
+
+        if((m_WriteBufferUsed += bs) == size_t(BUFFER_SIZE))
+            FlushWriteBuffer(file);
+    }
+}
+
+void MadLines::CopyFileRange(wxFile &file, MadFileData *fd, wxFileOffset pos, wxFileOffset size)
+{
+    FlushWriteBuffer(file);
+
+    wxFileOffset copied = KernelCopyFileRange(fd->m_File.fd(), pos, file.fd(), size);
+    m_SaveStats.m_Copied += copied;
+
+    if(copied < size) // the kernel has advanced the offset of file by copied
+        WriteBuffered(file, fd, pos + copied, size - copied);
+}
+
 void MadLines::WriteToFile(wxFile &file, MadFileData *oldfd, MadFileData *newfd)
 {
     if(m_Size > 0)
@@ -2663,6 +3580,12 @@ void MadLines::WriteToFile(wxFile &file, MadFileData *oldfd, MadFileData *newfd)
             m_WriteBufferVector.resize(BUFFER_SIZE);
             m_WriteBuffer = &m_WriteBufferVector[0];
         }
+        m_WriteBufferUsed = 0;
+
+        // the unchanged data of oldfd are merged into ranges to copy by the kernel,
+        // the other data are merged in m_WriteBuffer
+        bool kernelcopy = (oldfd != nullptr && oldfd->m_File.IsOpened());
+        wxFileOffset copypos = 0, copysize = 0;
 
         MadLineIterator lit = m_LineList.begin();
         wxFileOffset filepos=0;
@@ -2675,21 +3598,29 @@ void MadLines::WriteToFile(wxFile &file, MadFileData *oldfd, MadFileData *newfd)
                 size_t count=lit->m_Blocks.size();
                 do
                 {
-                    size_t bs = BUFFER_SIZE;
-                    wxFileOffset size = bit->m_Size;
-                    wxFileOffset pos = bit->m_Pos;
-
-                    do
+                    if(kernelcopy && bit->m_Data == oldfd)
                     {
-                        if(BUFFER_SIZE > size)
-                            bs = size_t(size);
-
-                        bit->m_Data->Get(pos, m_WriteBuffer, bs);
-                        pos += bs;
-
-                        file.Write(m_WriteBuffer, bs);
+                        if(copysize != 0 && copypos + copysize == bit->m_Pos)
+                        {
+                            copysize += bit->m_Size;
+                        }
+                        else
+                        {
+                            if(copysize != 0)
+                                CopyFileRange(file, oldfd, copypos, copysize);
+                            copypos = bit->m_Pos;
+                            copysize = bit->m_Size;
+                        }
+                    }
+                    else
+                    {
+                        if(copysize != 0)
+                        {
+                            CopyFileRange(file, oldfd, copypos, copysize);
+                            copysize = 0;
+                        }
+                        WriteBuffered(file, bit->m_Data, bit->m_Pos, bit->m_Size);
                     }
-                    while((size -= bs) > 0);
 
                     if(bit->m_Data == oldfd)
                     {
@@ -2704,6 +3635,10 @@ void MadLines::WriteToFile(wxFile &file, MadFileData *oldfd, MadFileData *newfd)
             }
         }
         while(++lit != m_LineList.end());
+
+        if(copysize != 0)
+            CopyFileRange(file, oldfd, copypos, copysize);
+        FlushWriteBuffer(file);
     }
 }
 
@@ -2889,9 +3824,18 @@ void MadLines::DetectSyntax(const wxString &filename)
 
 bool MadLines::SaveToFile(const wxString &filename, const wxString &tempdir)
 {
+    XM_TRACE_SCOPE("MadLines::SaveToFile");
+
     if (!m_manual)
         DetectSyntax(filename);
 
+    m_SaveStats.Reset();
+    ++m_Generation;
+
+    // the file data copied to the clipboard are to be rewritten or replaced
+    if(m_FileData != nullptr)
+        MadEdit::RenderDeferredClipboardText(this);
+
     if(m_FileData == nullptr)
     {
         int utf8test=MadFileNameIsUTF8(filename);
@@ -2960,6 +3904,7 @@ bool MadLines::SaveToFile(const wxString &filename, const wxString &tempdir)
             return false;
         }
 
+        fd->Unmap();
         wxFileOffset filesize=fd->m_File.SeekEnd(0);
 
         fd->m_File.Seek(0);
@@ -2973,8 +3918,7 @@ bool MadLines::SaveToFile(const wxString &filename, const wxString &tempdir)
         }
 
         fd->m_Size=m_Size;
-        fd->m_Buf1Pos = -1;
-        fd->m_Buf2Pos = -1;
+        fd->Refresh();
 
         delete m_FileData;
         m_FileData=fd;
@@ -2990,6 +3934,8 @@ bool MadLines::SaveToFile(const wxString &filename, const wxString &tempdir)
 
     if(m_ReadOnly) return false;
 
+    m_FileData->Unmap();
+
     if(m_Size==0)
     {
         if(m_FileData->m_File.SeekEnd(0)!=0)
@@ -3055,6 +4001,7 @@ bool MadLines::SaveToFile(const wxString &filename, const wxString &tempdir)
         {
             // this block is not necessary for writing back
             writepos+=write_bit->m_Size;
+            m_SaveStats.m_Unchanged+=write_bit->m_Size;
             file_lit_not_set=true;
 
             if(++write_bit == write_bitend)
@@ -3135,6 +4082,7 @@ bool MadLines::SaveToFile(const wxString &filename, const wxString &tempdir)
                         tempmemdata->m_Size=pos0;
                     }
                     WriteBlockToData(tempoutdata, file_bit);
+                    m_SaveStats.m_Moved+=file_bit->m_Size;
 
                     file_bit->m_Data=tempindata;
                     file_bit->m_Pos=pos0;
@@ -3176,6 +4124,7 @@ bool MadLines::SaveToFile(const wxString &filename, const wxString &tempdir)
         // write the block to file
         m_FileData->m_SavePos=writepos;
         WriteBlockToData(m_FileData, write_bit);
+        m_SaveStats.m_Rewritten+=write_bit->m_Size;
 
         if(write_bit->m_Data==m_FileData)
         {
@@ -3246,8 +4195,7 @@ bool MadLines::SaveToFile(const wxString &filename, const wxString &tempdir)
     }
 
     m_FileData->m_Size=m_Size;
-    m_FileData->m_Buf1Pos=-1;
-    m_FileData->m_Buf2Pos=-1;
+    m_FileData->Refresh();
 
     if(tempmemdata!=nullptr)
     {
@@ -3266,166 +4214,110 @@ MadLineList::MadLineList()
 {
 }
 
-// Toggle bookmark from given position.
-// If there is a bookmark on the given position, remove it. If there is not, add it.
-void MadLineList::ToggleBookmark(MadLineIterator position)
+MadLineIterator MadLineList::insert( MadLineIterator position, const MadLine& line )
 {
-    if ( m_BookmarkList.empty() )
-    {
-        m_BookmarkList.push_front( position );
-        return;
-    }
-
-    MadBookmarkIterator bmkIter = find( m_BookmarkList.begin(), m_BookmarkList.end(), position );
-    if ( bmkIter != m_BookmarkList.end() )
-    {
-        m_BookmarkList.erase( bmkIter );   // we remove this bookmark
-        return;
-    }
-
-    // we keep the bookmarks sorted, we have to find out where to insert the new one
+    MadLineIterator lit = list<MadLine>::insert( position, line );
+    lit->m_IndexHook = nullptr;
+    m_Index.Insert( lit, position == end() ? nullptr : position->m_IndexHook );
+    return lit;
+}
 
-    bmkIter = m_BookmarkList.begin();
-    MadLineIterator bookmark = *bmkIter;
-    MadLineIterator iter;
+int MadLineList::LocateByRow( MadLineIterator &lit, wxFileOffset &pos, int &rowid ) const
+{
+    size_t lineid, rowid0;
+    m_Index.FindByRow( size_t(rowid), lit, lineid, rowid0, pos );
+    rowid = int(rowid0);
+    return int(lineid);
+}
 
-    for ( iter = begin(); iter != end(); iter++ )
-    {
-        if ( iter == position )
-            break;
+int MadLineList::LocateByPos( MadLineIterator &lit, wxFileOffset &pos, int &rowid ) const
+{
+    size_t lineid, rowid0;
+    m_Index.FindByPos( pos, lit, lineid, rowid0, pos );
+    rowid = int(rowid0);
+    return int(lineid);
+}
 
-        if ( iter == bookmark )
-        {
-            if ( ++bmkIter == m_BookmarkList.end() )
-                break;
-            bookmark = *bmkIter;
-        }
-    }
+int MadLineList::LocateByLine( MadLineIterator &lit, wxFileOffset &pos, int lineid ) const
+{
+    size_t rowid;
+    m_Index.FindByLine( size_t(lineid), lit, rowid, pos );
+    return int(rowid);
+}
 
-    wxASSERT( iter != end() );
-    m_BookmarkList.insert( bmkIter, position );
+int MadLineList::GetLineId( MadLineIterator position ) const
+{
+    size_t lineid, rowid;
+    wxFileOffset pos;
+    m_Index.Locate( position, lineid, rowid, pos );
+    return int(lineid);
 }
 
-void MadLineList::ClearAllBookmarks()
+// Toggle bookmark from given position.
+// If there is a bookmark on the given position, remove it. If there is not, add it.
+void MadLineList::ToggleBookmark(MadLineIterator position)
 {
-    m_BookmarkList.clear();
+    m_Index.SetMark( position, !m_Index.Marked(position) );
 }
 
 // Return line number, or -1 if there are no bookmars.
+// The first bookmark is returned if there is no bookmark after position.
 //
 int MadLineList::GetNextBookmark( MadLineIterator position )
 {
-    if ( m_BookmarkList.empty() )
+    size_t count = m_Index.MarkCount();
+    if ( count == 0 )
         return -1;
 
-    int lineNumFirstBmk = -1;
-    int lineNum = 1;
-    bool positionFound = false;
-
-    MadBookmarkIterator bmkIter = m_BookmarkList.begin();
-    MadLineIterator bookmark = *bmkIter;
-
-    MadLineIterator iter;
-    for ( iter = begin(); iter != end(); ++lineNum, ++iter )
-    {
-        if ( iter == bookmark )
-        {
-            if ( positionFound )
-                break;   // we found the next bookmark
-
-            if ( lineNumFirstBmk < 0 )
-                lineNumFirstBmk = lineNum;
+    size_t markid = m_Index.CountMarksBefore( position );
+    if ( m_Index.Marked(position) )
+        ++markid;
+    if ( markid == count )
+        markid = 0;
 
-            if ( ++bmkIter == m_BookmarkList.end() )
-                return lineNumFirstBmk; // no more bookmarks, we return the position of the first one
-
-            bookmark = *bmkIter;
-        }
-        if ( iter == position )
-            positionFound = true;
-    }
-
-    wxASSERT( iter != end() );  // this can be triggered if bookmark list is not sorted
-    return lineNum;
+    MadLineIterator lit;
+    size_t lineid;
+    m_Index.FindByMark( markid, lit, lineid );
+    return int(lineid) + 1;
 }
 
 
 // Return opposite line number (from the end to the beginning, i.e. the last line as N= 1),
 // or -1 if there are no bookmars.
+// The last bookmark is returned if there is no bookmark before position.
 //
 int MadLineList::GetPreviousBookmark( MadLineIterator position )
 {
-    if ( m_BookmarkList.empty() )
+    size_t count = m_Index.MarkCount();
+    if ( count == 0 )
         return -1;
 
-    int lineNumFirstBmk = -1;
-    int lineNum = 1;
-    bool positionFound = false;
-
-    list<MadLineIterator>::reverse_iterator bmkIter = m_BookmarkList.rbegin();
-    MadLineIterator bookmark = *bmkIter;
-
-    list<MadLine>::reverse_iterator iter;
-    for ( iter = rbegin(); iter != rend(); ++lineNum, ++iter )
-    {
-        MadLineIterator frwiter = iter.base();
-        --frwiter;
-
-        if ( frwiter == bookmark )
-        {
-            if ( positionFound )
-                break;   // we found the next bookmark
+    size_t markid = m_Index.CountMarksBefore( position );
+    markid = (markid == 0) ? count - 1 : markid - 1;
 
-            if ( lineNumFirstBmk < 0 )
-                lineNumFirstBmk = lineNum;
-
-            if ( ++bmkIter == m_BookmarkList.rend() )
-                return lineNumFirstBmk; // no more bookmarks, we return the position of the first one
-
-            bookmark = *bmkIter;
-        }
-        if ( frwiter == position )
-            positionFound = true;
-    }
-
-    wxASSERT( iter != rend() );  // this can be triggered if bookmark list is not sorted
-    return lineNum;
+    MadLineIterator lit;
+    size_t lineid;
+    m_Index.FindByMark( markid, lit, lineid );
+    return int(m_Index.LineCount() - lineid);
 }
 
 
 MadLineIterator MadLineList::erase( MadLineIterator position )
 {
-    // using remove() is simpler, but we plan more sophisticated bookmars later
-    MadBookmarkIterator found = find( m_BookmarkList.begin(), m_BookmarkList.end(), position );
-    if ( found != m_BookmarkList.end() )
-        m_BookmarkList.erase( found );
-
+    m_Index.Erase( position );
     return list<MadLine>::erase( position );
 }
 
-
-bool MadLineList::Bookmarked( MadLineIterator position )
-{
-    MadBookmarkIterator found = find( m_BookmarkList.begin(), m_BookmarkList.end(), position );
-    return found != m_BookmarkList.end();
-}
-
 LineNumberList MadLineList::SaveBookmarkLineNumberList() const
 {
-    list<MadLineIterator>::const_iterator bmkIter = m_BookmarkList.begin();
-    list<MadLineIterator>::const_iterator bmkEnd = m_BookmarkList.end();
-
     LineNumberList linenums;
-    size_t linenum = 0;
-    for(list<MadLine>::const_iterator iter = begin(); bmkIter!=bmkEnd && iter!=end(); ++iter)
+    size_t count = m_Index.MarkCount();
+    for(size_t markid = 0; markid < count; ++markid)
     {
-        ++linenum;
-
-        if (*bmkIter != iter)
-            continue;
-
-        linenums.push_back(linenum);
-        ++bmkIter;
+        MadLineIterator lit;
+        size_t lineid;
+        m_Index.FindByMark(markid, lit, lineid);
+        linenums.push_back(lineid + 1);
     }
 
     return linenums;
@@ -3436,18 +4328,19 @@ void MadLineList::RestoreBookmarkByLineNumberList(const LineNumberList& linenums
     if (linenums.empty())
         return;
 
-    m_BookmarkList.clear();
+    m_Index.ClearMarks();
 
-    size_t max_bmklinenum = *(linenums.rbegin());
-    size_t linenum = 0;
-    size_t i = 0;
-    for(MadLineIterator iter = begin(); linenum<max_bmklinenum && iter!=end(); ++iter)
+    size_t linecount = m_Index.LineCount();
+    for(size_t i = 0; i < linenums.size(); ++i)
     {
-        ++linenum;
-        if (linenum < linenums[i])
+        size_t linenum = linenums[i];
+        if (linenum == 0 || linenum > linecount)
             continue;
 
-        m_BookmarkList.push_back(iter);
-        ++i;
+        MadLineIterator lit;
+        size_t rowid;
+        wxFileOffset pos;
+        m_Index.FindByLine(linenum - 1, lit, rowid, pos);
+        m_Index.SetMark(lit, true);
     }
 }
@@ -10,6 +10,8 @@
 #define _WXM_LINES_H_
 
 #include "../xm/cxx11.h"
+#include "../xm/newline_scan.h"
+#include "../xm/live_ranges.hpp"
 #include "../wxm/line_enc_adapter.h"
 #include "../wxm/def.h"
 
@@ -47,6 +49,7 @@ using std::pair;
 
 #include "ucs4_t.h"
 #include "wxm_deque.hpp"
+#include "wxm_line_index.hpp"
 
 //===========================================================================
 // MadFileNameIsUTF8, MadDirExists, MadConvFileName_WC2MB_UseLibc
@@ -106,6 +109,9 @@ public:
 };
 
 
+typedef xm::LiveRanges<wxFileOffset> MadLiveRanges;
+
+// the data are appended only, the data no longer referred to are dropped by Compact()
 class MadMemData : public MadInData, public MadOutData
 {
 private:
@@ -122,6 +128,11 @@ public:
     virtual wxByte Get(const wxFileOffset &pos) override;
     virtual void Get(const wxFileOffset &pos, wxByte *buffer, size_t size) override;
     virtual wxFileOffset Put(wxByte *buffer, size_t size) override;
+
+    // copy the packed live ranges into fresh buffers in order, and free the old buffers
+    // as soon as they are copied; the blocks must be remapped by live.Map() after it
+    void Compact(const MadLiveRanges &live);
+    wxFileOffset GetAllocatedSize();
 };
 
 class MadFileData : public MadInData, public MadOutData
@@ -137,11 +148,22 @@ private:
     wxByte *m_Buffer1,*m_Buffer2;
     wxFileOffset m_Buf1Pos,m_Buf2Pos;
 
+    // the whole file mapped into memory, or nullptr to use m_Buffer1/m_Buffer2
+    wxByte *m_Map;
+    wxFileOffset m_MapSize;
+#ifdef __WXMSW__
+    void *m_MapHandle;
+#endif
+
     wxFileOffset m_SavePos; // for Put()
 
     bool OpenFile();
     bool Rename(const wxString &name);
 
+    bool Map();
+    void Unmap();
+    void Refresh(); // drop the buffered data and remap the file after writing
+
 public:
     MadFileData(const wxString &name);
     virtual ~MadFileData();
@@ -157,6 +179,10 @@ public:
 
     bool OpenSuccess() { return m_OpenSuccess; }
     bool IsReadOnly() { return m_ReadOnly; }
+    bool IsMapped() { return m_Map != nullptr; }
+
+    // fall back to buffered reading if the file was truncated by another application
+    void VerifyMapping();
 };
 
 //==================================================
@@ -252,6 +278,7 @@ typedef vector < MadRowIndex >::iterator MadRowIndexIterator;
 namespace wxm
 {
 struct WXMEncoding;
+struct EncodingSample;
 }
 
 struct MadLine
@@ -262,10 +289,13 @@ struct MadLine
     wxByte                  m_NewLineSize;  // ANSI: "0D,0A" , UNICODE: "0D,00,0A,00"
 
     MadLineState            m_State;
+    bool                    m_StaleState;   // m_State was changed but the line is not reformatted with it yet
 
     vector <BracePairIndex> m_BracePairIndices;
 
-    MadLine():m_Size(0), m_NewLineSize(0)
+    MadLineIndexHook       *m_IndexHook;    // node in MadLineList::m_Index
+
+    MadLine():m_Size(0), m_NewLineSize(0), m_StaleState(false), m_IndexHook(nullptr)
     {
     }
     void Reset();
@@ -337,19 +367,45 @@ typedef list<MadLine>::iterator         MadLineIterator;
 typedef MadDeque<MadUCPair>::iterator   MadUCQueueIterator;
 typedef vector<wxString>::iterator      MadStringIterator;
 
+struct MadLineIndexTraits
+{
+    typedef wxFileOffset offset_type;
+
+    static wxFileOffset Size(const MadLineIterator& lit) { return lit->m_Size; }
+    static size_t RowCount(const MadLineIterator& lit)
+    {
+        return lit->m_RowIndices.empty() ? 0 : lit->RowCount();
+    }
+    static MadLineIndexHook*& Hook(const MadLineIterator& lit) { return lit->m_IndexHook; }
+};
+
 class MadLineList : public list <MadLine>
 {
-    list<MadLineIterator> m_BookmarkList;
+    // the bookmarks are the marks of m_Index, they are erased with their lines
+    MadLineIndex<MadLineIterator, MadLineIndexTraits> m_Index;
 
 public:
     MadLineList();
 
+    MadLineIterator insert( MadLineIterator position, const MadLine& line );
+
+    // must be called after the size or the rows of a line were changed
+    void UpdateIndex( MadLineIterator position ) { m_Index.Update(position); }
+    void UpdateAllIndices() { m_Index.UpdateAll(); }
+
+    // O(log n) lookups, see MadEdit::GetLineByRow(), GetLineByPos(), GetLineByLine()
+    int  LocateByRow( /*OUT*/ MadLineIterator &lit, /*OUT*/ wxFileOffset &pos, /*IN_OUT*/ int &rowid ) const;
+    int  LocateByPos( /*OUT*/ MadLineIterator &lit, /*IN_OUT*/ wxFileOffset &pos, /*OUT*/ int &rowid ) const;
+    int  LocateByLine( /*OUT*/ MadLineIterator &lit, /*OUT*/ wxFileOffset &pos, /*IN*/ int lineid ) const;
+    int  GetLineId( MadLineIterator position ) const;
+
+    // O(log n) bookmark operations
     void ToggleBookmark( MadLineIterator position );      // toggle bookmark from given position
     int  GetNextBookmark( MadLineIterator position );     // return line number, or -1 if no bookmars
     int  GetPreviousBookmark( MadLineIterator position ); // return line number from the end to the beginning, or -1
-    bool Bookmarked( MadLineIterator position );
-    void ClearAllBookmarks();
-    bool BookmarkExist() { return !m_BookmarkList.empty(); }
+    bool Bookmarked( MadLineIterator position ) const { return m_Index.Marked(position); }
+    void ClearAllBookmarks() { m_Index.ClearMarks(); }
+    bool BookmarkExist() const { return m_Index.MarkCount() != 0; }
 
     LineNumberList SaveBookmarkLineNumberList() const;
     void RestoreBookmarkByLineNumberList(const LineNumberList& linenums);
@@ -357,12 +413,11 @@ public:
     MadLineIterator erase( MadLineIterator position );
 
 private:
-    // it is private because bookmarks removal is not implemented yet for it
+    // it is private because the index is not updated for it
     // in this way if someone try to use it, he will get compiler error
     MadLineIterator erase( MadLineIterator first, MadLineIterator last )
         { return list<MadLine>::erase(first, last); }
 };
-typedef list<MadLineIterator>::iterator  MadBookmarkIterator;
 
 class MadEdit;
 class MadSyntax;
@@ -372,6 +427,37 @@ namespace wxm
     struct WXMSearcher;
 }
 
+// how the bytes were written by the last MadLines::SaveToFile()
+struct MadSaveStats
+{
+    wxFileOffset m_Copied;      // copied from the old file by the kernel
+    wxFileOffset m_Rewritten;   // written from the buffer
+    wxFileOffset m_Unchanged;   // left in place when saving to the same file
+    wxFileOffset m_Moved;       // moved to tempdata when saving to the same file
+
+    MadSaveStats() { Reset(); }
+    void Reset() { m_Copied = m_Rewritten = m_Unchanged = m_Moved = 0; }
+};
+
+// the bytes of MadMemData counted by the last MadLines::CountMemData() or CompactMemData()
+struct MadMemDataStats
+{
+    wxFileOffset m_Live;        // referred to by the lines, the undos or the clipboard
+    wxFileOffset m_Dead;        // put but no longer referred to
+    wxFileOffset m_Allocated;   // the buffers
+    size_t       m_Compactions; // done so far
+    wxFileOffset m_Reclaimed;   // freed by the compactions so far
+
+    MadMemDataStats(): m_Live(0), m_Dead(0), m_Allocated(0), m_Compactions(0), m_Reclaimed(0) {}
+};
+
+// visits every block vector that may refer to MadMemData, see MadLines::VisitBlocks()
+struct MadBlockVisitor
+{
+    virtual ~MadBlockVisitor() {}
+    virtual void Visit(MadBlockVector &blocks) = 0;
+};
+
 class MadLines: public wxm::UChar32BytesMapper
 {
 private:
@@ -390,6 +476,19 @@ private:
 
     MadLineState m_EndState;
 
+    // changed whenever the data, the rows or the states of some lines may have changed,
+    // MadEdit keeps the layouts of the painted rows only within a generation
+    size_t m_Generation;
+
+    // the states of some lines were not propagated to their following lines,
+    // the lines before m_StaleLineHint are not stale
+    bool m_HasStaleLines;
+    size_t m_StaleLineHint;
+
+    // if it isn't nluNone, the last line holds the data after the newline chars
+    // found so far, which is split into lines by IndexTail() on demand
+    xm::NewLineUnit m_TailNewLineUnit;
+
     MadFileData *m_FileData;
     MadFileData *m_TmpFileData;
 
@@ -401,6 +500,14 @@ private:
 
     wxByte          *m_WriteBuffer;
     vector<wxByte>  m_WriteBufferVector;
+    size_t          m_WriteBufferUsed;  // by WriteToFile()
+
+    MadSaveStats    m_SaveStats;
+
+    // the blocks referring to m_MemData are held elsewhere while it's pinned
+    friend struct MadMemDataPin;
+    size_t          m_MemDataPins;
+    MadMemDataStats m_MemDataStats;
 
 private:
 
@@ -410,8 +517,39 @@ private:
     size_t ReformatCount;
     // reformat single line, return the state of line-end
     MadLineState Reformat(MadLineIterator iter);
-    // reformat lines in [first,last]
+    // reformat lines in [first,last], and the following lines whose states changed
+    // up to about a screen of lines, the rest are left to ReformatStaleLines()
     size_t Reformat(MadLineIterator first, MadLineIterator last);
+    size_t Reformat(MadLineIterator first, MadLineIterator last, size_t maxrest);
+    void MarkStaleLine(MadLineIterator lit);
+
+public:
+    size_t GetGeneration() const { return m_Generation; }
+
+    bool HasStaleLines() const { return m_HasStaleLines; }
+    // propagate the states of stale lines in document order for about maxms milliseconds,
+    // return reformatted line count, [firstline, lastline] are the ids of the reformatted lines
+    size_t ReformatStaleLines(long maxms, /*OUT*/ int &firstline, /*OUT*/ int &lastline);
+
+    // a huge file is shown after the lines of its head are split, the rest are split
+    // when they are required, and in the idle time by ReformatStaleLines()
+    bool HasUnindexedTail() const { return m_TailNewLineUnit != xm::nluNone; }
+    // split lines out of the unindexed tail until rowid, lineid or pos is not in it
+    void IndexTailByRow(size_t rowid);
+    void IndexTailByLine(size_t lineid);
+    void IndexTailByPos(wxFileOffset pos);
+    void IndexWholeTail() { IndexTailByPos(m_Size); }
+    // m_RowCount plus the rows of the unindexed tail estimated by the indexed lines
+    size_t GetEstimatedRowCount();
+
+private:
+    // split the data of iter into lines by locating the newline chars in the raw bytes,
+    // stop at the first newline char after minsize bytes and return true if some data is left;
+    // the new lines are left to Reformat() & ReformatStaleLines()
+    bool SplitLines(MadLineIterator iter, xm::NewLineUnit nlu, wxFileOffset minsize);
+    bool IsUnindexedTail(const MadLineIterator &lit);
+    void IndexTail(wxFileOffset minsize);
+
     // Recount all lines' width
     void RecountLineWidth(void);
 
@@ -421,9 +559,18 @@ private:
     // write to fd or file if which one isn't Null
     void WriteBlockToData(MadOutData *fd, const MadBlockIterator &bit);
     void WriteToFile(wxFile &file, MadFileData *oldfd, MadFileData *newfd);
+    // for WriteToFile(), the ranges of oldfd are copied by the kernel if possible
+    void WriteBuffered(wxFile &file, MadInData *data, wxFileOffset pos, wxFileOffset size);
+    void FlushWriteBuffer(wxFile &file);
+    void CopyFileRange(wxFile &file, MadFileData *fd, wxFileOffset pos, wxFileOffset size);
 
     wxFileOffset GetMaxTempSize(const wxString &filename);
 
+    // visit the blocks of the lines, the undos and the deferred clipboard text
+    void VisitBlocks(MadBlockVisitor &visitor);
+    // collect and pack the live ranges of m_MemData, and count them into m_MemDataStats
+    void CollectLiveMemData(MadLiveRanges &live);
+
     void InitFileSyntax();
 
 public:
@@ -432,8 +579,17 @@ public:
 
     bool LoadFromFile(const wxString &filename, const wxString &encoding = wxEmptyString);
     bool SaveToFile(const wxString &filename, const wxString &tempdir);
+    const MadSaveStats &GetSaveStats() { return m_SaveStats; }
     wxFileOffset GetSize() { return m_Size; }
 
+    // count the live bytes of m_MemData referred to by the lines, the undos and the clipboard
+    const MadMemDataStats &CountMemData();
+    const MadMemDataStats &GetMemDataStats() { return m_MemDataStats; }
+    // copy the live bytes of m_MemData into fresh buffers and free the old buffers if
+    // the bytes to free are not less than minFree and the live bytes; it must not be
+    // called while any block is held out of the lines, the undos and the clipboard
+    bool CompactMemData(wxFileOffset minFree);
+
 private:  // NextUChar()
     wxByte          *m_NextUChar_Buffer;
     size_t          m_NextUChar_BufferStart;
@@ -447,6 +603,16 @@ private:  // NextUChar()
     wxFileOffset    m_NextUChar_LineSize;
     wxFileOffset    m_NextUChar_Pos;
 
+    // UChar32s decoded ahead by WXMEncoding::DecodeUChar32s(),
+    // their bytes have been taken out of m_NextUChar_Buffer
+    ucs4_t          *m_NextUChar_UCs;
+    wxByte          *m_NextUChar_Lens;
+    size_t          m_NextUChar_DecodedStart;
+    size_t          m_NextUChar_DecodedCount;
+    size_t          m_NextUChar_DecodeBatch;
+    bool DecodeNextUChars();
+    void UndoDecodedUChars();
+
     bool m_manual;
 
     virtual void MoveUChar32Bytes(MadUCQueue &ucqueue, ucs4_t uc, size_t len) override;
@@ -456,9 +622,9 @@ private:  // NextUChar()
 
     void DetectSyntax(const wxString &filename);
 
-    bool PresetFileEncoding(const wxString& encoding, const wxByte* buf, size_t sz);
+    bool PresetFileEncoding(const wxString& encoding, const wxm::EncodingSample& sample);
     void SetFileEncoding(const wxString& encoding, const wxString& defaultenc, 
-                         const wxByte* buf, size_t sz, bool skip_utf8);
+                         const wxm::EncodingSample& sample, bool skip_utf8);
 
     int FindStringCase(MadUCQueue &ucqueue, MadStringIterator begin,
                    const MadStringIterator &end, size_t &len);
@@ -488,5 +654,15 @@ public:
     MadUCPair PreviousUChar(/*IN_OUT*/MadLineIterator &lit, /*IN_OUT*/wxFileOffset &linepos);
 };
 
+// MadLines::CompactMemData() does nothing in the scope of it, for the blocks held
+// while the events may be dispatched, e.g. by a progress dialog
+struct MadMemDataPin
+{
+    MadMemDataPin(MadLines *lines): m_Lines(lines) { ++m_Lines->m_MemDataPins; }
+    ~MadMemDataPin() { --m_Lines->m_MemDataPins; }
+private:
+    MadLines *m_Lines;
+};
+
 
 #endif
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4 expandtab
+// Name:        wxmedit/wxm_row_layout.h
+// Description: The Cached Layouts of the Painted Rows
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WXM_ROW_LAYOUT_H_
+#define _WXM_ROW_LAYOUT_H_
+
+#include "../xm/cxx11.h"
+#include "../xm/lru_cache.hpp"
+#include "ucs4_t.h"
+
+#ifdef _MSC_VER
+# pragma warning( push )
+# pragma warning( disable : 4996 )
+#endif
+// disable 4996 {
+#include <wx/defs.h>
+#include <wx/colour.h>
+#include <wx/font.h>
+// disable 4996 }
+#ifdef _MSC_VER
+# pragma warning( pop )
+#endif
+
+#include <vector>
+#include <utility>
+
+struct MadLine;
+
+// a word returned by MadSyntax::NextWord(), its chars and widths are in MadRowLayout
+struct MadRowWord
+{
+    size_t  first;      // index of the first char in MadRowLayout::chars
+    size_t  count;
+    int     width;
+    wxColour color, bgcolor;
+    wxFont  *font;
+};
+
+// the words of a row laid out by MadSyntax::NextWord() for MadEdit::PaintTextLines(),
+// which are painted again without decoding and parsing the row until it is changed
+struct MadRowLayout
+{
+    std::vector<ucs4_t> chars;
+    std::vector<int>    widths;
+    std::vector<MadRowWord> words;
+    int     width;              // sum of the widths of words
+    // the row was laid out to its end; otherwise it was cut after the first word
+    // crossing the right side of the text area, and width is beyond the side
+    bool    complete;
+    bool    end_of_line;        // it's the last row of its line
+    wxColour current_bgcolor;   // for the rest of the row
+    wxColour eol_color, eol_bgcolor;  // for the mark of the newline chars
+
+    MadRowLayout(): width(0), complete(false), end_of_line(false) {}
+
+    void Clear()
+    {
+        chars.clear();
+        widths.clear();
+        words.clear();
+        width = 0;
+        complete = true;
+        end_of_line = false;
+    }
+
+    void AddWord(const ucs4_t *wordchars, const int *wordwidths, size_t count, int wordwidth,
+                 const wxColour &color, const wxColour &bgcolor, wxFont *font)
+    {
+        MadRowWord word;
+        word.first = chars.size();
+        word.count = count;
+        word.width = wordwidth;
+        word.color = color;
+        word.bgcolor = bgcolor;
+        word.font = font;
+        words.push_back(word);
+
+        chars.insert(chars.end(), wordchars, wordchars + count);
+        widths.insert(widths.end(), wordwidths, wordwidths + count);
+        width += wordwidth;
+    }
+};
+
+// a row of a line, the layouts of all lines are dropped when MadLines::GetGeneration() changes,
+// then a line erased is never confused with a new line at the same address
+typedef std::pair<const MadLine*, int> MadRowLayoutKey;
+typedef xm::LRUCache<MadRowLayoutKey, MadRowLayout> MadRowLayoutCache;
+
+#endif //_WXM_ROW_LAYOUT_H_
@@ -21,12 +21,17 @@
 #include <wx/textfile.h>
 #include <wx/filename.h>
 #include <wx/intl.h>
+#include <wx/file.h>
+#include <wx/log.h>
+#include <wx/thread.h>
 // disable 4996 }
 #ifdef _MSC_VER
 # pragma warning( pop )
 #endif
 
 #include <boost/tr1/unordered_map.hpp>
+#include <string>
+#include <cstring>
 
 #ifdef _DEBUG
 #include <crtdbg.h>
@@ -565,6 +570,363 @@ bool MadSyntax::DeleteScheme(const wxString &schname)
     return true;
 }
 
+//========================================================
+// parsed syntax files cache
+
+wxString MadSyntax::s_CacheFilePath;
+
+struct ParsedSyntax
+{
+    time_t mtime;
+    boost::shared_ptr<const MadSyntax> syntax;
+};
+
+typedef std::tr1::unordered_map<wxString, ParsedSyntax, wxStringHash> ParsedSyntaxMap;
+
+ParsedSyntaxMap g_ParsedSyntaxMap;
+wxMutex g_ParsedSyntaxMutex;
+
+// the cache file is only read back on the same machine by the same build,
+// so the values are written in native byte order
+const char SyntaxCacheMagic[8] = { 'W', 'X', 'M', 'S', 'Y', 'N', '1', char(sizeof(wchar_t)) };
+const wxUint64 SyntaxCacheEndMark = 0x444E454E59534D58ULL;
+
+class SyntaxCacheWriter
+{
+    std::string m_Data;
+
+    void Put(const void *p, size_t n) { m_Data.append((const char*)p, n); }
+public:
+    const std::string &Data() { return m_Data; }
+
+    void Magic() { Put(SyntaxCacheMagic, sizeof(SyntaxCacheMagic)); }
+
+    template <typename T>
+    void operator()(const T &v)
+    {
+        wxUint64 u = wxUint64(v);
+        Put(&u, sizeof(u));
+    }
+    void operator()(const wxString &s)
+    {
+        (*this)(s.Len());
+        Put(s.wc_str(), s.Len() * sizeof(wchar_t));
+    }
+    void operator()(const wxColour &c)
+    {
+        bool ok = c.Ok();
+        (*this)(ok);
+        if(ok)
+            (*this)((wxUint32(c.Red()) << 16) | (wxUint32(c.Green()) << 8) | wxUint32(c.Blue()));
+    }
+    template <typename T>
+    void operator()(const vector<T> &vec)
+    {
+        (*this)(vec.size());
+        for(size_t i = 0; i < vec.size(); ++i)
+            (*this)(vec[i]);
+    }
+    void operator()(const MadSyntaxRange &ra)
+    {
+        (*this)(ra.id);
+        (*this)(ra.begin);
+        (*this)(ra.end);
+        (*this)(ra.bgcolor);
+    }
+    void operator()(const MadSyntaxKeyword &kw)
+    {
+        (*this)(kw.m_Name);
+        (*this)(kw.m_Attr.color);
+        (*this)(kw.m_Attr.bgcolor);
+        (*this)(kw.m_Attr.style);
+        (*this)(kw.m_InRange);
+        (*this)(kw.m_CaseSensitive);
+        (*this)(kw.m_Keywords->size());
+        for(MadKeywordSet::const_iterator it = kw.m_Keywords->begin(); it != kw.m_Keywords->end(); ++it)
+            (*this)(*it);
+    }
+};
+
+class SyntaxCacheReader
+{
+    const char *m_Pos, *m_End;
+    bool m_OK;
+
+    bool Get(void *p, size_t n)
+    {
+        if(!m_OK || size_t(m_End - m_Pos) < n)
+            return m_OK = false;
+        memcpy(p, m_Pos, n);
+        m_Pos += n;
+        return true;
+    }
+    size_t GetSize()
+    {
+        wxUint64 u = 0;
+        Get(&u, sizeof(u));
+        if(u > wxUint64(m_End - m_Pos))   // a corrupted count
+        {
+            m_OK = false;
+            return 0;
+        }
+        return size_t(u);
+    }
+public:
+    SyntaxCacheReader(const char *data, size_t size): m_Pos(data), m_End(data + size), m_OK(true) {}
+
+    bool OK() const { return m_OK; }
+    bool AtEnd() const { return m_OK && m_Pos == m_End; }
+
+    bool Magic()
+    {
+        char magic[sizeof(SyntaxCacheMagic)];
+        return Get(magic, sizeof(magic)) && memcmp(magic, SyntaxCacheMagic, sizeof(magic)) == 0;
+    }
+
+    template <typename T>
+    void operator()(T &v)
+    {
+        wxUint64 u = 0;
+        Get(&u, sizeof(u));
+        v = T(u);
+    }
+    void operator()(bool &b)
+    {
+        wxUint64 u = 0;
+        Get(&u, sizeof(u));
+        b = (u != 0);
+    }
+    void operator()(wxString &s)
+    {
+        size_t len = GetSize();
+        vector<wchar_t> buf(len + 1);
+        Get(&buf[0], len * sizeof(wchar_t));
+        s = m_OK ? wxString(&buf[0], len) : wxString();
+    }
+    void operator()(wxColour &c)
+    {
+        bool ok = false;
+        (*this)(ok);
+        c = wxNullColour;
+        if(ok)
+        {
+            wxUint32 rgb = 0;
+            (*this)(rgb);
+            c.Set(wxByte(rgb >> 16), wxByte(rgb >> 8), wxByte(rgb));
+        }
+    }
+    template <typename T>
+    void operator()(vector<T> &vec)
+    {
+        size_t n = GetSize();
+        vec.clear();
+        vec.resize(n);
+        for(size_t i = 0; i < n && m_OK; ++i)
+            (*this)(vec[i]);
+    }
+    void operator()(MadSyntaxRange &ra)
+    {
+        (*this)(ra.id);
+        (*this)(ra.begin);
+        (*this)(ra.end);
+        (*this)(ra.bgcolor);
+    }
+    void operator()(MadSyntaxKeyword &kw)
+    {
+        (*this)(kw.m_Name);
+        (*this)(kw.m_Attr.color);
+        (*this)(kw.m_Attr.bgcolor);
+        (*this)(kw.m_Attr.style);
+        (*this)(kw.m_InRange);
+        (*this)(kw.m_CaseSensitive);
+        size_t n = GetSize();
+        wxString word;
+        for(size_t i = 0; i < n && m_OK; ++i)
+        {
+            (*this)(word);
+            kw.m_Keywords->insert(word);
+        }
+    }
+};
+
+template <typename Archive>
+void MadSyntax::Serialize(Archive &ar)
+{
+    ar(m_Title);
+    for(int i = 0; i < aeNone; i++)
+    {
+        ar(m_SystemAttributes[i].color);
+        ar(m_SystemAttributes[i].bgcolor);
+        ar(m_SystemAttributes[i].style);
+    }
+    ar(m_CaseSensitive);
+    ar(m_Delimiter);
+    ar(m_LineComment);
+    ar(m_BlockCommentOn);
+    ar(m_BlockCommentOff);
+    ar(m_EscapeChar);
+    ar(m_StringChar);
+    ar(m_DirectiveLeading);
+    ar(m_KeywordPrefix);
+    ar(m_SpecialWordPrefix);
+    ar(m_IndentChar);
+    ar(m_UnindentChar);
+    ar(m_LeftBrace);
+    ar(m_RightBrace);
+    ar(m_AutoCompleteLeftChar);
+    ar(m_AutoCompleteRightChar);
+    ar(m_Encoding);
+    ar(m_StringInRange);
+    ar(m_LineCommentInRange);
+    ar(m_BlockCommentInRange);
+    ar(m_LineCommentAtBOL);
+    ar(m_DirectiveLeadingAtBOL);
+    ar(m_CustomRange);
+    ar(m_RangeBeginString);
+    ar(m_CustomKeyword);
+    ar(m_CheckState);
+    ar(nw_EscapeChar);
+    ar(nw_MaxKeywordLen);
+}
+
+bool MadSyntax::LoadCache(const wxString &cachefile, const wxString &filename, time_t mtime)
+{
+    wxLogNull nolog;
+    if(!wxFileExists(cachefile))
+        return false;
+
+    wxFile file(cachefile);
+    wxFileOffset size = file.IsOpened() ? file.Length() : -1;
+    if(size <= 0 || size > 64 * 1024 * 1024)
+        return false;
+
+    vector<char> data(size_t(size));
+    if(size_t(file.Read(&data[0], data.size())) != data.size())
+        return false;
+
+    SyntaxCacheReader ar(&data[0], data.size());
+
+    wxString name;
+    wxInt64 mt = 0;
+    if(!ar.Magic())
+        return false;
+    ar(name);
+    ar(mt);
+    if(!ar.OK() || name != filename || mt != wxInt64(mtime))
+        return false;
+
+    Serialize(ar);
+
+    wxUint64 endmark = 0;
+    ar(endmark);
+    return endmark == SyntaxCacheEndMark && ar.AtEnd();
+}
+
+void MadSyntax::SaveCache(const wxString &cachefile, const wxString &filename, time_t mtime)
+{
+    SyntaxCacheWriter ar;
+    ar.Magic();
+    ar(filename);
+    ar(wxInt64(mtime));
+    Serialize(ar);
+    ar(SyntaxCacheEndMark);
+
+    wxLogNull nolog;
+    wxFileName fn(cachefile);
+    if(!wxDirExists(fn.GetPath()) && !wxFileName::Mkdir(fn.GetPath(), 0777, wxPATH_MKDIR_FULL))
+        return;
+
+    wxFile file(cachefile, wxFile::write);
+    if(file.IsOpened())
+        file.Write(ar.Data().data(), ar.Data().size());
+}
+
+boost::shared_ptr<const MadSyntax> MadSyntax::GetParsedSyntax(const wxString &filename)
+{
+    time_t mtime = -1;
+    if(wxFileExists(filename))
+    {
+        wxLogNull nolog;
+        mtime = wxFileModificationTime(filename);
+    }
+
+    wxMutexLocker lock(g_ParsedSyntaxMutex);
+
+    ParsedSyntaxMap::iterator it = g_ParsedSyntaxMap.find(filename);
+    if(it != g_ParsedSyntaxMap.end() && it->second.mtime == mtime)
+        return it->second.syntax;
+
+    boost::shared_ptr<MadSyntax> syn(new MadSyntax(false));
+
+    wxString cachefile;
+    wxFileName fn(filename);
+    if(mtime != -1 && !s_CacheFilePath.IsEmpty() && fn.GetExt().CmpNoCase(wxT("syn")) == 0)
+        cachefile = s_CacheFilePath + fn.GetName() + wxT(".synbin");
+
+    if(cachefile.IsEmpty() || !syn->LoadCache(cachefile, filename, mtime))
+    {
+        syn->Reset();
+        syn->ParseSyntax(filename);
+
+        if(!cachefile.IsEmpty())
+            syn->SaveCache(cachefile, filename, mtime);
+    }
+
+    ParsedSyntax &ps = g_ParsedSyntaxMap[filename];
+    ps.mtime = mtime;
+    ps.syntax = syn;
+    return syn;
+}
+
+void MadSyntax::ForgetParsedSyntax(const wxString &filename)
+{
+    wxMutexLocker lock(g_ParsedSyntaxMutex);
+    g_ParsedSyntaxMap.erase(filename);
+}
+
+void MadSyntax::AssignDefinition(const MadSyntax &syn)
+{
+    m_Title = syn.m_Title;
+    for(int i = 0; i < aeNone; i++)
+        m_SystemAttributes[i] = syn.m_SystemAttributes[i];
+
+    m_CaseSensitive = syn.m_CaseSensitive;
+    m_Delimiter = syn.m_Delimiter;
+    m_LineComment = syn.m_LineComment;
+    m_BlockCommentOn = syn.m_BlockCommentOn;
+    m_BlockCommentOff = syn.m_BlockCommentOff;
+    m_EscapeChar = syn.m_EscapeChar;
+    m_StringChar = syn.m_StringChar;
+    m_DirectiveLeading = syn.m_DirectiveLeading;
+    m_KeywordPrefix = syn.m_KeywordPrefix;
+    m_SpecialWordPrefix = syn.m_SpecialWordPrefix;
+    m_IndentChar = syn.m_IndentChar;
+    m_UnindentChar = syn.m_UnindentChar;
+    m_LeftBrace = syn.m_LeftBrace;
+    m_RightBrace = syn.m_RightBrace;
+    m_AutoCompleteLeftChar = syn.m_AutoCompleteLeftChar;
+    m_AutoCompleteRightChar = syn.m_AutoCompleteRightChar;
+    m_Encoding = syn.m_Encoding;
+
+    m_StringInRange = syn.m_StringInRange;
+    m_LineCommentInRange = syn.m_LineCommentInRange;
+    m_BlockCommentInRange = syn.m_BlockCommentInRange;
+
+    m_LineCommentAtBOL = syn.m_LineCommentAtBOL;
+    m_DirectiveLeadingAtBOL = syn.m_DirectiveLeadingAtBOL;
+
+    m_CustomRange = syn.m_CustomRange;
+    m_RangeBeginString = syn.m_RangeBeginString;
+    m_CustomKeyword = syn.m_CustomKeyword;  // the keyword sets are shared
+
+    m_CheckState = syn.m_CheckState;
+
+    nw_EscapeChar = syn.nw_EscapeChar;
+    nw_MaxKeywordLen = syn.nw_MaxKeywordLen;
+
+    BuildMatchers();
+}
+
 //========================================================
 
 MadSyntax::MadSyntax(const wxString &filename, bool loadAttr)
@@ -590,8 +952,7 @@ MadSyntax::~MadSyntax()
 
 void MadSyntax::LoadFromFile(const wxString &filename)
 {
-    Reset();    // reset attributes
-    ParseSyntax(filename);
+    AssignDefinition(*GetParsedSyntax(filename));
 }
 
 void MadSyntax::ParseSyntax(const wxString &filename)
@@ -879,7 +1240,7 @@ void MadSyntax::ParseSyntax(const wxString &filename)
                     if(!ck->m_CaseSensitive)
                         kw.MakeLower();
 
-                    ck->m_Keywords.insert(kw);
+                    ck->m_Keywords->insert(kw);
 
                     kw=tkz.GetNextToken();
                 }
@@ -1024,12 +1385,7 @@ void MadSyntax::Reset()
     m_CustomRange.clear();
     m_RangeBeginString.clear();
 
-    for(i = 0; i < m_CustomKeyword.size(); i++)
-    {
-        m_CustomKeyword[i].m_InRange.clear();
-        m_CustomKeyword[i].m_Keywords.clear();
-    }
-    m_CustomKeyword.clear();
+    m_CustomKeyword.clear();  // the keyword sets may be shared
 
     m_CheckState = false;
 
@@ -1057,6 +1413,31 @@ void MadSyntax::Reset()
         pat->style=fsNone;
         pat++;
     }
+
+    BuildMatchers();
+}
+
+void MadSyntax::BuildMatchers()
+{
+    m_DelimiterBits.Clear();
+    const wchar_t *cstr = m_Delimiter.c_str();
+    while(*cstr != 0)
+    {
+        m_DelimiterBits.Set((ucs4_t)*cstr);
+        ++cstr;
+    }
+
+    m_DelimiterOrSpaceBits = m_DelimiterBits;
+    m_DelimiterOrSpaceBits.Set(0x20);
+    for(ucs4_t uc = 0x09; uc <= 0x0D; uc++)
+        m_DelimiterOrSpaceBits.Set(uc);
+
+    bool nocase = !m_CaseSensitive;
+    m_LineCommentMatcher.Build(m_LineComment, nocase);
+    m_BlockCommentOnMatcher.Build(m_BlockCommentOn, nocase);
+    m_LeftBraceMatcher.Build(m_LeftBrace, nocase);
+    m_RightBraceMatcher.Build(m_RightBrace, nocase);
+    m_RangeBeginMatcher.Build(m_RangeBeginString, nocase);
 }
 
 MadAttributes *MadSyntax::GetAttributes(const wxString &name)
@@ -1269,6 +1650,7 @@ void MadSyntax::InitNextWord2(MadLineIterator &lit, size_t row)
         if((nw_State.rangeid = state.RangeId) != 0)
         {
             nw_SynRange = GetSyntaxRange(nw_State.rangeid);
+            nw_SynRangeEnd.assign(1, nw_SynRange->end);
             nw_CurrentBgColor = nw_SynRange->bgcolor; // set bgcolor for empty lines
             if(nw_CurrentBgColor==wxNullColour)
             {
@@ -1320,6 +1702,98 @@ void MadSyntax::SetEncoding(wxm::WXMEncoding *encoding)
     nw_Encoding=encoding;
 }
 
+void MadStringMatcher::Clear()
+{
+    m_Nodes.assign(1, Node());
+    m_FirstChars.Clear();
+    m_WideFirstChar = false;
+    m_NoCase = false;
+}
+
+void MadStringMatcher::Build(const vector < wxString > &strs, bool nocase)
+{
+    Clear();
+    m_NoCase = nocase;
+
+    for(size_t i = 0; i < strs.size(); i++)
+    {
+        const wchar_t *cstr = strs[i].c_str();
+        if(*cstr == 0) continue;
+
+        int idx = int(i + 1);
+        if((ucs4_t)*cstr < 0x100)
+            m_FirstChars.Set((ucs4_t)*cstr);
+        else
+            m_WideFirstChar = true;
+
+        size_t node = 0;
+        do
+        {
+            ucs4_t uc = (ucs4_t)*cstr;
+            size_t next = Child(node, uc);
+            if(next == 0)
+            {
+                next = m_Nodes.size();
+                m_Nodes[node].children.push_back(std::make_pair(uc, next));
+                m_Nodes.push_back(Node());
+            }
+            node = next;
+
+            // the smaller index wins, as FindString() tests the strings in order
+            int &ni = (*(++cstr) == 0) ? m_Nodes[node].index : m_Nodes[node].subindex;
+            if(ni == 0) ni = idx;
+        }
+        while(*cstr != 0);
+    }
+}
+
+size_t MadStringMatcher::Child(size_t node, ucs4_t uc) const
+{
+    const vector < std::pair<ucs4_t, size_t> > &children = m_Nodes[node].children;
+    for(size_t i = 0; i < children.size(); i++)
+    {
+        if(children[i].first == uc)
+            return children[i].second;
+    }
+    return 0;
+}
+
+int MadStringMatcher::FindFrom(MadLines *lines, MadUCQueue &ucqueue, size_t first, ucs4_t uc, size_t &len) const
+{
+    int found = 0;
+    size_t node = 0, depth = 0;
+
+    for(;;)
+    {
+        if((node = Child(node, uc)) == 0)
+            break;
+        ++depth;
+
+        const Node &n = m_Nodes[node];
+        if(n.index != 0 && (found == 0 || n.index < found))
+        {
+            found = n.index;
+            len = depth;
+        }
+
+        // no longer string can win
+        if(n.subindex == 0 || (found != 0 && n.subindex > found))
+            break;
+
+        size_t i = first + depth;
+        if(i == ucqueue.size() && !lines->NextUChar(ucqueue))
+            break;
+
+        uc = ucqueue[i].first;
+        if(uc == 0x0D || uc == 0x0A)
+            break;
+        if(m_NoCase && uc >= 'A' && uc <= 'Z')
+            uc |= 0x20; // to lower case
+    }
+
+    return found;
+}
+
 // 0: none, 1: first, 2:...
 int MadSyntax::FindStringCase(MadUCQueue & ucqueue, size_t first,
                         MadStringIterator begin, const MadStringIterator & end,
@@ -1569,10 +2043,8 @@ int MadSyntax::NextWord(int &wordwidth)
                         {
                             if(nw_SynRange)
                             {
-                                vector < wxString > strvec;
-                                strvec.push_back(nw_SynRange->end);
                                 if((this->*FindString)(nw_ucqueue, nw_FirstIndex,
-                                    strvec.begin(), strvec.end(), strlen) != 0)
+                                    nw_SynRangeEnd.begin(), nw_SynRangeEnd.end(), strlen) != 0)
                                 {
                                     nw_NextState.rangeid = 0;
                                     nw_FirstIndex += strlen;
@@ -1607,8 +2079,7 @@ int MadSyntax::NextWord(int &wordwidth)
                         // check Block Comment On
                         if(!m_BlockCommentOn.empty())
                         {
-                            idx =(this->*FindString)(nw_ucqueue, nw_FirstIndex,
-                                m_BlockCommentOn.begin(), m_BlockCommentOn.end(), strlen);
+                            idx = m_BlockCommentOnMatcher.Find(nw_MadLines, nw_ucqueue, nw_FirstIndex, strlen);
                             if(idx != 0)
                             {
                                 // check InRange
@@ -1634,8 +2105,7 @@ int MadSyntax::NextWord(int &wordwidth)
                         {
                             if(!m_LineComment.empty())
                             {
-                                idx =(this->*FindString)(nw_ucqueue, nw_FirstIndex,
-                                    m_LineComment.begin(), m_LineComment.end(), strlen);
+                                idx = m_LineCommentMatcher.Find(nw_MadLines, nw_ucqueue, nw_FirstIndex, strlen);
                                 if(idx != 0)
                                 {
                                     if(IsInRange(nw_State.rangeid, m_LineCommentInRange))
@@ -1685,12 +2155,13 @@ int MadSyntax::NextWord(int &wordwidth)
                         // check Range On
                         if(nw_State.rangeid == 0 && !m_RangeBeginString.empty())
                         {
-                            idx = (this->*FindString)(nw_ucqueue, nw_FirstIndex,
-                                m_RangeBeginString.begin(), m_RangeBeginString.end(), strlen);
+                            idx = m_RangeBeginMatcher.Find(nw_MadLines, nw_ucqueue, nw_FirstIndex, strlen);
                             if(idx != 0)
                             {
                                 nw_NextState.rangeid = wxByte(m_CustomRange[idx - 1].id);
                                 nw_SynRange = GetSyntaxRange(nw_NextState.rangeid);
+                                if(nw_SynRange)
+                                    nw_SynRangeEnd.assign(1, nw_SynRange->end);
 
                                 nw_FirstIndex += strlen;
 
@@ -1964,9 +2435,9 @@ int MadSyntax::NextWord(int &wordwidth)
                 {
                     if(IsInRange(nw_State.rangeid, kit->m_InRange))
                     {
-                        if(kit->m_CaseSensitive) it = kit->m_Keywords.find(strorg);
-                        else                     it = kit->m_Keywords.find(strlower);
-                        if(it != kit->m_Keywords.end())
+                        if(kit->m_CaseSensitive) it = kit->m_Keywords->find(strorg);
+                        else                     it = kit->m_Keywords->find(strlower);
+                        if(it != kit->m_Keywords->end())
                         {
                             bIsKeyword = true;
                             break;
@@ -2078,9 +2549,9 @@ int MadSyntax::NextWord(int &wordwidth)
                 {
                     if(IsInRange(nw_State.rangeid, kit->m_InRange))
                     {
-                        if(kit->m_CaseSensitive) it = kit->m_Keywords.find(strorg);
-                        else                     it = kit->m_Keywords.find(strlower);
-                        if(it != kit->m_Keywords.end())
+                        if(kit->m_CaseSensitive) it = kit->m_Keywords->find(strorg);
+                        else                     it = kit->m_Keywords->find(strlower);
+                        if(it != kit->m_Keywords->end())
                         {
                             bIsKeyword = true;
                             break;
@@ -2359,6 +2830,9 @@ void MadSyntax::SaveAttributes(const wxString &file)
         value.Printf(wxT("%s"), GetStyleString(m_CustomKeyword[i].m_Attr.style).c_str());
         syn.Write(str, value);
     }
+
+    syn.Flush();
+    ForgetParsedSyntax(attfile);
 }
 
 void MadSyntax::AssignAttributes(MadSyntax *syn, bool add)
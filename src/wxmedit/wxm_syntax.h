@@ -35,6 +35,7 @@
 #endif
 
 #include <boost/tr1/unordered_set.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <map>
 #include <vector>
@@ -71,10 +72,10 @@ struct MadSyntaxKeyword
     wxString m_Name;
     MadAttributes m_Attr;
     vector < int > m_InRange;
-    MadKeywordSet m_Keywords;
+    boost::shared_ptr<MadKeywordSet> m_Keywords; // shared by the copies of a parsed syntax
     bool m_CaseSensitive;
 
-    MadSyntaxKeyword() : m_CaseSensitive(false)
+    MadSyntaxKeyword() : m_Keywords(new MadKeywordSet), m_CaseSensitive(false)
     {}
 };
 
@@ -98,6 +99,71 @@ struct MadState
 };
 
 
+// a set of chars in 0x00~0xFF
+struct MadCharBits
+{
+    wxUint32 m_Bits[8];
+
+    MadCharBits() { Clear(); }
+    void Clear()
+    {
+        for(int i = 0; i < 8; i++) m_Bits[i] = 0;
+    }
+    void Set(ucs4_t uc)
+    {
+        if(uc < 0x100) m_Bits[uc >> 5] |= (wxUint32(1) << (uc & 31));
+    }
+    bool Test(ucs4_t uc) const
+    {
+        return uc < 0x100 && (m_Bits[uc >> 5] & (wxUint32(1) << (uc & 31))) != 0;
+    }
+};
+
+// MadStringMatcher is a trie compiled from a list of strings, it finds
+// which string of the list matches the chars at a position of MadUCQueue
+// by walking the chars only once, instead of comparing every string.
+class MadStringMatcher
+{
+public:
+    MadStringMatcher() { Clear(); }
+
+    void Clear();
+    // if nocase, strs must be lower case
+    void Build(const vector < wxString > &strs, bool nocase);
+
+    // the same as MadSyntax::FindString(): 0: none, 1: first, 2:...
+    // more chars of the line will be read into ucqueue by lines if need
+    int Find(MadLines *lines, MadUCQueue &ucqueue, size_t first, size_t &len) const
+    {
+        ucs4_t uc = ucqueue[first].first;
+        if(m_NoCase && uc >= 'A' && uc <= 'Z')
+            uc |= 0x20; // to lower case
+
+        if(uc < 0x100 ? !m_FirstChars.Test(uc) : !m_WideFirstChar)
+            return 0;
+
+        return FindFrom(lines, ucqueue, first, uc, len);
+    }
+
+private:
+    struct Node
+    {
+        int index;      // the first string which ends at this node, 0: none
+        int subindex;   // the first string which passes by this node, 0: none
+        vector < std::pair<ucs4_t, size_t> > children;
+        Node() : index(0), subindex(0) {}
+    };
+    vector < Node > m_Nodes; // m_Nodes[0] is the root
+    MadCharBits m_FirstChars;
+    bool m_WideFirstChar;
+    bool m_NoCase;
+
+    // return 0 if not found
+    size_t Child(size_t node, ucs4_t uc) const;
+    int FindFrom(MadLines *lines, MadUCQueue &ucqueue, size_t first, ucs4_t uc, size_t &len) const;
+};
+
+
 class MadEdit;
 class wxFileConfig;
 namespace wxm
@@ -140,6 +206,22 @@ public:
     static bool SaveScheme(const wxString &schname, MadSyntax *syn); // save scheme from syn
     static bool DeleteScheme(const wxString &schname);
 
+private: // parsed syntax files cache
+    static wxString s_CacheFilePath;
+    // the parsed files are shared by all MadSyntax objects in the process,
+    // and the .syn files are also cached in s_CacheFilePath by their mtime
+    static boost::shared_ptr<const MadSyntax> GetParsedSyntax(const wxString &filename);
+    static void ForgetParsedSyntax(const wxString &filename);
+    bool LoadCache(const wxString &cachefile, const wxString &filename, time_t mtime);
+    void SaveCache(const wxString &cachefile, const wxString &filename, time_t mtime);
+    template <typename Archive> void Serialize(Archive &ar);
+    void AssignDefinition(const MadSyntax &syn);
+public:
+    static void SetCacheFilePath(const wxString &path) // where to cache .syn files, empty to disable
+    {
+        s_CacheFilePath=path;
+    }
+
 private:
     friend class MadEdit;
     friend class MadLines;
@@ -189,6 +271,16 @@ public:
 
     bool m_CheckState;
 
+private: // compiled from the definition by BuildMatchers()
+    MadCharBits m_DelimiterBits;
+    MadCharBits m_DelimiterOrSpaceBits;
+    MadStringMatcher m_LineCommentMatcher;
+    MadStringMatcher m_BlockCommentOnMatcher;
+    MadStringMatcher m_LeftBraceMatcher;
+    MadStringMatcher m_RightBraceMatcher;
+    MadStringMatcher m_RangeBeginMatcher;
+    void BuildMatchers();
+
 public:
     MadSyntax(const wxString &filename, bool loadAttr = true);
     MadSyntax(bool loadAttr = true);
@@ -216,11 +308,11 @@ public:
 
     bool IsDelimiter(ucs4_t uc)
     {
-        return (uc < 0x100 && m_Delimiter.Find(wxChar(uc))>=0);
+        return m_DelimiterBits.Test(uc);
     }
     bool IsNotDelimiter(ucs4_t uc)
     {
-        return (uc < 0x100 && m_Delimiter.Find(wxChar(uc))<0 && !IsSpace(uc));
+        return (uc < 0x100 && !m_DelimiterOrSpaceBits.Test(uc));
     }
 
     void SetAttributes(MadAttributeElement ae)
@@ -249,6 +341,7 @@ private: // for NextWord()
     bool nw_BeginOfLine;
 
     MadSyntaxRange *nw_SynRange;
+    vector < wxString > nw_SynRangeEnd; // { nw_SynRange->end } for FindString()
 
     ucs4_t nw_StringChar, nw_EscapeChar;
 
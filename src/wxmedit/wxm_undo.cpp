@@ -9,6 +9,10 @@
 #include "wxm_undo.h"
 #include  "../xm/cxx11.h"
 
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <algorithm>
+
 #ifdef _DEBUG
 #include <crtdbg.h>
 #define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
@@ -31,7 +35,11 @@ MadUndo::~MadUndo()
 }
 
 
-MadUndoBuffer::MadUndoBuffer()
+const size_t SPILL_BUFFER_SIZE = 1024 * 1024;
+
+MadUndoBuffer::MadUndoBuffer(MadMemData *memdata)
+    :m_MemData(memdata), m_MemoryLimit(0), m_MemorySize(0),
+     m_SpillFileSize(0), m_SpillFailed(false), m_Trimmed(false)
 {
     m_CurrentUndo = m_UndoList.begin();
 }
@@ -45,26 +53,371 @@ void MadUndoBuffer::Clear()
 {
     m_UndoList.clear();
     m_CurrentUndo = m_UndoList.begin();
+    m_MemorySize = 0;
+    m_Trimmed = true;
+
+    if(m_SpillFile.IsOpened())
+    {
+        m_SpillFile.Close();
+        wxLogNull nolog;
+        wxRemoveFile(m_SpillFileName);
+    }
+    m_SpillFileName.clear();
+    m_SpillFileSize = 0;
+    m_SpillFailed = false;
 }
 
 void MadUndoBuffer::ClearTillEnd()
 {
     if(m_CurrentUndo != m_UndoList.end())
     {
+        for(MadUndoIterator it = m_CurrentUndo; it != m_UndoList.end(); ++it)
+            Uncount(*it);
+
         m_CurrentUndo = m_UndoList.erase(m_CurrentUndo, m_UndoList.end());
+        m_Trimmed = true;
     }
 }
 
+void MadUndoBuffer::SetMemoryLimit(wxFileOffset limit)
+{
+    m_MemoryLimit = limit;
+    ShrinkToLimit();
+}
+
 
 MadUndo *MadUndoBuffer::Add()
 {
     ClearTillEnd();
 
+    // the last undo has been filled
+    if(!m_UndoList.empty())
+    {
+        Count(m_UndoList.back());
+        ShrinkToLimit();
+    }
+
     static MadUndo undo;
     m_UndoList.push_back(undo);
     return &m_UndoList.back();
 }
 
+static void AppendBlocks(MadBlockVector &dest, const MadBlockVector &src)
+{
+    MadBlockVector::const_iterator it = src.begin();
+    if(it == src.end())
+        return;
+
+    if(!dest.empty())
+    {
+        MadBlock &last = dest.back();
+        if(last.m_Data == it->m_Data && last.m_Pos + last.m_Size == it->m_Pos)
+        {
+            last.m_Size += it->m_Size;
+            ++it;
+        }
+    }
+    dest.insert(dest.end(), it, src.end());
+}
+
+void MadUndoBuffer::Coalesce(const MadUndo *savepoint)
+{
+    wxASSERT(m_CurrentUndo == m_UndoList.end() && !m_UndoList.empty());
+
+    MadUndoIterator last = m_UndoList.end();
+    --last;
+    if(last->m_Undos.size() != 1)
+        return;
+    last->m_Coalescible = true;
+
+    if(last == m_UndoList.begin())
+        return;
+
+    MadUndoIterator prev = last;
+    --prev;
+    // the spilled copy of prev cannot be changed
+    if(!prev->m_Coalescible || &(*prev) == savepoint || prev->m_SpillSize != 0)
+        return;
+
+    MadUndoData *pud = prev->m_Undos.front();
+    MadUndoData *lud = last->m_Undos.front();
+    MadInsertUndoData *pins = dynamic_cast<MadInsertUndoData*>(pud);
+    MadInsertUndoData *lins = dynamic_cast<MadInsertUndoData*>(lud);
+    MadDeleteUndoData *pdel = dynamic_cast<MadDeleteUndoData*>(pud);
+    MadDeleteUndoData *ldel = dynamic_cast<MadDeleteUndoData*>(lud);
+
+    if(pins != nullptr && lins != nullptr)
+    {
+        if(pins->m_Pos + pins->m_Size != lins->m_Pos)
+            return;
+
+        AppendBlocks(pins->m_Data, lins->m_Data);
+        pins->m_Size += lins->m_Size;
+    }
+    else if(pdel != nullptr && ldel != nullptr)
+    {
+        if(ldel->m_Pos + ldel->m_Size == pdel->m_Pos)   // backspace
+        {
+            AppendBlocks(ldel->m_Data, pdel->m_Data);
+            pdel->m_Data.swap(ldel->m_Data);
+            pdel->m_Pos = ldel->m_Pos;
+        }
+        else if(ldel->m_Pos == pdel->m_Pos)             // delete
+        {
+            AppendBlocks(pdel->m_Data, ldel->m_Data);
+        }
+        else
+        {
+            return;
+        }
+        pdel->m_Size += ldel->m_Size;
+    }
+    else
+    {
+        return;
+    }
+
+    prev->m_CaretPosAfter = last->m_CaretPosAfter;
+    m_UndoList.erase(last);
+    m_CurrentUndo = m_UndoList.end();
+
+    // prev will be counted again by next Add()
+    Uncount(*prev);
+}
+
+static wxFileOffset UndoDataMemSize(MadUndoData *ud)
+{
+    wxFileOffset size = sizeof(MadOverwriteUndoData);
+    MadBlockVector *blocks;
+    if((blocks = ud->DelData()) != nullptr)
+        size += blocks->capacity() * sizeof(MadBlock) + ud->DelSize();
+    if((blocks = ud->InsData()) != nullptr)
+        size += blocks->capacity() * sizeof(MadBlock) + ud->InsSize();
+    return size;
+}
+
+void MadUndoBuffer::Count(MadUndo &undo)
+{
+    if(undo.m_MemSize != 0 || undo.m_Undos.empty())
+        return;
+
+    wxFileOffset size = sizeof(MadUndo) + undo.m_Undos.capacity() * sizeof(MadUndoData*);
+    for(MadUndoDataIterator it = undo.m_Undos.begin(); it != undo.m_Undos.end(); ++it)
+        size += UndoDataMemSize(*it);
+
+    undo.m_MemSize = size;
+    m_MemorySize += size;
+}
+
+void MadUndoBuffer::Uncount(MadUndo &undo)
+{
+    m_MemorySize -= undo.m_MemSize;
+    undo.m_MemSize = 0;
+}
+
+void MadUndoBuffer::ShrinkToLimit()
+{
+    if(m_MemoryLimit <= 0 || m_MemorySize <= m_MemoryLimit || m_SpillFailed)
+        return;
+
+    // spill the oldest undos till 3/4 of the limit to avoid spilling on every Add(),
+    // but keep the undos next to m_CurrentUndo in memory
+    wxFileOffset target = m_MemoryLimit - m_MemoryLimit / 4;
+    for(MadUndoIterator it = m_UndoList.begin(); it != m_UndoList.end() && m_MemorySize > target; ++it)
+    {
+        if(it->m_MemSize == 0 || it == m_CurrentUndo)
+            continue;
+
+        MadUndoIterator next = it;
+        if(++next == m_CurrentUndo)
+            continue;
+
+        if(!Spill(*it))
+            break;
+    }
+}
+
+bool MadUndoBuffer::OpenSpillFile()
+{
+    if(m_SpillFile.IsOpened())
+        return true;
+    if(m_SpillFailed)
+        return false;
+
+    wxLogNull nolog;
+    m_SpillFileName = wxFileName::CreateTempFileName(wxFileName::GetTempDir() + wxFILE_SEP_PATH + wxT("wxmedit_undo"));
+    if(m_SpillFileName.IsEmpty() || !m_SpillFile.Open(m_SpillFileName, wxFile::read_write))
+    {
+        m_SpillFailed = true;
+        return false;
+    }
+
+    m_SpillFileSize = 0;
+    return true;
+}
+
+// spilled undo:
+//   wxUint32 count of MadUndoData, then for every MadUndoData
+//   wxByte flags(1: DelData, 2: InsData), wxInt64 pos, delsize, inssize,
+//   the bytes of DelData, the bytes of InsData
+bool MadUndoBuffer::WriteBlocks(MadBlockVector *blocks, vector < wxByte > &buffer)
+{
+    if(blocks == nullptr)
+        return true;
+
+    for(MadBlockIterator bit = blocks->begin(); bit != blocks->end(); ++bit)
+    {
+        wxFileOffset pos = bit->m_Pos, rest = bit->m_Size;
+        while(rest > 0)
+        {
+            size_t size = size_t(std::min(rest, wxFileOffset(buffer.size())));
+            bit->m_Data->Get(pos, &buffer[0], size);
+            if(m_SpillFile.Write(&buffer[0], size) != size)
+                return false;
+            pos += size;
+            rest -= size;
+        }
+    }
+    return true;
+}
+
+bool MadUndoBuffer::Spill(MadUndo &undo)
+{
+    if(undo.m_SpillSize == 0)
+    {
+        if(!OpenSpillFile() || m_SpillFile.Seek(m_SpillFileSize) != m_SpillFileSize)
+            return false;
+
+        vector < wxByte > buffer(SPILL_BUFFER_SIZE);
+        bool ok = true;
+
+        wxUint32 count = wxUint32(undo.m_Undos.size());
+        ok = m_SpillFile.Write(&count, sizeof(count)) == sizeof(count);
+
+        for(MadUndoDataIterator it = undo.m_Undos.begin(); ok && it != undo.m_Undos.end(); ++it)
+        {
+            MadUndoData *ud = *it;
+            wxByte flags = (ud->DelData() ? 1 : 0) | (ud->InsData() ? 2 : 0);
+            wxInt64 head[3] = { ud->m_Pos, ud->DelSize(), ud->InsSize() };
+
+            ok = m_SpillFile.Write(&flags, 1) == 1
+                && m_SpillFile.Write(head, sizeof(head)) == sizeof(head)
+                && WriteBlocks(ud->DelData(), buffer)
+                && WriteBlocks(ud->InsData(), buffer);
+        }
+
+        wxFileOffset end = m_SpillFile.Tell();
+        if(!ok || end <= m_SpillFileSize)
+        {
+            m_SpillFailed = true;   // the disk may be full
+            return false;
+        }
+
+        undo.m_SpillPos = m_SpillFileSize;
+        undo.m_SpillSize = end - m_SpillFileSize;
+        m_SpillFileSize = end;
+    }
+
+    Uncount(undo);
+
+    for(MadUndoDataIterator it = undo.m_Undos.begin(); it != undo.m_Undos.end(); ++it)
+        delete *it;
+    vector < MadUndoData* >().swap(undo.m_Undos);
+    m_Trimmed = true;
+
+    return true;
+}
+
+bool MadUndoBuffer::ReadBlock(wxFileOffset size, MadBlockVector *blocks, vector < wxByte > &buffer)
+{
+    if(size == 0)
+        return true;
+
+    MadBlock blk(m_MemData, -1, size);
+    while(size > 0)
+    {
+        size_t len = size_t(std::min(size, wxFileOffset(buffer.size())));
+        if(m_SpillFile.Read(&buffer[0], len) != ssize_t(len))
+            return false;
+
+        wxFileOffset pos = m_MemData->Put(&buffer[0], len);
+        if(blk.m_Pos < 0)
+            blk.m_Pos = pos;
+        size -= len;
+    }
+
+    blocks->push_back(blk);
+    return true;
+}
+
+bool MadUndoBuffer::Reload(MadUndo &undo)
+{
+    if(!undo.IsReleased())
+        return true;
+
+    if(!m_SpillFile.IsOpened() || m_SpillFile.Seek(undo.m_SpillPos) != undo.m_SpillPos)
+        return false;
+
+    vector < wxByte > buffer(SPILL_BUFFER_SIZE);
+    vector < MadUndoData* > undos;
+    bool ok = true;
+
+    wxUint32 count = 0;
+    ok = m_SpillFile.Read(&count, sizeof(count)) == ssize_t(sizeof(count));
+
+    for(wxUint32 i = 0; ok && i < count; ++i)
+    {
+        wxByte flags = 0;
+        wxInt64 head[3];
+        ok = m_SpillFile.Read(&flags, 1) == 1
+            && m_SpillFile.Read(head, sizeof(head)) == ssize_t(sizeof(head));
+        if(!ok)
+            break;
+
+        MadUndoData *ud;
+        MadBlockVector *deldata = nullptr, *insdata = nullptr;
+        if(flags == 1)
+        {
+            MadDeleteUndoData *dud = new MadDeleteUndoData;
+            dud->m_Size = head[1];
+            deldata = &dud->m_Data;
+            ud = dud;
+        }
+        else if(flags == 2)
+        {
+            MadInsertUndoData *iud = new MadInsertUndoData;
+            iud->m_Size = head[2];
+            insdata = &iud->m_Data;
+            ud = iud;
+        }
+        else
+        {
+            MadOverwriteUndoData *oud = new MadOverwriteUndoData;
+            oud->m_DelSize = head[1];
+            oud->m_InsSize = head[2];
+            deldata = &oud->m_DelData;
+            insdata = &oud->m_InsData;
+            ud = oud;
+        }
+        ud->m_Pos = head[0];
+        undos.push_back(ud);
+
+        ok = (deldata == nullptr || ReadBlock(head[1], deldata, buffer))
+            && (insdata == nullptr || ReadBlock(head[2], insdata, buffer));
+    }
+
+    if(!ok)
+    {
+        for(MadUndoDataIterator it = undos.begin(); it != undos.end(); ++it)
+            delete *it;
+        return false;
+    }
+
+    undo.m_Undos.swap(undos);
+    Count(undo);
+    return true;
+}
+
 void MadUndoBuffer::Add(wxFileOffset caretPosBefore, wxFileOffset caretPosAfter)
 {
 #if 0
@@ -77,6 +430,21 @@ void MadUndoBuffer::Add(wxFileOffset caretPosBefore, wxFileOffset caretPosAfter)
     m_UndoList.insert(m_CurrentUndo, MadUndo(caretPosBefore, caretPosAfter) );
 }
 
+void MadUndoBuffer::VisitBlocks(MadBlockVisitor &visitor)
+{
+    for(MadUndoIterator uit = m_UndoList.begin(); uit != m_UndoList.end(); ++uit)
+    {
+        for(MadUndoDataIterator it = uit->m_Undos.begin(); it != uit->m_Undos.end(); ++it)
+        {
+            MadBlockVector *blocks;
+            if((blocks = (*it)->DelData()) != nullptr)
+                visitor.Visit(*blocks);
+            if((blocks = (*it)->InsData()) != nullptr)
+                visitor.Visit(*blocks);
+        }
+    }
+}
+
 MadUndo *MadUndoBuffer::GetPrevUndo()
 {
     if(m_CurrentUndo==m_UndoList.begin())
@@ -85,10 +453,10 @@ MadUndo *MadUndoBuffer::GetPrevUndo()
     MadUndoIterator it = m_CurrentUndo;
     --it; // to previous
 
-    while(it!=m_UndoList.begin() && it->m_Undos.size()==0)
+    while(it!=m_UndoList.begin() && it->IsCaretMovement())
         --it;
 
-    if(it==m_UndoList.begin() && it->m_Undos.size()==0)
+    if(it==m_UndoList.begin() && it->IsCaretMovement())
         return nullptr;
 
     return &(*it);
@@ -99,20 +467,27 @@ MadUndo *MadUndoBuffer::Undo(bool noCaretMovement)
     if(m_CurrentUndo == m_UndoList.begin())
         return nullptr;
 
+    MadUndoIterator it = m_CurrentUndo;
+    --it;
+
     if(noCaretMovement)
     {
-        --m_CurrentUndo;
-
-        while(m_CurrentUndo != m_UndoList.begin() && m_CurrentUndo->m_Undos.size()==0)
-            --m_CurrentUndo;
+        while(it != m_UndoList.begin() && it->IsCaretMovement())
+            --it;
 
-        if(m_CurrentUndo==m_UndoList.begin() && m_CurrentUndo->m_Undos.size()==0)
+        if(it==m_UndoList.begin() && it->IsCaretMovement())
+        {
+            m_CurrentUndo = it;
             return nullptr;
-
-        return &(*m_CurrentUndo);
+        }
     }
 
-    return &(*--m_CurrentUndo);
+    if(!Reload(*it)) // cannot undo beyond it
+        return nullptr;
+
+    m_CurrentUndo = it;
+    ShrinkToLimit();
+    return &(*it);
 }
 
 MadUndo *MadUndoBuffer::Redo(bool noCaretMovement)
@@ -122,14 +497,19 @@ MadUndo *MadUndoBuffer::Redo(bool noCaretMovement)
 
     if(noCaretMovement)
     {
-        while(m_CurrentUndo != m_UndoList.end() && m_CurrentUndo->m_Undos.size()==0)
+        while(m_CurrentUndo != m_UndoList.end() && m_CurrentUndo->IsCaretMovement())
             ++m_CurrentUndo;
 
         if(m_CurrentUndo==m_UndoList.end())
             return nullptr;
     }
 
-    return &(*m_CurrentUndo++);
+    if(!Reload(*m_CurrentUndo))
+        return nullptr;
+
+    MadUndo *redo = &(*m_CurrentUndo++);
+    ShrinkToLimit();
+    return redo;
 }
 
 bool MadUndoBuffer::CanUndo(bool noCaretMovement)
@@ -142,10 +522,10 @@ bool MadUndoBuffer::CanUndo(bool noCaretMovement)
         MadUndoIterator it=m_CurrentUndo;
         --it;
 
-        while(it!=m_UndoList.begin() && it->m_Undos.size()==0)
+        while(it!=m_UndoList.begin() && it->IsCaretMovement())
             --it;
 
-        if(it==m_UndoList.begin() && it->m_Undos.size()==0)
+        if(it==m_UndoList.begin() && it->IsCaretMovement())
             return false;
     }
 
@@ -161,7 +541,7 @@ bool MadUndoBuffer::CanRedo(bool noCaretMovement)
     {
         MadUndoIterator it=m_CurrentUndo;
 
-        while(it != m_UndoList.end() && it->m_Undos.size()==0)
+        while(it != m_UndoList.end() && it->IsCaretMovement())
             ++it;
 
         if(it==m_UndoList.end())
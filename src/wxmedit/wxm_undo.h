@@ -108,12 +108,25 @@ struct MadUndo
     vector < MadUndoData* > m_Undos;
     wxFileOffset m_CaretPosBefore, m_CaretPosAfter;
 
-    MadUndo() {}
+    // m_Undos were written to the spill file of MadUndoBuffer at m_SpillPos,
+    // and they are released if m_Undos is empty
+    wxFileOffset m_SpillPos;
+    wxFileOffset m_SpillSize;   // 0: not spilled
+    wxFileOffset m_MemSize;     // the memory counted by MadUndoBuffer, 0: not counted
+    bool m_Coalescible;         // typing or deleting a char
+
+    MadUndo()
+        :m_SpillPos(0), m_SpillSize(0), m_MemSize(0), m_Coalescible(false)
+    {}
     MadUndo(wxFileOffset caretPosBefore, wxFileOffset caretPosAfter)
-        :m_CaretPosBefore(caretPosBefore), m_CaretPosAfter(caretPosAfter)
+        :m_CaretPosBefore(caretPosBefore), m_CaretPosAfter(caretPosAfter),
+         m_SpillPos(0), m_SpillSize(0), m_MemSize(0), m_Coalescible(false)
     {}
 
     ~MadUndo();
+
+    bool IsCaretMovement() { return m_Undos.empty() && m_SpillSize == 0; }
+    bool IsReleased() { return m_Undos.empty() && m_SpillSize != 0; }
 };
 
 typedef list < MadUndo > MadUndoList;
@@ -129,15 +142,56 @@ private:
 
     void ClearTillEnd();       // clear current undo till end
 
+    // the undos beyond m_MemoryLimit are spilled to a temp file,
+    // and reloaded into m_MemData when undo/redo reaches them
+    MadMemData *m_MemData;
+    wxFileOffset m_MemoryLimit;     // 0: unlimited
+    wxFileOffset m_MemorySize;      // the sum of m_MemSize of the undos
+    wxFile m_SpillFile;
+    wxString m_SpillFileName;
+    wxFileOffset m_SpillFileSize;
+    bool m_SpillFailed;
+    bool m_Trimmed;                 // some undos were dropped or spilled
+
+    void Count(MadUndo &undo);
+    void Uncount(MadUndo &undo);
+    void ShrinkToLimit();
+    bool OpenSpillFile();
+    bool Spill(MadUndo &undo);
+    bool Reload(MadUndo &undo);
+    bool WriteBlocks(MadBlockVector *blocks, vector < wxByte > &buffer);
+    bool ReadBlock(wxFileOffset size, MadBlockVector *blocks, vector < wxByte > &buffer);
+
 public:
-    MadUndoBuffer();
+    MadUndoBuffer(MadMemData *memdata);
     ~MadUndoBuffer();
 
     void Clear();      // clear all
 
+    // the estimated memory of undo data to keep in memory, 0: unlimited
+    void SetMemoryLimit(wxFileOffset limit);
+    wxFileOffset GetMemorySize() { return m_MemorySize; }
+
+    // return whether some undos were dropped or spilled since the last call,
+    // then the data they referred to in m_MemData may be dead
+    bool ResetTrimmed()
+    {
+        bool trimmed = m_Trimmed;
+        m_Trimmed = false;
+        return trimmed;
+    }
+
+    // visit the blocks of the undos in memory
+    void VisitBlocks(MadBlockVisitor &visitor);
+
     MadUndo *Add();
     void Add(wxFileOffset caretPosBefore, wxFileOffset caretPosAfter);
 
+    // mark the last undo as typing or deleting a char, and merge it into
+    // the previous one if that is also such an undo next to it;
+    // it must be called after the last use of the last undo
+    void Coalesce(const MadUndo *savepoint);
+
     MadUndo *GetPrevUndo();      // just for savepoint
 
     MadUndo *Undo(bool noCaretMovement);
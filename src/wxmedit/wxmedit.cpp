@@ -17,6 +17,7 @@
 #include "wxm_undo.h"
 #include "../mad_utils.h"
 #include "../xm/uutils.h"
+#include "../xm/trace.h"
 
 #ifdef _MSC_VER
 # pragma warning( push )
@@ -66,6 +67,7 @@
 
 #include <boost/static_assert.hpp>
 #include <locale.h>
+#include <set>
 
 using std::vector;
 using std::list;
@@ -87,6 +89,9 @@ using std::list;
 MadKeyBindings MadEdit::ms_KeyBindings;
 
 const int HexModeMaxColumns = 78;
+const size_t ROW_LAYOUT_CACHE_ROWS = 4096; // rows whose layouts are kept for repainting
+const wxFileOffset MEMDATA_COMPACT_MIN_FREE = 4 * 1024 * 1024;  // bytes to free at least by a compaction
+const wxFileOffset MEMDATA_RECOUNT_GROWTH = 16 * 1024 * 1024;   // bytes put before counting the dead bytes again
 extern const ucs4_t HexHeader[78] =
 {
     ' ', 'O', 'f', 'f', 's', 'e', 't', ' ', ' ', ' ', '0', '0', ' ', '0', '1', ' ',
@@ -249,6 +254,7 @@ BEGIN_EVENT_TABLE(MadEdit, MadEditSuperClass)
 
     EVT_ERASE_BACKGROUND(MadEdit::OnEraseBackground)
     EVT_PAINT(MadEdit::OnPaint)
+    EVT_IDLE(MadEdit::OnIdle)
 
 END_EVENT_TABLE()
 
@@ -431,6 +437,8 @@ list<FontWidthManager::VerifiedFlag> FontWidthManager::VerifiedFlagList;
 
 bool FontWidthManager::VerifyFontWidths(wxUint16 *widths, const wxString &fontname, int fontsize, wxWindow *win)
 {
+    XM_TRACE_SCOPE("FontWidthManager::VerifyFontWidths");
+
     // check the VerifiedFlag
     list<VerifiedFlag>::iterator vfit=VerifiedFlagList.begin();
     list<VerifiedFlag>::iterator vfend=VerifiedFlagList.end();
@@ -580,6 +588,8 @@ void FontWidthManager::Init(const wxString &datadir)
 
 wxUint16 *FontWidthManager::GetFontWidths(int index, const wxString &fontname, int fontsize, wxWindow *win)
 {
+    XM_TRACE_SCOPE("FontWidthManager::GetFontWidths");
+
     wxASSERT(index>=0 && index<=16);
 
     FontWidthBuffers &fwbuffers=FontWidthBuffersVector[index];
@@ -712,9 +722,11 @@ void FontWidthManager::FreeMem()
 //==================================================
 
 int MadEdit::ms_Count = 0;
+bool MadEdit::ms_TraceOverlay = false;
 
 MadEdit::MadEdit(wxm::ConfigWriter* cfg_writer, wxWindow* parent, wxWindowID id, const wxPoint& pos, const wxSize& size, long style)
-    : MadEditSuperClass(parent, id, pos, size, style), m_cfg_writer(cfg_writer)
+    : MadEditSuperClass(parent, id, pos, size, style)
+    , m_RowLayouts(ROW_LAYOUT_CACHE_ROWS), m_RowLayoutGeneration(0), m_cfg_writer(cfg_writer)
     , m_newline(&wxm::g_nl_default), m_newline_for_insert(&wxm::g_nl_default)
 {
     ++ms_Count;
@@ -758,8 +770,10 @@ MadEdit::MadEdit(wxm::ConfigWriter* cfg_writer, wxWindow* parent, wxWindowID id,
     m_Config->Read(wxT("MaxTextFileSize"), &templong, 10*1000*1000);
 
 
-    m_UndoBuffer = new MadUndoBuffer();
+    m_UndoBuffer = new MadUndoBuffer(m_Lines->m_MemData);
     m_SavePoint = nullptr;
+    m_Config->Read(wxT("UndoMemoryLimitMB"), &templong, 128); // 0: unlimited
+    m_UndoBuffer->SetMemoryLimit(wxFileOffset(templong) * 1024 * 1024);
     m_Config->Read(wxT("RecordCaretMovements"), &m_RecordCaretMovements, false);
 
     m_Modified=false;
@@ -867,6 +881,7 @@ MadEdit::MadEdit(wxm::ConfigWriter* cfg_writer, wxWindow* parent, wxWindowID id,
     m_HexDigitBitmap=nullptr;
 
     m_LoadingFile=false;
+    m_HoldingLines=false;
 
     // set fonts
     memset(m_TextFontWidths, 0, sizeof(m_TextFontWidths));
@@ -878,6 +893,7 @@ MadEdit::MadEdit(wxm::ConfigWriter* cfg_writer, wxWindow* parent, wxWindowID id,
     m_Painted=false;
 
     m_LastPaintBitmap=-1;
+    m_PaintedTopRow=-1;
 
     m_UseDefaultSyntax=false;
     m_SearchWholeWord=false;
@@ -941,101 +957,10 @@ MadEdit::~MadEdit()
 
 int MadEdit::GetLineByRow(MadLineIterator &lit, wxFileOffset &pos, int &rowid)
 {
-    int lineid, count, rowid0;
-
-    // begin <= rowid <= validpos
-    if(rowid <= m_ValidPos_rowid)
-    {
-        if(m_ValidPos_rowid-rowid <= rowid)  // rowid <-- validpos
-        {
-            lit     = m_ValidPos_iter;
-            lineid  = m_ValidPos_lineid;
-            pos     = m_ValidPos_pos;
-            rowid0  = m_ValidPos_rowid;
-
-            if(rowid0 > rowid)
-            {
-                do
-                {
-                    --lit;
-                    --lineid;
-                    rowid0 -= int(lit->RowCount());
-                    pos-=lit->m_Size;
-                }
-                while(rowid0 > rowid);
-            }
-
-            rowid = rowid0;
-        }
-        else                                // begin --> rowid
-        {
-            lit     = m_Lines->m_LineList.begin();
-            lineid  = 0;
-            pos     = 0;
-            rowid0  = 0;
-
-            if(rowid0 + (count = int(lit->RowCount())) <= rowid)
-            {
-                do
-                {
-                    rowid0 += count;
-                    pos += lit->m_Size;
-                    ++lit;
-                    ++lineid;
-                }
-                while(rowid0 + (count = int(lit->RowCount())) <= rowid);
-            }
+    if(m_Lines->HasUnindexedTail() && rowid > 0)
+        m_Lines->IndexTailByRow(size_t(rowid));
 
-            rowid = rowid0;
-        }
-    }
-    else    // validpos < rowid <= end
-    {
-        if(rowid-m_ValidPos_rowid < int(m_Lines->m_RowCount)-rowid)  // validpos --> rowid
-        {
-            lit     = m_ValidPos_iter;
-            lineid  = m_ValidPos_lineid;
-            pos     = m_ValidPos_pos;
-            rowid0  = m_ValidPos_rowid;
-
-            if(rowid0 + (count = int(lit->RowCount())) <= rowid)
-            {
-                do
-                {
-                    rowid0 += count;
-                    pos += lit->m_Size;
-                    ++lit;
-                    ++lineid;
-                }
-                while(rowid0 + (count = int(lit->RowCount())) <= rowid);
-            }
-
-            rowid = rowid0;
-
-        }
-        else                                                    // rowid <-- end
-        {
-            lit     = m_Lines->m_LineList.end();
-            --lit;
-            lineid  = int(m_Lines->m_LineCount) - 1;
-            pos     = m_Lines->m_Size - lit->m_Size;
-            rowid0  = int(m_Lines->m_RowCount - lit->RowCount());
-
-            if(rowid0 > rowid)
-            {
-                do
-                {
-                    --lit;
-                    --lineid;
-                    rowid0-= int(lit->RowCount());
-                    pos-=lit->m_Size;
-                }
-                while(rowid0 > rowid);
-            }
-
-            rowid = rowid0;
-        }
-    }
+    int lineid = m_Lines->m_LineList.LocateByRow(lit, pos, rowid);
 
     if(m_UpdateValidPos<0 || (m_UpdateValidPos>0 && rowid<m_ValidPos_rowid))
     {
@@ -1050,101 +975,10 @@ int MadEdit::GetLineByRow(MadLineIterator &lit, wxFileOffset &pos, int &rowid)
 
 int MadEdit::GetLineByPos(MadLineIterator &lit, wxFileOffset &pos, int &rowid)
 {
-    int lineid;
-    wxFileOffset pos0, size;
-
-    // begin <= pos <= validpos
-    if(pos <= m_ValidPos_pos)
-    {
-        if(m_ValidPos_pos-pos <= pos)       // pos <-- validpos
-        {
-            lit     = m_ValidPos_iter;
-            lineid  = m_ValidPos_lineid;
-            pos0    = m_ValidPos_pos;
-            rowid   = m_ValidPos_rowid;
-
-            if(pos0 > pos)
-            {
-                do
-                {
-                    --lit;
-                    --lineid;
-                    rowid-= int(lit->RowCount());
-                    pos0-=lit->m_Size;
-                }
-                while(pos0 > pos);
-            }
-
-            pos = pos0;
-        }
-        else                                // begin --> pos
-        {
-            lit     = m_Lines->m_LineList.begin();
-            lineid  = 0;
-            pos0    = 0;
-            rowid   = 0;
-
-            if((size=lit->m_Size)!=0 && pos0+size <= pos)
-            {
-                do
-                {
-                    pos0+=size;
-                    rowid+= int(lit->RowCount());
-                    ++lit;
-                    ++lineid;
-                }
-                while((size=lit->m_Size)!=0 && pos0+size <= pos);
-            }
-
-            pos = pos0;
-        }
-    }
-    else    // validpos < pos <= end
-    {
-        if(pos-m_ValidPos_pos < m_Lines->m_Size-pos)    // validpos --> pos
-        {
-            lit     = m_ValidPos_iter;
-            lineid  = m_ValidPos_lineid;
-            pos0    = m_ValidPos_pos;
-            rowid   = m_ValidPos_rowid;
-
-            if((size=lit->m_Size)!=0 && pos0+size <= pos)
-            {
-                do
-                {
-                    pos0+=size;
-                    rowid+= int(lit->RowCount());
-                    ++lit;
-                    ++lineid;
-                }
-                while((size=lit->m_Size)!=0 && pos0+size <= pos);
-            }
-
-            pos = pos0;
-        }
-        else                                            // pos <-- end
-        {
-            lit     = m_Lines->m_LineList.end();
-            --lit;
-            lineid  = int(m_Lines->m_LineCount - 1);
-            pos0    = m_Lines->m_Size - lit->m_Size;
-            rowid   = int(m_Lines->m_RowCount - lit->RowCount());
-
-            if(pos0 > pos)
-            {
-                do
-                {
-                    --lit;
-                    --lineid;
-                    rowid-= int(lit->RowCount());
-                    pos0-=lit->m_Size;
-                }
-                while(pos0 > pos);
-            }
+    if(m_Lines->HasUnindexedTail())
+        m_Lines->IndexTailByPos(pos);
 
-            pos = pos0;
-        }
-    }
+    int lineid = m_Lines->m_LineList.LocateByPos(lit, pos, rowid);
 
     if(m_UpdateValidPos<0 || (m_UpdateValidPos>0 && pos<m_ValidPos_pos))
     {
@@ -1159,96 +993,10 @@ int MadEdit::GetLineByPos(MadLineIterator &lit, wxFileOffset &pos, int &rowid)
 
 int MadEdit::GetLineByLine(/*OUT*/ MadLineIterator &lit, /*OUT*/ wxFileOffset &pos, /*IN*/ int lineid)
 {
-    int rowid, lineid0;
-
-    // begin <= lineid <= validpos
-    if(lineid <= m_ValidPos_lineid)
-    {
-        if(m_ValidPos_lineid-lineid <= lineid)       // lineid <-- validpos
-        {
-            lit     = m_ValidPos_iter;
-            lineid0 = m_ValidPos_lineid;
-            pos     = m_ValidPos_pos;
-            rowid   = m_ValidPos_rowid;
-
-            if(lineid0 > lineid)
-            {
-                do
-                {
-                    --lit;
-                    --lineid0;
-                    rowid-= int(lit->RowCount());
-                    pos-=lit->m_Size;
-                }
-                while(lineid0 > lineid);
-            }
-
-        }
-        else                                // begin --> lineid
-        {
-            lit     = m_Lines->m_LineList.begin();
-            lineid0 = 0;
-            pos     = 0;
-            rowid   = 0;
-
-            if(lineid0 + 1 <= lineid)
-            {
-                do
-                {
-                    rowid += int(lit->RowCount());
-                    pos += lit->m_Size;
-                    ++lit;
-                    ++lineid0;
-                }
-                while(lineid0 + 1 <= lineid);
-            }
-
-        }
-    }
-    else    // validpos < lineid <= end
-    {
-        if(lineid-m_ValidPos_lineid < int(m_Lines->m_LineCount)-lineid)    // validpos --> lineid
-        {
-            lit     = m_ValidPos_iter;
-            lineid0 = m_ValidPos_lineid;
-            pos     = m_ValidPos_pos;
-            rowid   = m_ValidPos_rowid;
-
-            if(lineid0+1 <= lineid)
-            {
-                do
-                {
-                    rowid += int(lit->RowCount());
-                    pos += lit->m_Size;
-                    ++lit;
-                    ++lineid0;
-                }
-                while(lineid0 + 1 <= lineid);
-            }
+    if(m_Lines->HasUnindexedTail() && lineid > 0)
+        m_Lines->IndexTailByLine(size_t(lineid));
 
-        }
-        else                                            // lineid <-- end
-        {
-            lit     = m_Lines->m_LineList.end();
-            --lit;
-            lineid0 = int(m_Lines->m_LineCount - 1);
-            pos     = m_Lines->m_Size - lit->m_Size;
-            rowid   = int(m_Lines->m_RowCount - lit->RowCount());
-
-            if(lineid0 > lineid)
-            {
-                do
-                {
-                    --lit;
-                    --lineid0;
-                    rowid -= int(lit->RowCount());
-                    pos   -= lit->m_Size;
-                }
-                while(lineid0 > lineid);
-            }
-
-        }
-    }
+    int rowid = m_Lines->m_LineList.LocateByLine(lit, pos, lineid);
 
     if(m_UpdateValidPos<0 || (m_UpdateValidPos>0 && lineid<m_ValidPos_lineid))
     {
@@ -1261,7 +1009,6 @@ int MadEdit::GetLineByLine(/*OUT*/ MadLineIterator &lit, /*OUT*/ wxFileOffset &p
     return rowid;
 }
 
-
 void MadEdit::UpdateCaret(MadCaretPos &caretPos,
                           MadUCQueue &ucharQueue, vector<int> &widthArray,
                           int &ucharPos)
@@ -1805,42 +1552,118 @@ void MadEdit::PaintText(wxDC *dc, int x, int y, const ucs4_t *text, const int *w
 #endif //__WXMSW__
 }
 
-void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowcount, const wxColor &bgcolor)
+const MadRowLayout &MadEdit::GetRowLayout(MadLineIterator &lit, int row, int maxwidth, int &syntax_row)
 {
-    MadLineIterator lineiter;
-    int subrowid = toprow;
-    wxFileOffset notused;
-    int lineid = GetLineByRow(lineiter, notused, subrowid) + 1;
-    subrowid=toprow-subrowid;
+    const MadRowLayoutKey key(&*lit, row);
+    MadRowLayout *layout = m_RowLayouts.Find(key);
+    if(layout != nullptr && (layout->complete || layout->width > maxwidth))
+        return *layout;
 
-    bool is_trailing_subrow = false;
-    int wordwidth, wordlength;
+    if(syntax_row != row)
+    {
+        if(m_Syntax->m_CheckState)
+        {
+            // the states at the beginning of a row are known by parsing the rows above it
+            m_Syntax->InitNextWord2(lit, 0);
+            for(int r = 0; r < row; ++r)
+                LayOutRow(m_RowLayouts.Get(MadRowLayoutKey(&*lit, r)), lit, r, maxwidth);
+        }
+        else
+        {
+            m_Syntax->InitNextWord2(lit, row);
+        }
+    }
 
-    if(m_Syntax->m_CheckState)
+    MadRowLayout &newlayout = m_RowLayouts.Get(key);
+    LayOutRow(newlayout, lit, row, maxwidth);
+    syntax_row = row + 1;
+    return newlayout;
+}
+
+namespace
+{
+    struct RowLayoutOutOfLines
     {
-        m_Syntax->InitNextWord2(lineiter, 0);
-        if(subrowid != 0)           // ignore rows above toprow
+        const std::set<const MadLine*> &lines;
+        explicit RowLayoutOutOfLines(const std::set<const MadLine*> &l): lines(l) {}
+
+        bool operator()(const MadRowLayoutKey &key) const { return lines.find(key.first) == lines.end(); }
+    };
+}
+
+void MadEdit::KeepRowLayouts(MadLineIterator first, MadLineIterator last)
+{
+    std::set<const MadLine*> lines;
+    for(MadLineIterator lit = first; ; ++lit)
+    {
+        lines.insert(&*lit);
+        if(lit == last)
+            break;
+    }
+
+    m_RowLayouts.EraseIf(RowLayoutOutOfLines(lines));
+    m_RowLayoutGeneration = m_Lines->GetGeneration();
+}
+
+void MadEdit::LayOutRow(MadRowLayout &layout, MadLineIterator &lit, int row, int maxwidth)
+{
+    layout.Clear();
+
+    int wordwidth, wordlength;
+    do                        // every word of row
+    {
+        wordlength = m_Syntax->NextWord(wordwidth);
+        if(wordlength)
         {
-            is_trailing_subrow = true;
-            size_t hiderows = subrowid;
-            do
-            {
-                do
-                {
-                    m_Syntax->NextWord(wordwidth);
-                }
-                while(m_Syntax->nw_LineWidth != 0);
+            layout.AddWord(m_WordBuffer, m_WidthBuffer, wordlength, wordwidth,
+                           m_Syntax->nw_Color, m_Syntax->nw_BgColor, m_Syntax->nw_Font);
+        }
 
+        // ignore the text outside the rect
+        if(layout.width > maxwidth)
+        {
+            if(row + 1 == int(lit->RowCount()))
+            {
+                m_Syntax->nw_EndOfLine = true;
+                layout.complete = false;
+                break;
+            }
+            // the rows below need the states at the end of this row
+            if(m_Syntax->m_CheckState == false)
+            {
+                layout.current_bgcolor = m_Syntax->nw_CurrentBgColor;
+                m_Syntax->InitNextWord2(lit, row + 1);
+                layout.complete = false;
+                return;
             }
-            while(--hiderows != 0);
         }
     }
-    else
+    while(m_Syntax->nw_LineWidth != 0);
+
+    layout.current_bgcolor = m_Syntax->nw_CurrentBgColor;
+    layout.end_of_line = m_Syntax->nw_EndOfLine;
+    if(layout.end_of_line)
     {
-        m_Syntax->InitNextWord2(lineiter, subrowid);
-        if(subrowid != 0)           // ignore rows above toprow
-            is_trailing_subrow = true;
+        wxColour color = m_Syntax->nw_Color, bgcolor = m_Syntax->nw_BgColor;
+        m_Syntax->SetAttributes(aeSpace);
+        layout.eol_color = m_Syntax->nw_Color;
+        layout.eol_bgcolor = m_Syntax->nw_BgColor;
+        m_Syntax->nw_Color = color;
+        m_Syntax->nw_BgColor = bgcolor;
     }
+}
+
+void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowcount, const wxColor &bgcolor)
+{
+    XM_TRACE_SCOPE("MadEdit::PaintTextLines");
+
+    MadLineIterator lineiter;
+    int subrowid = toprow;
+    wxFileOffset notused;
+    int lineid = GetLineByRow(lineiter, notused, subrowid) + 1;
+    subrowid=toprow-subrowid;
+
+    bool is_trailing_subrow = (subrowid != 0);
 
     const int minleft = rect.GetLeft() + CachedLineNumberAreaWidth();
     const int maxright = rect.GetRight();
@@ -1871,6 +1694,14 @@ void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowco
         }
     }
 
+    // the layouts of the rows are valid until the lines are changed
+    if(m_RowLayoutGeneration != m_Lines->GetGeneration())
+    {
+        m_RowLayouts.Clear();
+        m_RowLayoutGeneration = m_Lines->GetGeneration();
+    }
+    int syntax_row = -1;
+
 
     int SpacingHeight = m_RowHeight - m_TextFontHeight;
     int left, text_top = rect.GetTop() + (SpacingHeight >> 1);
@@ -1879,12 +1710,15 @@ void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowco
 
     int SelLeft=0/*?*/, SelRight=0/*?*/;
     int xpos1=0, xpos2=0;
+    bool end_of_line;
 
     // Begin Paint Lines
     for(;;)                         // every line
     {
         do                          // every row of line
         {
+            const MadRowLayout &layout = GetRowLayout(lineiter, subrowid, maxright - leftpos, syntax_row);
+
             left = leftpos;
             wxColor current_bgcolor = bgcolor;
 
@@ -1927,136 +1761,126 @@ void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowco
                 }
             }
 
-            do                        // every word of row
+            end_of_line = layout.end_of_line;
+            for(size_t w = 0; w < layout.words.size(); ++w)   // every word of row
             {
-                wordlength = m_Syntax->NextWord(wordwidth);
-                if(wordlength)
+                const MadRowWord &word = layout.words[w];
+                const ucs4_t *wordbuf = &layout.chars[word.first];
+                const int *widthbuf = &layout.widths[word.first];
+                const int wordlength = int(word.count);
+                const int wordwidth = word.width;
+
+                if(left < maxright && left + wordwidth > minleft)
                 {
-                    if(left < maxright && left + wordwidth > minleft)
+                    if(wordbuf[0] == 0x20 || wordbuf[0] == 0x09)
                     {
-                        if(m_WordBuffer[0] == 0x20 || m_WordBuffer[0] == 0x09)
+                        if(word.bgcolor != current_bgcolor)
                         {
-                            if(m_Syntax->nw_BgColor != current_bgcolor)
-                            {
-                                current_bgcolor = m_Syntax->nw_BgColor;
-                                dc->SetPen(*wxThePenList->FindOrCreatePen(m_Syntax->nw_BgColor, 1, wxSOLID));
-                                dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(m_Syntax->nw_BgColor));
-                                dc->DrawRectangle(left, row_top, rectright-left, m_RowHeight);
-                            }
-
-                            dc->SetPen(*wxThePenList->FindOrCreatePen(m_Syntax->nw_Color, 1, wxSOLID));
+                            current_bgcolor = word.bgcolor;
+                            dc->SetPen(*wxThePenList->FindOrCreatePen(word.bgcolor, 1, wxSOLID));
+                            dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(word.bgcolor));
+                            dc->DrawRectangle(left, row_top, rectright-left, m_RowHeight);
+                        }
 
-                            int idx = 0;
-                            int x0 = left;
-                            do
-                            {
-                                if (x0 + m_WidthBuffer[idx] <= minleft)
-                                    continue;
+                        dc->SetPen(*wxThePenList->FindOrCreatePen(word.color, 1, wxSOLID));
 
-                                if(m_WordBuffer[idx] == 0x20)
-                                {
-                                    if (m_ShowSpaceChar)
-                                        dc->DrawLines(m_space_points.size(), &m_space_points[0], x0, text_top);
-                                }
-                                else if(m_ShowTabChar)
-                                {
-                                    const wxSize charsz(m_WidthBuffer[idx], m_TextFontHeight);
+                        int idx = 0;
+                        int x0 = left;
+                        do
+                        {
+                            if (x0 + widthbuf[idx] <= minleft)
+                                continue;
 
-                                    std::vector<wxPoint> pts;
-                                    CalcTabMarkPoints(pts, charsz);
+                            if(wordbuf[idx] == 0x20)
+                            {
+                                if (m_ShowSpaceChar)
+                                    dc->DrawLines(m_space_points.size(), &m_space_points[0], x0, text_top);
+                            }
+                            else if(m_ShowTabChar)
+                            {
+                                const wxSize charsz(widthbuf[idx], m_TextFontHeight);
 
-                                    dc->DrawLines(pts.size(), &pts[0], x0, text_top);
-                                }
+                                std::vector<wxPoint> pts;
+                                CalcTabMarkPoints(pts, charsz);
 
-                                x0 += m_WidthBuffer[idx];
+                                dc->DrawLines(pts.size(), &pts[0], x0, text_top);
                             }
-                            while(++idx < wordlength && x0<maxright);
 
+                            x0 += widthbuf[idx];
                         }
-                        else
+                        while(++idx < wordlength && x0<maxright);
+
+                    }
+                    else
+                    {
+                        if(word.bgcolor != current_bgcolor)
                         {
-                            if(m_Syntax->nw_BgColor != current_bgcolor)
-                            {
-                                current_bgcolor = m_Syntax->nw_BgColor;
-                                dc->SetPen(*wxThePenList->FindOrCreatePen(m_Syntax->nw_BgColor, 1, wxSOLID));
-                                dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(m_Syntax->nw_BgColor));
-                                dc->DrawRectangle(left, row_top, rectright-left, m_RowHeight);
-                            }
+                            current_bgcolor = word.bgcolor;
+                            dc->SetPen(*wxThePenList->FindOrCreatePen(word.bgcolor, 1, wxSOLID));
+                            dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(word.bgcolor));
+                            dc->DrawRectangle(left, row_top, rectright-left, m_RowHeight);
+                        }
 
-                            dc->SetTextForeground(m_Syntax->nw_Color);
-                            dc->SetFont(*(m_Syntax->nw_Font));
+                        dc->SetTextForeground(word.color);
+                        dc->SetFont(*(word.font));
 
-                            PaintText(dc, left, text_top, m_WordBuffer, m_WidthBuffer, wordlength, minleft, maxright);
-                        }
+                        PaintText(dc, left, text_top, wordbuf, widthbuf, wordlength, minleft, maxright);
                     }
+                }
 
-                    if(xpos1 > 0 || xpos2 > 0)
+                if(xpos1 > 0 || xpos2 > 0)
+                {
+                    int idx = 0;
+                    const int *pw = widthbuf;
+                    do
                     {
-                        int idx = 0;
-                        int *pw = m_WidthBuffer;
-                        do
+                        if(xpos1 > (*pw >> 1))
                         {
-                            if(xpos1 > (*pw >> 1))
-                            {
-                                SelLeft += *pw;
-                                xpos1 -= *pw;
-                            }
-                            else
-                                xpos1 = 0;
-
-                            if(xpos2 > (*pw >> 1))
-                            {
-                                SelRight += *pw;
-                                xpos2 -= *pw;
-                            }
-                            else
-                                xpos2 = 0;
+                            SelLeft += *pw;
+                            xpos1 -= *pw;
+                        }
+                        else
+                            xpos1 = 0;
 
-                            ++pw;
+                        if(xpos2 > (*pw >> 1))
+                        {
+                            SelRight += *pw;
+                            xpos2 -= *pw;
                         }
-                        while(++idx < wordlength && (xpos1 > 0 || xpos2 > 0));
-                    }
+                        else
+                            xpos2 = 0;
 
-                    left += wordwidth;
+                        ++pw;
+                    }
+                    while(++idx < wordlength && (xpos1 > 0 || xpos2 > 0));
                 }
 
+                left += wordwidth;
+
                 // ignore the text outside the rect
                 if(left > maxright)
                 {
-                    if(subrowid + 1 == int(lineiter->RowCount()))
-                    {
-                        m_Syntax->nw_EndOfLine = true;
-                        break;
-                    }
-                    /***/
-                    if(m_Syntax->m_CheckState == false)
-                    {
-                        m_Syntax->InitNextWord2(lineiter, subrowid + 1);
-                        break;
-                    }
-                    /***/
+                    end_of_line = (subrowid + 1 == int(lineiter->RowCount()));
+                    break;
                 }
             }
-            while(m_Syntax->nw_LineWidth != 0);
 
             // show end of line
-            if(m_Syntax->nw_EndOfLine && left < maxright && m_ShowEndOfLine)
+            if(end_of_line && left < maxright && m_ShowEndOfLine)
             {
-                m_Syntax->SetAttributes(aeSpace);
-
                 int w = m_TextFontAveCharWidth;
 
                 // clear background
-                if(m_Syntax->nw_BgColor != current_bgcolor)
+                if(layout.eol_bgcolor != current_bgcolor)
                 {
-                    current_bgcolor = m_Syntax->nw_BgColor;
-                    dc->SetPen(*wxThePenList->FindOrCreatePen(m_Syntax->nw_BgColor, 1, wxSOLID));
-                    dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(m_Syntax->nw_BgColor));
+                    current_bgcolor = layout.eol_bgcolor;
+                    dc->SetPen(*wxThePenList->FindOrCreatePen(layout.eol_bgcolor, 1, wxSOLID));
+                    dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(layout.eol_bgcolor));
                     dc->DrawRectangle(left, row_top, rectright-left, m_RowHeight);
                 }
 
-                dc->SetPen(*wxThePenList->FindOrCreatePen(m_Syntax->nw_Color, 1, wxSOLID));
-                dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(m_Syntax->nw_Color));
+                dc->SetPen(*wxThePenList->FindOrCreatePen(layout.eol_color, 1, wxSOLID));
+                dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(layout.eol_color));
 
                 switch(m_Lines->GetNewLine(lineiter))
                 {
@@ -2079,7 +1903,7 @@ void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowco
 
             if(left < maxright)       // paint range color at rest of row
             {
-                wxColor c=m_Syntax->nw_CurrentBgColor;
+                const wxColor &c=layout.current_bgcolor;
                 if(c != current_bgcolor)
                 {
                     dc->SetBrush(*wxTheBrushList->FindOrCreateBrush(c));
@@ -2090,7 +1914,7 @@ void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowco
 
             if(bPaintSelection)
             {
-                if(!m_ShowEndOfLine && m_Syntax->nw_EndOfLine)
+                if(!m_ShowEndOfLine && end_of_line)
                     left += m_TextFontAveCharWidth;
 
                 if(m_EditMode == emTextMode)
@@ -2164,7 +1988,7 @@ void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowco
             text_top += m_RowHeight;
             row_top += m_RowHeight;
         }
-        while(--rowcount > 0 && !m_Syntax->nw_EndOfLine);
+        while(--rowcount > 0 && !end_of_line);
 
         if(rowcount == 0)
         {
@@ -2172,7 +1996,7 @@ void MadEdit::PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowco
         }
 
         ++lineiter;
-        m_Syntax->InitNextWord2(lineiter, 0);
+        syntax_row = -1;
         subrowid = 0;
         is_trailing_subrow = false;
 
@@ -2225,6 +2049,8 @@ void MadEdit::PaintHexOffset(wxDC *dc, int x, int y, const ucs4_t *hexdigit, con
 
 void MadEdit::PaintHexLines(wxDC *dc, wxRect &rect, int toprow, int rowcount, bool painthead)
 {
+    XM_TRACE_SCOPE("MadEdit::PaintHexLines");
+
     int left = rect.x;
     int top = rect.y;
 
@@ -3078,6 +2904,8 @@ void MadEdit::RecountLineWidth(bool bForceRecount)
     if(m_LoadingFile)
         return;
 
+    XM_TRACE_SCOPE("MadEdit::RecountLineWidth");
+
     if(bForceRecount == false)
     {
         if (GetWordWrapMode() == wwmWrapByWindow && (m_Lines->m_RowCount != m_Lines->m_LineCount
@@ -3129,6 +2957,8 @@ void MadEdit::RecountLineWidth(bool bForceRecount)
 
 void MadEdit::ReformatAll()
 {
+    XM_TRACE_SCOPE("MadEdit::ReformatAll");
+
     m_Lines->m_MaxLineWidth = 0;
 
     MadLineIterator first = m_Lines->m_LineList.begin();
@@ -3176,6 +3006,8 @@ void MadEdit::ReformatAll()
 
 void MadEdit::UpdateAppearance()
 {
+    ClearRowLayouts();
+
     if(m_EditMode!=emHexMode)
     {
         m_RowHeight=(m_LineSpacing*m_TextFontHeight) /100;
@@ -3247,7 +3079,7 @@ void MadEdit::UpdateScrollBarPos()
         if(m_Lines->m_RowCount>1)
         {
             m_VScrollBar->Enable();
-            int ymax = int(m_Lines->m_RowCount) + m_PageRowCount-1;
+            int ymax = int(m_Lines->GetEstimatedRowCount()) + m_PageRowCount-1;
             m_VScrollBar->SetScrollbar(m_TopRow, m_PageRowCount, ymax, m_PageRowCount, true);
         }
         else
@@ -3837,6 +3669,172 @@ namespace
             wxTheClipboard->Close();
         }
     };
+
+    const size_t CLIPBOARD_DECODE_CHUNK = 256 * 1024;
+
+    struct WxStringTextSink
+    {
+        wxString &ws;
+        explicit WxStringTextSink(wxString &s): ws(s) {}
+
+        void Append(ucs4_t uc) { wxm::WxStrAppendUCS4(ws, uc); }
+        void AppendNewLine() { ws << wxm::g_nl_default.wxValue(); }
+    };
+
+    struct UTF8TextSink
+    {
+        std::string &utf8;
+        wxm::WXMEncoding *enc;
+        explicit UTF8TextSink(std::string &s)
+            : utf8(s), enc(wxm::WXMEncodingManager::Instance().GetWxmEncoding(wxm::ENC_UTF_8))
+        {}
+
+        void Append(ucs4_t uc)
+        {
+            wxByte mb[4];
+            size_t n = enc->UCS4toMultiByte(uc, mb);
+            if(n == 0)
+                n = enc->UCS4toMultiByte(0xFFFD, mb);
+            utf8.append((const char*)mb, n);
+        }
+        void AppendNewLine() { utf8 += (const char*)wxm::g_nl_default.wxValue().ToUTF8(); }
+    };
+
+    // decode the bytes in blocks by enc chunk by chunk into sink,
+    // every 0x0D, 0x0A or 0x0D0x0A is appended as the default newline chars
+    template <typename Sink>
+    void DecodeBlocksText(wxm::WXMEncoding *enc, MadBlockVector &blocks, Sink &sink)
+    {
+        vector<wxByte> inbuf(CLIPBOARD_DECODE_CHUNK);
+        vector<ucs4_t> ucs(CLIPBOARD_DECODE_CHUNK);
+        vector<wxByte> lens(CLIPBOARD_DECODE_CHUNK);
+
+        size_t bidx = 0;
+        wxFileOffset bpos = 0;
+        size_t kept = 0;    // the bytes of an incomplete char left by the last chunk
+        bool cr = false;    // the last char is 0x0D
+
+        for(;;)
+        {
+            size_t len = kept;
+            while(len < CLIPBOARD_DECODE_CHUNK && bidx < blocks.size())
+            {
+                MadBlock &blk = blocks[bidx];
+                size_t size = size_t(std::min(wxFileOffset(CLIPBOARD_DECODE_CHUNK - len), blk.m_Size - bpos));
+                if(size > 0)
+                    blk.Get(bpos, &inbuf[len], size);
+                len += size;
+                bpos += size;
+                if(bpos == blk.m_Size)
+                {
+                    ++bidx;
+                    bpos = 0;
+                }
+            }
+
+            if(len == 0)
+                break;
+
+            bool more = (bidx < blocks.size());
+            size_t count = enc->DecodeUChar32s(&inbuf[0], len, more, &ucs[0], &lens[0], ucs.size());
+            if(count == 0)
+                break;
+
+            size_t used = 0;
+            for(size_t i=0; i<count; ++i)
+            {
+                ucs4_t uc = ucs[i];
+                used += lens[i];
+
+                if(uc == 0x0A && cr)
+                {
+                    cr = false;
+                    continue;
+                }
+                cr = (uc == 0x0D);
+
+                if(uc == 0x0D || uc == 0x0A)
+                    sink.AppendNewLine();
+                else
+                    sink.Append(uc);
+            }
+
+            kept = len - used;
+            if(kept > 0)
+                memmove(&inbuf[0], &inbuf[used], kept);
+        }
+    }
+
+#ifdef __WXGTK__
+    // the text of the blocks copied from a MadLines is decoded when it's pasted,
+    // or before the data of the blocks are freed or overwritten by the MadLines
+    class MadDeferredTextDataObject : public wxDeferredTextDataObject
+    {
+    public:
+        MadDeferredTextDataObject(MadLines *lines, wxm::WXMEncoding *enc, MadBlockVector &blocks)
+            : m_Lines(lines), m_Encoding(enc)
+        {
+            m_Blocks.swap(blocks);
+            ms_Unrendered.insert(this);
+        }
+        virtual ~MadDeferredTextDataObject()
+        {
+            ms_Unrendered.erase(this);
+        }
+
+        virtual bool RenderUTF8(std::string &utf8) override
+        {
+            XM_TRACE_SCOPE("MadDeferredTextDataObject::RenderUTF8");
+
+            if(m_Lines == nullptr)
+            {
+                utf8 += m_Text;
+                return true;
+            }
+
+            UTF8TextSink sink(utf8);
+            DecodeBlocksText(m_Encoding, m_Blocks, sink);
+            return true;
+        }
+
+        static void VisitAll(MadLines *lines, MadBlockVisitor &visitor)
+        {
+            std::set<MadDeferredTextDataObject*>::iterator it = ms_Unrendered.begin();
+            for(; it != ms_Unrendered.end(); ++it)
+            {
+                if((*it)->m_Lines == lines)
+                    visitor.Visit((*it)->m_Blocks);
+            }
+        }
+
+        static void RenderAll(MadLines *lines)
+        {
+            std::set<MadDeferredTextDataObject*> objs(ms_Unrendered);
+            std::set<MadDeferredTextDataObject*>::iterator it = objs.begin();
+            for(; it != objs.end(); ++it)
+            {
+                MadDeferredTextDataObject *obj = *it;
+                if(obj->m_Lines != lines)
+                    continue;
+
+                obj->RenderUTF8(obj->m_Text);
+                obj->m_Lines = nullptr;
+                MadBlockVector().swap(obj->m_Blocks);
+                ms_Unrendered.erase(obj);
+            }
+        }
+
+    private:
+        MadLines *m_Lines;      // nullptr if the text has been rendered into m_Text
+        wxm::WXMEncoding *m_Encoding;
+        MadBlockVector m_Blocks;
+        std::string m_Text;
+
+        static std::set<MadDeferredTextDataObject*> ms_Unrendered;
+    };
+
+    std::set<MadDeferredTextDataObject*> MadDeferredTextDataObject::ms_Unrendered;
+#endif
 };
 
 bool MadEdit::PutTextToClipboard(const wxString &ws)
@@ -3897,6 +3895,74 @@ bool MadEdit::PutRawBytesToClipboard(const std::string& cs)
     return ok;
 }
 
+void MadEdit::GetSelectionBlocks(MadBlockVector &blocks)
+{
+    MadLineIterator lit = m_SelectionBegin->iter;
+    wxFileOffset linepos = m_SelectionBegin->linepos;
+    wxFileOffset rest = m_SelectionEnd->pos - m_SelectionBegin->pos;
+
+    for(; rest > 0; ++lit, linepos = 0)
+    {
+        MadBlockIterator bit = lit->m_Blocks.begin();
+        MadBlockIterator bend = lit->m_Blocks.end();
+        for(; bit != bend && rest > 0; ++bit)
+        {
+            if(linepos >= bit->m_Size)
+            {
+                linepos -= bit->m_Size;
+                continue;
+            }
+
+            wxFileOffset size = std::min(bit->m_Size - linepos, rest);
+            const wxFileOffset pos = bit->m_Pos + linepos;
+            if(!blocks.empty() && blocks.back().m_Data == bit->m_Data
+                && blocks.back().m_Pos + blocks.back().m_Size == pos)
+            {
+                blocks.back().m_Size += size;
+            }
+            else
+            {
+                blocks.push_back(MadBlock(bit->m_Data, pos, size));
+            }
+
+            rest -= size;
+            linepos = 0;
+        }
+    }
+}
+
+bool MadEdit::PutBlocksTextToClipboard(MadBlockVector &blocks)
+{
+#ifdef __WXGTK__
+    if(!wxTheClipboard->Open())
+        return false;
+
+    wxTheClipboardCloser clipbrd_closer;
+    bool ok=wxTheClipboard->SetData( new MadDeferredTextDataObject(m_Lines, m_Encoding, blocks) );
+    wxTheClipboard->Flush();
+    return ok;
+#else
+    wxString ws;
+    WxStringTextSink sink(ws);
+    DecodeBlocksText(m_Encoding, blocks, sink);
+    return PutTextToClipboard(ws);
+#endif
+}
+
+void MadEdit::RenderDeferredClipboardText(MadLines *lines)
+{
+#ifdef __WXGTK__
+    MadDeferredTextDataObject::RenderAll(lines);
+#endif
+}
+
+void MadEdit::VisitDeferredClipboardBlocks(MadLines *lines, MadBlockVisitor &visitor)
+{
+#ifdef __WXGTK__
+    MadDeferredTextDataObject::VisitAll(lines, visitor);
+#endif
+}
+
 // translate newline & utf16 surrogates
 // return linecount
 int MadEdit::TranslateText(const wxChar* pwcs, size_t count, vector<ucs4_t>& ucs, bool passNewLine)
@@ -4129,6 +4195,8 @@ MadLineIterator MadEdit::DeleteInsertData(wxFileOffset pos,
     int lid = GetLineByPos(lit, bpos, tmp_rowid);
     if(lineid != nullptr) *lineid = lid;
 
+    ++m_Lines->m_Generation;
+
     m_UpdateValidPos = 0;
 
     MadBlockVector &blocks = lit->m_Blocks;
@@ -4436,7 +4504,34 @@ MadLineIterator MadEdit::DeleteInsertData(wxFileOffset pos,
         }
     }
 
-    return lit;
+    m_Lines->m_LineList.UpdateIndex(lit);
+
+    return lit;
+}
+
+void MadEdit::EncodeUCS4(wxm::WXMEncoding* enc, ucs4_t uc, std::string& bytes)
+{
+    wxByte mb[4];
+    size_t size = enc->UCS4toMultiByte(uc, mb);
+
+    BOOST_STATIC_ASSERT(sizeof(char) == sizeof(wxByte));
+
+    if(size != 0)
+    {
+        bytes.append((const char*)mb, size);
+        return;
+    }
+
+    // the uc is not supported in the encoding
+    wxASSERT(uc>=0 && uc<=0x10FFFF);
+
+    std::string ascii_uescape = (boost::format("{U+%04X}") % uc).str();
+
+    for(size_t i=0; i<ascii_uescape.size(); ++i)
+    {
+        size_t n = enc->UCS4toMultiByte((ucs4_t)ascii_uescape[i], mb);
+        bytes.append((const char*)mb, n);
+    }
 }
 
 // block should be set before call UCStoBlock
@@ -4444,39 +4539,16 @@ void MadEdit::UCStoBlock(const ucs4_t *ucs, size_t count, MadBlock & block)
 {
     MadMemData *md = (MadMemData *) block.m_Data;
 
-    ucs4_t uc;
     size_t size;
-    wxByte mb[4];
     wxByte *b;
-
-    BOOST_STATIC_ASSERT(sizeof(char) == sizeof(wxByte));
+    std::string bytes;
 
     do
     {
-        size = m_Encoding->UCS4toMultiByte(*ucs, mb);
-        b = mb;
-
-        std::string enc_uescape;
-
-        // the uc is not supported in current encoding
-        if(size == 0)
-        {
-            enc_uescape.clear();
-            uc = *ucs;
-            wxASSERT(uc>=0 && uc<=0x10FFFF);
-
-            std::string ascii_uescape = (boost::format("{U+%04X}") % uc).str();
-
-            for(size_t i=0; i<ascii_uescape.size(); ++i)
-            {
-                wxByte buf[4];
-                size_t n = m_Encoding->UCS4toMultiByte((ucs4_t)ascii_uescape[i], buf);
-                enc_uescape.append((const char*)buf, n);
-            }
-
-            b = (wxByte *)enc_uescape.c_str();
-            size = enc_uescape.size();
-        }
+        bytes.clear();
+        EncodeUCS4(m_Encoding, *ucs, bytes);
+        b = (wxByte *)bytes.data();
+        size = bytes.size();
 
         if(block.m_Pos < 0)
         {
@@ -4802,6 +4874,10 @@ void MadEdit::InsertString(const ucs4_t *ucs, size_t count, bool bColumnEditing,
                 m_SelectionPos2.pos=insud->m_Pos+insud->m_Size;
                 UpdateSelectionPos();
             }
+            else if(count == 1 && moveCaret && ucs[0] != 0x0D && ucs[0] != 0x0A)
+            {
+                m_UndoBuffer->Coalesce(m_SavePoint); // typing
+            }
 
             DoSelectionChanged();
             if(changed) DoStatusChanged();
@@ -6290,6 +6366,193 @@ void MadEdit::OverwriteDataMultiple(vector<wxFileOffset> &del_bpos, vector<wxFil
         DisplayCaret(true);
 }
 
+// the matches closer than this share one overwrite with the data between
+// them copied, the others are overwritten separately
+const wxFileOffset OVERWRITE_MAX_COPIED_GAP = 64 * 1024;
+
+wxFileOffset MadEdit::AppendOverwriteData(MadOverwriteStream &ows, const MadCaretPos &bpos, const MadCaretPos &epos,
+                                          const ucs4_t *ins_ucs, wxByte *ins_data, size_t ins_len)
+{
+    wxASSERT(bpos.pos >= ows.m_LastEndPos && epos.pos >= bpos.pos);
+
+    MadMemData *md=m_Lines->m_MemData;
+
+    if(ows.m_Count == 0)
+        ows.m_NewCaretPos = m_CaretPos.pos;
+
+    wxFileOffset size = bpos.pos - ows.m_LastEndPos;
+    if(ows.m_Chunks.empty() || !IsTextFile() || size > OVERWRITE_MAX_COPIED_GAP)
+    {
+        ows.m_Chunks.push_back(MadOverwriteChunk(md, bpos.pos, md->m_Size));
+    }
+    else if(size > 0) // copy the data from the previous match
+    {
+        MadLineIterator lit;
+        wxFileOffset lpos=ows.m_LastEndPos;
+        int rowid;
+
+        m_UpdateValidPos=-1;
+        GetLineByPos(lit, lpos, rowid);
+        m_UpdateValidPos=0;
+
+        lpos=ows.m_LastEndPos-lpos;
+
+        wxByte buf[4096];
+        for(;;)
+        {
+            size_t len=sizeof(buf);
+            if((wxFileOffset)len>size) len=size_t(size);
+
+            wxFileOffset ll=lit->m_Size- lpos;
+            if((wxFileOffset)len>ll) len=size_t(ll);
+
+            if(len != 0)
+            {
+                lit->Get(lpos, buf, len);
+                md->Put(buf, len);
+                ows.m_Chunks.back().m_Ins.m_Size+=len;
+            }
+
+            if((size-=len)==0) break;
+
+            if((lpos+=len) == lit->m_Size)
+            {
+                ++lit;          // to next line
+                lpos=0;
+            }
+        }
+    }
+
+    MadOverwriteChunk &chunk = ows.m_Chunks.back();
+    wxFileOffset oldsize=chunk.m_Ins.m_Size;
+
+    if(ins_len != 0)
+    {
+        if(ins_ucs)
+        {
+            UCStoBlock(ins_ucs, ins_len, chunk.m_Ins);
+        }
+        else
+        {
+            md->Put(ins_data, ins_len);
+            chunk.m_Ins.m_Size+=ins_len;
+        }
+    }
+
+    chunk.m_DelSize = epos.pos - chunk.m_Pos;
+    ows.m_LastEndPos = epos.pos;
+    ++ows.m_Count;
+
+    // adjust caretpos
+    wxFileOffset ins_size=chunk.m_Ins.m_Size-oldsize;
+    wxFileOffset del_size=epos.pos-bpos.pos;
+    wxFileOffset caretdiffsize=m_CaretPos.pos-bpos.pos;
+    if(caretdiffsize>0)
+    {
+        if(caretdiffsize>=del_size) // not in the del-data
+        {
+            ows.m_NewCaretPos=ows.m_NewCaretPos-del_size+ins_size;
+        }
+        else        // in the del-data
+        {
+            if(ins_size<caretdiffsize)
+            {
+                ows.m_NewCaretPos -= (caretdiffsize-ins_size);
+            }
+        }
+    }
+
+    return ins_size;
+}
+
+void MadEdit::OverwriteData(MadOverwriteStream &ows)
+{
+    if(ows.m_Chunks.empty())
+        return;
+
+    bool oldModified=m_Modified;
+
+    MadLineIterator litfirst, litlast;
+    wxFileOffset lastpos=ows.m_LastEndPos;
+    MadUndo *undo = m_UndoBuffer->Add();
+
+    // from the last chunk, so the positions of the others are not changed
+    vector<MadOverwriteChunk>::reverse_iterator it=ows.m_Chunks.rbegin();
+    for(; it!=ows.m_Chunks.rend(); ++it)
+    {
+        MadOverwriteUndoData *oudata = new MadOverwriteUndoData();
+
+        oudata->m_Pos = it->m_Pos;
+        oudata->m_DelSize = it->m_DelSize;
+        oudata->m_InsSize = it->m_Ins.m_Size;
+        oudata->m_InsData.push_back(it->m_Ins);
+
+        litfirst=DeleteInsertData(oudata->m_Pos,
+                        oudata->m_DelSize, &oudata->m_DelData,
+                        oudata->m_InsSize, &oudata->m_InsData);
+        lastpos += oudata->m_InsSize - oudata->m_DelSize;
+
+        undo->m_Undos.push_back(oudata);
+    }
+
+    // the line of the last chunk may be joined by the chunks before it
+    int rowid;
+    GetLineByPos(litlast, lastpos, rowid);
+
+    undo->m_CaretPosBefore=m_CaretPos.pos;
+    undo->m_CaretPosAfter=ows.m_NewCaretPos;
+
+    ows.m_Chunks.clear();
+
+    bool sc= (oldModified==false);
+    m_Modified = true;
+    m_Selection = false;
+    m_RepaintAll = true;
+    Refresh(false);
+
+    if(IsTextFile())
+    {
+        m_Lines->Reformat(litfirst, litlast);
+
+        m_CaretPos.pos = undo->m_CaretPosAfter;
+        UpdateCaretByPos(m_CaretPos, m_ActiveRowUChars, m_ActiveRowWidths, m_CaretRowUCharPos);
+
+        //AppearCaret();
+        UpdateScrollBarPos();
+
+        if(m_EditMode == emHexMode)
+        {
+            if(!m_CaretAtHexArea)
+            {
+                UpdateTextAreaXPos();
+                m_LastTextAreaXPos = m_TextAreaXPos;
+            }
+        }
+    }
+    else
+    {
+        m_CaretPos.pos = undo->m_CaretPosAfter;
+        m_CaretPos.linepos = m_CaretPos.pos;
+
+        //AppearCaret();
+        UpdateScrollBarPos();
+
+        if(!m_CaretAtHexArea)
+        {
+            UpdateTextAreaXPos();
+            m_LastTextAreaXPos = m_TextAreaXPos;
+        }
+    }
+
+    m_LastCaretXPos = m_CaretPos.xpos;
+
+    DoSelectionChanged();
+    if(sc) DoStatusChanged();
+
+    if(FindFocus()!=this)
+        DisplayCaret(true);
+}
+
 void MadEdit::FindLeftBrace(int &rowid, MadLineIterator lit, wxFileOffset linepos, BracePairIndex &bpi)    // find by bpi.BraceIndex
 {
     wxASSERT(m_Syntax->m_LeftBrace.size()!=0);
@@ -6741,7 +7004,6 @@ void MadEdit::ProcessCommand(MadEditCommand command)
             --m_TopRow;
             UpdateScrollBarPos();
 
-            m_RepaintAll = true;
             Refresh(false);
 
             NewAutoCompleteRightChar=m_AutoCompleteRightChar;
@@ -6752,7 +7014,6 @@ void MadEdit::ProcessCommand(MadEditCommand command)
             ++m_TopRow;
             UpdateScrollBarPos();
 
-            m_RepaintAll = true;
             Refresh(false);
 
             NewAutoCompleteRightChar=m_AutoCompleteRightChar;
@@ -6763,7 +7024,6 @@ void MadEdit::ProcessCommand(MadEditCommand command)
             m_TopRow -= m_PageRowCount;
             UpdateScrollBarPos();
 
-            m_RepaintAll = true;
             Refresh(false);
 
             NewAutoCompleteRightChar=m_AutoCompleteRightChar;
@@ -6774,7 +7034,6 @@ void MadEdit::ProcessCommand(MadEditCommand command)
             m_TopRow += m_PageRowCount;
             UpdateScrollBarPos();
 
-            m_RepaintAll = true;
             Refresh(false);
 
             NewAutoCompleteRightChar=m_AutoCompleteRightChar;
@@ -7248,6 +7507,7 @@ void MadEdit::ProcessCommand(MadEditCommand command)
 
                 case ecEndDoc:
                 case ecSelEndDoc:
+                    m_Lines->IndexWholeTail();
                     m_CaretPos.iter = m_Lines->m_LineList.end();
                     --m_CaretPos.iter;
                     m_CaretPos.pos = m_Lines->m_Size;
@@ -7752,6 +8012,8 @@ void MadEdit::ProcessCommand(MadEditCommand command)
                                         }
                                         Refresh(false);
 
+                                        m_UndoBuffer->Coalesce(m_SavePoint); // deleting a char
+
                                         DoSelectionChanged();
                                         if(sc) DoStatusChanged();
                                     }
@@ -7915,6 +8177,8 @@ void MadEdit::ProcessCommand(MadEditCommand command)
                                             m_RepaintAll = true;
                                             Refresh(false);
 
+                                            m_UndoBuffer->Coalesce(m_SavePoint); // deleting a char
+
                                             DoSelectionChanged();
                                             if(sc) DoStatusChanged();
 
@@ -8003,6 +8267,8 @@ void MadEdit::ProcessCommand(MadEditCommand command)
                                         }
                                         Refresh(false);
 
+                                        m_UndoBuffer->Coalesce(m_SavePoint); // deleting a char
+
                                         DoSelectionChanged();
                                         if(sc) DoStatusChanged();
                                     }
@@ -9273,6 +9539,9 @@ void MadEdit::OnVScroll(wxScrollEvent &evt)
 
     if(m_EditMode!=emHexMode)
     {
+        if(m_Lines->HasUnindexedTail() && m_TopRow>0)
+            m_Lines->IndexTailByRow(size_t(m_TopRow + m_PageRowCount));
+
         if(m_TopRow<0) m_TopRow=0;
         else if(m_TopRow>=int(m_Lines->m_RowCount)) m_TopRow=int(m_Lines->m_RowCount-1);
     }
@@ -9284,7 +9553,7 @@ void MadEdit::OnVScroll(wxScrollEvent &evt)
         else if(m_TopRow>=rowcount) m_TopRow=rowcount-1;
     }
 
-    m_RepaintAll=true;
+    // OnPaint() shifts the painted rows, see ScrollClientBitmap()
     Refresh(false);
     //evt.Skip();
 }
@@ -9344,7 +9613,7 @@ void MadEdit::OnMouseWheel(wxMouseEvent &evt)
 
         UpdateScrollBarPos();
 
-        m_RepaintAll=true;
+        // OnPaint() shifts the painted rows, see ScrollClientBitmap()
         Refresh(false);
     }
     //evt.Skip();
@@ -9411,8 +9680,129 @@ void MadEdit::OnEraseBackground(wxEraseEvent &evt)
     // do nothing
 }
 
+void MadEdit::CompactMemData()
+{
+    if(m_Lines->CompactMemData(MEMDATA_COMPACT_MIN_FREE))
+    {
+        const MadMemDataStats &stats = m_Lines->GetMemDataStats();
+        wxLogDebug(wxT("memdata: compacted to %s live bytes, %s freed by %u compactions"),
+                   wxLongLong(stats.m_Live).ToString().c_str(), wxLongLong(stats.m_Reclaimed).ToString().c_str(),
+                   unsigned(stats.m_Compactions));
+    }
+}
+
+void MadEdit::CompactMemDataOnIdle()
+{
+    if(m_Lines->m_MemDataPins != 0)
+        return;
+
+    // the dead bytes are counted again only if some may have been added
+    const MadMemDataStats &stats = m_Lines->GetMemDataStats();
+    wxFileOffset growth = m_Lines->m_MemData->GetSize() - (stats.m_Live + stats.m_Dead);
+    if(!m_UndoBuffer->ResetTrimmed() && growth < MEMDATA_RECOUNT_GROWTH)
+        return;
+
+    CompactMemData();
+}
+
+// propagate the deferred syntax states in time slices, see MadLines::Reformat()
+void MadEdit::OnIdle(wxIdleEvent &evt)
+{
+    evt.Skip();
+
+    if(m_HoldingLines)
+        return;
+
+    CompactMemDataOnIdle();
+
+    if(!m_Lines->HasStaleLines())
+        return;
+
+    ReformatStaleLines(20);
+
+    if(m_Lines->HasStaleLines())
+        evt.RequestMore();
+}
+
+void MadEdit::ReformatStaleLines(long maxms)
+{
+    MadLineIterator lit, toplit, bottomlit;
+    wxFileOffset pos;
+    int rowid = m_TopRow;
+    int toplineid = GetLineByRow(toplit, pos, rowid);
+    int topsubrow = m_TopRow - rowid;
+    rowid = m_TopRow + m_VisibleRowCount;
+    int bottomlineid = GetLineByRow(bottomlit, pos, rowid);
+
+    int firstline, lastline;
+    size_t oldrows = m_Lines->m_RowCount;
+    int oldmaxwidth = m_Lines->m_MaxLineWidth;
+    bool layoutsvalid = (m_RowLayoutGeneration == m_Lines->GetGeneration());
+    m_Lines->ReformatStaleLines(maxms, firstline, lastline);
+
+    if(firstline > bottomlineid && m_CaretPos.lineid < firstline && m_ValidPos_lineid < firstline &&
+       (!m_Selection || m_SelectionEnd->lineid < firstline))
+    {
+        // only the lines below the window were reformatted or split out of the tail,
+        // the window, the caret & the selection are not moved
+        if(oldrows != m_Lines->m_RowCount || oldmaxwidth != m_Lines->m_MaxLineWidth)
+            UpdateScrollBarPos();
+
+        if(layoutsvalid)
+            KeepRowLayouts(toplit, bottomlit);
+    }
+    else if(oldrows != m_Lines->m_RowCount)
+    {
+        // the lines split by MadLines::SplitLines() got their rows,
+        // keep the top line at the top of the window
+        rowid = GetLineByLine(lit, pos, toplineid);
+        if(topsubrow >= int(lit->RowCount()))
+            topsubrow = int(lit->RowCount()) - 1;
+        m_TopRow = rowid + topsubrow;
+
+        m_ValidPos_iter = m_Lines->m_LineList.begin();
+        m_ValidPos_lineid = 0;
+        m_ValidPos_rowid = 0;
+        m_ValidPos_pos = 0;
+
+        m_UpdateValidPos = -1;
+        UpdateCaretByPos(m_CaretPos, m_ActiveRowUChars, m_ActiveRowWidths, m_CaretRowUCharPos);
+        m_UpdateValidPos = 0;
+
+        if(m_Selection)
+            UpdateSelectionPos();
+
+        UpdateScrollBarPos();
+        m_RepaintAll = true;
+        Refresh(false);
+    }
+    else if(firstline >= 0)
+    {
+        if(oldmaxwidth != m_Lines->m_MaxLineWidth)
+            UpdateScrollBarPos();
+
+        // repaint only if the reformatted lines are visible
+        if(firstline <= bottomlineid && lastline >= toplineid)
+        {
+            m_RepaintAll = true;
+            Refresh(false);
+        }
+    }
+}
+
+void MadEdit::HoldLines()
+{
+    m_Lines->IndexWholeTail();
+    while(m_Lines->HasStaleLines())
+        ReformatStaleLines(1000);
+
+    m_HoldingLines = true;
+}
+
 void MadEdit::OnPaint(wxPaintEvent &evt)
 {
+    XM_TRACE_SCOPE("MadEdit::OnPaint");
+
     wxPaintDC dc(this);
     wxMemoryDC memdc, markdc;
 
@@ -9447,12 +9837,20 @@ void MadEdit::OnPaint(wxPaintEvent &evt)
             memdc.SelectObject(*m_ClientBitmap);
             memdc.SetFont(*m_TextFont);
 
+            // the rows to paint must be split out of the unindexed tail
+            if(m_Lines->HasUnindexedTail() && !m_HoldingLines)
+                m_Lines->IndexTailByRow(size_t(m_TopRow + m_VisibleRowCount));
+
             // calculate rows to paint
             int rowcount=(int)(m_Lines->m_RowCount-m_TopRow);
             if(rowcount>(int)m_VisibleRowCount)
                 rowcount=(int)m_VisibleRowCount;
             const int lastrow = int(m_TopRow) + rowcount - 1;
 
+            // a scrolling only changes m_TopRow, the painted rows are shifted
+            if(!m_RepaintAll && m_TopRow != m_PaintedTopRow)
+                m_RepaintAll = !ScrollClientBitmap(memdc, rowcount);
+
             if(m_RepaintAll)
             {
                 // update ValidPos
@@ -9514,6 +9912,7 @@ void MadEdit::OnPaint(wxPaintEvent &evt)
 
                 m_RepaintSelection=false;
             }
+            m_PaintedTopRow = m_TopRow;
 
             if(m_Selection)
             {
@@ -9665,7 +10064,7 @@ void MadEdit::OnPaint(wxPaintEvent &evt)
         {
             memdc.SelectObject(*m_ClientBitmap);
 
-            if(m_RepaintAll || m_RepaintSelection)
+            if(m_RepaintAll || m_RepaintSelection || m_TopRow != m_PaintedTopRow)
             {
                 int count = GetVisibleHexRowCount();
                 if(count == 0)
@@ -9719,6 +10118,7 @@ void MadEdit::OnPaint(wxPaintEvent &evt)
 
                 m_RepaintAll = false;
                 m_RepaintSelection = false;
+                m_PaintedTopRow = m_TopRow;
             }
 
 #ifndef __WXMSW__
@@ -9738,6 +10138,10 @@ void MadEdit::OnPaint(wxPaintEvent &evt)
             dc.Blit(0,0,m_ClientWidth,m_ClientHeight, &memdc, 0, 0);
             m_LastPaintBitmap=0;
         }
+
+        // painted on the window only, the bitmaps are kept clean
+        if(ms_TraceOverlay)
+            PaintTraceOverlay(dc);
     }
     
     if(focuswin==this)
@@ -9754,6 +10158,123 @@ void MadEdit::OnPaint(wxPaintEvent &evt)
     m_Painted=true;
 }
 
+bool MadEdit::ScrollClientBitmap(wxMemoryDC &memdc, int rowcount)
+{
+    XM_TRACE_SCOPE("MadEdit::ScrollClientBitmap");
+
+    if(m_PaintedTopRow < 0)
+        return false;
+
+    const int delta = int(m_TopRow) - m_PaintedTopRow;
+    const int shift = delta > 0 ? delta : -delta;
+    if(shift >= m_CompleteRowCount)
+        return false;
+
+    // update ValidPos
+    m_UpdateValidPos=-1;
+
+    MadLineIterator lit;
+    wxFileOffset tmppos;
+    int rowid=m_TopRow;
+    int lineid=GetLineByRow(lit, tmppos, rowid);
+
+    m_UpdateValidPos=0;
+
+    // the line numbers of the new rows may need another width
+    if(CalcLineNumberAreaWidth(lit, lineid, rowid, m_TopRow, rowcount) != CachedLineNumberAreaWidth())
+        return false;
+
+    // copied through m_MarkBitmap, blitting an overlapped area in one DC is not portable,
+    // and m_MarkBitmap is refilled from m_ClientBitmap before it is used
+    const int shiftheight = shift * m_RowHeight;
+    {
+        wxMemoryDC markdc;
+        markdc.SelectObject(*m_MarkBitmap);
+        markdc.Blit(0, 0, m_ClientWidth, m_ClientHeight - shiftheight, &memdc, 0, delta > 0 ? shiftheight : 0);
+        memdc.Blit(0, delta > 0 ? 0 : shiftheight, m_ClientWidth, m_ClientHeight - shiftheight, &markdc, 0, 0);
+    }
+
+    // the exposed rows, the last complete row before them is repainted too when scrolling down
+    // because it was the clipped last row
+    int firstrow, rows;
+    if(delta > 0)
+    {
+        firstrow = m_CompleteRowCount - shift;
+        rows = m_VisibleRowCount - firstrow;
+    }
+    else
+    {
+        firstrow = 0;
+        rows = shift;
+    }
+
+    wxColor &bgcolor=m_Syntax->GetAttributes(aeText)->bgcolor;
+    wxRect rect(0, firstrow * m_RowHeight, m_ClientWidth, rows * m_RowHeight);
+    memdc.SetBrush(*wxTheBrushList->FindOrCreateBrush(bgcolor));
+    memdc.SetPen(*wxThePenList->FindOrCreatePen(bgcolor, 1, wxSOLID));
+    memdc.DrawRectangle(rect.x, rect.y, rect.width, rect.height);
+
+    if(rows > rowcount - firstrow)
+        rows = rowcount - firstrow;
+    if(rows > 0)
+        PaintTextLines(&memdc, rect, m_TopRow + firstrow, rows, bgcolor);
+
+    return true;
+}
+
+void MadEdit::PaintTraceOverlay(wxDC &dc)
+{
+    const size_t maxrows = 8;
+    const xm::TraceTime window = 1000000; // the last second
+
+    std::vector<xm::TraceSummary> sums;
+    if(xm::TracingEnabled())
+        xm::SummarizeTraceSpans(sums, window);
+
+    std::vector<wxString> lines;
+    lines.push_back(wxString::Format(wxT("%-32s %6s %9s %9s"), wxT("span (1s)"), wxT("count"), wxT("total ms"), wxT("max ms")));
+    if(!xm::TracingEnabled())
+        lines.push_back(_("Performance tracing is not recording."));
+    for(size_t i = 0; i < sums.size() && i < maxrows; ++i)
+    {
+        const xm::TraceSummary &sum = sums[i];
+        lines.push_back(wxString::Format(wxT("%-32s %6u %9.2f %9.2f"), wxString::FromAscii(sum.name).c_str(),
+            unsigned(sum.count), double(sum.total) / 1000.0, double(sum.longest) / 1000.0));
+    }
+
+    // as counted by the last check of the dead data
+    const MadMemDataStats &mem = m_Lines->GetMemDataStats();
+    lines.push_back(wxString::Format(wxT("memdata KB: %.0f live, %.0f dead, %.0f allocated, %.0f freed by %u compactions"),
+        double(mem.m_Live) / 1024.0, double(mem.m_Dead) / 1024.0, double(mem.m_Allocated) / 1024.0,
+        double(mem.m_Reclaimed) / 1024.0, unsigned(mem.m_Compactions)));
+
+    dc.SetFont(*wxTheFontList->FindOrCreateFont(9, wxFONTFAMILY_MODERN, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+
+    wxCoord w = 0, h = 0;
+    for(size_t i = 0; i < lines.size(); ++i)
+    {
+        wxCoord lw, lh;
+        dc.GetTextExtent(lines[i], &lw, &lh);
+        if(lw > w) w = lw;
+        h = lh;
+    }
+
+    const int margin = 4;
+    const int boxw = w + margin * 2;
+    const int boxh = h * int(lines.size()) + margin * 2;
+    const int left = m_ClientWidth - boxw - margin;
+    const int top = margin;
+
+    dc.SetPen(*wxBLACK_PEN);
+    dc.SetBrush(*wxTheBrushList->FindOrCreateBrush(wxColour(255, 255, 225), wxSOLID));
+    dc.DrawRectangle(left, top, boxw, boxh);
+
+    dc.SetTextForeground(*wxBLACK);
+    dc.SetBackgroundMode(wxTRANSPARENT);
+    for(size_t i = 0; i < lines.size(); ++i)
+        dc.DrawText(lines[i], left + margin, top + margin + h * int(i));
+}
+
 #ifdef __WXMSW__
 WXLRESULT MadEdit::MSWWindowProc(WXUINT message, WXWPARAM wParam, WXLPARAM lParam)
 {
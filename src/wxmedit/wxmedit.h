@@ -37,10 +37,12 @@
 #include "../wxm/encoding/encoding.h"
 #include "wxm_syntax.h"
 #include "wxm_undo.h"
+#include "wxm_row_layout.h"
 #include "ucs4_t.h"
 
 #include <wx/confbase.h>
 
+#include <boost/function.hpp>
 #include <string>
 
 enum { ID_VSCROLLBAR=19876, ID_HSCROLLBAR };
@@ -51,14 +53,14 @@ namespace wxm
 {
     struct WordCountData
     {
-        int bytes;
-        int words;
-        int chars;
-        int spaces;
-        int controls;
-        int fullwidths;
-        int ambws;
-        int lines;
+        wxInt64 bytes;
+        wxInt64 words;
+        wxInt64 chars;
+        wxInt64 spaces;
+        wxInt64 controls;
+        wxInt64 fullwidths;
+        wxInt64 ambws;
+        wxInt64 lines;
         wxArrayString detail;
 
         WordCountData()
@@ -204,6 +206,10 @@ enum MadConvertEncodingFlag
   cefC2JK   // Trad&Simp Chinese   ==> Japanese Kanji
 };
 
+// called with the processed size and the total size during a long operation,
+// return false to cancel it
+typedef boost::function<bool(wxFileOffset pos, wxFileOffset end)> MadProgressCallback;
+
 // flags for SortLines
 typedef int MadSortFlags;
 enum
@@ -260,6 +266,34 @@ struct WXMCharIterator
 
 struct UCIterator;
 
+// the matches of ReplaceAll collected by MadEdit::AppendOverwriteData()
+struct MadOverwriteChunk
+{
+    wxFileOffset m_Pos;
+    wxFileOffset m_DelSize;
+    MadBlock     m_Ins;         // the replacements and the data between them
+
+    MadOverwriteChunk(MadInData *data, wxFileOffset pos, wxFileOffset inspos)
+        :m_Pos(pos), m_DelSize(0), m_Ins(data, inspos, 0)
+    {
+    }
+};
+
+struct MadOverwriteStream
+{
+    vector<MadOverwriteChunk> m_Chunks;
+    wxFileOffset m_LastEndPos;
+    wxFileOffset m_NewCaretPos;
+    size_t       m_Count;
+
+    // m_Chunks are held out of the lines while the progress dialog dispatches the events
+    MadMemDataPin m_Pin;
+
+    MadOverwriteStream(MadLines *lines):m_LastEndPos(-1), m_NewCaretPos(-1), m_Count(0), m_Pin(lines)
+    {
+    }
+};
+
 
 #define MadEditSuperClass wxWindow //wxScrolledWindow//wxPanel//wxControl//
 
@@ -299,6 +333,7 @@ private:
     friend struct wxm::HexSearcher;
 
     static int      ms_Count; // the count of MadEdit
+    static bool     ms_TraceOverlay;
 
     wxScrollBar     *m_VScrollBar, *m_HScrollBar;
     int             m_VSBWidth, m_VSBHeight, m_HSBWidth, m_HSBHeight;
@@ -323,6 +358,10 @@ private:
 
     wxBitmap        *m_ClientBitmap, *m_MarkBitmap;
     int             m_LastPaintBitmap;// 0:client, 1:mark
+    int             m_PaintedTopRow;  // the top row painted in m_ClientBitmap, -1 if none
+
+    MadRowLayoutCache m_RowLayouts;   // of the rows painted in text mode
+    size_t          m_RowLayoutGeneration;  // m_Lines->GetGeneration() of m_RowLayouts
 
     std::vector<wxPoint> m_space_points, m_eof_points;
     std::vector<wxPoint> m_cr_points, m_lf_points, m_crlf_points;
@@ -471,6 +510,7 @@ private:
     wxFileOffset    m_AutoCompletePos;
 
     bool            m_LoadingFile;
+    bool            m_HoldingLines;
     bool            m_Painted;
 
     // speed-up flags for FindInFiles
@@ -485,7 +525,7 @@ private:
 
 protected:
 
-    // GetLineByXXX() will get the wanted line from the nearest position(begin of lines, end of lines, or m_ValidPos)
+    // GetLineByXXX() will get the wanted line by the line index of m_Lines->m_LineList in O(log n)
     // IN:  rowid in whole file
     // OUT: lit of wanted line
     // OUT: rowid of the line
@@ -528,6 +568,18 @@ protected:
 
     void PaintText(wxDC *dc, int x, int y, const ucs4_t *text, const int *width, int count, int minleft, int maxright);
     void PaintTextLines(wxDC *dc, const wxRect &rect, int toprow, int rowcount, const wxColor &bgcolor);
+    // return the layout of the row of lit from m_RowLayouts, or lay it out by m_Syntax
+    // to the first word crossing maxwidth; syntax_row is the row of lit that m_Syntax
+    // is at the beginning of, or -1, and it is updated when m_Syntax is used
+    const MadRowLayout &GetRowLayout(MadLineIterator &lit, int row, int maxwidth, int &syntax_row);
+    void LayOutRow(MadRowLayout &layout, MadLineIterator &lit, int row, int maxwidth);
+    void ClearRowLayouts() { m_RowLayouts.Clear(); }
+    // drop the layouts of the lines out of [first, last] only,
+    // when the lines are not changed since m_RowLayouts was validated
+    void KeepRowLayouts(MadLineIterator first, MadLineIterator last);
+    // shift the rows painted at m_PaintedTopRow to m_TopRow and paint the exposed rows only,
+    // return false if the whole client area must be repainted
+    bool ScrollClientBitmap(wxMemoryDC &memdc, int rowcount);
 
     virtual int CachedLineNumberAreaWidth() = 0;
     virtual void CacheLineNumberAreaWidth(int width) = 0;
@@ -573,8 +625,19 @@ protected:
     static bool PutColumnDataToClipboard(const wxString &ws, int linecount);
     static bool PutRawBytesToClipboard(const std::string& cs);
 
+    // get the blocks of the selected bytes, the contiguous blocks are merged
+    void GetSelectionBlocks(MadBlockVector &blocks);
+    // put the text of the bytes in blocks to the clipboard, under GTK+ it's decoded
+    // only when it's pasted, so the blocks are taken as a snapshot
+    bool PutBlocksTextToClipboard(MadBlockVector &blocks);
+
 public:
     static bool PutTextToClipboard(const wxString &ws);
+    // the text copied from lines but not rendered yet is rendered before
+    // the data it's copied from are freed or overwritten
+    static void RenderDeferredClipboardText(MadLines *lines);
+    // visit the blocks of the text copied from lines but not rendered yet
+    static void VisitDeferredClipboardBlocks(MadLines *lines, MadBlockVisitor &visitor);
 
     bool GetRawBytesFromClipboardDirectly(vector<char>& cs);
     void ConvertToRawBytesFromUnicodeText(vector<char>& cs, const vector<ucs4_t>& ucs);
@@ -596,6 +659,8 @@ protected:
                                      wxFileOffset inssize, /*IN*/  MadBlockVector *insdata,
                                      /*OUT*/ int *lineid = nullptr);
 
+    // append the bytes of uc in enc, or of "{U+XXXX}" if enc cannot encode it
+    static void EncodeUCS4(wxm::WXMEncoding* enc, ucs4_t uc, std::string& bytes);
     void UCStoBlock(const ucs4_t *ucs, size_t count, MadBlock & block);
     void NewLineToBlock(const wxm::NewLineChar& nl, MadBlock & block)
     {
@@ -634,6 +699,14 @@ protected:
                                vector<const ucs4_t*> *ins_ucs, vector<wxByte*> *ins_data,
                                vector<wxFileOffset> &ins_len);
 
+    // append a match in [bpos, epos) after the previous one, the replacement
+    // is written to m_MemData at once and no per-match data is kept;
+    // return the byte-length of the replacement
+    wxFileOffset AppendOverwriteData(MadOverwriteStream &ows, const MadCaretPos &bpos, const MadCaretPos &epos,
+                                     const ucs4_t *ins_ucs, wxByte *ins_data, size_t ins_len);
+    // overwrite all the appended matches in a single Undo
+    void OverwriteData(MadOverwriteStream &ows);
+
     // FindLeft/RightBrace()
     // IN: rowid of begin of lit
     // OUT: rowid of bpi, or -1: not found
@@ -691,10 +764,25 @@ protected:
 
     void OnEraseBackground(wxEraseEvent &evt);
     void OnPaint(wxPaintEvent &evt);
+    void OnIdle(wxIdleEvent &evt);
+
+    // reformat the stale lines for maxms, and update the caret and the view by them
+    void ReformatStaleLines(long maxms);
+
+    // free the dead data of m_Lines->m_MemData if they are many, it's tried when the file
+    // is saved, and in the idle time after some undos were trimmed or the data grew much
+    void CompactMemData();
+    void CompactMemDataOnIdle();
 
     virtual void OnPaintInPrinting(wxPaintDC& dc, wxMemoryDC& memdc) = 0;
 
 public:
+    // ReplaceAll keeps the iterators of m_Lines while the progress dialog dispatches the events,
+    // so the stale lines and the unindexed tail must be done before, and not be touched by
+    // OnIdle and OnPaint until ReleaseLines()
+    void HoldLines();
+    void ReleaseLines() { m_HoldingLines = false; }
+
     void OnSelectionAndStatusChanged()
     {
         DoSelectionChanged();
@@ -933,6 +1021,10 @@ public: // basic functions
     void GetSelText(wxString &ws);
     void GetText(wxString &ws, bool ignoreBOM = true);
     void SetText(const wxString &ws);
+protected:
+    // replace the whole text by the data of blk, which may be empty
+    void SetTextBlock(MadBlock &blk);
+public:
 
     // line: zero based
     // return true for full line, false for partial line
@@ -998,9 +1090,18 @@ public: // basic functions
     // return wxID_YES(Saved), wxID_NO(Not Saved), or wxID_CANCEL
     int Save(bool ask, const wxString &title, bool saveas);
 
+protected:
+    // decode the text from pos by m_Encoding chunk by chunk, convert the Chinese chars by flag,
+    // and append them encoded by enc to blk in m_MemData;
+    // converted is the count of converted Chinese chars, return false if canceled by progress
+    bool TranscodeToBlock(wxm::WXMEncoding* enc, wxFileOffset pos, MadConvertEncodingFlag flag,
+                          MadBlock &blk, int &converted, const MadProgressCallback& progress);
+
 public: // advanced functions
-    void ConvertEncoding(const wxString &newenc, MadConvertEncodingFlag flag);
-    void ConvertChinese(MadConvertEncodingFlag flag);
+    void ConvertEncoding(const wxString &newenc, MadConvertEncodingFlag flag,
+                         const MadProgressCallback& progress = MadProgressCallback());
+    void ConvertChinese(MadConvertEncodingFlag flag,
+                        const MadProgressCallback& progress = MadProgressCallback());
 
     bool HasBOM()
     {
@@ -1062,7 +1163,12 @@ protected: // Printing functions
     bool HexPrinting()  { return m_Printing>0; }
     bool InPrinting()   { return m_Printing!=0; }
 
+    // draw the recent spans of xm::TraceScope over the editing area
+    static void SetTraceOverlay(bool show) { ms_TraceOverlay = show; }
+    static bool GetTraceOverlay() { return ms_TraceOverlay; }
+
 private:
+    void PaintTraceOverlay(wxDC &dc);
 
     virtual void SetClientSizeData(int w, int h);
     void UpdateClientBitmap();
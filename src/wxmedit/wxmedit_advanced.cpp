@@ -13,10 +13,12 @@
 #include "../wxm/case_conv.h"
 #include "../xm/ublock.h"
 #include "../xm/uutils.h"
+#include "../xm/trace.h"
 #include "../mad_utils.h"
 #include "../wxm/searcher.h"
+#include "../wxm/line_sorter.h"
+#include "../wxm/word_counter.h"
 
-#include <boost/scoped_ptr.hpp>
 #include <algorithm>
 #include <vector>
 using std::vector;
@@ -109,23 +111,108 @@ void MadEdit::ToggleBOM()
 }
 
 
-wxString *ConvertTextToNewString(const wxString& text, MadConvertChineseFlag flag)
+// the bytes decoded and encoded at a time by TranscodeToBlock()
+const size_t TRANSCODE_CHUNK_SIZE = 256 * 1024;
+
+bool GetConvertChineseFlag(MadConvertEncodingFlag flag, MadConvertChineseFlag& ccf)
 {
-    wxString *ptext=nullptr;
-    if(text.Len()!=0)
+    MadConvertEncodingFlag cefs[]=
+        { cefSC2TC, cefTC2SC, cefJK2TC, cefJK2SC, cefC2JK };
+    MadConvertChineseFlag ccfs[]=
+        { ccfSimp2Trad, ccfTrad2Simp, ccfKanji2Trad, ccfKanji2Simp, ccfChinese2Kanji };
+    for(size_t i=0; i<sizeof(cefs)/sizeof(cefs[0]); ++i)
     {
-        wxChar *str=new wxChar[text.Len()];
-        int count=::ConvertChinese(text.c_str(), str, text.Len(), flag);
-        if(count>0)
+        if(flag==cefs[i])
+        {
+            ccf=ccfs[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MadEdit::TranscodeToBlock(wxm::WXMEncoding* enc, wxFileOffset pos, MadConvertEncodingFlag flag,
+                               MadBlock &blk, int &converted, const MadProgressCallback& progress)
+{
+    XM_TRACE_SCOPE("MadEdit::TranscodeToBlock");
+
+    // blk is held out of the lines while the progress dialog dispatches the events
+    MadMemDataPin pin(m_Lines);
+
+    MadConvertChineseFlag ccf;
+    bool chinese = GetConvertChineseFlag(flag, ccf);
+    converted = 0;
+
+    // the working memory is bounded by the chunk size, whatever the size of the text is
+    vector<wxByte> inbuf(TRANSCODE_CHUNK_SIZE);
+    vector<ucs4_t> ucs(TRANSCODE_CHUNK_SIZE);
+    vector<wxByte> lens(TRANSCODE_CHUNK_SIZE);
+    std::string outbuf;
+
+    // all of pos is in the first line, which holds the BOM
+    MadLineIterator lit = m_Lines->m_LineList.begin();
+    MadLineIterator lend = m_Lines->m_LineList.end();
+    wxFileOffset linepos = pos;
+    size_t kept = 0;    // the bytes of an incomplete char left by the last chunk
+
+    for(;;)
+    {
+        size_t len = kept;
+        while(len < TRANSCODE_CHUNK_SIZE && lit != lend)
+        {
+            size_t size = size_t(std::min(wxFileOffset(TRANSCODE_CHUNK_SIZE - len), lit->m_Size - linepos));
+            if(size > 0)
+                lit->Get(linepos, &inbuf[len], size);
+            len += size;
+            linepos += size;
+            if(linepos == lit->m_Size)
+            {
+                ++lit;
+                linepos = 0;
+            }
+        }
+
+        if(len == 0)
+            break;
+
+        bool more = (lit != lend);
+        size_t count = m_Encoding->DecodeUChar32s(&inbuf[0], len, more, &ucs[0], &lens[0], ucs.size());
+        if(count == 0)
+            break;
+
+        if(chinese)
+            converted += ::ConvertChinese(&ucs[0], count, ccf);
+
+        outbuf.clear();
+        size_t used = 0;
+        for(size_t i=0; i<count; ++i)
+        {
+            EncodeUCS4(enc, ucs[i], outbuf);
+            used += lens[i];
+        }
+
+        if(!outbuf.empty())
         {
-            ptext=new wxString(str, text.Len());
+            wxFileOffset outpos = m_Lines->m_MemData->Put((wxByte*)&outbuf[0], outbuf.size());
+            if(blk.m_Pos < 0)
+                blk.m_Pos = outpos;
+            blk.m_Size += outbuf.size();
         }
-        delete []str;
+
+        kept = len - used;
+        if(kept > 0)
+            memmove(&inbuf[0], &inbuf[used], kept);
+        pos += used;
+
+        if(!progress.empty() && !progress(pos, m_Lines->m_Size))
+            return false;
     }
-    return ptext;
+
+    return true;
 }
 
-void MadEdit::ConvertEncoding(const wxString &newenc, MadConvertEncodingFlag flag)
+void MadEdit::ConvertEncoding(const wxString &newenc, MadConvertEncodingFlag flag,
+                              const MadProgressCallback& progress)
 {
     if(IsReadOnly() || !IsTextFile())
         return;
@@ -133,17 +220,7 @@ void MadEdit::ConvertEncoding(const wxString &newenc, MadConvertEncodingFlag fla
     wxString lowerenc=newenc.Lower();
     if(lowerenc == m_Encoding->GetName().Lower())
     {
-        switch(flag)
-        {
-        case cefTC2SC:
-        case cefSC2TC:
-        case cefJK2TC:
-        case cefJK2SC:
-        case cefC2JK:
-            ConvertChinese(flag);
-            break;
-        default: break;
-        }
+        ConvertChinese(flag, progress);
         return;
     }
 
@@ -155,80 +232,44 @@ void MadEdit::ConvertEncoding(const wxString &newenc, MadConvertEncodingFlag fla
 
     WXMLocations loc = SaveLocations();
 
-    bool ignoreBOM=true;
+    // the BOM is converted to the BOM of a Unicode encoding, or dropped
+    wxFileOffset pos = 0;
 	wxm::WXMEncoding* enc = wxm::WXMEncodingManager::Instance().GetWxmEncoding(newenc);
-	if(enc->IsUnicodeEncoding())
+	if(!enc->IsUnicodeEncoding())
     {
-        ignoreBOM=false;
+        pos = m_Lines->m_LineList.begin()->m_RowIndices.front().m_Start;
     }
 
-    wxString text, *ptext=nullptr;
-    GetText(text, ignoreBOM);
-
-    if(flag != cefNone)
-    {
-        MadConvertEncodingFlag cefs[]=
-            { cefSC2TC, cefTC2SC, cefJK2TC, cefJK2SC, cefC2JK };
-        MadConvertChineseFlag ccfs[]=
-            { ccfSimp2Trad, ccfTrad2Simp, ccfKanji2Trad, ccfKanji2Simp, ccfChinese2Kanji };
-        for(size_t i=0; i<sizeof(cefs)/sizeof(cefs[0]); ++i)
-        {
-            if(flag==cefs[i])
-            {
-                ptext=ConvertTextToNewString(text, ccfs[i]);
-                break;
-            }
-        }
-    }
+    // the converted text is streamed into m_MemData before switching the encoding,
+    // the document is left untouched if it's canceled
+    MadBlock blk(m_Lines->m_MemData, -1, 0);
+    int converted;
+    if(!TranscodeToBlock(enc, pos, flag, blk, converted, progress))
+        return;
 
     m_LoadingFile=true; // don't reformat
     SetEncoding(newenc);
     m_LoadingFile=false;
 
-    if(ptext)
-    {
-        SetText(*ptext);
-        delete ptext;
-    }
-    else
-    {
-        SetText(text);
-    }
+    SetTextBlock(blk);
 
     RestoreLocations(loc);
 }
 
-void MadEdit::ConvertChinese(MadConvertEncodingFlag flag)
+void MadEdit::ConvertChinese(MadConvertEncodingFlag flag, const MadProgressCallback& progress)
 {
-    if(IsReadOnly() || !IsTextFile() || m_Lines->m_Size==0)
+    MadConvertChineseFlag ccf;
+    if(IsReadOnly() || !IsTextFile() || m_Lines->m_Size==0 || !GetConvertChineseFlag(flag, ccf))
         return;
 
     WXMLocations loc = SaveLocations();
 
-    wxString text, *ptext=nullptr;
-    GetText(text, false);
-
-    if(flag != cefNone)
-    {
-        MadConvertEncodingFlag cefs[]=
-            { cefSC2TC, cefTC2SC, cefJK2TC, cefJK2SC, cefC2JK };
-        MadConvertChineseFlag ccfs[]=
-            { ccfSimp2Trad, ccfTrad2Simp, ccfKanji2Trad, ccfKanji2Simp, ccfChinese2Kanji };
-        for(size_t i=0; i<sizeof(cefs)/sizeof(cefs[0]); ++i)
-        {
-            if(flag==cefs[i])
-            {
-                ptext=ConvertTextToNewString(text, ccfs[i]);
-                break;
-            }
-        }
-    }
+    MadBlock blk(m_Lines->m_MemData, -1, 0);
+    int converted;
+    if(!TranscodeToBlock(m_Encoding, 0, flag, blk, converted, progress) || converted==0)
+        return;
 
-    if(ptext!=nullptr)
-    {
-        SetText(*ptext);
-        delete ptext;
-    }
+    SetTextBlock(blk);
 
     RestoreLocations(loc);
 }
@@ -238,6 +279,8 @@ void MadEdit::ConvertNewLine(const wxm::NewLineChar& nl)
     if(IsReadOnly() || !IsTextFile())
         return;
 
+    m_Lines->IndexWholeTail();
+
     if(m_Lines->m_LineCount<2)
     {
         m_newline = &nl;
@@ -1225,10 +1268,14 @@ void MadEdit::ToFullWidth(bool ascii, bool japanese, bool korean, bool other)
 }
 
 
+// the bytes of the lines counted by a thread at a time in WordCount()
+const size_t WORD_COUNT_CHUNK_SIZE = 1024 * 1024;
+
 void MadEdit::WordCount(bool selection, wxm::WordCountData& data)
 {
+    XM_TRACE_SCOPE("MadEdit::WordCount");
+
     xm::UnicodeBlockSet& ublock_set = xm::UnicodeBlockSet::GetInstance();
-    xm::UnicodeBlockCharCounter ublock_counter;
 
     MadLineIterator lit;
     wxFileOffset linepos, nowpos, endpos;
@@ -1242,364 +1289,82 @@ void MadEdit::WordCount(bool selection, wxm::WordCountData& data)
     }
     else
     {
-        data.lines=(int)m_Lines->m_LineCount;
+        m_Lines->IndexWholeTail();
+        data.lines=m_Lines->m_LineCount;
         lit=m_Lines->m_LineList.begin();
         linepos=0;
         nowpos=0;
         endpos=m_Lines->m_Size;
     }
-    data.bytes = int(endpos - nowpos);
+    data.bytes = endpos - nowpos;
 
-    // begin counting
-    MadUCQueue ucqueue;
-    m_Lines->InitNextUChar(lit, linepos);
-    int idx=0, count=0;
-    boost::scoped_ptr<xm::WordCounter> word_counter(new xm::AccumulativeWordCounter(0x4000));
+    // begin counting, the lines are copied into chunks here since MadLines is not thread-safe,
+    // and the chunks are decoded and counted in parallel
+    wxm::ParallelWordCounter counter(m_Lines->m_Encoding);
+    MadLineIterator chunklit = lit;
+    wxFileOffset chunkpos = linepos;
+    size_t chunksize = 0;
 
     while (nowpos < endpos)
     {
-        if (++count >= 1024)
-        {
-            ucqueue.clear();
-            count=0;
-        }
+        size_t size = size_t(std::min(lit->m_Size - linepos, endpos - nowpos));
+        chunksize += size;
+        nowpos += size;
+        ++lit;
+        linepos = 0;
 
-        if (!m_Lines->NextUChar(ucqueue))
+        if (chunksize < WORD_COUNT_CHUNK_SIZE && nowpos < endpos)
+            continue;
+
+        wxByte *buf = counter.AddChunk(chunksize);
+        for (; chunksize > 0; ++chunklit, chunkpos = 0)
         {
-            ++lit;
-            m_Lines->InitNextUChar(lit, 0);
-            m_Lines->NextUChar(ucqueue);
+            size = size_t(std::min(chunklit->m_Size - chunkpos, wxFileOffset(chunksize)));
+            chunklit->Get(chunkpos, buf, size);
+            buf += size;
+            chunksize -= size;
         }
-        MadUCPair &ucp=ucqueue.back();
-        nowpos+=ucp.second;
-        ucs4_t uc=ucp.first;
-
-        idx = ublock_set.FindBlockIndex(uc);
-        ublock_counter.Count(idx);
-        (*word_counter) += (UChar32)uc;
-
-        ++data.chars;
-        if (u_iscntrl(uc))
-            ++data.controls;
-        else if (u_isspace(uc))
-            ++data.spaces;
-
-        if (xm::IsWideWidthEverywhere(uc))
-            ++data.fullwidths;
-        if (xm::IsAmbiguousWidth(uc))
-            ++data.ambws;
+        chunklit = lit;
+        chunkpos = 0;
+
+        if (counter.IsFull())
+            counter.Count();
     }
-    data.words = word_counter->GetWordCountNoCtrlNoSP();
+    counter.Count();
+
+    wxm::WordCountPart& result = counter.Result();
+    data.chars = result.chars;
+    data.controls = result.controls;
+    data.spaces = result.spaces;
+    data.fullwidths = result.fullwidths;
+    data.ambws = result.ambws;
+    data.words = result.words.GetWordCountNoCtrlNoSP();
 
-    for (idx=ublock_counter.BlockIndexBegin(); ublock_counter.IsValidBlock(idx); idx=ublock_counter.NextBlock())
+    xm::UnicodeBlockCharCounter& ublock_counter = result.blocks;
+    for (int idx=ublock_counter.BlockIndexBegin(); ublock_counter.IsValidBlock(idx); idx=ublock_counter.NextBlock())
     {
-        int cnt = ublock_counter.GetBlockCharCount(idx);
+        wxLongLong_t cnt = ublock_counter.GetBlockCharCount(idx);
         wxString block_begin = wxString::Format(wxT("U+%04X"), ublock_set.Begin(idx));
         wxString block_end = wxString::Format(wxT("U+%04X"), ublock_set.End(idx));
-        data.detail.Add(wxString::Format(wxT("%10d    %8s - %8s: %s"), cnt,
+        data.detail.Add(wxString::Format(wxT("%10") wxLongLongFmtSpec wxT("d    %8s - %8s: %s"), cnt,
             block_begin.c_str(), block_end.c_str(), wxGetTranslation(ublock_set.Description(idx))));
     }
     if (ublock_counter.GetInvalidBlockCharCount() > 0)
     {
-        int cnt = ublock_counter.GetInvalidBlockCharCount();
-        data.detail.Add(wxString::Format(wxT("%10d           ? -        ? %s"), cnt, _("Invalid Unicode Characters")));
+        wxLongLong_t cnt = ublock_counter.GetInvalidBlockCharCount();
+        data.detail.Add(wxString::Format(wxT("%10") wxLongLongFmtSpec wxT("d           ? -        ? %s"), cnt, _("Invalid Unicode Characters")));
     }
 }
 
 
 //==============================================================================
-struct SortLineData
-{
-    static bool s_casesensitive;
-    static bool s_numeric;
-    static MadLines *s_lines;
-
-    MadLineIterator lit;
-    int lineid;
-    vector<ucs4_t> ucdata;
-    // for numeric sorting. int_begin=-1 indicates invalid number
-    int int_begin, int_len, frac_begin, frac_len;
-    bool negative;
-
-    SortLineData(const MadLineIterator& l, int id);
-    bool Equal(const SortLineData *data);
-};
-bool SortLineData::s_casesensitive=false;
-bool SortLineData::s_numeric=false;
-MadLines *SortLineData::s_lines=nullptr;
-
-SortLineData::SortLineData(const MadLineIterator& l, int id)
-    : lit(l), lineid(id), ucdata(), int_begin(-1), frac_begin(-1), negative(false)
-{
-    enum { NUM_SIGN, NUM_INT, NUM_FRAC ,NUM_END};
-    int numstep=NUM_SIGN;
-    int num_idx=0;
-
-    static MadUCQueue ucq;
-    ucq.clear();
-
-    s_lines->InitNextUChar(lit, lit->m_RowIndices[0].m_Start);
-    ucs4_t uc;
-    while(s_lines->NextUChar(ucq)) // get line content
-    {
-        if( (uc=ucq.back().first)==0x0D || uc==0x0A)
-        {
-            ucq.pop_back();
-            break;
-        }
-
-        if(!s_casesensitive) // ignore case
-        {
-            uc = u_tolower(uc);
-        }
-
-        //save every character
-        ucdata.push_back(uc);
-
-        if(s_numeric && numstep!=NUM_END)
-        {
-            if(numstep==NUM_SIGN)
-            {
-                switch(uc)
-                {
-                case ' ':
-                case '\t':
-                    break;
-                case '-':
-                    negative=true;
-                    ++numstep;
-                    break;
-                case '+':
-                    ++numstep;
-                    break;
-                case '.':
-                    numstep=NUM_FRAC;
-                    break;
-                default:
-                    if(uc>='0' && uc<='9')
-                    {
-                        int_begin=num_idx;
-                        int_len=1;
-                        ++numstep;
-                    }
-                    else
-                    {
-                        numstep=NUM_END; // invalid number format
-                    }
-                    break;
-                }
-            }
-            else if(numstep==NUM_INT)
-            {
-                switch(uc)
-                {
-                case '.':
-                    ++numstep;
-                    break;
-                default:
-                    if(uc>='0' && uc<='9')
-                    {
-                        if(int_begin==-1)
-                        {
-                            int_begin=num_idx;
-                            int_len=1;
-                        }
-                        else
-                        {
-                            ++int_len;
-                        }
-                    }
-                    else
-                    {
-                        numstep=NUM_END; // invalid number format
-                    }
-                    break;
-                }
-            }
-            else //if(numstep==NUM_FRAC)
-            {
-                if(uc>='0' && uc<='9')
-                {
-                    if(int_begin==-1)
-                    {
-                        int_begin=0;
-                        int_len=0;
-                    }
-                    if(frac_begin==-1)
-                    {
-                        frac_begin=num_idx;
-                        frac_len=1;
-                    }
-                    else
-                    {
-                        ++frac_len;
-                    }
-                }
-                else
-                {
-                    numstep=NUM_END; // invalid number format
-                }
-            }
-            ++num_idx;
-        }
-    }
-
-    if(s_numeric) //post processing
-    {
-        if(int_begin>=0 && int_len>0) // trim leading '0'
-        {
-            do
-            {
-                if(ucq[int_begin].first!='0')
-                {
-                    break;
-                }
-                ++int_begin;
-            }
-            while(--int_len > 0);
-        }
-        if(frac_begin>=0) // trim trailing '0'
-        {
-            do
-            {
-                if(ucq[frac_begin+frac_len-1].first!='0')
-                {
-                    break;
-                }
-            }
-            while(--frac_len > 0);
-            if(frac_len==0)
-            {
-                frac_begin=-1;
-            }
-        }
-    }
-}
-
-bool SortLineData::Equal(const SortLineData *data)
-{
-    size_t count = ucdata.size();
-    const vector<ucs4_t> &ucdata2 = data->ucdata;
-    if(count != ucdata2.size()) return false;
-    if(count == 0) return true;
-
-    size_t i=0;
-    do
-    {
-        if(ucdata[i] != ucdata2[i]) return false;
-    }
-    while(++i < count);
-    return true;
-}
-
-
-// it's LessThan Comparable. For std::sort().
-struct SortLineComp
-{
-    static bool s_numeric;
-    SortLineData *data;
-
-    SortLineComp() :data(nullptr) {}
-    SortLineComp(SortLineData *d) :data(d) {}
-
-    bool operator<(const SortLineComp& it) const
-    {
-        if(s_numeric) // compare number
-        {
-            if(data->int_begin>=0)
-            {
-                if(it.data->int_begin < 0) return true;
-
-                if(data->negative && !it.data->negative) return true;
-                if(!data->negative && it.data->negative) return false;
-
-                const SortLineData *data1, *data2;
-                if(data->negative)
-                {
-                    data1 = it.data;
-                    data2 = this->data;
-                }
-                else
-                {
-                    data1 = this->data;
-                    data2 = it.data;
-                }
-
-                // compare integer
-                if(data1->int_len < data2->int_len) return true;
-                if(data1->int_len > data2->int_len) return false;
-
-                //int_len == it.int_len
-                const vector<ucs4_t> &it1ucdata = data1->ucdata;
-                const vector<ucs4_t> &it2ucdata = data2->ucdata;
-                if(data1->int_len > 0)
-                {
-                    const int it1beg=data1->int_begin;
-                    const int it2beg=data2->int_begin;
-                    int i=0;
-                    do
-                    {
-                        const ucs4_t uc1 = it1ucdata[it1beg+i];
-                        const ucs4_t uc2 = it2ucdata[it2beg+i];
-                        if(uc1 < uc2) return true;
-                        if(uc1 > uc2) return false;
-                    }
-                    while(++i < data1->int_len);
-                }
-
-                // compare fraction
-                const int it1beg=data1->frac_begin;
-                const int it2beg=data2->frac_begin;
-                if(it2beg < 0) return false;
-                if(it1beg < 0) return true;
-
-                const int it1len=data1->frac_len;
-                const int it2len=data2->frac_len;
-                int i=0;
-                do
-                {
-                    const ucs4_t uc1 = it1ucdata[it1beg+i];
-                    const ucs4_t uc2 = it2ucdata[it2beg+i];
-                    if(uc1 < uc2) return true;
-                    if(uc1 > uc2) return false;
-                    ++i;
-                }
-                while(i<it1len && i<it2len);
-
-                if(it1len < it2len) return true;
-            }
-        }
-        else // compare string
-        {
-            const vector<ucs4_t> &ucdata1 = data->ucdata;
-            const vector<ucs4_t> &ucdata2 = it.data->ucdata;
-            const size_t len1 = ucdata1.size();
-            const size_t len2 = ucdata2.size();
-
-            if(len1==0) return true;
-            if(len2==0) return false;
-
-            size_t i = 0;
-            do
-            {
-                if(ucdata1[i] < ucdata2[i]) return true;
-                if(ucdata1[i] > ucdata2[i]) return false;
-                ++i;
-            }
-            while(i<len1 && i<len2);
-
-            if(len1 < len2) return true;
-        }
-        return false;
-    }
-};
-bool SortLineComp::s_numeric=false;
-
 void MadEdit::SortLines(MadSortFlags flags, int beginline, int endline)
 {
     if(IsReadOnly() || m_EditMode==emHexMode)
         return;
 
+    m_Lines->IndexWholeTail();
+
     int maxline=int(m_Lines->m_LineCount) - 1;
     MadLineIterator lit = m_Lines->m_LineList.end();
     --lit;
@@ -1621,14 +1386,8 @@ void MadEdit::SortLines(MadSortFlags flags, int beginline, int endline)
 
     bool bDescending = (flags&sfDescending)!=0;
     bool bRemoveDup = (flags&sfRemoveDuplicate)!=0;
-    SortLineData::s_casesensitive = (flags&sfCaseSensitive)!=0;
-    SortLineData::s_numeric = (flags&sfNumericSort)!=0;
-    SortLineComp::s_numeric = SortLineData::s_numeric;
-
-    SortLineData::s_lines=m_Lines;
-
-    std::list<SortLineData*> datalist;
-    std::vector<SortLineComp> lines;
+    wxm::LineSorter sorter((flags&sfCaseSensitive)!=0, (flags&sfNumericSort)!=0);
+    std::vector<MadLineIterator> lines;
 
     wxFileOffset pos=0, delsize=0, lastNewLineSize;
 
@@ -1647,11 +1406,15 @@ void MadEdit::SortLines(MadSortFlags flags, int beginline, int endline)
         delsize = -pos;
     }
 
-    for(;;) // prepare for data & calc delsize
+    for(;;) // copy the text of lines to sorter & calc delsize
     {
-        SortLineData *d = new SortLineData(lit, i);
-        datalist.push_back(d);
-        lines.push_back(SortLineComp(d));
+        wxFileOffset spos = lit->m_RowIndices[0].m_Start;
+        size_t len = size_t(lit->m_Size - spos - lit->m_NewLineSize);
+        wxByte *text = sorter.AddLine(len);
+        if(len>0)
+            lit->Get(spos, text, len);
+
+        lines.push_back(lit);
         delsize += lit->m_Size;
         if(++i > endline)
         {
@@ -1664,7 +1427,7 @@ void MadEdit::SortLines(MadSortFlags flags, int beginline, int endline)
     }
 
     // sort lines
-    std::stable_sort(lines.begin(), lines.end());
+    sorter.Sort(m_Lines->m_Encoding);
 
     // put the sorted lines to MemData
     MadBlock blk(m_Lines->m_MemData, m_Lines->m_MemData->m_Size, 0);
@@ -1672,79 +1435,46 @@ void MadEdit::SortLines(MadSortFlags flags, int beginline, int endline)
     vector<wxByte> buffervector;
     wxByte *buf=nullptr;
 
-    std::vector<SortLineComp>::iterator slit = lines.begin();
-    std::vector<SortLineComp>::iterator slitend = lines.end();
-    std::vector<SortLineComp>::reverse_iterator slrit = lines.rbegin();
-    //std::vector<SortLineComp>::reverse_iterator slritend = lines.rend();
-    SortLineData *dupdata=nullptr;
-    do
+    const size_t count = sorter.Count();
+    for(size_t idx=0; idx<count; ++idx)
     {
-        SortLineData *data=nullptr;
-        if(bDescending)
-        {
-            data = (*slrit).data;
-        }
-        else
-        {
-            data = slit->data;
-        }
-        ++slrit;
-        ++slit;
+        const size_t sorted = bDescending ? count-1-idx : idx;
+        const bool last = (idx+1 == count);
 
-        if(bRemoveDup)
+        // the duplicate lines are adjacent after sorting
+        if(bRemoveDup && idx>0 && sorter.SameText(bDescending ? sorted+1 : sorted-1, sorted))
         {
-            if(dupdata!=nullptr && dupdata->Equal(data))
+            if(last)
             {
-                dupdata = data;
-                data = nullptr;
-                if(slit == slitend)
-                {
-                    delsize += lastNewLineSize; // delete last newner char
-                }
-            }
-            else
-            {
-                dupdata = data;
+                delsize += lastNewLineSize; // delete last newner char
             }
+            continue;
         }
 
-        if(data != nullptr)
-        {
-            lit = data->lit;
-            wxFileOffset spos = lit->m_RowIndices[0].m_Start;
-            size_t size= size_t(lit->m_Size - spos);
+        lit = lines[sorter.Order(sorted)];
+        wxFileOffset spos = lit->m_RowIndices[0].m_Start;
+        size_t size= size_t(lit->m_Size - spos);
 
-            if(slit == slitend) // ignore newline char of last line
-            {
-                size -= lit->m_NewLineSize;
-            }
+        if(last) // ignore newline char of last line
+        {
+            size -= lit->m_NewLineSize;
+        }
 
-            if(size>0)
+        if(size>0)
+        {
+            if(buffervector.size()<size)
             {
-                if(buffervector.size()<size)
-                {
-                    buffervector.resize(size);
-                    buf=&buffervector[0];
-                }
-                lit->Get(spos, buf, size);
-                m_Lines->m_MemData->Put(buf, size); // put line text (include newline char)
-                blk.m_Size+=size;
+                buffervector.resize(size);
+                buf=&buffervector[0];
             }
-
-            if(lit->m_NewLineSize == 0 && slit != slitend) //append a newline char
-                NewLineToBlock(blk);
+            lit->Get(spos, buf, size);
+            m_Lines->m_MemData->Put(buf, size); // put line text (include newline char)
+            blk.m_Size+=size;
         }
 
+        if(lit->m_NewLineSize == 0 && !last) //append a newline char
+            NewLineToBlock(blk);
     }
-    while(slit != slitend);
-
-    // free all data in datalist
-    std::list<SortLineData*>::iterator dit=datalist.begin();
-    do
-    {
-        delete (*dit);
-    }
-    while(++dit != datalist.end());
 
     //
     MadOverwriteUndoData *oudata = new MadOverwriteUndoData();
@@ -86,6 +86,7 @@ void MadEdit::SetSyntax(const wxString &title, bool manual)
 
     m_Lines->m_Syntax=m_Syntax;
     m_Lines->SetManual(manual);
+    ClearRowLayouts();
 
     if (m_LoadingFile)
         return;
@@ -108,6 +109,7 @@ void MadEdit::ApplySyntaxAttributes(MadSyntax *syn, bool matchTitle)
     if(!matchTitle || syn->GetTitle()==m_Syntax->GetTitle())
     {
         m_Syntax->AssignAttributes(syn);
+        ClearRowLayouts();
         if(m_EditMode==emHexMode && m_HexDigitBitmap)
         {
             delete m_HexDigitBitmap;
@@ -919,17 +921,31 @@ void MadEdit::GetText(wxString &ws, bool ignoreBOM)
 
 void MadEdit::SetText(const wxString &ws)
 {
-    MadLineIterator lit;
     size_t size = ws.Len();
 
     if (!AdjustStringLength(ws, size))
         return;
 
+    MadBlock blk(m_Lines->m_MemData, -1, 0);
+
+    if(size != 0)
+    {
+        vector<ucs4_t> ucs;
+        TranslateText(ws.c_str(), size, ucs, true);
+        UCStoBlock(&ucs[0], ucs.size(), blk);
+    }
+
+    SetTextBlock(blk);
+}
+
+void MadEdit::SetTextBlock(MadBlock &blk)
+{
+    MadLineIterator lit;
     MadUndo *undo=nullptr;
 
     if(m_Lines->m_Size)
     {
-        if(size == 0)               // delete
+        if(blk.m_Size == 0)         // delete
         {
             MadDeleteUndoData *dudata = new MadDeleteUndoData;
 
@@ -948,12 +964,6 @@ void MadEdit::SetText(const wxString &ws)
             oudata->m_Pos = 0;
             oudata->m_DelSize = m_Lines->m_Size;
 
-            MadBlock blk(m_Lines->m_MemData, -1, 0);
-
-            vector<ucs4_t> ucs;
-            TranslateText(ws.c_str(), size, ucs, true);
-            UCStoBlock(&ucs[0], ucs.size(), blk);
-
             oudata->m_InsSize = blk.m_Size;
             oudata->m_InsData.push_back(blk);
 
@@ -966,15 +976,9 @@ void MadEdit::SetText(const wxString &ws)
     }
     else                          //insert
     {
-        if(size == 0)
+        if(blk.m_Size == 0)
             return;
 
-        MadBlock blk(m_Lines->m_MemData, -1, 0);
-
-        vector<ucs4_t> ucs;
-        TranslateText(ws.c_str(), size, ucs, true);
-        UCStoBlock(&ucs[0], ucs.size(), blk);
-
         MadInsertUndoData *insud = new MadInsertUndoData;
         insud->m_Pos = 0;
         insud->m_Size = blk.m_Size;
@@ -1098,6 +1102,8 @@ void MadEdit::SelectAll()
 {
     if(m_Lines->m_Size)
     {
+        m_Lines->IndexWholeTail();
+
         m_SelectionPos1.Reset(m_Lines->m_LineList.begin());
         m_SelectionBegin = &m_SelectionPos1;
 
@@ -1167,44 +1173,9 @@ void MadEdit::CopyColumnText()
 
 void MadEdit::CopyRegularText()
 {
-    wxString ws;
-    MadUCQueue ucqueue;
-
-    wxFileOffset pos = m_SelectionBegin->pos;
-    MadLineIterator lit = m_SelectionBegin->iter;
-    m_Lines->InitNextUChar(lit, m_SelectionBegin->linepos);
-    do
-    {
-        if(ucqueue.size() || m_Lines->NextUChar(ucqueue))
-        {
-            ucs4_t &uc=ucqueue.front().first;
-            if(uc==0x0D || uc==0x0A)
-            {
-                ws << wxm::g_nl_default.wxValue();
-
-                pos += ucqueue.front().second;
-
-                if(uc==0x0D && m_Lines->NextUChar(ucqueue) &&
-                    ucqueue.back().first==0x0A)
-                {
-                    pos += ucqueue.back().second;
-                }
-
-                ucqueue.clear();
-            }
-
-            wxm::WxStrAppendUCS4(ws, uc);
-            pos += ucqueue.front().second;
-            ucqueue.clear();
-        }
-        else
-        {
-            m_Lines->InitNextUChar(++lit, 0);
-        }
-    }
-    while(pos < m_SelectionEnd->pos);
-
-    PutTextToClipboard(ws);
+    MadBlockVector blocks;
+    GetSelectionBlocks(blocks);
+    PutBlocksTextToClipboard(blocks);
 }
 
 void MadEdit::CopyRawBytes()
@@ -1724,6 +1695,13 @@ bool MadEdit::SaveToFile(const wxString &filename)
         return false;
     }
 
+    const MadSaveStats &stats = m_Lines->GetSaveStats();
+    wxLogDebug(wxT("save: %s copied, %s rewritten, %s unchanged, %s moved"),
+               wxLongLong(stats.m_Copied).ToString().c_str(), wxLongLong(stats.m_Rewritten).ToString().c_str(),
+               wxLongLong(stats.m_Unchanged).ToString().c_str(), wxLongLong(stats.m_Moved).ToString().c_str());
+
+    CompactMemData();
+
     m_SavePoint = m_UndoBuffer->GetPrevUndo();
     m_Modified=false;
     wxLogNull nolog;
@@ -1833,6 +1811,9 @@ bool MadEdit::ReloadByModificationTime()
 
     m_ModificationTime = modtime;
 
+    if(m_Lines->m_FileData != nullptr)
+        m_Lines->m_FileData->VerifyMapping();
+
     wxMessageDialog dlg(this,
         wxString(_("This file has been changed by another application."))+ wxT("\n")+
         wxString(_("Do you want to reload it?"))+ wxT("\n\n")+ m_Lines->m_Name,
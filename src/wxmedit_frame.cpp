@@ -33,6 +33,7 @@
 #include "wxm/update.h"
 #include "wxm/recent_list.h"
 #include "wxm/def.h"
+#include "xm/trace.h"
 
 #ifdef _MSC_VER
 # pragma warning( push )
@@ -44,11 +45,13 @@
 #include <wx/tokenzr.h>
 #include <wx/fontenum.h>
 #include <wx/filename.h>
+#include <wx/file.h>
 #include <wx/fontdlg.h>
 #include <wx/textdlg.h>
 #include <wx/msgdlg.h>
 #include <wx/dnd.h>
 #include <wx/printdlg.h>
+#include <wx/progdlg.h>
 #include <wx/config.h>
 // disable 4996 }
 #ifdef _MSC_VER
@@ -904,6 +907,8 @@ BEGIN_EVENT_TABLE(MadEditFrame,wxFrame)
 	EVT_UPDATE_UI(menuKanji2SimpChinese, MadEditFrame::OnUpdateUI_MenuToolsConvertEncoding)
 	EVT_UPDATE_UI(menuChinese2Kanji, MadEditFrame::OnUpdateUI_MenuToolsConvertEncoding)
 	EVT_UPDATE_UI(menuWordCount, MadEditFrame::OnUpdateUI_MenuFile_CheckCount)
+	EVT_UPDATE_UI(menuTraceRecord, MadEditFrame::OnUpdateUI_MenuToolsTraceRecord)
+	EVT_UPDATE_UI(menuTraceOverlay, MadEditFrame::OnUpdateUI_MenuToolsTraceOverlay)
 	// window
 	EVT_UPDATE_UI(menuToggleWindow, MadEditFrame::OnUpdateUI_MenuWindow_CheckCount)
 	EVT_UPDATE_UI(menuNextWindow, MadEditFrame::OnUpdateUI_MenuWindow_CheckCount)
@@ -1034,6 +1039,9 @@ BEGIN_EVENT_TABLE(MadEditFrame,wxFrame)
 	EVT_MENU(menuKanji2SimpClipboard, MadEditFrame::OnToolsKanji2SimpClipboard)
 	EVT_MENU(menuChinese2KanjiClipboard, MadEditFrame::OnToolsChinese2KanjiClipboard)
 	EVT_MENU(menuWordCount, MadEditFrame::OnToolsWordCount)
+	EVT_MENU(menuTraceRecord, MadEditFrame::OnToolsTraceRecord)
+	EVT_MENU(menuTraceOverlay, MadEditFrame::OnToolsTraceOverlay)
+	EVT_MENU(menuTraceDump, MadEditFrame::OnToolsTraceDump)
 	// window
 	EVT_MENU(menuToggleWindow, MadEditFrame::OnWindowToggleWindow)
 	EVT_MENU(menuNextWindow, MadEditFrame::OnWindowNextWindow)
@@ -1042,6 +1050,7 @@ BEGIN_EVENT_TABLE(MadEditFrame,wxFrame)
 	EVT_MENU(menuCheckUpdates, MadEditFrame::OnHelpCheckUpdates)
 	EVT_MENU(menuAbout, MadEditFrame::OnHelpAbout)
 	
+	EVT_TIMER(ID_TRACEOVERLAYTIMER, MadEditFrame::OnTraceOverlayTimer)
 	EVT_CLOSE(MadEditFrame::MadEditFrameClose)
 	EVT_KEY_DOWN(MadEditFrame::MadEditFrameKeyDown)
 END_EVENT_TABLE()
@@ -1392,6 +1401,10 @@ CommandData CommandTable[]=
     { 0,               2, menuChinese2KanjiClipboard, wxT("menuChinese2KanjiClipboard"), _("Clipboard: Chinese to Japanese &Kanji"),                 0,             wxITEM_NORMAL,    -1, 0,                                _("Convert Chinese chars to Japanese Kanji in the clipboard")},
     { 0,               1, 0,                      0,                             0,                                                  0,             wxITEM_SEPARATOR, -1, 0,                                0},
     { 0,               1, menuWordCount,          wxT("menuWordCount"),          _("&Word Count"),                                   0,             wxITEM_NORMAL,    -1, 0,                                _("Count the words and chars of the file or selection")},
+    { 0,               1, 0,                      0,                             0,                                                  0,             wxITEM_SEPARATOR, -1, 0,                                0},
+    { 0,               1, menuTraceRecord,        wxT("menuTraceRecord"),        _("Record Performance &Trace"),                     0,             wxITEM_CHECK,     -1, 0,                                _("Record the time spent in loading, formatting, painting, searching and saving")},
+    { 0,               1, menuTraceOverlay,       wxT("menuTraceOverlay"),       _("Show Performance &Overlay"),                     0,             wxITEM_CHECK,     -1, 0,                                _("Show the recorded time of the last second over the editing area")},
+    { 0,               1, menuTraceDump,          wxT("menuTraceDump"),          _("&Dump Performance Trace..."),                    0,             wxITEM_NORMAL,    -1, 0,                                _("Save the recorded performance trace as a Chrome trace file")},
 
     // Window
     { 0, 0, 0, 0, _("&Window"), 0, wxITEM_NORMAL, 0, &g_Menu_Window, 0},
@@ -1460,6 +1473,18 @@ CommandData CommandTable[]=
 #define _(s)    wxGetTranslation(_T(s))
 //==========================================================
 
+wxString g_TraceFile;
+
+static bool WriteTraceFile(const wxString &filename)
+{
+    wxFile file;
+    if(!file.Create(filename, true))
+        return false;
+
+    std::string json = xm::ChromeTraceJSON();
+    return file.Write(json.data(), json.size()) == json.size();
+}
+
 void LoadDefaultSettings(wxConfigBase *m_Config)
 {
     m_Config->SetPath(wxT("/wxMEdit"));
@@ -1477,6 +1502,13 @@ void LoadDefaultSettings(wxConfigBase *m_Config)
     extern bool g_regex_dot_match_newline;
     m_Config->Read(wxT("RegexDotMatchNewline"), &g_regex_dot_match_newline, false);
 
+    // TraceFile: dump the performance trace to the file when quitting
+    bool trace = false;
+    m_Config->Read(wxT("TraceEnabled"), &trace, false);
+    m_Config->Read(wxT("TraceFile"), &g_TraceFile, wxEmptyString);
+    if(trace || !g_TraceFile.IsEmpty())
+        xm::EnableTracing(true);
+
     long templong, x,y;
     bool tempbool;
     wxString tempstr;
@@ -1530,6 +1562,7 @@ void LoadDefaultSettings(wxConfigBase *m_Config)
 
 MadEditFrame::MadEditFrame( wxWindow *parent, wxWindowID id, const wxString &title, const wxPoint &position, const wxSize& size, long style )
     : wxFrame( parent, id, title, position, size, style)
+    , m_TraceOverlayTimer(this, ID_TRACEOVERLAYTIMER)
 {
 #ifndef __WXMSW__
     wxConvFileName=&MadConvFileNameObj;
@@ -1543,6 +1576,7 @@ MadEditFrame::MadEditFrame( wxWindow *parent, wxWindowID id, const wxString &tit
     wxm::WXMEncodingManager::Instance().InitEncodings();
 
     MadSyntax::SetAttributeFilePath(wxm::AppPath::Instance().HomeDir() + wxT("syntax/"));
+    MadSyntax::SetCacheFilePath(wxm::AppPath::Instance().HomeDir() + wxT("cache/syntax/"));
 
 #if defined(__WXMSW__)
     MadSyntax::AddSyntaxFilesPath(wxm::AppPath::Instance().AppDir() + wxT("syntax/"));
@@ -2125,6 +2159,10 @@ void MadEditFrame::MadEditFrameClose(wxCloseEvent& event)
         g_FindInFilesDialog->m_RecentFindExclude->Save(*m_Config);
     }
 
+    m_TraceOverlayTimer.Stop();
+    if(!g_TraceFile.IsEmpty())
+        WriteTraceFile(g_TraceFile);
+
     // reset SearchInSelection
     m_Config->Write(wxT("/wxMEdit/SearchInSelection"), false);
     m_Config->Write(wxT("/wxMEdit/SearchFrom"), wxEmptyString);
@@ -3185,6 +3223,16 @@ void MadEditFrame::OnUpdateUI_MenuToolsConvertEncoding(wxUpdateUIEvent& event)
         !g_active_wxmedit->IsReadOnly() && g_active_wxmedit->IsTextFile());
 }
 
+void MadEditFrame::OnUpdateUI_MenuToolsTraceRecord(wxUpdateUIEvent& event)
+{
+    event.Check(xm::TracingEnabled());
+}
+
+void MadEditFrame::OnUpdateUI_MenuToolsTraceOverlay(wxUpdateUIEvent& event)
+{
+    event.Check(MadEdit::GetTraceOverlay());
+}
+
 void MadEditFrame::OnUpdateUI_MenuWindow_CheckCount(wxUpdateUIEvent& event)
 {
     event.Enable(m_Notebook->GetPageCount()>=2);
@@ -4786,6 +4834,43 @@ void MadEditFrame::OnToolsInsertUNIX(wxCommandEvent& event)
 }
 
 
+// show a progress dialog for converting a document larger than this
+const wxFileOffset CONVERT_PROGRESS_SIZE = 16 * 1024 * 1024;
+
+struct ConvertProgress
+{
+    wxProgressDialog* dialog;
+    ConvertProgress(wxProgressDialog* dlg): dialog(dlg) {}
+
+    bool operator()(wxFileOffset pos, wxFileOffset end)
+    {
+        if(end <= 0)
+            return dialog->Update(0);
+        return dialog->Update(int(pos * 100 / end));
+    }
+};
+
+wxProgressDialog* NewConvertProgressDialog(wxWindow* parent)
+{
+    if(g_active_wxmedit->GetFileSize() < CONVERT_PROGRESS_SIZE)
+        return nullptr;
+    return new wxProgressDialog(wxT("wxMEdit"), _("Converting..."), 100, parent,
+                                wxPD_CAN_ABORT|wxPD_APP_MODAL|wxPD_ELAPSED_TIME|wxPD_REMAINING_TIME);
+}
+
+MadProgressCallback ConvertProgressCallback(wxProgressDialog* dialog)
+{
+    if(dialog == nullptr)
+        return MadProgressCallback();
+    return ConvertProgress(dialog);
+}
+
+void ConvertChineseWithProgress(wxWindow* parent, MadConvertEncodingFlag flag)
+{
+    boost::scoped_ptr<wxProgressDialog> dialog(NewConvertProgressDialog(parent));
+    g_active_wxmedit->ConvertChinese(flag, ConvertProgressCallback(dialog.get()));
+}
+
 void MadEditFrame::OnToolsConvertEncoding(wxCommandEvent& event)
 {
     if (g_active_wxmedit == nullptr)
@@ -4795,8 +4880,12 @@ void MadEditFrame::OnToolsConvertEncoding(wxCommandEvent& event)
 
     if(g_ConvEncDialog->ShowModal()==wxID_OK)
     {
-        g_active_wxmedit->ConvertEncoding(g_ConvEncDialog->GetEncoding(),
-                                         MadConvertEncodingFlag(g_ConvEncDialog->WxRadioBoxOption->GetSelection()));
+        {
+            boost::scoped_ptr<wxProgressDialog> dialog(NewConvertProgressDialog(this));
+            g_active_wxmedit->ConvertEncoding(g_ConvEncDialog->GetEncoding(),
+                                             MadConvertEncodingFlag(g_ConvEncDialog->WxRadioBoxOption->GetSelection()),
+                                             ConvertProgressCallback(dialog.get()));
+        }
         wxString oldpath=m_Config->GetPath();
         m_Config->SetPath(wxT("/wxMEdit"));
         m_Config->Write(wxT("/wxMEdit/ConvertEncoding"), g_ConvEncDialog->GetEncoding());
@@ -4816,35 +4905,35 @@ void MadEditFrame::OnToolsSimp2TradChinese(wxCommandEvent& event)
 {
     if (g_active_wxmedit == nullptr)
         return;
-    g_active_wxmedit->ConvertChinese(cefSC2TC);
+    ConvertChineseWithProgress(this, cefSC2TC);
 }
 
 void MadEditFrame::OnToolsTrad2SimpChinese(wxCommandEvent& event)
 {
     if (g_active_wxmedit == nullptr)
         return;
-    g_active_wxmedit->ConvertChinese(cefTC2SC);
+    ConvertChineseWithProgress(this, cefTC2SC);
 }
 
 void MadEditFrame::OnToolsKanji2TradChinese(wxCommandEvent& event)
 {
     if (g_active_wxmedit == nullptr)
         return;
-    g_active_wxmedit->ConvertChinese(cefJK2TC);
+    ConvertChineseWithProgress(this, cefJK2TC);
 }
 
 void MadEditFrame::OnToolsKanji2SimpChinese(wxCommandEvent& event)
 {
     if (g_active_wxmedit == nullptr)
         return;
-    g_active_wxmedit->ConvertChinese(cefJK2SC);
+    ConvertChineseWithProgress(this, cefJK2SC);
 }
 
 void MadEditFrame::OnToolsChinese2Kanji(wxCommandEvent& event)
 {
     if (g_active_wxmedit == nullptr)
         return;
-    g_active_wxmedit->ConvertChinese(cefC2JK);
+    ConvertChineseWithProgress(this, cefC2JK);
 }
 
 void MadEditFrame::OnToolsSimp2TradClipboard(wxCommandEvent& event)
@@ -4881,6 +4970,52 @@ void MadEditFrame::OnToolsWordCount(wxCommandEvent& event)
     dialog.ShowModal();
 }
 
+void MadEditFrame::OnToolsTraceRecord(wxCommandEvent& event)
+{
+    xm::EnableTracing(!xm::TracingEnabled());
+}
+
+void MadEditFrame::OnToolsTraceOverlay(wxCommandEvent& event)
+{
+    bool show = !MadEdit::GetTraceOverlay();
+    MadEdit::SetTraceOverlay(show);
+
+    if(show)
+    {
+        xm::EnableTracing(true);
+        m_TraceOverlayTimer.Start(500);
+    }
+    else
+    {
+        m_TraceOverlayTimer.Stop();
+    }
+
+    if(g_active_wxmedit != nullptr)
+        g_active_wxmedit->Refresh(false);
+}
+
+void MadEditFrame::OnToolsTraceDump(wxCommandEvent& event)
+{
+    wxFileDialog dlg(this, _("Dump Performance Trace"), wxEmptyString, wxT("wxmedit_trace.json"),
+        wxT("JSON (*.json)|*.json|") + wxString(wxFileSelectorDefaultWildcardStr),
+#if wxCHECK_VERSION(2,8,0)
+        wxFD_SAVE|wxFD_OVERWRITE_PROMPT );
+#else
+        wxSAVE|wxOVERWRITE_PROMPT );
+#endif
+    if(dlg.ShowModal() != wxID_OK)
+        return;
+
+    if(!WriteTraceFile(dlg.GetPath()))
+        wxLogError(wxString(_("Cannot save this file:")) + wxT("\n\n") + dlg.GetPath());
+}
+
+void MadEditFrame::OnTraceOverlayTimer(wxTimerEvent &evt)
+{
+    if(g_active_wxmedit != nullptr)
+        g_active_wxmedit->Refresh(false);
+}
+
 void MadEditFrame::OnWindowToggleWindow(wxCommandEvent& event)
 {
     int count=int(m_Notebook->GetPageCount());
@@ -40,6 +40,7 @@
 #endif
 #include <wx/docview.h>
 #include <wx/treectrl.h>
+#include <wx/timer.h>
 #include <wx/aui/aui.h>
 // disable 4996 }
 #ifdef _MSC_VER
@@ -86,6 +87,7 @@ public:
         ID_NOTEBOOK, // for wxAuiNotebook m_Notebook
         ID_OUTPUTNOTEBOOK,
         ID_FINDINFILESRESULTS,
+        ID_TRACEOVERLAYTIMER,
 
         ID_DUMMY_VALUE_ //Dont Delete this DummyValue
     }; //End of Enum
@@ -160,6 +162,8 @@ public:
     void OnUpdateUI_MenuToolsInsertNewLineChar(wxUpdateUIEvent& event);
     void OnUpdateUI_MenuToolsConvertNL(wxUpdateUIEvent& event);
     void OnUpdateUI_MenuToolsConvertEncoding(wxUpdateUIEvent& event);
+    void OnUpdateUI_MenuToolsTraceRecord(wxUpdateUIEvent& event);
+    void OnUpdateUI_MenuToolsTraceOverlay(wxUpdateUIEvent& event);
 
     void OnUpdateUI_MenuWindow_CheckCount(wxUpdateUIEvent& event);
 
@@ -291,6 +295,9 @@ public:
     void OnToolsKanji2SimpClipboard(wxCommandEvent& event);
     void OnToolsChinese2KanjiClipboard(wxCommandEvent& event);
     void OnToolsWordCount(wxCommandEvent& event);
+    void OnToolsTraceRecord(wxCommandEvent& event);
+    void OnToolsTraceOverlay(wxCommandEvent& event);
+    void OnToolsTraceDump(wxCommandEvent& event);
 
     void OnWindowToggleWindow(wxCommandEvent& event);
     void OnWindowPreviousWindow(wxCommandEvent& event);
@@ -302,6 +309,7 @@ public:
     void OnSize(wxSizeEvent& event);
 private:
     bool m_PageClosing; // prevent from reentry of CloseFile(), OnNotebookPageClosing()
+    wxTimer m_TraceOverlayTimer; // refresh the performance overlay
 
     typedef std::map<wxm::WXMEncodingGroupID, wxMenu*> EncGrps;
     EncGrps m_encgrps;
@@ -343,6 +351,7 @@ protected:
     wxString GetMenuKey(const wxString &menu, const wxString &defaultkey);
 
     void OnInfoNotebookSize(wxSizeEvent &evt);
+    void OnTraceOverlayTimer(wxTimerEvent &evt);
     void OnFindInFilesResultsDClick(wxMouseEvent& event);
 
 #ifdef __WXMSW__
@@ -535,6 +544,9 @@ enum { // menu id
     menuKanji2SimpClipboard,
     menuChinese2KanjiClipboard,
     menuWordCount,
+    menuTraceRecord,
+    menuTraceOverlay,
+    menuTraceDump,
 
     // window
     menuToggleWindow,
@@ -0,0 +1,284 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        xm/encoding_scan.cpp
+// Description: Validate Raw Text Data as ASCII, UTF-8 and UTF-16
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#include "encoding_scan.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define XM_ENCODING_SCAN_SSE2_
+# include <emmintrin.h>
+#endif
+#if defined(XM_ENCODING_SCAN_SSE2_) && defined(__AVX2__)
+# define XM_ENCODING_SCAN_AVX2_
+# include <immintrin.h>
+#endif
+#if defined(XM_ENCODING_SCAN_SSE2_) && defined(_MSC_VER)
+# include <intrin.h>
+#endif
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
+#endif
+
+namespace xm
+{
+
+namespace
+{
+
+#ifdef XM_ENCODING_SCAN_SSE2_
+
+inline unsigned int FirstBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return (unsigned int)idx;
+#else
+	return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+inline unsigned int BitCount(unsigned int mask)
+{
+	unsigned int n = 0;
+	for (; mask != 0; mask &= mask - 1)
+		++n;
+	return n;
+}
+
+// bytes >= 0x80, or also 0x00 if withnul is true
+inline unsigned int SSE2NonASCIIMask(__m128i v, bool withnul)
+{
+	if (withnul)
+		v = _mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+	return (unsigned int)_mm_movemask_epi8(v);
+}
+
+#ifdef XM_ENCODING_SCAN_AVX2_
+inline unsigned int AVX2NonASCIIMask(__m256i v, bool withnul)
+{
+	if (withnul)
+		v = _mm256_or_si256(v, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+	return (unsigned int)_mm256_movemask_epi8(v);
+}
+#endif
+
+#endif //XM_ENCODING_SCAN_SSE2_
+
+size_t FindNonASCIIByte(const unsigned char* buf, size_t size, bool withnul)
+{
+	size_t off = 0;
+
+#ifdef XM_ENCODING_SCAN_AVX2_
+	for (; off + 32 <= size; off += 32)
+	{
+		unsigned int mask = AVX2NonASCIIMask(_mm256_loadu_si256((const __m256i*)(buf + off)), withnul);
+		if (mask != 0)
+			return off + FirstBit(mask);
+	}
+#endif
+#ifdef XM_ENCODING_SCAN_SSE2_
+	for (; off + 16 <= size; off += 16)
+	{
+		unsigned int mask = SSE2NonASCIIMask(_mm_loadu_si128((const __m128i*)(buf + off)), withnul);
+		if (mask != 0)
+			return off + FirstBit(mask);
+	}
+#endif
+
+	for (; off < size; ++off)
+	{
+		if (buf[off] >= 0x80 || (withnul && buf[off] == 0))
+			break;
+	}
+	return off;
+}
+
+// the length of the UTF-8 sequence led by a byte, 0 if the byte cannot lead one
+struct UTF8LeadTable
+{
+	unsigned char len[256];
+	unsigned char lo[256];  // the range of the second byte
+	unsigned char hi[256];
+
+	UTF8LeadTable()
+	{
+		for (unsigned int b = 0; b < 256; ++b)
+		{
+			len[b] = (b < 0x80) ? 1 : (b < 0xC2) ? 0 : (b < 0xE0) ? 2 : (b < 0xF0) ? 3 : (b < 0xF5) ? 4 : 0;
+			lo[b] = 0x80;
+			hi[b] = 0xBF;
+		}
+		lo[0xE0] = 0xA0;    // overlong
+		hi[0xED] = 0x9F;    // surrogates
+		lo[0xF0] = 0x90;    // overlong
+		hi[0xF4] = 0x8F;    // > U+10FFFF
+	}
+};
+
+const UTF8LeadTable utf8lead;
+
+inline bool IsUTF16High(unsigned int u) { return (u & 0xFC00) == 0xD800; }
+inline bool IsUTF16Low(unsigned int u)  { return (u & 0xFC00) == 0xDC00; }
+
+// return false if u is 0x0000 or an ill-formed surrogate
+inline bool ScanUTF16Unit(unsigned int u, bool& high, UTF16ScanStats& stats)
+{
+	if (u == 0)
+	{
+		++stats.zero;
+		high = false;
+		return false;
+	}
+
+	if (IsUTF16High(u))
+	{
+		if (high)
+		{
+			++stats.invalid;
+			return false;
+		}
+		high = true;
+		return true;
+	}
+
+	if (IsUTF16Low(u))
+	{
+		if (!high)
+		{
+			++stats.invalid;
+			return false;
+		}
+		++stats.pairs;
+	}
+	else if ((u & 0xFF00) == 0)
+	{
+		++stats.latin;
+	}
+
+	// a high surrogate followed by a non-surrogate is dropped
+	high = false;
+	return true;
+}
+
+} //namespace
+
+size_t FindNonASCII(const unsigned char* buf, size_t size)
+{
+	return FindNonASCIIByte(buf, size, false);
+}
+
+size_t FindNonISO646(const unsigned char* buf, size_t size)
+{
+	return FindNonASCIIByte(buf, size, true);
+}
+
+void ScanUTF8(const unsigned char* buf, size_t size, bool atstart, bool atend, UTF8ScanStats& stats)
+{
+	size_t i = 0;
+	if (!atstart)
+	{
+		while (i < size && i < 3 && (buf[i] & 0xC0) == 0x80)
+			++i;
+	}
+
+	while (i < size)
+	{
+		size_t n = FindNonASCII(buf + i, size - i);
+		stats.ascii += n;
+		i += n;
+
+		// the multi-byte sequences up to the next ASCII byte
+		while (i < size && buf[i] >= 0x80)
+		{
+			const unsigned char b = buf[i];
+			const size_t len = utf8lead.len[b];
+			if (len == 0)
+			{
+				++stats.invalid;
+				++i;
+				continue;
+			}
+
+			const size_t avail = (i + len <= size) ? len : size - i;
+			bool valid = true;
+			if (avail > 1)
+				valid = buf[i+1] >= utf8lead.lo[b] && buf[i+1] <= utf8lead.hi[b];
+			for (size_t k = 2; valid && k < avail; ++k)
+				valid = (buf[i+k] & 0xC0) == 0x80;
+
+			if (!valid)
+			{
+				++stats.invalid;
+				++i;
+				continue;
+			}
+
+			if (avail < len) // truncated by the window
+			{
+				if (atend)
+					++stats.invalid;
+				i = size;
+				break;
+			}
+
+			++stats.multibyte;
+			i += len;
+		}
+	}
+}
+
+void ScanUTF16(const unsigned char* buf, size_t size, bool bigendian, bool stopbad, UTF16ScanStats& stats)
+{
+	const size_t end = size & ~size_t(1);
+	size_t off = 0;
+	bool high = false;
+
+	while (off < end)
+	{
+#ifdef XM_ENCODING_SCAN_SSE2_
+		// 8 units without 0x0000 and surrogates at a time
+		const __m128i vzero = _mm_setzero_si128();
+		const __m128i vsurmask = _mm_set1_epi16((short)0xF800);
+		const __m128i vsur = _mm_set1_epi16((short)0xD800);
+		const __m128i vhimask = _mm_set1_epi16((short)0xFF00);
+		for (; off + 16 <= end; off += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(buf + off));
+			if (bigendian)
+				v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+			__m128i bad = _mm_or_si128(_mm_cmpeq_epi16(v, vzero),
+			                           _mm_cmpeq_epi16(_mm_and_si128(v, vsurmask), vsur));
+			if (_mm_movemask_epi8(bad) != 0)
+				break;
+
+			unsigned int latin = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, vhimask), vzero));
+			stats.latin += BitCount(latin) / 2;
+			high = false;
+		}
+		if (off >= end)
+			break;
+
+		// the block that stopped the vector loop, or the last units
+		const size_t blockend = (off + 16 <= end) ? off + 16 : end;
+#else
+		const size_t blockend = end;
+#endif
+		for (; off < blockend; off += 2)
+		{
+			unsigned int u = bigendian ? (unsigned int)(buf[off] << 8 | buf[off+1])
+			                           : (unsigned int)(buf[off+1] << 8 | buf[off]);
+			if (!ScanUTF16Unit(u, high, stats) && stopbad)
+				return;
+		}
+	}
+}
+
+} //namespace xm
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        xm/encoding_scan.h
+// Description: Validate Raw Text Data as ASCII, UTF-8 and UTF-16
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _XM_ENCODING_SCAN_H_
+#define _XM_ENCODING_SCAN_H_
+
+#include "cxx11.h"
+#include <stddef.h>
+
+namespace xm
+{
+
+// return the offset of the first byte >= 0x80 in buf, or size if there is none
+size_t FindNonASCII(const unsigned char* buf, size_t size);
+
+// return the offset of the first byte which is 0x00 or >= 0x80 in buf,
+// or size if there is none
+size_t FindNonISO646(const unsigned char* buf, size_t size);
+
+struct UTF8ScanStats
+{
+	size_t ascii;       // bytes < 0x80
+	size_t multibyte;   // well-formed multi-byte sequences
+	size_t invalid;     // ill-formed or truncated sequences
+
+	UTF8ScanStats() : ascii(0), multibyte(0), invalid(0) {}
+};
+
+// accumulate the UTF-8 sequences of a window of text into stats;
+// if the window is not at the start of the text, the continuation bytes at
+// its head are skipped, and if it is not at the end, an incomplete sequence
+// at its tail is ignored
+void ScanUTF8(const unsigned char* buf, size_t size, bool atstart, bool atend, UTF8ScanStats& stats);
+
+struct UTF16ScanStats
+{
+	size_t zero;        // 0x0000 units
+	size_t latin;       // units in 0x0001-0x00FF
+	size_t pairs;       // well-formed surrogate pairs
+	size_t invalid;     // a low surrogate without a high one, or two high surrogates
+
+	UTF16ScanStats() : zero(0), latin(0), pairs(0), invalid(0) {}
+};
+
+// accumulate the UTF-16 units of buf into stats, an odd byte at the end is ignored;
+// stop at the first 0x0000 unit or ill-formed surrogate if stopbad is true
+void ScanUTF16(const unsigned char* buf, size_t size, bool bigendian, bool stopbad, UTF16ScanStats& stats);
+
+} //namespace xm
+
+#endif //_XM_ENCODING_SCAN_H_
@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        xm/live_ranges.hpp
+// Description: Packing the Referred Ranges of an Append-only Store
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _XM_LIVE_RANGES_HPP_
+#define _XM_LIVE_RANGES_HPP_
+
+#include "cxx11.h"
+
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+
+namespace xm
+{
+	// LiveRanges collects the ranges of an append-only store that are still referred to,
+	// merges them and gives them their positions when they are packed in order
+	// to the front of the store, the bytes out of them are dead
+	template<typename T>
+	struct LiveRanges: private boost::noncopyable
+	{
+		struct Range
+		{
+			T pos;
+			T size;
+			T packed;   // the position after packing, valid after Pack()
+
+			Range(T p, T s): pos(p), size(s), packed(0) {}
+			T End() const { return pos + size; }
+			bool operator<(const Range& r) const { return pos < r.pos; }
+		};
+
+		LiveRanges(): m_packed(true), m_live(0) {}
+
+		// the ranges may overlap and be added in any order, the empty ones are ignored
+		void Add(T pos, T size)
+		{
+			if (size <= 0)
+				return;
+			m_packed = false;
+
+			// the ranges referred to by consecutive blocks are often adjacent
+			if (!m_ranges.empty())
+			{
+				Range& last = m_ranges.back();
+				if (pos >= last.pos && pos <= last.End())
+				{
+					if (pos + size > last.End())
+						last.size = pos + size - last.pos;
+					return;
+				}
+			}
+			m_ranges.push_back(Range(pos, size));
+		}
+
+		// merge the overlapping and adjacent ranges, and give them their packed positions
+		void Pack()
+		{
+			if (m_packed)
+				return;
+
+			std::sort(m_ranges.begin(), m_ranges.end());
+
+			size_t count = 0;
+			for (size_t i = 0; i < m_ranges.size(); ++i)
+			{
+				const Range& r = m_ranges[i];
+				if (count > 0 && r.pos <= m_ranges[count - 1].End())
+				{
+					Range& last = m_ranges[count - 1];
+					if (r.End() > last.End())
+						last.size = r.End() - last.pos;
+					continue;
+				}
+				m_ranges[count++] = r;
+			}
+			m_ranges.erase(m_ranges.begin() + count, m_ranges.end());
+
+			m_live = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				m_ranges[i].packed = m_live;
+				m_live += m_ranges[i].size;
+			}
+			m_packed = true;
+		}
+
+		// the following are valid after Pack()
+		T LiveSize() const { return m_live; }
+		size_t Count() const { return m_ranges.size(); }
+		const Range& operator[](size_t idx) const { return m_ranges[idx]; }
+
+		// return the packed position of pos, which must be in a collected range
+		T Map(T pos) const
+		{
+			typename std::vector<Range>::const_iterator it =
+				std::upper_bound(m_ranges.begin(), m_ranges.end(), Range(pos, 0));
+			--it;
+			return it->packed + (pos - it->pos);
+		}
+
+		void Clear()
+		{
+			m_ranges.clear();
+			m_packed = true;
+			m_live = 0;
+		}
+
+	private:
+		std::vector<Range> m_ranges;
+		bool m_packed;
+		T m_live;
+	};
+}; // namespace xm
+
+#endif //_XM_LIVE_RANGES_HPP_
@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        xm/lru_cache.hpp
+// Description: Bounded Cache Evicting the Least Recently Used Entries
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _XM_LRU_CACHE_HPP_
+#define _XM_LRU_CACHE_HPP_
+
+#include "cxx11.h"
+
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+#include <utility>
+#include <cstddef>
+
+namespace xm
+{
+	// LRUCache keeps at most capacity entries, the entries are ordered by their last use
+	// in a list, and located by a map of the list iterators
+	template<typename K, typename V>
+	struct LRUCache: private boost::noncopyable
+	{
+		explicit LRUCache(size_t capacity): m_capacity(capacity == 0 ? 1 : capacity) {}
+
+		// return the value of key and make it the most recently used, or nullptr
+		V* Find(const K& key)
+		{
+			typename IndexMap::iterator it = m_index.find(key);
+			if (it == m_index.end())
+				return nullptr;
+
+			m_entries.splice(m_entries.begin(), m_entries, it->second);
+			return &it->second->second;
+		}
+
+		// return the value of key, which is default-constructed if key was not cached;
+		// the least recently used entry is evicted if the cache is full
+		V& Get(const K& key)
+		{
+			V* val = Find(key);
+			if (val != nullptr)
+				return *val;
+
+			if (m_index.size() >= m_capacity)
+			{
+				m_index.erase(m_entries.back().first);
+				m_entries.pop_back();
+			}
+
+			m_entries.push_front(Entry(key, V()));
+			m_index[key] = m_entries.begin();
+			return m_entries.front().second;
+		}
+
+		bool Erase(const K& key)
+		{
+			typename IndexMap::iterator it = m_index.find(key);
+			if (it == m_index.end())
+				return false;
+
+			m_entries.erase(it->second);
+			m_index.erase(it);
+			return true;
+		}
+
+		// erase the entries of the keys satisfying pred(key)
+		template<typename Pred>
+		void EraseIf(Pred pred)
+		{
+			typename EntryList::iterator it = m_entries.begin();
+			while (it != m_entries.end())
+			{
+				if (pred(it->first))
+				{
+					m_index.erase(it->first);
+					it = m_entries.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+		}
+
+		void Clear()
+		{
+			m_index.clear();
+			m_entries.clear();
+		}
+
+		size_t Size() const { return m_index.size(); }
+		size_t Capacity() const { return m_capacity; }
+
+	private:
+		typedef std::pair<K, V> Entry;
+		typedef std::list<Entry> EntryList;
+		typedef std::map<K, typename EntryList::iterator> IndexMap;
+
+		size_t m_capacity;
+		EntryList m_entries;    // the most recently used first
+		IndexMap m_index;
+	};
+}; // namespace xm
+
+#endif //_XM_LRU_CACHE_HPP_
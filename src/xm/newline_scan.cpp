@@ -0,0 +1,183 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        xm/newline_scan.cpp
+// Description: Locate Newline Characters in Raw Text Data
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#include "newline_scan.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define XM_NEWLINE_SCAN_SSE2_
+# include <emmintrin.h>
+#endif
+#if defined(XM_NEWLINE_SCAN_SSE2_) && defined(__AVX2__)
+# define XM_NEWLINE_SCAN_AVX2_
+# include <immintrin.h>
+#endif
+#if defined(XM_NEWLINE_SCAN_SSE2_) && defined(_MSC_VER)
+# include <intrin.h>
+#endif
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
+#endif
+
+namespace xm
+{
+
+namespace
+{
+
+bool ScanScalar(const unsigned char* buf, size_t& off, size_t end, NewLineUnit nlu, size_t unit)
+{
+	for (; off < end; off += unit)
+	{
+		if (NewLineChar(buf + off, nlu) != 0)
+			return true;
+	}
+	return false;
+}
+
+#ifdef XM_NEWLINE_SCAN_SSE2_
+
+inline unsigned int FirstBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return (unsigned int)idx;
+#else
+	return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+// the registers are little-endian, so a big-endian newline unit
+// is compared with the byte-swapped value, e.g. 0x0A00 for UTF-16BE
+template <size_t W> struct SSE2Lanes;
+
+template <> struct SSE2Lanes<1>
+{
+	static __m128i Set(unsigned int v) { return _mm_set1_epi8((char)v); }
+	static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); }
+};
+template <> struct SSE2Lanes<2>
+{
+	static __m128i Set(unsigned int v) { return _mm_set1_epi16((short)v); }
+	static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+};
+template <> struct SSE2Lanes<4>
+{
+	static __m128i Set(unsigned int v) { return _mm_set1_epi32((int)v); }
+	static __m128i CmpEq(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+};
+
+template <size_t W>
+bool ScanSSE2(const unsigned char* buf, size_t& off, size_t end, unsigned int cr, unsigned int lf)
+{
+	typedef SSE2Lanes<W> L;
+	const __m128i vcr = L::Set(cr);
+	const __m128i vlf = L::Set(lf);
+
+	for (; off + 16 <= end; off += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(buf + off));
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(L::CmpEq(v, vcr), L::CmpEq(v, vlf)));
+		if (mask != 0)
+		{
+			off += FirstBit(mask);
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef XM_NEWLINE_SCAN_AVX2_
+
+template <size_t W> struct AVX2Lanes;
+
+template <> struct AVX2Lanes<1>
+{
+	static __m256i Set(unsigned int v) { return _mm256_set1_epi8((char)v); }
+	static __m256i CmpEq(__m256i a, __m256i b) { return _mm256_cmpeq_epi8(a, b); }
+};
+template <> struct AVX2Lanes<2>
+{
+	static __m256i Set(unsigned int v) { return _mm256_set1_epi16((short)v); }
+	static __m256i CmpEq(__m256i a, __m256i b) { return _mm256_cmpeq_epi16(a, b); }
+};
+template <> struct AVX2Lanes<4>
+{
+	static __m256i Set(unsigned int v) { return _mm256_set1_epi32((int)v); }
+	static __m256i CmpEq(__m256i a, __m256i b) { return _mm256_cmpeq_epi32(a, b); }
+};
+
+template <size_t W>
+bool ScanAVX2(const unsigned char* buf, size_t& off, size_t end, unsigned int cr, unsigned int lf)
+{
+	typedef AVX2Lanes<W> L;
+	const __m256i vcr = L::Set(cr);
+	const __m256i vlf = L::Set(lf);
+
+	for (; off + 32 <= end; off += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buf + off));
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(L::CmpEq(v, vcr), L::CmpEq(v, vlf)));
+		if (mask != 0)
+		{
+			off += FirstBit(mask);
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif //XM_NEWLINE_SCAN_AVX2_
+
+template <size_t W>
+bool ScanVector(const unsigned char* buf, size_t& off, size_t end, unsigned int cr, unsigned int lf)
+{
+#ifdef XM_NEWLINE_SCAN_AVX2_
+	if (ScanAVX2<W>(buf, off, end, cr, lf))
+		return true;
+#endif
+	return ScanSSE2<W>(buf, off, end, cr, lf);
+}
+
+#endif //XM_NEWLINE_SCAN_SSE2_
+
+} //namespace
+
+size_t FindNewLine(const unsigned char* buf, size_t size, NewLineUnit nlu)
+{
+	const size_t unit = NewLineUnitSize(nlu);
+	if (unit == 0)
+		return size;
+
+	const size_t end = size - size % unit;
+	size_t off = 0;
+
+#ifdef XM_NEWLINE_SCAN_SSE2_
+	const bool be = (nlu == nluUTF16BE || nlu == nluUTF32BE);
+	const unsigned int shift = be ? unsigned(unit - 1) * 8 : 0;
+	const unsigned int cr = 0x0DU << shift;
+	const unsigned int lf = 0x0AU << shift;
+
+	bool found;
+	switch (unit)
+	{
+	case 1:  found = ScanVector<1>(buf, off, end, cr, lf); break;
+	case 2:  found = ScanVector<2>(buf, off, end, cr, lf); break;
+	default: found = ScanVector<4>(buf, off, end, cr, lf); break;
+	}
+	if (found)
+		return off;
+#endif
+
+	ScanScalar(buf, off, end, nlu, unit);
+	return off;
+}
+
+} //namespace xm
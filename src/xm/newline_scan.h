@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        xm/newline_scan.h
+// Description: Locate Newline Characters in Raw Text Data
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _XM_NEWLINE_SCAN_H_
+#define _XM_NEWLINE_SCAN_H_
+
+#include "cxx11.h"
+#include <stddef.h>
+
+namespace xm
+{
+
+// the code unit in which 0x0D/0x0A can be matched without decoding the text
+enum NewLineUnit
+{
+	nluNone,    // the encoding must be decoded char by char
+	nluByte,    // ISO-646 compatible encodings: UTF-8, single-byte, DBCS, GB18030
+	nluUTF16LE,
+	nluUTF16BE,
+	nluUTF32LE,
+	nluUTF32BE,
+};
+
+inline size_t NewLineUnitSize(NewLineUnit nlu)
+{
+	switch (nlu)
+	{
+	case nluByte:    return 1;
+	case nluUTF16LE:
+	case nluUTF16BE: return 2;
+	case nluUTF32LE:
+	case nluUTF32BE: return 4;
+	default:         return 0;
+	}
+}
+
+// return 0x0D or 0x0A if the unit at buf is a newline char, otherwise 0
+inline unsigned int NewLineChar(const unsigned char* buf, NewLineUnit nlu)
+{
+	unsigned int c;
+	switch (nlu)
+	{
+	case nluByte:    c = buf[0]; break;
+	case nluUTF16LE: c = buf[1] ? 0 : buf[0]; break;
+	case nluUTF16BE: c = buf[0] ? 0 : buf[1]; break;
+	case nluUTF32LE: c = (buf[1] | buf[2] | buf[3]) ? 0 : buf[0]; break;
+	case nluUTF32BE: c = (buf[0] | buf[1] | buf[2]) ? 0 : buf[3]; break;
+	default:         return 0;
+	}
+	return (c == 0x0D || c == 0x0A) ? c : 0;
+}
+
+// return the offset of the first 0x0D/0x0A unit in buf,
+// or the offset of the first incomplete unit if there is none;
+// the scanning is vectorized with SSE2/AVX2 when available
+size_t FindNewLine(const unsigned char* buf, size_t size, NewLineUnit nlu);
+
+} //namespace xm
+
+#endif //_XM_NEWLINE_SCAN_H_
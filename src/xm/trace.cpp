@@ -0,0 +1,243 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        xm/trace.cpp
+// Description: Scoped Timing Spans of the Hot Paths
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <time.h>
+# include <sys/time.h>
+#endif
+
+#ifdef _MSC_VER
+# define XM_THREAD_LOCAL_ __declspec(thread)
+#else
+# define XM_THREAD_LOCAL_ __thread
+#endif
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
+#endif
+
+namespace xm
+{
+
+volatile bool g_tracing = false;
+
+namespace
+{
+
+// every thread writes to its own ring until there are more threads than rings,
+// then the rings are shared, so the slots are reserved by atomic increments;
+// the first ring is kept for the first thread recording, mostly the GUI thread
+const size_t TRACE_RING_SIZE = 4096; // must be a power of 2
+const unsigned int TRACE_RING_COUNT = 16;
+
+struct TraceRing
+{
+	volatile long next;
+	TraceSpan spans[TRACE_RING_SIZE];
+};
+
+TraceRing* s_rings[TRACE_RING_COUNT];
+volatile long s_ring_binds = 0;
+
+XM_THREAD_LOCAL_ unsigned int t_ring = 0; // index + 1 of the ring bound to this thread
+
+long AtomicIncrement(volatile long* val)
+{
+#ifdef _MSC_VER
+	return InterlockedIncrement(val);
+#else
+	return __sync_add_and_fetch(val, 1);
+#endif
+}
+
+struct SpanBeginLess
+{
+	bool operator()(const TraceSpan& a, const TraceSpan& b) const
+	{
+		return a.begin < b.begin;
+	}
+};
+
+struct NameLess
+{
+	bool operator()(const char* a, const char* b) const
+	{
+		return std::strcmp(a, b) < 0;
+	}
+};
+
+struct SummaryTotalGreater
+{
+	bool operator()(const TraceSummary& a, const TraceSummary& b) const
+	{
+		return a.total > b.total;
+	}
+};
+
+void AppendJSONString(std::string& out, const char* s)
+{
+	out += '"';
+	for (; *s != 0; ++s)
+	{
+		if (*s == '"' || *s == '\\')
+			out += '\\';
+		out += *s;
+	}
+	out += '"';
+}
+
+} // namespace
+
+TraceTime TraceNow()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq = {};
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER cnt;
+	QueryPerformanceCounter(&cnt);
+	return TraceTime(cnt.QuadPart / freq.QuadPart) * 1000000
+		+ TraceTime(cnt.QuadPart % freq.QuadPart) * 1000000 / TraceTime(freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return TraceTime(ts.tv_sec) * 1000000 + TraceTime(ts.tv_nsec) / 1000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, nullptr);
+	return TraceTime(tv.tv_sec) * 1000000 + TraceTime(tv.tv_usec);
+#endif
+}
+
+void EnableTracing(bool enable)
+{
+	// the rings are never freed, a span may be recorded after disabling
+	if (enable && s_rings[0] == nullptr)
+	{
+		for (unsigned int i = 0; i < TRACE_RING_COUNT; ++i)
+			s_rings[i] = new TraceRing(); // zero-initialized
+	}
+	g_tracing = enable;
+}
+
+void RecordTraceSpan(const char* name, TraceTime begin, TraceTime end)
+{
+	if (t_ring == 0)
+	{
+		unsigned long bind = (unsigned long)(AtomicIncrement(&s_ring_binds) - 1);
+		t_ring = (bind == 0) ? 1 : 2 + (bind - 1) % (TRACE_RING_COUNT - 1);
+	}
+
+	TraceRing* ring = s_rings[t_ring - 1];
+	if (ring == nullptr)
+		return;
+
+	unsigned long n = (unsigned long)(AtomicIncrement(&ring->next) - 1);
+	TraceSpan& span = ring->spans[n & (TRACE_RING_SIZE - 1)];
+	span.name = name;
+	span.begin = begin;
+	span.end = end;
+	span.thread = t_ring;
+}
+
+void CollectTraceSpans(std::vector<TraceSpan>& spans, TraceTime since)
+{
+	spans.clear();
+	for (unsigned int i = 0; i < TRACE_RING_COUNT; ++i)
+	{
+		TraceRing* ring = s_rings[i];
+		if (ring == nullptr)
+			continue;
+
+		unsigned long next = (unsigned long)ring->next;
+		size_t count = std::min(size_t(next), TRACE_RING_SIZE);
+		for (size_t j = 0; j < count; ++j)
+		{
+			const TraceSpan& span = ring->spans[j];
+			if (span.name != nullptr && span.end >= since)
+				spans.push_back(span);
+		}
+	}
+	std::sort(spans.begin(), spans.end(), SpanBeginLess());
+}
+
+void SummarizeTraceSpans(std::vector<TraceSummary>& sums, TraceTime window)
+{
+	TraceTime now = TraceNow();
+	std::vector<TraceSpan> spans;
+	CollectTraceSpans(spans, now > window ? now - window : 0);
+
+	typedef std::map<const char*, TraceSummary, NameLess> SummaryMap;
+	SummaryMap summap;
+	for (size_t i = 0; i < spans.size(); ++i)
+	{
+		const TraceSpan& span = spans[i];
+		TraceSummary& sum = summap[span.name];
+		TraceTime dur = span.end - span.begin;
+		if (sum.name == nullptr)
+		{
+			sum.name = span.name;
+			sum.count = 0;
+			sum.total = 0;
+			sum.longest = 0;
+		}
+		++sum.count;
+		sum.total += dur;
+		sum.longest = std::max(sum.longest, dur);
+	}
+
+	sums.clear();
+	for (SummaryMap::const_iterator it = summap.begin(); it != summap.end(); ++it)
+		sums.push_back(it->second);
+	std::sort(sums.begin(), sums.end(), SummaryTotalGreater());
+}
+
+std::string ChromeTraceJSON()
+{
+	std::vector<TraceSpan> spans;
+	CollectTraceSpans(spans);
+
+	std::string json("{\"traceEvents\":[");
+	char buf[128];
+	for (size_t i = 0; i < spans.size(); ++i)
+	{
+		const TraceSpan& span = spans[i];
+		json += (i == 0) ? "\n{\"name\":" : ",\n{\"name\":";
+		AppendJSONString(json, span.name);
+		std::sprintf(buf, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu}",
+			span.thread, span.begin, span.end - span.begin);
+		json += buf;
+	}
+	json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return json;
+}
+
+void ClearTrace()
+{
+	for (unsigned int i = 0; i < TRACE_RING_COUNT; ++i)
+	{
+		TraceRing* ring = s_rings[i];
+		if (ring == nullptr)
+			continue;
+		for (size_t j = 0; j < TRACE_RING_SIZE; ++j)
+			ring->spans[j].name = nullptr;
+		ring->next = 0;
+	}
+}
+
+} // namespace xm
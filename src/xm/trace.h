@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        xm/trace.h
+// Description: Scoped Timing Spans of the Hot Paths
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef _XM_TRACE_H_
+#define _XM_TRACE_H_
+
+#include "cxx11.h"
+#include <boost/noncopyable.hpp>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace xm
+{
+
+// microseconds of a monotonic clock
+typedef unsigned long long TraceTime;
+TraceTime TraceNow();
+
+// name must be a string literal, it is kept in the ring buffers
+struct TraceSpan
+{
+	const char* name;
+	TraceTime begin;
+	TraceTime end;
+	unsigned int thread;
+};
+
+extern volatile bool g_tracing;
+
+inline bool TracingEnabled()
+{
+	return g_tracing;
+}
+void EnableTracing(bool enable);
+
+// append a span to the ring buffer of the current thread,
+// the oldest spans of the thread are overwritten when the ring is full
+void RecordTraceSpan(const char* name, TraceTime begin, TraceTime end);
+
+// time the enclosing scope, it costs a flag test only when tracing is disabled
+struct TraceScope: private boost::noncopyable
+{
+	explicit TraceScope(const char* name)
+		: m_name(g_tracing ? name : nullptr), m_begin(m_name ? TraceNow() : 0)
+	{
+	}
+	~TraceScope()
+	{
+		if (m_name != nullptr)
+			RecordTraceSpan(m_name, m_begin, TraceNow());
+	}
+private:
+	const char* m_name;
+	TraceTime m_begin;
+};
+
+#define XM_TRACE_CAT2_(a, b) a##b
+#define XM_TRACE_CAT_(a, b) XM_TRACE_CAT2_(a, b)
+#define XM_TRACE_SCOPE(name) xm::TraceScope XM_TRACE_CAT_(xm_trace_scope_, __LINE__)(name)
+
+// copy the spans of all threads which ended at or after since, ordered by their beginning
+void CollectTraceSpans(std::vector<TraceSpan>& spans, TraceTime since = 0);
+
+struct TraceSummary
+{
+	const char* name;
+	size_t count;
+	TraceTime total;
+	TraceTime longest;
+};
+
+// sum up the spans which ended in the last window microseconds by name,
+// the most time-consuming ones first
+void SummarizeTraceSpans(std::vector<TraceSummary>& sums, TraceTime window);
+
+// the recorded spans as complete events in the Trace Event Format of Chrome,
+// which can be loaded by chrome://tracing or Perfetto
+std::string ChromeTraceJSON();
+
+void ClearTrace();
+
+} // namespace xm
+
+#endif //_XM_TRACE_H_
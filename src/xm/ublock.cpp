@@ -18,6 +18,8 @@ namespace xm
 {
 
 UnicodeBlockSet::UnicodeBlockSet()
+	: m_block_table(((UCHAR_MAX_VALUE + 1) >> BLOCK_ALIGN_BITS), short(UBLOCK_NO_BLOCK))
+	, m_block_end(UBLOCK_NO_BLOCK + 1)
 {
 	int last_block = UBLOCK_INVALID_CODE;
 	for(UChar32 u=0; u<=0x110000; ++u)
@@ -32,6 +34,19 @@ UnicodeBlockSet::UnicodeBlockSet()
 			m_block_map[block].first = u;
 		}
 		last_block = block;
+
+		if (u > UCHAR_MAX_VALUE)
+			break;
+
+		int index = (block == UBLOCK_INVALID_CODE) ? UBLOCK_NO_BLOCK : block;
+		short& entry = m_block_table[u >> BLOCK_ALIGN_BITS];
+		if ((u & ((1 << BLOCK_ALIGN_BITS) - 1)) == 0)
+			entry = short(index);
+		else if (entry != index)
+			entry = MIXED_BLOCKS;
+
+		if (index >= m_block_end)
+			m_block_end = index + 1;
 	}
 
 	m_block_map.erase(UBLOCK_INVALID_CODE);
@@ -48,7 +63,7 @@ UnicodeBlockSet& UnicodeBlockSet::GetInstance()
 }
 UnicodeBlockSet::object_creator UnicodeBlockSet::create_object;
 
-int UnicodeBlockSet::FindBlockIndex(UChar32 ch)
+int UnicodeBlockSet::FindBlockIndexByICU(UChar32 ch)
 {
 	int block = ublock_getCode(ch);
 	if (block == UBLOCK_INVALID_CODE)
@@ -92,22 +107,25 @@ bool UnicodeBlockSet::Valid(int index)
 UnicodeBlockCharCounter::UnicodeBlockCharCounter():
 	m_ublock_set(UnicodeBlockSet::GetInstance())
 {
+	m_counts.resize(m_ublock_set.BlockIndexEnd(), 0);
 }
 
-
-void UnicodeBlockCharCounter::Count(int index)
+void UnicodeBlockCharCounter::Merge(const UnicodeBlockCharCounter& other)
 {
-	++m_counts_map[index];
+	for(size_t i=0; i<m_counts.size(); ++i)
+		m_counts[i] += other.m_counts[i];
 }
 
 void UnicodeBlockCharCounter::FillBlockIndexSet()
 {
 	m_blockidx_set.clear();
-	typedef std::map<int, int>::const_iterator CntMapCIter;
-	for(CntMapCIter it=m_counts_map.begin(); it!=m_counts_map.end(); ++it)
+	for(size_t i=0; i<m_counts.size(); ++i)
 	{
+		if (m_counts[i] == 0)
+			continue;
+
 		BlockIndex bi;
-		bi.index = it->first;
+		bi.index = int(i);
 		bi.ubegin = m_ublock_set.Begin(bi.index);
 		m_blockidx_set.insert(bi);
 	}
@@ -135,23 +153,23 @@ int UnicodeBlockCharCounter::NextBlock()
 
 bool UnicodeBlockCharCounter::IsValidBlock(int index)
 {
-	if (m_counts_map.find(index)==m_counts_map.end())
+	if (GetBlockCharCount(index) == 0)
 		return false;
 
 	return m_ublock_set.Valid(index);
 }
 
-int UnicodeBlockCharCounter::GetBlockCharCount(int index)
+int64_t UnicodeBlockCharCounter::GetBlockCharCount(int index)
 {
-	if (m_counts_map.find(index)==m_counts_map.end())
+	if (index < 0 || size_t(index) >= m_counts.size())
 		return 0;
 
-	return m_counts_map[index];
+	return m_counts[index];
 }
 
-int UnicodeBlockCharCounter::GetInvalidBlockCharCount()
+int64_t UnicodeBlockCharCounter::GetInvalidBlockCharCount()
 {
-	return m_counts_map[UBLOCK_NO_BLOCK];
+	return m_counts[UBLOCK_NO_BLOCK];
 }
 
 }; // namespace xm
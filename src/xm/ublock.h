@@ -14,13 +14,22 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace xm
 {
 
 struct UnicodeBlockSet: private boost::noncopyable
 {
-	int FindBlockIndex(UChar32 ch);
+	int FindBlockIndex(UChar32 ch)
+	{
+		if (ch < 0 || ch > UCHAR_MAX_VALUE)
+			return UBLOCK_NO_BLOCK;
+		int block = m_block_table[ch >> BLOCK_ALIGN_BITS];
+		return (block != MIXED_BLOCKS) ? block : FindBlockIndexByICU(ch);
+	}
+	// all of the indices are less than it
+	int BlockIndexEnd() { return m_block_end; }
 
 	UChar32 Begin(int index);
 	UChar32 End(int index);
@@ -32,6 +41,13 @@ struct UnicodeBlockSet: private boost::noncopyable
 private:
 	UnicodeBlockSet();
 	void InitBlockDescriptions();
+	int FindBlockIndexByICU(UChar32 ch);
+
+	// the blocks begin and end at the multiples of 16 code points,
+	// so one entry of m_block_table is enough for 16 of them
+	enum { BLOCK_ALIGN_BITS = 4, MIXED_BLOCKS = -1 };
+	std::vector<short> m_block_table;
+	int m_block_end;
 
 	typedef std::pair<UChar32, UChar32> UBlockRange;
 	typedef std::map<int, UBlockRange>  UBlockMap;
@@ -50,20 +66,26 @@ private:
 
 struct UnicodeBlockCharCounter
 {
-	void Count(int index);
+	void Count(int index)
+	{
+		++m_counts[index];
+	}
+
+	// add the counts of other
+	void Merge(const UnicodeBlockCharCounter& other);
 
 	int BlockIndexBegin();
 	int NextBlock();
 	bool IsValidBlock(int index);
-	int GetBlockCharCount(int index);
+	int64_t GetBlockCharCount(int index);
 
-	int GetInvalidBlockCharCount();
+	int64_t GetInvalidBlockCharCount();
 
 	UnicodeBlockCharCounter();
 private:
 	void FillBlockIndexSet();
 
-	std::map<int, int> m_counts_map;
+	std::vector<int64_t> m_counts;          // by block index
 	UnicodeBlockSet& m_ublock_set;
 
 	struct BlockIndex
@@ -62,6 +62,9 @@ size_t SimpleWordCounter::GetWordCountNoCtrlNoSP()
 
 void AccumulativeWordCounter::operator+=(UChar32 ch)
 {
+	if (m_first < 0)
+		m_first = ch;
+
 	if (m_size >= m_capacity)
 	{
 		PiecewiseCount(ch);
@@ -98,6 +101,25 @@ size_t AccumulativeWordCounter::GetWordCountNoCtrlNoSP()
 	return m_cnt + cnt - m_ctrl_cnt - ctrl_cnt - m_sp_cnt - sp_cnt;
 }
 
+void AccumulativeWordCounter::Merge(const AccumulativeWordCounter& following)
+{
+	if (following.m_first < 0)
+		return;
+
+	if (m_first < 0)
+		m_first = following.m_first;
+	else
+		PiecewiseCount(following.m_first);
+
+	m_cnt += following.m_cnt;
+	m_ctrl_cnt += following.m_ctrl_cnt;
+	m_sp_cnt += following.m_sp_cnt;
+
+	// the last piece of following is the last piece of all text now
+	m_ustr = following.m_ustr;
+	m_size = following.m_size;
+}
+
 void AccumulativeWordCounter::PiecewiseClear()
 {
 	m_size = 0;
@@ -72,8 +72,12 @@ struct AccumulativeWordCounter: public WordCounter
 	virtual size_t GetWordCount() override;
 	virtual size_t GetWordCountNoCtrlNoSP() override;
 
+	// append the counts of following, which counted the text right after the text of this,
+	// the joint of the two texts is counted as the joint of two pieces
+	void Merge(const AccumulativeWordCounter& following);
+
 	AccumulativeWordCounter(int32_t capacity)
-		: m_capacity(capacity), m_size(0)
+		: m_capacity(capacity), m_size(0), m_first(-1)
 		, m_cnt(0), m_ctrl_cnt(0), m_sp_cnt(0)
 	{
 	}
@@ -85,6 +89,7 @@ private:
 	UnicodeString m_ustr;
 	int32_t m_capacity;
 	int32_t m_size;
+	UChar32 m_first;    // the first char of all text, -1 if none
 	size_t m_cnt;
 	size_t m_ctrl_cnt;
 	size_t m_sp_cnt;
@@ -0,0 +1,739 @@
+///////////////////////////////////////////////////////////////////////////////
+// vim:         ts=4 sw=4
+// Name:        test/bench/bench.cpp
+// Description: Headless Performance Benchmarks of wxMEdit
+// Copyright:   2015  JiaYanwei   <wxmedit@gmail.com>
+// License:     GPLv3
+///////////////////////////////////////////////////////////////////////////////
+
+// Usage: wxmedit_bench [--size=MB] [--encoding=NAME] [--charset=ascii|latin|cjk|mixed]
+//                      [--newline=lf|crlf] [--seed=N] [--jumps=N] [--file=PATH]
+//                      [--ops=load,reformat,...] [--keep]
+//
+// A synthetic corpus is generated in the temporary directory (or --file is used),
+// and it is loaded into a MadEdit which is never shown. Every operation prints
+// one JSON object per line to stdout:
+//   {"op":"load","bytes":16777216,"lines":298405,"encoding":"UTF-8","ms":153,"result":0,"peak_rss_kb":190212}
+//
+// The micro benchmarks of the buffer parts are run only if they are listed in --ops,
+// and they need neither the corpus nor the MadEdit:
+//   {"op":"deque","variant":"push_back","count":1048576,"ms":4,"result":0}
+
+#include "../../src/xm/cxx11.h"
+#include "../../src/wxm/edit/simple.h"
+#include "../../src/wxm/encoding/encoding.h"
+#include "../../src/wxm/searcher.h"
+#include "../../src/wxm/utils.h"
+#include "../../src/wxmedit/wxm_syntax.h"
+#include "../../src/wxmedit/wxm_deque.hpp"
+#include "../../src/xm/newline_scan.h"
+
+#include <wx/app.h>
+#include <wx/frame.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/memconf.h>
+#include <wx/stopwatch.h>
+#include <wx/tokenzr.h>
+
+#ifdef __WXMSW__
+# include <windows.h>
+# include <psapi.h>
+#else
+# include <sys/resource.h>
+#endif
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#define new new(_NORMAL_BLOCK ,__FILE__, __LINE__)
+#endif
+
+// owned by wxmedit_app.cpp in wxmedit
+bool g_DoNotSaveSettings = true;
+bool g_regex_dot_match_newline = false;
+
+namespace
+{
+
+const wxChar* const ALL_OPS = wxT("load,reformat,find_string,find_regex,goto_random_line,")
+	wxT("word_count,replace_string,replace_regex,sort_lines,convert_encoding,save");
+const wxChar* const MICRO_OPS = wxT("deque,newline_scan,bulk_decode");
+
+long PeakRSSInKB()
+{
+#ifdef __WXMSW__
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return -1;
+	return long(pmc.PeakWorkingSetSize / 1024);
+#else
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return -1;
+# ifdef __APPLE__
+	return long(ru.ru_maxrss / 1024);
+# else
+	return long(ru.ru_maxrss);
+# endif
+#endif
+}
+
+struct XorShift
+{
+	explicit XorShift(unsigned int seed) : m_state(seed ? seed : 2463534242U) {}
+	unsigned int Next()
+	{
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return m_state;
+	}
+	unsigned int Next(unsigned int bound) { return Next() % bound; }
+private:
+	unsigned int m_state;
+};
+
+struct BenchOptions
+{
+	long size_mb;
+	wxString encoding;
+	wxString charset;
+	bool crlf;
+	long seed;
+	long jumps;
+	wxString file;
+	wxArrayString ops;
+	bool keep;
+
+	BenchOptions()
+		: size_mb(16), encoding(wxT("UTF-8")), crlf(false), seed(1), jumps(1000), keep(false)
+	{
+		ops = wxStringTokenize(ALL_OPS, wxT(","));
+	}
+
+	bool Parse(int argc, wxChar** argv);
+	bool HasOp(const wxChar* op) const { return ops.Index(op) != wxNOT_FOUND; }
+	bool HasDocumentOp() const;
+};
+
+bool BenchOptions::HasDocumentOp() const
+{
+	wxArrayString docops = wxStringTokenize(ALL_OPS, wxT(","));
+	for (size_t i = 0; i < docops.GetCount(); ++i)
+	{
+		if (HasOp(docops[i].c_str()))
+			return true;
+	}
+	return false;
+}
+
+bool BenchOptions::Parse(int argc, wxChar** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		wxString arg(argv[i]);
+		wxString val = arg.AfterFirst(wxT('='));
+
+		if (arg.StartsWith(wxT("--size=")))
+		{
+			if (!val.ToLong(&size_mb) || size_mb <= 0)
+				return false;
+		}
+		else if (arg.StartsWith(wxT("--encoding=")))
+			encoding = val;
+		else if (arg.StartsWith(wxT("--charset=")))
+			charset = val.Lower();
+		else if (arg.StartsWith(wxT("--newline=")))
+			crlf = (val.Lower() == wxT("crlf"));
+		else if (arg.StartsWith(wxT("--seed=")))
+		{
+			if (!val.ToLong(&seed))
+				return false;
+		}
+		else if (arg.StartsWith(wxT("--jumps=")))
+		{
+			if (!val.ToLong(&jumps) || jumps < 0)
+				return false;
+		}
+		else if (arg.StartsWith(wxT("--file=")))
+			file = val;
+		else if (arg.StartsWith(wxT("--ops=")))
+			ops = wxStringTokenize(val, wxT(","));
+		else if (arg == wxT("--keep"))
+			keep = true;
+		else
+			return false;
+	}
+	return true;
+}
+
+// the words of the corpus, the ones cannot be encoded are dropped
+const wchar_t* const ASCII_WORDS[] = {
+	L"alpha", L"beta", L"gamma", L"delta", L"epsilon", L"zeta", L"eta", L"theta",
+	L"iota", L"kappa", L"lambda", L"mu", L"nu", L"xi", L"omicron", L"pi",
+	L"rho", L"sigma", L"tau", L"upsilon", L"phi", L"chi", L"psi", L"omega",
+	L"The", L"Editor", L"{", L"}", L"(x);", L"=", L"//", L"#include",
+};
+const wchar_t* const LATIN_WORDS[] = {
+	L"caf\u00E9", L"na\u00EFve", L"fa\u00E7ade", L"\u00FCber", L"stra\u00DFe", L"ni\u00F1o", L"\u00C5ngstr\u00F6m",
+};
+const wchar_t* const CJK_WORDS[] = {
+	L"\u6587\u5B57", L"\u7DE8\u96C6", L"\u691C\u7D22", L"\u7F6E\u63DB", L"\u4E2D\u6587", L"\u6F22\u5B57",
+	L"\u7F16\u8F91", L"\u641C\u7D22", L"\u3072\u3089\u304C\u306A", L"\u30AB\u30BF\u30AB\u30CA",
+};
+
+bool Encode(wxm::WXMEncoding* enc, const wchar_t* word, std::string& out)
+{
+	wxByte mb[16];
+	for (; *word != 0; ++word)
+	{
+		size_t len = enc->UCS4toMultiByte(ucs4_t(*word), mb);
+		if (len == 0)
+			return false;
+		out.append((const char*)mb, len);
+	}
+	return true;
+}
+
+void AddWords(wxm::WXMEncoding* enc, const wchar_t* const* words, size_t count, std::vector<std::string>& vocab)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::string w;
+		if (Encode(enc, words[i], w))
+			vocab.push_back(w);
+	}
+}
+
+wxString DefaultCharset(wxm::WXMEncoding* enc)
+{
+	std::string tmp;
+	if (Encode(enc, L"\u6587\u5B57", tmp))
+		return wxm::WXMEncodingManager::IsSimpleUnicodeEncoding(enc->GetEncoding()) ? wxT("mixed") : wxT("cjk");
+	if (Encode(enc, L"\u00E9", tmp))
+		return wxT("latin");
+	return wxT("ascii");
+}
+
+// write about size_mb MB of random lines of words, numbers and indents
+bool GenerateCorpus(const wxString& path, wxm::WXMEncoding* enc, const BenchOptions& opt)
+{
+	wxString charset = opt.charset.IsEmpty() ? DefaultCharset(enc) : opt.charset;
+
+	std::vector<std::string> vocab;
+	AddWords(enc, ASCII_WORDS, sizeof(ASCII_WORDS) / sizeof(ASCII_WORDS[0]), vocab);
+	if (charset == wxT("latin") || charset == wxT("mixed"))
+		AddWords(enc, LATIN_WORDS, sizeof(LATIN_WORDS) / sizeof(LATIN_WORDS[0]), vocab);
+	if (charset == wxT("cjk") || charset == wxT("mixed"))
+		AddWords(enc, CJK_WORDS, sizeof(CJK_WORDS) / sizeof(CJK_WORDS[0]), vocab);
+
+	std::string space, tab, newline, digits[10];
+	Encode(enc, L" ", space);
+	Encode(enc, L"\t", tab);
+	Encode(enc, opt.crlf ? L"\r\n" : L"\n", newline);
+	for (int d = 0; d < 10; ++d)
+	{
+		wchar_t ds[2] = { wchar_t(L'0' + d), 0 };
+		Encode(enc, ds, digits[d]);
+	}
+
+	wxFile file;
+	if (!file.Create(path, true))
+		return false;
+
+	const size_t total = size_t(opt.size_mb) * 1024 * 1024;
+	XorShift rnd((unsigned int)opt.seed);
+	std::string buf;
+	size_t written = 0;
+	while (written < total)
+	{
+		buf.clear();
+		while (buf.size() < 256 * 1024)
+		{
+			for (unsigned int indent = rnd.Next(4); indent > 0; --indent)
+				buf += tab;
+
+			for (unsigned int words = rnd.Next(17); words > 0; --words)
+			{
+				if (rnd.Next(8) == 0)
+				{
+					for (unsigned int n = 1 + rnd.Next(6); n > 0; --n)
+						buf += digits[rnd.Next(10)];
+				}
+				else
+				{
+					buf += vocab[rnd.Next((unsigned int)vocab.size())];
+				}
+				if (words > 1)
+					buf += space;
+			}
+			buf += newline;
+		}
+		if (file.Write(buf.data(), buf.size()) != buf.size())
+			return false;
+		written += buf.size();
+	}
+	return file.Close();
+}
+
+void ReportMicro(const char* op, const std::string& variant, size_t count, const wxStopWatch& sw, long long result)
+{
+	std::printf("{\"op\":\"%s\",\"variant\":\"%s\",\"count\":%lu,\"ms\":%ld,\"result\":%lld}\n",
+		op, variant.c_str(), (unsigned long)count, sw.Time(), result);
+	std::fflush(stdout);
+}
+
+typedef MadDeque<int> IntDeque;
+
+// the former IntDeque::iterator::operator+=: one step per element
+void StepAdvance(IntDeque::iterator& it, ssize_t off)
+{
+	for (; off > 0; --off) ++it;
+	for (; off < 0; ++off) --it;
+}
+
+// the queue operations, and the random access by the former stepping iterator & the current one
+void BenchDeque(const BenchOptions& opt)
+{
+	const size_t count = 1 << 20;
+	IntDeque dq;
+
+	wxStopWatch sw;
+	for (size_t i = 0; i < count; ++i)
+		dq.push_back(int(i));
+	ReportMicro("deque", "push_back", count, sw, 0);
+
+	long long sum = 0;
+	sw.Start();
+	for (IntDeque::iterator it = dq.begin(); it != dq.end(); ++it)
+		sum += *it;
+	ReportMicro("deque", "scan", count, sw, sum);
+
+	XorShift rnd((unsigned int)opt.seed);
+	std::vector<ssize_t> offs(opt.jumps);
+	for (size_t i = 0; i < offs.size(); ++i)
+		offs[i] = ssize_t(rnd.Next((unsigned int)count));
+
+	sum = 0;
+	sw.Start();
+	for (size_t i = 0; i < offs.size(); ++i)
+	{
+		IntDeque::iterator it = dq.begin();
+		StepAdvance(it, offs[i]);
+		sum += *it;
+	}
+	ReportMicro("deque", "advance_stepping", offs.size(), sw, sum);
+
+	sum = 0;
+	sw.Start();
+	for (size_t i = 0; i < offs.size(); ++i)
+	{
+		IntDeque::iterator it = dq.begin();
+		it += offs[i];
+		sum += *it;
+	}
+	ReportMicro("deque", "advance", offs.size(), sw, sum);
+
+	sw.Start();
+	while (!dq.empty())
+		dq.pop_front();
+	ReportMicro("deque", "pop_front", count, sw, 0);
+}
+
+size_t FindNewLineUnitByUnit(const wxByte* buf, size_t size, xm::NewLineUnit nlu)
+{
+	const size_t unit = xm::NewLineUnitSize(nlu);
+	const size_t end = size - size % unit;
+	size_t off = 0;
+	for (; off < end; off += unit)
+	{
+		if (xm::NewLineChar(buf + off, nlu) != 0)
+			break;
+	}
+	return off;
+}
+
+// the vectorized & the unit by unit scanning of --size MB of long lines
+void BenchNewLineScan(const BenchOptions& opt)
+{
+	const xm::NewLineUnit units[] = {
+		xm::nluByte, xm::nluUTF16LE, xm::nluUTF16BE, xm::nluUTF32LE, xm::nluUTF32BE,
+	};
+	const char* names[] = { "byte", "UTF-16LE", "UTF-16BE", "UTF-32LE", "UTF-32BE" };
+
+	const size_t size = size_t(opt.size_mb) * 1024 * 1024;
+	std::vector<wxByte> text(size);
+	for (size_t i = 0; i < size; ++i)
+		text[i] = (i % 4096 == 4095) ? 0x0A : wxByte('a' + i % 26);
+
+	for (size_t n = 0; n < sizeof(units) / sizeof(units[0]); ++n)
+	{
+		xm::NewLineUnit nlu = units[n];
+
+		long long lines = 0;
+		wxStopWatch sw;
+		for (size_t off = 0; off < size; ++lines)
+			off += FindNewLineUnitByUnit(&text[off], size - off, nlu) + 1;
+		ReportMicro("newline_scan", std::string(names[n]) + "_unit_by_unit", size, sw, lines);
+
+		lines = 0;
+		sw.Start();
+		for (size_t off = 0; off < size; ++lines)
+			off += xm::FindNewLine(&text[off], size - off, nlu) + 1;
+		ReportMicro("newline_scan", std::string(names[n]) + "_vectorized", size, sw, lines);
+	}
+}
+
+// collect the UChar32s from WXMEncoding::NextUChar32() one by one
+struct VectorBytesMapper: public wxm::UChar32BytesMapper
+{
+	VectorBytesMapper(const std::vector<wxByte>& data): count(0), m_data(data), m_pos(0)
+	{}
+
+	virtual void MoveUChar32Bytes(MadUCQueue &ucqueue, ucs4_t uc, size_t len) override
+	{
+		++count;
+		m_pos += len;
+	}
+
+	virtual wxByte* BufferLoadBytes(wxFileOffset& rest, size_t buf_len) override
+	{
+		if (m_pos >= m_data.size())
+			return nullptr;
+
+		rest = wxFileOffset(m_data.size() - m_pos);
+		return const_cast<wxByte*>(&m_data[m_pos]);
+	}
+
+	size_t count;
+
+private:
+	const std::vector<wxByte>& m_data;
+	size_t m_pos;
+};
+
+// decoding --size MB of encodable characters mixed with some random bytes
+// by NextUChar32() & DecodeUChar32s(), of all the encodings if --encoding=all
+void BenchBulkDecode(const BenchOptions& opt)
+{
+	const ucs4_t samples[] = {
+		'a', 'Z', '0', ' ', 0x0A, 0x0D, 0xE9, 0x3B1, 0x416, 0x4E2D, 0x6587, 0x3042, 0xAC00, 0xFF21, 0x1F600,
+	};
+	const size_t nsamples = sizeof(samples) / sizeof(samples[0]);
+
+	wxm::WXMEncodingManager& encmgr = wxm::WXMEncodingManager::Instance();
+	std::vector<wxm::WXMEncoding*> encs;
+	if (opt.encoding.Lower() == wxT("all"))
+	{
+		for (size_t idx = 0; idx < encmgr.GetEncodingsCount(); ++idx)
+			encs.push_back(encmgr.GetWxmEncoding(ssize_t(idx)));
+	}
+	else
+	{
+		encs.push_back(encmgr.GetWxmEncoding(opt.encoding));
+	}
+
+	const size_t size = size_t(opt.size_mb) * 1024 * 1024;
+	const size_t maxcount = 256;
+	std::vector<ucs4_t> ucs(maxcount);
+	std::vector<wxByte> lens(maxcount);
+
+	for (size_t e = 0; e < encs.size(); ++e)
+	{
+		wxm::WXMEncoding* enc = encs[e];
+		std::string encname(enc->GetName().mb_str());
+
+		XorShift rnd((unsigned int)opt.seed);
+		std::vector<wxByte> data;
+		data.reserve(size + 16);
+		while (data.size() < size)
+		{
+			wxByte mb[16];
+			size_t len = 0;
+			if (rnd.Next(64) == 0)
+				mb[len++] = wxByte(rnd.Next());
+			else
+				len = enc->UCS4toMultiByte(samples[rnd.Next((unsigned int)nsamples)], mb);
+
+			data.insert(data.end(), mb, mb + len);
+		}
+
+		wxStopWatch sw;
+		VectorBytesMapper mapper(data);
+		MadUCQueue ucqueue;
+		while (enc->NextUChar32(ucqueue, mapper))
+		{
+		}
+		ReportMicro("bulk_decode", encname + "_NextUChar32", data.size(), sw, (long long)mapper.count);
+
+		sw.Start();
+		long long total = 0;
+		for (size_t pos = 0; pos < data.size(); )
+		{
+			size_t count = enc->DecodeUChar32s(&data[pos], data.size() - pos, false, &ucs[0], &lens[0], maxcount);
+			for (size_t i = 0; i < count; ++i)
+				pos += lens[i];
+			total += count;
+		}
+		ReportMicro("bulk_decode", encname + "_DecodeUChar32s", data.size(), sw, total);
+	}
+}
+
+void RunMicroBenchmarks(const BenchOptions& opt)
+{
+	if (opt.HasOp(wxT("deque")))
+		BenchDeque(opt);
+	if (opt.HasOp(wxT("newline_scan")))
+		BenchNewLineScan(opt);
+	if (opt.HasOp(wxT("bulk_decode")))
+		BenchBulkDecode(opt);
+}
+
+class Bench
+{
+public:
+	Bench(wxm::SearchingWXMEdit* edit, const BenchOptions& opt, const wxString& path)
+		: m_edit(edit), m_opt(opt), m_path(path)
+	{
+	}
+
+	bool Run();
+
+private:
+	void Report(const wxChar* op, const wxStopWatch& sw, long result);
+	int FindAll(const wxString& expr, bool use_regex);
+	int ReplaceAll(const wxString& expr, const wxString& fmt, bool use_regex);
+	long GoToRandomLines();
+
+	wxm::SearchingWXMEdit* m_edit;
+	const BenchOptions& m_opt;
+	wxString m_path;
+};
+
+void Bench::Report(const wxChar* op, const wxStopWatch& sw, long result)
+{
+	long ms = sw.Time();
+	std::printf("{\"op\":\"%s\",\"bytes\":%lld,\"lines\":%d,\"encoding\":\"%s\",\"ms\":%ld,\"result\":%ld,\"peak_rss_kb\":%ld}\n",
+		(const char*)wxString(op).mb_str(wxConvUTF8),
+		(long long)m_edit->GetFileSize(), m_edit->GetLineCount(),
+		(const char*)m_edit->GetEncodingName().mb_str(wxConvUTF8),
+		ms, result, PeakRSSInKB());
+	std::fflush(stdout);
+}
+
+int Bench::FindAll(const wxString& expr, bool use_regex)
+{
+	std::vector<wxFileOffset> begpos, endpos;
+	wxm::WXMSearcher* searcher = m_edit->Searcher(false, use_regex);
+	searcher->SetOption(true, false);
+	return searcher->FindAll(expr, false, &begpos, &endpos);
+}
+
+int Bench::ReplaceAll(const wxString& expr, const wxString& fmt, bool use_regex)
+{
+	wxm::WXMSearcher* searcher = m_edit->Searcher(false, use_regex);
+	searcher->SetOption(true, false);
+	return searcher->ReplaceAll(expr, fmt);
+}
+
+long Bench::GoToRandomLines()
+{
+	XorShift rnd((unsigned int)m_opt.seed);
+	unsigned int lines = (unsigned int)m_edit->GetLineCount();
+	for (long i = 0; i < m_opt.jumps; ++i)
+		m_edit->GoToLine(int(1 + rnd.Next(lines)));
+	return m_opt.jumps;
+}
+
+bool Bench::Run()
+{
+	wxStopWatch sw;
+	if (!m_edit->LoadFromFile(m_path, m_opt.encoding))
+	{
+		std::fprintf(stderr, "cannot load %s\n", (const char*)m_path.mb_str());
+		return false;
+	}
+	if (m_opt.HasOp(wxT("load")))
+		Report(wxT("load"), sw, 0);
+
+	if (m_opt.HasOp(wxT("reformat")))
+	{
+		sw.Start();
+		m_edit->SetSyntax(m_edit->GetSyntaxTitle());
+		Report(wxT("reformat"), sw, 0);
+	}
+
+	if (m_opt.HasOp(wxT("find_string")))
+	{
+		sw.Start();
+		int cnt = FindAll(wxT("omega"), false);
+		Report(wxT("find_string"), sw, cnt);
+	}
+
+	if (m_opt.HasOp(wxT("find_regex")))
+	{
+		sw.Start();
+		int cnt = FindAll(wxT("(alpha|omega) [a-z]+a\\b"), true);
+		Report(wxT("find_regex"), sw, cnt);
+	}
+
+	if (m_opt.HasOp(wxT("goto_random_line")))
+	{
+		sw.Start();
+		long cnt = GoToRandomLines();
+		Report(wxT("goto_random_line"), sw, cnt);
+	}
+
+	if (m_opt.HasOp(wxT("word_count")))
+	{
+		wxm::WordCountData data;
+		sw.Start();
+		m_edit->WordCount(false, data);
+		Report(wxT("word_count"), sw, long(data.words));
+	}
+
+	if (m_opt.HasOp(wxT("replace_string")))
+	{
+		sw.Start();
+		int cnt = ReplaceAll(wxT("gamma"), wxT("GAMMA"), false);
+		Report(wxT("replace_string"), sw, cnt);
+	}
+
+	if (m_opt.HasOp(wxT("replace_regex")))
+	{
+		sw.Start();
+		int cnt = ReplaceAll(wxT("([0-9]{3,})"), wxT("<$1>"), true);
+		Report(wxT("replace_regex"), sw, cnt);
+	}
+
+	if (m_opt.HasOp(wxT("sort_lines")))
+	{
+		sw.Start();
+		m_edit->SortLines(sfAscending, -1, -1);
+		Report(wxT("sort_lines"), sw, 0);
+	}
+
+	if (m_opt.HasOp(wxT("convert_encoding")))
+	{
+		wxString newenc = (m_edit->GetEncodingName().Lower() == wxT("utf-8")) ? wxT("UTF-16LE") : wxT("UTF-8");
+		sw.Start();
+		m_edit->ConvertEncoding(newenc, cefNone);
+		Report(wxT("convert_encoding"), sw, 0);
+	}
+
+	if (m_opt.HasOp(wxT("save")))
+	{
+		wxString saved = m_path + wxT(".saved");
+		sw.Start();
+		bool ok = m_edit->SaveToFile(saved);
+		Report(wxT("save"), sw, ok ? 0 : -1);
+		if (!m_opt.keep)
+			wxRemoveFile(saved);
+	}
+
+	return true;
+}
+
+} // namespace
+
+class BenchApp : public wxApp
+{
+public:
+	virtual bool OnInit() override;
+	virtual int OnRun() override;
+	virtual int OnExit() override;
+
+private:
+	BenchOptions m_opt;
+	wxString m_path;
+	bool m_generated;
+	wxFrame* m_frame;
+	wxm::SearchingWXMEdit* m_edit;
+};
+
+IMPLEMENT_APP(BenchApp)
+
+bool BenchApp::OnInit()
+{
+	m_generated = false;
+	m_frame = nullptr;
+	m_edit = nullptr;
+
+	if (!m_opt.Parse(argc, argv))
+	{
+		std::fprintf(stderr, "usage: wxmedit_bench [--size=MB] [--encoding=NAME] [--charset=ascii|latin|cjk|mixed]"
+			" [--newline=lf|crlf] [--seed=N] [--jumps=N] [--file=PATH] [--ops=%s,%s] [--keep]\n",
+			(const char*)wxString(ALL_OPS).mb_str(), (const char*)wxString(MICRO_OPS).mb_str());
+		return false;
+	}
+
+	wxm::WXMEncodingManager::PreInit();
+	wxm::WXMEncodingManager::Instance().InitEncodings();
+	wxm::AppPath::Instance().Init(wxT("wxmedit_bench"));
+
+	// never read nor write the settings of wxmedit
+	wxConfigBase::Set(new wxMemoryConfig());
+
+	MadSyntax::AddSyntaxFilesPath(wxm::AppPath::Instance().AppDir() + wxT("syntax/"));
+	FontWidthManager::Init(wxm::AppPath::Instance().HomeDir());
+
+	if (!m_opt.HasDocumentOp())
+		return true;
+
+	m_path = m_opt.file;
+	if (m_path.IsEmpty())
+	{
+		m_path = wxFileName::CreateTempFileName(wxT("wxmedit_bench"));
+		wxm::WXMEncoding* enc = wxm::WXMEncodingManager::Instance().GetWxmEncoding(m_opt.encoding);
+		wxStopWatch sw;
+		if (!GenerateCorpus(m_path, enc, m_opt))
+		{
+			std::fprintf(stderr, "cannot write %s\n", (const char*)m_path.mb_str());
+			wxRemoveFile(m_path);
+			return false;
+		}
+		m_generated = true;
+		std::fprintf(stderr, "generated %ld MB of %s in %ld ms: %s\n", m_opt.size_mb,
+			(const char*)enc->GetName().mb_str(), sw.Time(), (const char*)m_path.mb_str());
+	}
+
+	// the frame and the edit are never shown
+	m_frame = new wxFrame(nullptr, wxID_ANY, wxT("wxmedit_bench"), wxDefaultPosition, wxSize(1024, 768));
+	m_edit = new wxm::SearchingWXMEdit(m_frame, false);
+	m_edit->SetSize(m_frame->GetClientSize());
+	SetTopWindow(m_frame);
+
+	return true;
+}
+
+int BenchApp::OnRun()
+{
+	RunMicroBenchmarks(m_opt);
+
+	if (m_edit == nullptr)
+		return 0;
+
+	Bench bench(m_edit, m_opt, m_path);
+	int ret = bench.Run() ? 0 : 1;
+
+	m_frame->Destroy();
+	m_frame = nullptr;
+	m_edit = nullptr;
+
+	return ret;
+}
+
+int BenchApp::OnExit()
+{
+	if (m_generated && !m_opt.keep)
+		wxRemoveFile(m_path);
+
+	FontWidthManager::FreeMem();
+	delete wxConfigBase::Set(nullptr);
+
+	return wxApp::OnExit();
+}
@@ -0,0 +1,37 @@
+#include "mixed_text.h"
+
+#include <cstdlib>
+
+namespace
+{
+
+// a character with its bytes in UTF-8 and in MS936
+struct MixedChar
+{
+	ucs4_t uc;
+	const char* utf8;
+	const char* ms936;
+};
+
+const MixedChar mixed_chars[] = {
+	{'a', "a", "a"}, {'A', "A", "A"}, {'b', "b", "b"}, {'B', "B", "B"},
+	{'z', "z", "z"}, {'Z', "Z", "Z"}, {' ', " ", " "}, {'\t', "\t", "\t"},
+	{'-', "-", "-"}, {'+', "+", "+"}, {'.', ".", "."}, {',', ",", ","},
+	{'0', "0", "0"}, {'0', "0", "0"}, {'1', "1", "1"}, {'2', "2", "2"},
+	{'5', "5", "5"}, {'7', "7", "7"}, {'9', "9", "9"},
+	{0x4E2D, "\xE4\xB8\xAD", "\xD6\xD0"}, {0x6587, "\xE6\x96\x87", "\xCE\xC4"},
+	{0x3000, "\xE3\x80\x80", "\xA1\xA1"}, {0x00B7, "\xC2\xB7", "\xA1\xA4"},
+};
+const size_t mixed_char_count = sizeof(mixed_chars) / sizeof(mixed_chars[0]);
+
+} // namespace
+
+void append_mixed_chars(size_t len, bool ms936, std::string& bytes, std::vector<ucs4_t>& text)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		const MixedChar& mc = mixed_chars[std::rand() % mixed_char_count];
+		bytes += ms936 ? mc.ms936 : mc.utf8;
+		text.push_back(mc.uc);
+	}
+}
@@ -0,0 +1,13 @@
+#ifndef WXMEDIT_TEST_BUFFER_MIXED_TEXT_H
+#define WXMEDIT_TEST_BUFFER_MIXED_TEXT_H
+
+#include "../../src/wxmedit/ucs4_t.h"
+
+#include <string>
+#include <vector>
+
+// append len random characters of ASCII and CJK to text,
+// and their bytes in MS936 or in UTF-8 to bytes
+void append_mixed_chars(size_t len, bool ms936, std::string& bytes, std::vector<ucs4_t>& text);
+
+#endif //WXMEDIT_TEST_BUFFER_MIXED_TEXT_H
@@ -0,0 +1,82 @@
+#include "../buffer_test.h"
+#include "../../src/wxmedit/wxm_deque.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+
+typedef MadDeque<int> IntDeque;
+
+// the former operator+=: one step per element
+static void step_advance(IntDeque::iterator& it, ssize_t off)
+{
+	for (; off > 0; --off) ++it;
+	for (; off < 0; ++off) --it;
+}
+
+void test_deque_iterator()
+{
+	std::cout << "wxMEdit-buffer-deque-iterator" << std::endl;
+
+	std::srand(20150502);
+
+	IntDeque dq;
+	std::deque<int> ref;
+
+	// move the front into later buffers to make the sequence numbers not start at 0
+	for (int i = 0; i < 20000; ++i)
+		dq.push_back(-1);
+	for (int i = 0; i < 20000; ++i)
+		dq.pop_front();
+
+	for (int i = 0; i < 50000; ++i)
+	{
+		dq.push_back(i);
+		ref.push_back(i);
+	}
+	for (int i = 0; i < 3000; ++i)
+	{
+		dq.pop_front();
+		ref.pop_front();
+	}
+
+	BOOST_CHECK(dq.size() == ref.size());
+	BOOST_CHECK(ssize_t(dq.end() - dq.begin()) == ssize_t(ref.size()));
+
+	for (int round = 0; round < 5000; ++round)
+	{
+		ssize_t a = std::rand() % ref.size();
+		ssize_t b = std::rand() % ref.size();
+
+		IntDeque::iterator it = dq.begin() + a;
+		BOOST_CHECK(*it == ref[a]);
+		BOOST_CHECK(dq[a] == ref[a]);
+
+		IntDeque::iterator it2 = it;
+		it2 += b - a;
+		BOOST_CHECK(*it2 == ref[b]);
+		BOOST_CHECK(it2 - it == b - a);
+		BOOST_CHECK((it < it2) == (a < b));
+		BOOST_CHECK((it <= it2) == (a <= b));
+
+		IntDeque::iterator it3 = it;
+		step_advance(it3, b - a);
+		BOOST_CHECK(it3 == it2);
+
+		it2 -= b - a;
+		BOOST_CHECK(it2 == it);
+		BOOST_CHECK(it[b - a] == ref[b]);
+	}
+
+	// advancing beyond the end appends buffers like operator++
+	IntDeque::iterator e = dq.end() + 3 * 8192;
+	BOOST_CHECK(e - dq.end() == 3 * 8192);
+	BOOST_CHECK((e - 3 * 8192) == dq.end());
+
+	dq.clear();
+	BOOST_CHECK(dq.begin() == dq.end());
+	dq.push_back(7);
+	BOOST_CHECK(dq[0] == 7 && dq.end() - dq.begin() == 1);
+}
@@ -0,0 +1,149 @@
+#include "../buffer_test.h"
+#include "../../src/wxmedit/wxm_line_index.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <list>
+
+struct FakeLine
+{
+	long long size;
+	size_t rows;
+	bool marked;
+	MadLineIndexHook* hook;
+
+	FakeLine(long long sz, size_t r) : size(sz), rows(r), marked(false), hook(nullptr) {}
+};
+
+typedef std::list<FakeLine>::iterator FakeLineIter;
+
+struct FakeLineTraits
+{
+	typedef long long offset_type;
+	static long long Size(const FakeLineIter& it) { return it->size; }
+	static size_t RowCount(const FakeLineIter& it) { return it->rows; }
+	static MadLineIndexHook*& Hook(const FakeLineIter& it) { return it->hook; }
+};
+
+typedef MadLineIndex<FakeLineIter, FakeLineTraits> FakeLineIndex;
+
+// compare every lookup of the index with a linear walk of the list
+static void check_index(std::list<FakeLine>& lines, const FakeLineIndex& index)
+{
+	BOOST_CHECK(index.LineCount() == lines.size());
+
+	size_t lineid = 0, rowid = 0, markid = 0;
+	long long pos = 0;
+	for (FakeLineIter it = lines.begin(); it != lines.end(); ++it, ++lineid)
+	{
+		size_t lid, rid;
+		long long p;
+		FakeLineIter lit;
+
+		index.Locate(it, lid, rid, p);
+		BOOST_CHECK(lid == lineid && rid == rowid && p == pos);
+
+		BOOST_CHECK(index.Marked(it) == it->marked);
+		BOOST_CHECK(index.CountMarksBefore(it) == markid);
+		if (it->marked)
+		{
+			index.FindByMark(markid, lit, lid);
+			BOOST_CHECK(lit == it && lid == lineid);
+			++markid;
+		}
+
+		index.FindByLine(lineid, lit, rid, p);
+		BOOST_CHECK(lit == it && rid == rowid && p == pos);
+
+		index.FindByRow(rowid + it->rows - 1, lit, lid, rid, p);
+		BOOST_CHECK(lit == it && lid == lineid && rid == rowid && p == pos);
+
+		if (it->size > 0)
+		{
+			index.FindByPos(pos + it->size - 1, lit, lid, rid, p);
+			BOOST_CHECK(lit == it && lid == lineid && rid == rowid && p == pos);
+		}
+
+		rowid += it->rows;
+		pos += it->size;
+	}
+
+	BOOST_CHECK(index.RowCount() == rowid);
+	BOOST_CHECK(index.Size() == pos);
+	BOOST_CHECK(index.MarkCount() == markid);
+}
+
+void test_line_index()
+{
+	std::cout << "wxMEdit-buffer-line-index" << std::endl;
+
+	std::srand(20150421);
+
+	std::list<FakeLine> lines;
+	FakeLineIndex index;
+
+	for (int i = 0; i < 500; ++i)
+	{
+		FakeLineIter it = lines.insert(lines.end(), FakeLine(1 + std::rand() % 100, 1 + std::rand() % 3));
+		index.Insert(it, nullptr);
+	}
+	check_index(lines, index);
+
+	for (int round = 0; round < 2000; ++round)
+	{
+		FakeLineIter it = lines.begin();
+		std::advance(it, std::rand() % lines.size());
+
+		switch (std::rand() % 4)
+		{
+		case 0: // insert before it
+			{
+				FakeLineIter nit = lines.insert(it, FakeLine(std::rand() % 100, 1 + std::rand() % 3));
+				index.Insert(nit, it->hook);
+			}
+			break;
+		case 1: // erase it
+			if (lines.size() > 1)
+			{
+				index.Erase(it);
+				lines.erase(it);
+			}
+			break;
+		case 2: // toggle the mark of it
+			it->marked = !it->marked;
+			index.SetMark(it, it->marked);
+			break;
+		default: // change it
+			it->size = std::rand() % 100;
+			it->rows = 1 + std::rand() % 3;
+			index.Update(it);
+			break;
+		}
+
+		if (round % 100 == 0)
+			check_index(lines, index);
+	}
+	check_index(lines, index);
+
+	for (FakeLineIter it = lines.begin(); it != lines.end(); ++it)
+		it->rows = 1;
+	index.UpdateAll();
+	check_index(lines, index);
+
+	// positions beyond the end belong to the last line
+	FakeLineIter lit;
+	size_t lid, rid;
+	long long p;
+	index.FindByPos(index.Size(), lit, lid, rid, p);
+	BOOST_CHECK(lid == lines.size() - 1);
+	index.FindByRow(index.RowCount() + 10, lit, lid, rid, p);
+	BOOST_CHECK(lid == lines.size() - 1);
+
+	BOOST_CHECK(index.MarkCount() > 0);
+	index.ClearMarks();
+	for (FakeLineIter it = lines.begin(); it != lines.end(); ++it)
+		it->marked = false;
+	check_index(lines, index);
+}
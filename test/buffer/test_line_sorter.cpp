@@ -0,0 +1,203 @@
+#include "../buffer_test.h"
+#include "mixed_text.h"
+#include "../../src/wxm/line_sorter.h"
+#include "../../src/wxm/encoding/encoding.h"
+
+#include <wx/init.h>
+#include <unicode/uchar.h>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// the line keyed as the comparator of MadEdit::SortLines did, character by character
+struct RefLine
+{
+	std::vector<ucs4_t> ucs;
+	int int_begin, int_len, frac_begin, frac_len;
+	bool negative;
+	size_t line;
+};
+
+RefLine make_ref_line(const std::vector<ucs4_t>& text, bool casesensitive, bool numeric, size_t line)
+{
+	RefLine ref;
+	ref.int_begin = ref.frac_begin = -1;
+	ref.int_len = ref.frac_len = 0;
+	ref.negative = false;
+	ref.line = line;
+
+	enum { NUM_SIGN, NUM_INT, NUM_FRAC, NUM_END };
+	int step = numeric ? NUM_SIGN : NUM_END;
+	for (size_t i = 0; i < text.size(); ++i)
+	{
+		ucs4_t uc = casesensitive ? text[i] : u_tolower(text[i]);
+		ref.ucs.push_back(uc);
+
+		bool digit = (uc >= '0' && uc <= '9');
+		int idx = int(i);
+		switch (step)
+		{
+		case NUM_SIGN:
+			if (uc == '-')
+				ref.negative = true, step = NUM_INT;
+			else if (uc == '+')
+				step = NUM_INT;
+			else if (uc == '.')
+				step = NUM_FRAC;
+			else if (digit)
+				ref.int_begin = idx, ref.int_len = 1, step = NUM_INT;
+			else if (uc != ' ' && uc != '\t')
+				step = NUM_END;
+			break;
+		case NUM_INT:
+			if (uc == '.')
+				step = NUM_FRAC;
+			else if (!digit)
+				step = NUM_END;
+			else if (ref.int_begin == -1)
+				ref.int_begin = idx, ref.int_len = 1;
+			else
+				++ref.int_len;
+			break;
+		case NUM_FRAC:
+			if (!digit)
+				step = NUM_END;
+			else
+			{
+				if (ref.int_begin == -1)
+					ref.int_begin = 0, ref.int_len = 0;
+				if (ref.frac_begin == -1)
+					ref.frac_begin = idx, ref.frac_len = 1;
+				else
+					++ref.frac_len;
+			}
+			break;
+		}
+	}
+
+	if (!numeric)
+		return ref;
+
+	while (ref.int_begin >= 0 && ref.int_len > 0 && ref.ucs[ref.int_begin] == '0')
+		++ref.int_begin, --ref.int_len;
+	if (ref.frac_begin >= 0)
+	{
+		while (ref.frac_len > 0 && ref.ucs[ref.frac_begin + ref.frac_len - 1] == '0')
+			--ref.frac_len;
+		if (ref.frac_len == 0)
+			ref.frac_begin = -1;
+	}
+	return ref;
+}
+
+struct RefLess
+{
+	bool numeric;
+
+	bool operator()(const RefLine& a, const RefLine& b) const
+	{
+		if (!numeric)
+			return std::lexicographical_compare(a.ucs.begin(), a.ucs.end(), b.ucs.begin(), b.ucs.end());
+
+		if (a.int_begin < 0)
+			return false;
+		if (b.int_begin < 0 || (a.negative && !b.negative))
+			return true;
+		if (!a.negative && b.negative)
+			return false;
+
+		const RefLine& d1 = a.negative ? b : a;
+		const RefLine& d2 = a.negative ? a : b;
+		if (d1.int_len != d2.int_len)
+			return d1.int_len < d2.int_len;
+		for (int i = 0; i < d1.int_len; ++i)
+		{
+			if (d1.ucs[d1.int_begin + i] != d2.ucs[d2.int_begin + i])
+				return d1.ucs[d1.int_begin + i] < d2.ucs[d2.int_begin + i];
+		}
+		if (d2.frac_begin < 0)
+			return false;
+		if (d1.frac_begin < 0)
+			return true;
+		for (int i = 0; i < d1.frac_len && i < d2.frac_len; ++i)
+		{
+			if (d1.ucs[d1.frac_begin + i] != d2.ucs[d2.frac_begin + i])
+				return d1.ucs[d1.frac_begin + i] < d2.ucs[d2.frac_begin + i];
+		}
+		return d1.frac_len < d2.frac_len;
+	}
+};
+
+void test_a_line_sort(wxm::WXMEncoding* enc, bool ms936, bool casesensitive, bool numeric,
+                      size_t threads, size_t count)
+{
+	wxm::LineSorter sorter(casesensitive, numeric, threads);
+	std::vector<RefLine> refs;
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::string bytes;
+		std::vector<ucs4_t> text;
+		size_t len = std::rand() % 12;
+		if (std::rand() % 10 == 0)
+			len += std::rand() % 30;
+		append_mixed_chars(len, ms936, bytes, text);
+
+		wxByte* buf = sorter.AddLine(bytes.size());
+		if (!bytes.empty())
+			std::memcpy(buf, bytes.data(), bytes.size());
+		refs.push_back(make_ref_line(text, casesensitive, numeric, i));
+	}
+
+	sorter.Sort(enc);
+	RefLess less = { numeric };
+	std::stable_sort(refs.begin(), refs.end(), less);
+
+	BOOST_CHECK(sorter.Count() == count);
+	bool same_order = true;
+	bool same_text = true;
+	for (size_t i = 0; i < count && i < sorter.Count(); ++i)
+	{
+		same_order = same_order && sorter.Order(i) == refs[i].line;
+		if (i > 0)
+			same_text = same_text && sorter.SameText(i - 1, i) == (refs[i - 1].ucs == refs[i].ucs);
+	}
+	BOOST_CHECK(same_order);
+	BOOST_CHECK(same_text);
+}
+
+} // namespace
+
+void test_line_sorter()
+{
+	wxInitializer initializer;
+	wxm::WXMEncodingManager::Instance().InitEncodings();
+
+	std::cout << "wxMEdit-buffer-line-sorter" << std::endl;
+
+	std::srand(20150901);
+
+	wxm::WXMEncoding* utf8 = wxm::WXMEncodingManager::Instance().GetWxmEncoding(wxm::ENC_UTF_8);
+	wxm::WXMEncoding* ms936 = wxm::WXMEncodingManager::Instance().GetWxmEncoding(wxm::ENC_MS936);
+
+	// more lines than one part for each thread to decode, sort and merge
+	for (int round = 0; round < 32; ++round)
+	{
+		bool casesensitive = (round & 1) != 0;
+		bool numeric = (round & 2) != 0;
+		bool isms936 = (round & 4) != 0;
+		size_t threads = (round & 8) ? 3 : 1;
+		size_t count = (round & 16) ? 4096 * 4 + std::rand() % 1000 : std::rand() % 100;
+
+		test_a_line_sort(isms936 ? ms936 : utf8, isms936, casesensitive, numeric, threads, count);
+	}
+
+	wxm::WXMEncodingManager::Instance().FreeEncodings();
+}
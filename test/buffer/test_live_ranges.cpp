@@ -0,0 +1,94 @@
+#include "../buffer_test.h"
+#include "../../src/xm/live_ranges.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+typedef xm::LiveRanges<long> LongLiveRanges;
+
+// pack the referred bytes of a store of size bytes, and check them against the bytes marked one by one
+void test_a_packing(long size, size_t refs)
+{
+	std::vector<long> packed(size, -1);
+	LongLiveRanges live;
+
+	std::vector<std::pair<long, long> > blocks;
+	for (size_t i = 0; i < refs; ++i)
+	{
+		long pos = std::rand() % size;
+		long len = std::rand() % (size - pos + 1);
+		if (std::rand() % 4 == 0 && !blocks.empty())
+		{
+			// right after the previous block
+			pos = blocks.back().first + blocks.back().second;
+			if (pos >= size)
+				continue;
+			len = std::rand() % (size - pos + 1);
+		}
+
+		live.Add(pos, len);
+		blocks.push_back(std::make_pair(pos, len));
+		for (long b = pos; b < pos + len; ++b)
+			packed[b] = 0;
+	}
+
+	live.Pack();
+
+	long count = 0;
+	for (long b = 0; b < size; ++b)
+	{
+		if (packed[b] >= 0)
+			packed[b] = count++;
+	}
+	BOOST_CHECK(live.LiveSize() == count);
+
+	// the ranges are sorted, disjoint and not adjacent
+	bool merged = true;
+	for (size_t i = 1; i < live.Count(); ++i)
+		merged = merged && live[i - 1].End() < live[i].pos;
+	BOOST_CHECK(merged);
+
+	// every referred byte keeps its order
+	bool same = true;
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		long pos = blocks[i].first;
+		for (long b = pos; b < pos + blocks[i].second; ++b)
+			same = same && live.Map(b) == packed[b];
+	}
+	BOOST_CHECK(same);
+}
+
+} // namespace
+
+void test_live_ranges()
+{
+	std::cout << "wxMEdit-buffer-live-ranges" << std::endl;
+
+	std::srand(20151018);
+
+	LongLiveRanges live;
+	live.Pack();
+	BOOST_CHECK(live.Count() == 0 && live.LiveSize() == 0);
+
+	live.Add(10, 0);
+	live.Add(30, 5);
+	live.Add(10, 5);
+	live.Add(15, 5);
+	live.Add(32, 1);
+	live.Pack();
+	BOOST_CHECK(live.Count() == 2 && live.LiveSize() == 15);
+	BOOST_CHECK(live.Map(10) == 0 && live.Map(19) == 9 && live.Map(30) == 10 && live.Map(34) == 14);
+
+	live.Clear();
+	BOOST_CHECK(live.Count() == 0 && live.LiveSize() == 0);
+
+	for (int round = 0; round < 200; ++round)
+		test_a_packing(std::rand() % 300 + 1, std::rand() % 12);
+}
@@ -0,0 +1,130 @@
+#include "../buffer_test.h"
+#include "../../src/xm/lru_cache.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+typedef std::pair<int, int> KeyValue;
+
+// the entries of the reference, the most recently used first
+struct ReferenceLRU
+{
+	explicit ReferenceLRU(size_t capacity): m_capacity(capacity) {}
+
+	int* Find(int key)
+	{
+		for (size_t i = 0; i < m_entries.size(); ++i)
+		{
+			if (m_entries[i].first != key)
+				continue;
+			std::rotate(m_entries.begin(), m_entries.begin() + i, m_entries.begin() + i + 1);
+			return &m_entries[0].second;
+		}
+		return nullptr;
+	}
+
+	int& Get(int key)
+	{
+		if (Find(key) != nullptr)
+			return m_entries[0].second;
+		if (m_entries.size() >= m_capacity)
+			m_entries.pop_back();
+		m_entries.insert(m_entries.begin(), KeyValue(key, 0));
+		return m_entries[0].second;
+	}
+
+	void Erase(int key)
+	{
+		if (Find(key) != nullptr)
+			m_entries.erase(m_entries.begin());
+	}
+
+	template<typename Pred>
+	void EraseIf(Pred pred)
+	{
+		for (size_t i = m_entries.size(); i > 0; --i)
+		{
+			if (pred(m_entries[i - 1].first))
+				m_entries.erase(m_entries.begin() + (i - 1));
+		}
+	}
+
+	size_t m_capacity;
+	std::vector<KeyValue> m_entries;
+};
+
+struct KeyDivisibleBy
+{
+	explicit KeyDivisibleBy(int d): m_d(d) {}
+	bool operator()(int key) const { return key % m_d == 0; }
+	int m_d;
+};
+
+} // namespace
+
+void test_lru_cache()
+{
+	std::cout << "wxMEdit-buffer-lru-cache" << std::endl;
+
+	std::srand(20151002);
+
+	for (size_t capacity = 1; capacity <= 8; ++capacity)
+	{
+		xm::LRUCache<int, int> cache(capacity);
+		ReferenceLRU ref(capacity);
+
+		bool same = true;
+		for (int op = 0; op < 2000 && same; ++op)
+		{
+			int key = std::rand() % 12;
+			switch (std::rand() % 8)
+			{
+			case 0:
+				{
+					int* val = cache.Find(key);
+					int* refval = ref.Find(key);
+					same = (val == nullptr) == (refval == nullptr) && (val == nullptr || *val == *refval);
+				}
+				break;
+			case 1:
+				cache.Erase(key);
+				ref.Erase(key);
+				break;
+			case 2:
+				cache.EraseIf(KeyDivisibleBy(key + 2));
+				ref.EraseIf(KeyDivisibleBy(key + 2));
+				break;
+			default:
+				{
+					int value = std::rand();
+					cache.Get(key) = value;
+					ref.Get(key) = value;
+				}
+				break;
+			}
+			same = same && cache.Size() == ref.m_entries.size() && cache.Size() <= capacity;
+		}
+		BOOST_CHECK(same);
+
+		// the least recently used entries are evicted
+		bool same_entries = true;
+		for (size_t i = ref.m_entries.size(); i > 0; --i)
+		{
+			const KeyValue& kv = ref.m_entries[i - 1];
+			int* val = cache.Find(kv.first);
+			same_entries = same_entries && val != nullptr && *val == kv.second;
+		}
+		BOOST_CHECK(same_entries);
+
+		cache.Clear();
+		BOOST_CHECK(cache.Size() == 0 && cache.Find(0) == nullptr);
+	}
+}
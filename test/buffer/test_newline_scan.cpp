@@ -0,0 +1,79 @@
+#include "../buffer_test.h"
+#include "../../src/xm/newline_scan.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using xm::NewLineUnit;
+
+static size_t find_newline_unit_by_unit(const unsigned char* buf, size_t size, NewLineUnit nlu)
+{
+	const size_t unit = xm::NewLineUnitSize(nlu);
+	const size_t end = size - size % unit;
+	size_t off = 0;
+	for (; off < end; off += unit)
+	{
+		if (xm::NewLineChar(buf + off, nlu) != 0)
+			break;
+	}
+	return off;
+}
+
+void test_newline_scan()
+{
+	std::cout << "wxMEdit-buffer-newline-scan" << std::endl;
+
+	std::srand(20150601);
+
+	const NewLineUnit units[] = {
+		xm::nluByte, xm::nluUTF16LE, xm::nluUTF16BE, xm::nluUTF32LE, xm::nluUTF32BE,
+	};
+
+	unsigned char le16[] = {'a', 0, 0x0A, 0x0D, 0x0D, 0};
+	BOOST_CHECK(xm::FindNewLine(le16, sizeof(le16), xm::nluUTF16LE) == 4);
+	BOOST_CHECK(xm::FindNewLine(le16, sizeof(le16), xm::nluUTF16BE) == 6);
+	BOOST_CHECK(xm::FindNewLine(le16, 5, xm::nluUTF16LE) == 4);
+	BOOST_CHECK(xm::FindNewLine(le16, 3, xm::nluUTF32LE) == 0);
+	BOOST_CHECK(xm::FindNewLine(le16, sizeof(le16), xm::nluNone) == sizeof(le16));
+
+	// random data around the vector widths, the newline units are sparse
+	// and the bytes of them often appear in other units
+	for (int round = 0; round < 20000; ++round)
+	{
+		NewLineUnit nlu = units[std::rand() % 5];
+		std::vector<unsigned char> data(std::rand() % 200 + 1);
+		for (size_t i = 0; i < data.size(); ++i)
+		{
+			int r = std::rand() % 100;
+			data[i] = (r < 2) ? 0x0A : (r < 4) ? 0x0D : (r < 60) ? 0 : (unsigned char)std::rand();
+		}
+
+		size_t start = std::rand() % data.size();
+		const unsigned char* buf = &data[start];
+		size_t size = data.size() - start;
+
+		BOOST_CHECK(xm::FindNewLine(buf, size, nlu) == find_newline_unit_by_unit(buf, size, nlu));
+	}
+
+	// long lines cross many vectors, see wxmedit_bench --ops=newline_scan for the throughput
+	const size_t size = 256 * 1024;
+	std::vector<unsigned char> text(size);
+	for (size_t i = 0; i < size; ++i)
+		text[i] = (i % 4096 == 4095) ? 0x0A : (unsigned char)('a' + i % 26);
+
+	for (int n = 0; n < 5; ++n)
+	{
+		NewLineUnit nlu = units[n];
+		bool same = true;
+		for (size_t off = 0; off < size && same; )
+		{
+			size_t len = xm::FindNewLine(&text[off], size - off, nlu);
+			same = (len == find_newline_unit_by_unit(&text[off], size - off, nlu));
+			off += len + 1;
+		}
+		BOOST_CHECK(same);
+	}
+}
@@ -0,0 +1,126 @@
+#include "../buffer_test.h"
+#include "mixed_text.h"
+#include "../../src/wxm/word_counter.h"
+#include "../../src/wxm/encoding/encoding.h"
+#include "../../src/xm/uutils.h"
+#include "../../src/xm/ublock.h"
+
+#include <wx/init.h>
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+void test_a_word_count(wxm::WXMEncoding* enc, bool ms936, size_t threads)
+{
+	wxm::ParallelWordCounter counter(enc, threads);
+
+	// the chunks are made of whole lines, each chunk is shorter than a piece of the word counter
+	xm::SimpleWordCounter words;
+	xm::UnicodeBlockCharCounter blocks;
+	xm::UnicodeBlockSet& ublock_set = xm::UnicodeBlockSet::GetInstance();
+	wxInt64 chars = 0, spaces = 0, controls = 0, fullwidths = 0, ambws = 0;
+
+	size_t chunks = std::rand() % 20;
+	for (size_t c = 0; c < chunks; ++c)
+	{
+		std::string bytes;
+		size_t lines = std::rand() % 8 + 1;
+		for (size_t l = 0; l < lines; ++l)
+		{
+			std::vector<ucs4_t> text;
+			append_mixed_chars(std::rand() % 40, ms936, bytes, text);
+			// only the last line may have no newline char
+			if (c + 1 < chunks || l + 1 < lines || std::rand() % 2 == 0)
+			{
+				bool crlf = (std::rand() % 2 == 0);
+				bytes += crlf ? "\r\n" : "\n";
+				if (crlf)
+					text.push_back(0x0D);
+				text.push_back(0x0A);
+			}
+
+			for (size_t i = 0; i < text.size(); ++i)
+			{
+				ucs4_t uc = text[i];
+				words += (UChar32)uc;
+				blocks.Count(ublock_set.FindBlockIndex(uc));
+				++chars;
+				if (u_iscntrl(uc))
+					++controls;
+				else if (u_isspace(uc))
+					++spaces;
+				if (xm::IsWideWidthEverywhere(uc))
+					++fullwidths;
+				if (xm::IsAmbiguousWidth(uc))
+					++ambws;
+			}
+		}
+
+		wxByte* buf = counter.AddChunk(bytes.size());
+		if (!bytes.empty())
+			std::memcpy(buf, bytes.data(), bytes.size());
+		if (counter.IsFull())
+			counter.Count();
+	}
+	counter.Count();
+
+	wxm::WordCountPart& result = counter.Result();
+	BOOST_CHECK(result.chars == chars);
+	BOOST_CHECK(result.spaces == spaces);
+	BOOST_CHECK(result.controls == controls);
+	BOOST_CHECK(result.fullwidths == fullwidths);
+	BOOST_CHECK(result.ambws == ambws);
+	BOOST_CHECK(result.words.GetWordCount() == words.GetWordCount());
+	BOOST_CHECK(result.words.GetWordCountNoCtrlNoSP() == words.GetWordCountNoCtrlNoSP());
+
+	bool same_blocks = true;
+	for (int idx = 0; idx < ublock_set.BlockIndexEnd(); ++idx)
+		same_blocks = same_blocks && result.blocks.GetBlockCharCount(idx) == blocks.GetBlockCharCount(idx);
+	BOOST_CHECK(same_blocks);
+}
+
+} // namespace
+
+void test_word_counter()
+{
+	wxInitializer initializer;
+	wxm::WXMEncodingManager::Instance().InitEncodings();
+
+	std::cout << "wxMEdit-buffer-word-counter" << std::endl;
+
+	std::srand(20150915);
+
+	// the flat table of the blocks agrees with ICU
+	xm::UnicodeBlockSet& ublock_set = xm::UnicodeBlockSet::GetInstance();
+	bool same_block = true;
+	for (UChar32 u = 0; u <= UCHAR_MAX_VALUE && same_block; ++u)
+	{
+		int block = ublock_getCode(u);
+		if (block == UBLOCK_INVALID_CODE)
+			block = UBLOCK_NO_BLOCK;
+		same_block = (ublock_set.FindBlockIndex(u) == block);
+	}
+	BOOST_CHECK(same_block);
+	BOOST_CHECK(ublock_set.FindBlockIndex(-1) == UBLOCK_NO_BLOCK);
+	BOOST_CHECK(ublock_set.FindBlockIndex(UCHAR_MAX_VALUE + 1) == UBLOCK_NO_BLOCK);
+
+	wxm::WXMEncoding* utf8 = wxm::WXMEncodingManager::Instance().GetWxmEncoding(wxm::ENC_UTF_8);
+	wxm::WXMEncoding* ms936 = wxm::WXMEncodingManager::Instance().GetWxmEncoding(wxm::ENC_MS936);
+
+	// both are decoded by the threads in parallel, MS936 by its tables
+	for (int round = 0; round < 40; ++round)
+	{
+		bool isms936 = (round & 1) != 0;
+		size_t threads = (round & 2) ? 3 : 1;
+		test_a_word_count(isms936 ? ms936 : utf8, isms936, threads);
+	}
+
+	wxm::WXMEncodingManager::Instance().FreeEncodings();
+}
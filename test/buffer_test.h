@@ -0,0 +1,12 @@
+#ifndef WXMEDIT_BUFFER_TEST_H
+#define WXMEDIT_BUFFER_TEST_H
+
+void test_line_index();
+void test_deque_iterator();
+void test_newline_scan();
+void test_line_sorter();
+void test_word_counter();
+void test_lru_cache();
+void test_live_ranges();
+
+#endif //WXMEDIT_BUFFER_TEST_H
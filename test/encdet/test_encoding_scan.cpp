@@ -0,0 +1,114 @@
+#include "../encdet_test.h"
+#include "../../src/xm/cxx11.h"
+#include "../../src/xm/encoding_scan.h"
+#include "../../src/wxm/encdet.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static size_t find_non_ascii_byte_by_byte(const unsigned char* buf, size_t size, bool withnul)
+{
+	size_t off = 0;
+	while (off < size && buf[off] < 0x80 && !(withnul && buf[off] == 0))
+		++off;
+	return off;
+}
+
+static void append_utf8(std::vector<unsigned char>& text, unsigned int c)
+{
+	if (c < 0x80)
+	{
+		text.push_back((unsigned char)c);
+	}
+	else if (c < 0x800)
+	{
+		text.push_back((unsigned char)(0xC0 | c >> 6));
+		text.push_back((unsigned char)(0x80 | (c & 0x3F)));
+	}
+	else if (c < 0x10000)
+	{
+		text.push_back((unsigned char)(0xE0 | c >> 12));
+		text.push_back((unsigned char)(0x80 | (c >> 6 & 0x3F)));
+		text.push_back((unsigned char)(0x80 | (c & 0x3F)));
+	}
+	else
+	{
+		text.push_back((unsigned char)(0xF0 | c >> 18));
+		text.push_back((unsigned char)(0x80 | (c >> 12 & 0x3F)));
+		text.push_back((unsigned char)(0x80 | (c >> 6 & 0x3F)));
+		text.push_back((unsigned char)(0x80 | (c & 0x3F)));
+	}
+}
+
+static std::string match_sampled(const std::vector<unsigned char>& text)
+{
+	wxm::EncodingSample sample(wxFileOffset(text.size()));
+	wxFileOffset pos;
+	size_t len;
+	while (sample.NextWindow(pos, len))
+		sample.AddWindow(&text[size_t(pos)], len);
+
+	wxString enc;
+	if (!wxm::MatchWXMEncoding(enc, sample))
+		return std::string();
+	return std::string(enc.mb_str().data());
+}
+
+void test_encdet_encoding_scan()
+{
+	std::cout << "wxMEdit-encdet-encoding-scan" << std::endl;
+
+	std::srand(20150701);
+
+	// random data around the vector widths
+	for (int round = 0; round < 20000; ++round)
+	{
+		std::vector<unsigned char> data(std::rand() % 100 + 1);
+		for (size_t i = 0; i < data.size(); ++i)
+		{
+			int r = std::rand() % 100;
+			data[i] = (r < 2) ? 0 : (r < 4) ? 0x80 + std::rand() % 0x80 : 0x20 + std::rand() % 0x60;
+		}
+
+		BOOST_CHECK(xm::FindNonASCII(&data[0], data.size()) == find_non_ascii_byte_by_byte(&data[0], data.size(), false));
+		BOOST_CHECK(xm::FindNonISO646(&data[0], data.size()) == find_non_ascii_byte_by_byte(&data[0], data.size(), true));
+	}
+
+	// a well-formed UTF-8 text split at any byte
+	std::vector<unsigned char> u8;
+	for (int i = 0; i < 200; ++i)
+		append_utf8(u8, (i % 3 == 0) ? 'a' + i % 26 : (i % 3 == 1) ? 0x4E00 + i : 0x10000 + i * 100);
+	for (size_t cut = 0; cut <= u8.size(); ++cut)
+	{
+		xm::UTF8ScanStats stats;
+		xm::ScanUTF8(&u8[0], cut, true, false, stats);
+		xm::ScanUTF8(&u8[0] + cut, u8.size() - cut, false, true, stats);
+		BOOST_CHECK(stats.invalid == 0);
+	}
+
+	// a truncated sequence at the end of the text
+	xm::UTF8ScanStats truncated;
+	xm::ScanUTF8(&u8[0], 2, true, true, truncated);
+	BOOST_CHECK(truncated.invalid == 1);
+
+	const unsigned char u16le[] = { 'a', 0, 0x3D, 0xD8, 0x00, 0xDE, 0x2D, 0x4E, 'b', 0, 'c', 0, 'd', 0, 'e', 0, 'f', 0 };
+	xm::UTF16ScanStats u16stats;
+	xm::ScanUTF16(u16le, sizeof(u16le), false, true, u16stats);
+	BOOST_CHECK(u16stats.zero == 0 && u16stats.invalid == 0 && u16stats.pairs == 1 && u16stats.latin == 6);
+
+	// an ASCII log with UTF-8 text after the head window
+	std::vector<unsigned char> log;
+	const char line[] = "2015-07-01 12:00:00 INFO request done\n";
+	while (log.size() < 4 * 1024 * 1024)
+		log.insert(log.end(), line, line + sizeof(line) - 1);
+	BOOST_CHECK(match_sampled(log) == "US-ASCII");
+
+	for (size_t pos = log.size() / 2; pos + 6 < log.size(); pos += 1000)
+		std::memcpy(&log[pos], "\xE4\xB8\xAD\xE6\x96\x87", 6);
+	BOOST_CHECK(match_sampled(log) == "UTF-8");
+}
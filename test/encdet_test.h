@@ -9,5 +9,6 @@ void test_encdet_wxmedit_utf16();
 void test_encdet_wxmedit_utf8();
 void test_encdet_wxmedit_bom();
 void test_encdet_wxmedit_iso646();
+void test_encdet_encoding_scan();
 
 #endif //WXMEDIT_ENCEET_TEST_H
@@ -0,0 +1,135 @@
+#include "../encoding_test.h"
+#include "../../src/wxm/encoding/encoding.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+// collect the UChar32s from WXMEncoding::NextUChar32() one by one
+struct VectorBytesMapper: public wxm::UChar32BytesMapper
+{
+	VectorBytesMapper(const std::vector<wxByte>& data): m_data(data), m_pos(0)
+	{}
+
+	virtual void MoveUChar32Bytes(MadUCQueue &ucqueue, ucs4_t uc, size_t len) override
+	{
+		ucs.push_back(uc);
+		lens.push_back(len);
+		m_pos += len;
+	}
+
+	virtual wxByte* BufferLoadBytes(wxFileOffset& rest, size_t buf_len) override
+	{
+		if (m_pos >= m_data.size())
+			return nullptr;
+
+		rest = wxFileOffset(m_data.size() - m_pos);
+		return const_cast<wxByte*>(&m_data[m_pos]);
+	}
+
+	std::vector<ucs4_t> ucs;
+	std::vector<size_t> lens;
+
+private:
+	const std::vector<wxByte>& m_data;
+	size_t m_pos;
+};
+
+// encodable characters mixed with some random bytes
+void build_sample(wxm::WXMEncoding* enc, size_t size, std::vector<wxByte>& data)
+{
+	const ucs4_t samples[] = {
+		'a', 'Z', '0', ' ', 0x0A, 0x0D, 0xE9, 0x3B1, 0x416, 0x4E2D, 0x6587, 0x3042, 0xAC00, 0xFF21, 0x1F600,
+	};
+	const size_t nsamples = sizeof(samples) / sizeof(samples[0]);
+
+	data.clear();
+	while (data.size() < size)
+	{
+		wxByte mb[16];
+		size_t len = 0;
+		if (std::rand() % 64 == 0)
+			mb[len++] = wxByte(std::rand());
+		else
+			len = enc->UCS4toMultiByte(samples[std::rand() % nsamples], mb);
+
+		data.insert(data.end(), mb, mb + len);
+	}
+}
+
+} // namespace
+
+void test_bulk_decode()
+{
+	wxm::WXMEncodingManager& encmgr = wxm::WXMEncodingManager::Instance();
+	encmgr.InitEncodings();
+
+	std::cout << "wxMEdit-enc-bulk-decode" << std::endl;
+
+	std::srand(20150801);
+
+	const size_t maxcount = 256;
+	std::vector<ucs4_t> ucs(maxcount);
+	std::vector<wxByte> lens(maxcount);
+
+	size_t cnt = encmgr.GetEncodingsCount();
+	for (size_t idx = 0; idx < cnt; ++idx)
+	{
+		wxm::WXMEncoding* enc = encmgr.GetWxmEncoding(ssize_t(idx));
+
+		// see wxmedit_bench --ops=bulk_decode for the throughput
+		std::vector<wxByte> data;
+		build_sample(enc, 256 * 1024, data);
+
+		VectorBytesMapper mapper(data);
+		MadUCQueue ucqueue;
+		while (enc->NextUChar32(ucqueue, mapper))
+		{
+		}
+
+		// decode in random chunks, as MadLines does with its buffer
+		bool same = true;
+		size_t pos = 0;
+		size_t n = 0;
+		while (pos < data.size() && same)
+		{
+			size_t len = std::min(data.size() - pos, size_t(std::rand() % 64 + 1));
+			bool more = (pos + len != data.size());
+			size_t count = enc->DecodeUChar32s(&data[pos], len, more, &ucs[0], &lens[0], std::rand() % maxcount + 1);
+			BOOST_CHECK(count > 0 || (more && len < wxm::UCHAR32_MAX_BYTES));
+			if (count == 0)
+			{
+				// too few bytes, decode them with the following ones
+				len = std::min(data.size() - pos, len + wxm::UCHAR32_MAX_BYTES);
+				more = (pos + len != data.size());
+				count = enc->DecodeUChar32s(&data[pos], len, more, &ucs[0], &lens[0], maxcount);
+				BOOST_CHECK(count > 0);
+			}
+
+			for (size_t i = 0; i < count && same; ++i, ++n)
+			{
+				same = n < mapper.ucs.size() && ucs[i] == mapper.ucs[n] && lens[i] == mapper.lens[n];
+				pos += lens[i];
+			}
+		}
+		BOOST_CHECK(same);
+		BOOST_CHECK(n == mapper.ucs.size());
+
+		size_t total = 0;
+		for (pos = 0; pos < data.size(); )
+		{
+			size_t count = enc->DecodeUChar32s(&data[pos], data.size() - pos, false, &ucs[0], &lens[0], maxcount);
+			for (size_t i = 0; i < count; ++i)
+				pos += lens[i];
+			total += count;
+		}
+
+		BOOST_CHECK(total == mapper.ucs.size());
+	}
+}
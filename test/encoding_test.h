@@ -10,4 +10,6 @@ void data_doublebyte_conv_init();
 void test_gb18030_conv();
 void data_gb18030_conv_init();
 
+void test_bulk_decode();
+
 #endif //WXMEDIT_ENCODING_TEST_H
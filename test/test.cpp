@@ -1,5 +1,6 @@
 #include "encoding_test.h"
 #include "encdet_test.h"
+#include "buffer_test.h"
 
 #include <boost/version.hpp>
 
@@ -17,6 +18,7 @@ boost::unit_test::test_suite* init_unit_test_suite(int argc, char* argv[])
 	encoding_test->add(BOOST_TEST_CASE(&test_gb18030_conv));
 	encoding_test->add(BOOST_TEST_CASE(&test_doublebyte_conv));
 	encoding_test->add(BOOST_TEST_CASE(&test_singlebyte_conv));
+	encoding_test->add(BOOST_TEST_CASE(&test_bulk_decode));
 
 	boost::unit_test::test_suite* encdet_test_with_mozcases = BOOST_TEST_SUITE("encdet_test_with_mozcases");
 	encdet_test_with_mozcases->add(BOOST_TEST_CASE(&test_encdet_moz_muticases));
@@ -28,15 +30,26 @@ boost::unit_test::test_suite* init_unit_test_suite(int argc, char* argv[])
 	encdet_test_wxmedit_cases->add(BOOST_TEST_CASE(&test_encdet_wxmedit_utf8));
 	encdet_test_wxmedit_cases->add(BOOST_TEST_CASE(&test_encdet_wxmedit_utf16));
 	encdet_test_wxmedit_cases->add(BOOST_TEST_CASE(&test_encdet_wxmedit_utf32));
+	encdet_test_wxmedit_cases->add(BOOST_TEST_CASE(&test_encdet_encoding_scan));
 
 	boost::unit_test::test_suite* encdet_test = BOOST_TEST_SUITE("encdet_test");
 	encdet_test->add(encdet_test_wxmedit_cases);
 	encdet_test->add(encdet_test_with_mozcases);
 	encdet_test->add(BOOST_TEST_CASE(&test_encdet_with_icucases));
 
+	boost::unit_test::test_suite* buffer_test = BOOST_TEST_SUITE("buffer_test");
+	buffer_test->add(BOOST_TEST_CASE(&test_line_index));
+	buffer_test->add(BOOST_TEST_CASE(&test_deque_iterator));
+	buffer_test->add(BOOST_TEST_CASE(&test_newline_scan));
+	buffer_test->add(BOOST_TEST_CASE(&test_line_sorter));
+	buffer_test->add(BOOST_TEST_CASE(&test_word_counter));
+	buffer_test->add(BOOST_TEST_CASE(&test_lru_cache));
+	buffer_test->add(BOOST_TEST_CASE(&test_live_ranges));
+
 	boost::unit_test::test_suite* test = BOOST_TEST_SUITE("wxmedit_test");
 	test->add(encdet_test);
 	test->add(encoding_test);
+	test->add(buffer_test);
 
 	return test;
 }